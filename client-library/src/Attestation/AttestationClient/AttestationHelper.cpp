@@ -4,10 +4,7 @@
 // </copyright>
 //-------------------------------------------------------------------------------------------------
 
-#include <boost/archive/iterators/base64_from_binary.hpp>
-#include <boost/archive/iterators/binary_from_base64.hpp>
-#include <boost/archive/iterators/transform_width.hpp>
-#include <boost/algorithm/string.hpp>
+#include <stdexcept>
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_generators.hpp>
 #include <boost/uuid/uuid_io.hpp>
@@ -15,76 +12,71 @@
 #include <windows.h>
 #endif
 #include "AttestationHelper.h"
+#include "Base64Codec.h"
 
-/* See header */
-std::vector<unsigned char> attest::base64::base64_to_binary(const std::string& base64_data)
-{
-    using namespace boost::archive::iterators;
-    using It = transform_width<binary_from_base64<std::string::const_iterator>, 8, 6>;
+namespace {
 
-    std::vector<unsigned char> binary_data(It(std::begin(base64_data)), It(std::end(base64_data)));
+std::string encode(const unsigned char* data, size_t size, attest::base64::Alphabet alphabet)
+{
+    std::string encoded(attest::base64::EncodedSize(size, alphabet), '\0');
+    if (!encoded.empty()) {
+        attest::base64::Encode(data, size, &encoded[0], alphabet);
+    }
+    return encoded;
+}
 
-    // remove padding from the end; preserve any zero bytes that are part of the original data
-    std::size_t num_padding_chars = std::count(base64_data.rbegin(), base64_data.rend(), '=');
-    if (num_padding_chars > 0) {
-        binary_data.resize(binary_data.size() - num_padding_chars);
+template <typename T>
+T decode(const std::string& data, attest::base64::Alphabet alphabet)
+{
+    T decoded(attest::base64::MaxDecodedSize(data.size()), 0);
+    size_t decoded_size = 0;
+    if (!decoded.empty() &&
+        !attest::base64::Decode(data.data(),
+                                data.size(),
+                                reinterpret_cast<unsigned char*>(&decoded[0]),
+                                decoded_size,
+                                alphabet)) {
+        throw std::invalid_argument("Invalid base64 data");
     }
+    decoded.resize(decoded_size);
+    return decoded;
+}
 
-    return binary_data;
+} // namespace
+
+/* See header */
+std::vector<unsigned char> attest::base64::base64_to_binary(const std::string& base64_data)
+{
+    return decode<std::vector<unsigned char>>(base64_data, Alphabet::Standard);
 }
 
 /* See header */
 std::string attest::base64::binary_to_base64(const std::vector<unsigned char>& binary_data)
 {
-    using namespace boost::archive::iterators;
-    using It = base64_from_binary<transform_width<std::vector<unsigned char>::const_iterator, 6, 8>>;
-    auto tmp = std::string(It(std::begin(binary_data)), It(std::end(binary_data)));
-    return tmp.append((3 - binary_data.size() % 3) % 3, '=');
+    return encode(binary_data.data(), binary_data.size(), Alphabet::Standard);
 }
 
 /* See header */
 std::string attest::base64::binary_to_base64url(const std::vector<unsigned char>& binary_data)
 {
-    using namespace boost::archive::iterators;
-    using It = base64_from_binary<transform_width<std::vector<unsigned char>::const_iterator, 6, 8>>;
-    auto tmp = std::string(It(std::begin(binary_data)), It(std::end(binary_data)));
-
-    // For encoding to base64url, replace "+" with "-" and "/" with "_"
-    boost::replace_all(tmp, "+", "-");
-    boost::replace_all(tmp, "/", "_");
-
     // We do not need to add padding characters while url encoding.
-    return tmp;
+    return encode(binary_data.data(), binary_data.size(), Alphabet::Url);
 }
 
 /* See header */
 std::vector<unsigned char> attest::base64::base64url_to_binary(const std::string& base64_data)
 {
-    std::string stringData = base64_data;
-
-    // While decoding base64 url, replace - with + and _ with + and 
-    // use stanard base64 decode. we dont need to add padding characters. underlying library handles it.
-    boost::replace_all(stringData, "-", "+");
-    boost::replace_all(stringData, "_", "/");
-
-    return base64_to_binary(stringData);
+    return decode<std::vector<unsigned char>>(base64_data, Alphabet::Url);
 }
 
 /* See header */
 std::string attest::base64::base64_encode(const std::string& data) {
-    using namespace boost::archive::iterators;
-    using It = base64_from_binary<transform_width<std::string::const_iterator, 6, 8>>;
-    auto tmp = std::string(It(std::begin(data)), It(std::end(data)));
-    return tmp.append((3 - data.size() % 3) % 3, '=');
+    return encode(reinterpret_cast<const unsigned char*>(data.data()), data.size(), Alphabet::Standard);
 }
 
 /* See header */
 std::string attest::base64::base64_decode(const std::string& data) {
-    using namespace boost::archive::iterators;
-    using It = transform_width<binary_from_base64<std::string::const_iterator>, 8, 6>;
-    return boost::algorithm::trim_right_copy_if(std::string(It(std::begin(data)), It(std::end(data))), [](char c) {
-        return c == '\0';
-    });
+    return decode<std::string>(data, Alphabet::Standard);
 }
 
 /* See header */
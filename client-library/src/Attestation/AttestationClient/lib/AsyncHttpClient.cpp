@@ -0,0 +1,332 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="AsyncHttpClient.cpp" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+#include <exception>
+#include "Logging.h"
+#include "AsyncHttpClient.h"
+
+// Upper bound on how long the client thread sleeps when nothing happens. New
+// requests and shutdown wake it up earlier.
+#define MAX_POLL_TIMEOUT_MS 1000
+
+// curl_multi_poll() and curl_multi_wakeup() appeared in libcurl 7.68. Older versions
+// wait with curl_multi_wait() on the event notifier instead.
+#define CURL_MULTI_POLL_VERSION 0x074400
+
+AsyncHttpClient::Transfer::~Transfer() {
+    curl_slist_free_all(headers);
+}
+
+AsyncHttpClient::AsyncHttpClient(bool external_event_loop)
+    : external_event_loop_(external_event_loop) {
+    // Make sure curl is initialized before the multi handle is created.
+    HttpTransport::GetInstance();
+
+    multi_ = curl_multi_init();
+    if (multi_ == nullptr) {
+        CLIENT_LOG_ERROR("Failed to initialize curl multi handle");
+        return;
+    }
+
+    if (external_event_loop_) {
+        curl_multi_setopt(multi_, CURLMOPT_SOCKETFUNCTION, onSocket);
+        curl_multi_setopt(multi_, CURLMOPT_SOCKETDATA, this);
+        curl_multi_setopt(multi_, CURLMOPT_TIMERFUNCTION, onTimer);
+        curl_multi_setopt(multi_, CURLMOPT_TIMERDATA, this);
+        return;
+    }
+    worker_ = std::thread(&AsyncHttpClient::run, this);
+}
+
+AsyncHttpClient::~AsyncHttpClient() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_requested_ = true;
+    }
+
+    if (multi_ == nullptr) {
+        return;
+    }
+
+    wakeUp();
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+
+    for (auto& transfer : active_) {
+        curl_multi_remove_handle(multi_, transfer.first);
+    }
+    active_.clear();
+    pending_.clear();
+    curl_multi_cleanup(multi_);
+}
+
+bool AsyncHttpClient::Post(const std::string& url, const std::string& payload, Completion done) {
+    if (multi_ == nullptr) {
+        return false;
+    }
+
+    std::unique_ptr<Transfer> transfer(new Transfer());
+    transfer->handle = HttpTransport::GetInstance().AcquireHandle(url);
+    CURL* curl = transfer->handle.get();
+    if (curl == nullptr) {
+        return false;
+    }
+
+    transfer->headers = curl_slist_append(nullptr, "Content-Type: application/json");
+    transfer->payload = payload;
+    transfer->done = std::move(done);
+
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, transfer->headers);
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, transfer->payload.c_str());
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, transfer->payload.size());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeResponse);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &transfer->response);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stop_requested_) {
+            return false;
+        }
+        // The multi handle is only used by the client thread, so new transfers are
+        // handed over and added there.
+        pending_.push_back(std::move(transfer));
+    }
+
+    if (external_event_loop_) {
+        wake_up_.Notify();
+    }
+    else {
+        wakeUp();
+    }
+    return true;
+}
+
+void AsyncHttpClient::GetPollDescriptors(std::vector<attest::PollDescriptor>& descriptors, int& timeout_ms) {
+    if (multi_ == nullptr || !external_event_loop_) {
+        return;
+    }
+
+    attest::PollDescriptor wake_up;
+    wake_up.fd = wake_up_.Fd();
+    wake_up.events = attest::PollDescriptor::Read;
+    descriptors.push_back(wake_up);
+
+    for (const auto& socket : sockets_) {
+        attest::PollDescriptor descriptor;
+        descriptor.fd = static_cast<int>(socket.first);
+        if (socket.second == CURL_POLL_IN || socket.second == CURL_POLL_INOUT) {
+            descriptor.events |= attest::PollDescriptor::Read;
+        }
+        if (socket.second == CURL_POLL_OUT || socket.second == CURL_POLL_INOUT) {
+            descriptor.events |= attest::PollDescriptor::Write;
+        }
+        descriptors.push_back(descriptor);
+    }
+
+    if (!timer_armed_) {
+        return;
+    }
+
+    // Round up so the loop does not wake up just before the timer is due and spin.
+    auto remaining = timer_deadline_ - std::chrono::steady_clock::now();
+    int timer_ms = 0;
+    if (remaining.count() > 0) {
+        timer_ms = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            remaining + std::chrono::milliseconds(1) - std::chrono::steady_clock::duration(1)).count());
+    }
+    if (timeout_ms < 0 || timer_ms < timeout_ms) {
+        timeout_ms = timer_ms;
+    }
+}
+
+void AsyncHttpClient::Step(const std::vector<attest::PollDescriptor>& ready) {
+    if (multi_ == nullptr || !external_event_loop_) {
+        return;
+    }
+
+    wake_up_.Clear();
+    addPendingTransfers();
+
+    int running = 0;
+    for (const auto& descriptor : ready) {
+        // A socket may have been closed by an earlier action of this step.
+        curl_socket_t socket = static_cast<curl_socket_t>(descriptor.fd);
+        if (descriptor.revents == 0 || sockets_.find(socket) == sockets_.end()) {
+            continue;
+        }
+
+        int mask = 0;
+        if (descriptor.revents & attest::PollDescriptor::Read) {
+            mask |= CURL_CSELECT_IN;
+        }
+        if (descriptor.revents & attest::PollDescriptor::Write) {
+            mask |= CURL_CSELECT_OUT;
+        }
+        if (descriptor.revents & attest::PollDescriptor::Error) {
+            mask |= CURL_CSELECT_ERR;
+        }
+        curl_multi_socket_action(multi_, socket, mask, &running);
+    }
+
+    // Adding a transfer arms the timer to fire right away, so new requests are
+    // started within this step.
+    if (timer_armed_ && std::chrono::steady_clock::now() >= timer_deadline_) {
+        timer_armed_ = false;
+        curl_multi_socket_action(multi_, CURL_SOCKET_TIMEOUT, 0, &running);
+    }
+
+    completeTransfers();
+}
+
+int AsyncHttpClient::onSocket(CURL* curl, curl_socket_t socket, int what, void* user_ptr, void* socket_ptr) {
+    (void)curl;
+    (void)socket_ptr;
+    AsyncHttpClient* client = static_cast<AsyncHttpClient*>(user_ptr);
+    if (what == CURL_POLL_REMOVE) {
+        client->sockets_.erase(socket);
+    }
+    else {
+        client->sockets_[socket] = what;
+    }
+    return 0;
+}
+
+int AsyncHttpClient::onTimer(CURLM* multi, long timeout_ms, void* user_ptr) {
+    (void)multi;
+    AsyncHttpClient* client = static_cast<AsyncHttpClient*>(user_ptr);
+    if (timeout_ms < 0) {
+        client->timer_armed_ = false;
+    }
+    else {
+        client->timer_armed_ = true;
+        client->timer_deadline_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    }
+    return 0;
+}
+
+size_t AsyncHttpClient::writeResponse(char* contents, size_t size, size_t nmemb, void* user_ptr) {
+    size_t contents_size = size * nmemb;
+    static_cast<std::string*>(user_ptr)->append(contents, contents_size);
+    return contents_size;
+}
+
+void AsyncHttpClient::run() {
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stop_requested_) {
+                break;
+            }
+        }
+
+        addPendingTransfers();
+
+        int running = 0;
+        CURLMcode rc = curl_multi_perform(multi_, &running);
+        if (rc != CURLM_OK) {
+            CLIENT_LOG_ERROR("Failed to drive http requests with error:%s",
+                             curl_multi_strerror(rc));
+        }
+
+        completeTransfers();
+
+        // Sleeps until a socket is ready, a curl timer expires or Post() wakes us up.
+        wait();
+    }
+}
+
+void AsyncHttpClient::wakeUp() {
+#if LIBCURL_VERSION_NUM >= CURL_MULTI_POLL_VERSION
+    curl_multi_wakeup(multi_);
+#else
+    wake_up_.Notify();
+#endif
+}
+
+void AsyncHttpClient::wait() {
+#if LIBCURL_VERSION_NUM >= CURL_MULTI_POLL_VERSION
+    curl_multi_poll(multi_, nullptr, 0, MAX_POLL_TIMEOUT_MS, nullptr);
+#else
+    struct curl_waitfd notifier;
+    notifier.fd = wake_up_.Fd();
+    notifier.events = CURL_WAIT_POLLIN;
+    notifier.revents = 0;
+    int ready = 0;
+    if (notifier.fd < 0 ||
+        curl_multi_wait(multi_, &notifier, 1, MAX_POLL_TIMEOUT_MS, &ready) != CURLM_OK) {
+        // curl_multi_wait() returns at once when it has nothing to wait on, so
+        // fall back to sleeping a little.
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        return;
+    }
+    if (notifier.revents != 0) {
+        wake_up_.Clear();
+    }
+#endif
+}
+
+void AsyncHttpClient::addPendingTransfers() {
+    std::vector<std::unique_ptr<Transfer>> added;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        added.swap(pending_);
+    }
+
+    for (auto& transfer : added) {
+        CURL* curl = transfer->handle.get();
+        CURLMcode rc = curl_multi_add_handle(multi_, curl);
+        if (rc != CURLM_OK) {
+            CLIENT_LOG_ERROR("Failed to start http request with error:%s",
+                             curl_multi_strerror(rc));
+            try {
+                transfer->done(CURLE_FAILED_INIT, 0, std::string(), 0);
+            }
+            catch (const std::exception& e) {
+                CLIENT_LOG_ERROR("Unhandled exception in http completion: %s", e.what());
+            }
+            continue;
+        }
+        active_[curl] = std::move(transfer);
+    }
+}
+
+void AsyncHttpClient::completeTransfers() {
+    CURLMsg* message = nullptr;
+    int queued = 0;
+    while ((message = curl_multi_info_read(multi_, &queued)) != nullptr) {
+        if (message->msg != CURLMSG_DONE) {
+            continue;
+        }
+
+        // The message is freed once the handle is removed, so copy what is needed first.
+        CURL* curl = message->easy_handle;
+        CURLcode result = message->data.result;
+        curl_multi_remove_handle(multi_, curl);
+
+        auto it = active_.find(curl);
+        if (it == active_.end()) {
+            continue;
+        }
+        std::unique_ptr<Transfer> transfer = std::move(it->second);
+        active_.erase(it);
+
+        long response_code = 0;
+        curl_off_t retry_after_seconds = 0;
+        if (result == CURLE_OK) {
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
+            curl_easy_getinfo(curl, CURLINFO_RETRY_AFTER, &retry_after_seconds);
+        }
+
+        try {
+            transfer->done(result, response_code, transfer->response, retry_after_seconds);
+        }
+        catch (const std::exception& e) {
+            CLIENT_LOG_ERROR("Unhandled exception in http completion: %s", e.what());
+        }
+    }
+}
@@ -0,0 +1,145 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="AsyncHttpClient.h" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <curl/curl.h>
+#include "AttestationLibTypes.h"
+#include "EventNotifier.h"
+#include "HttpTransport.h"
+
+/**
+ * HTTP client that keeps any number of requests in flight on a single thread.
+ *
+ * Requests are added to one curl multi handle which a background thread drives, so
+ * the caller does not wait for the response and no thread is blocked per request.
+ * The easy handles come from the HttpTransport pool and go back to it once the
+ * request completes.
+ *
+ * The multi handle can also be driven by the event loop of the caller instead of the
+ * background thread, through GetPollDescriptors() and Step().
+ */
+class AsyncHttpClient {
+public:
+    /**
+     * Called on the client thread, or from Step(), once a request completes. It must
+     * not block.
+     * response_code, response and retry_after_seconds are only set if result is
+     * CURLE_OK.
+     */
+    using Completion = std::function<void(CURLcode result,
+                                          long response_code,
+                                          const std::string& response,
+                                          curl_off_t retry_after_seconds)>;
+
+    /**
+     * @brief Starts the client thread.
+     * @param[in] external_event_loop If set, no thread is started and the caller
+     * drives the requests with GetPollDescriptors() and Step().
+     */
+    explicit AsyncHttpClient(bool external_event_loop = false);
+
+    /**
+     * @brief Stops and joins the client thread. Requests still in flight are
+     * abandoned and their completions are not called.
+     */
+    ~AsyncHttpClient();
+
+    AsyncHttpClient(const AsyncHttpClient&) = delete;
+    AsyncHttpClient& operator=(const AsyncHttpClient&) = delete;
+
+    /**
+     * @brief This function will be used to send a POST request with a JSON body
+     * without waiting for the response.
+     * @param[in] url The url the request is sent to.
+     * @param[in] payload The JSON body of the request.
+     * @param[in] done Called with the outcome of the request.
+     * @return false if the request could not be started, in which case done is
+     * not called.
+     */
+    bool Post(const std::string& url, const std::string& payload, Completion done);
+
+    /**
+     * @brief This function will be used to get what the event loop has to wait for
+     * before the next call to Step(). Only used with an external event loop.
+     * @param[in,out] descriptors The descriptors to wait on are appended to it.
+     * @param[in,out] timeout_ms Lowered to the longest the event loop may wait
+     * before calling Step(). -1 means there is no limit.
+     */
+    void GetPollDescriptors(std::vector<attest::PollDescriptor>& descriptors, int& timeout_ms);
+
+    /**
+     * @brief This function will be used to perform the pending I/O and call the
+     * completions of the requests that are done. It never blocks. Only used with
+     * an external event loop, and must not be called concurrently with
+     * GetPollDescriptors().
+     * @param[in] ready Descriptors with the events that occurred. Descriptors
+     * that do not belong to this client are ignored.
+     */
+    void Step(const std::vector<attest::PollDescriptor>& ready);
+
+private:
+    struct Transfer {
+        ~Transfer();
+
+        HttpTransport::Handle handle;
+        struct curl_slist* headers = nullptr;
+        std::string payload;
+        std::string response;
+        Completion done;
+    };
+
+    static size_t writeResponse(char* contents, size_t size, size_t nmemb, void* user_ptr);
+
+    static int onSocket(CURL* curl, curl_socket_t socket, int what, void* user_ptr, void* socket_ptr);
+
+    static int onTimer(CURLM* multi, long timeout_ms, void* user_ptr);
+
+    void run();
+
+    /**
+     * Wakes up the client thread waiting in wait().
+     */
+    void wakeUp();
+
+    /**
+     * Waits on the sockets of the transfers and for wakeUp(), at most MAX_POLL_TIMEOUT_MS.
+     */
+    void wait();
+
+    void addPendingTransfers();
+
+    void completeTransfers();
+
+    CURLM* multi_ = nullptr;
+    std::thread worker_;
+
+    bool external_event_loop_ = false;
+
+    // Wakes up the external event loop, or the client thread with libcurl older than 7.68.
+    EventNotifier wake_up_;
+
+    // Sockets and timer curl wants the external event loop to watch. Only touched
+    // by the thread calling Step().
+    std::unordered_map<curl_socket_t, int> sockets_;
+    bool timer_armed_ = false;
+    std::chrono::steady_clock::time_point timer_deadline_;
+
+    std::mutex mutex_;
+    bool stop_requested_ = false;
+    std::vector<std::unique_ptr<Transfer>> pending_;
+
+    // Only touched by the client thread, or the thread calling Step().
+    std::unordered_map<CURL*, std::unique_ptr<Transfer>> active_;
+};
@@ -12,7 +12,16 @@ AttestationClient* attestation_client = nullptr;
 
 bool Initialize(attest::AttestationLogger* attestation_logger,
                 AttestationClient** client) {
+    attest::ClientOptions options;
+    return InitializeWithOptions(attestation_logger, &options, client);
+}
+
+bool InitializeWithOptions(attest::AttestationLogger* attestation_logger,
+                           const attest::ClientOptions* options,
+                           AttestationClient** client) {
     if (attestation_logger == nullptr ||
+        options == nullptr ||
+        options->version != CLIENT_OPTIONS_VERSION ||
         client == nullptr) {
         fprintf(stderr, "Invalid input argument");
         return false;
@@ -22,7 +31,7 @@ bool Initialize(attest::AttestationLogger* attestation_logger,
     
     try {
         if (attestation_client == nullptr) {
-            attestation_client = new AttestationClientImpl(logger);
+            attestation_client = new AttestationClientImpl(logger, *options);
         }
         *client = attestation_client;
     }
@@ -45,7 +54,9 @@ void Uninitialize() {
         return;
     }
 
-    free(attestation_client);
+    // The client owns the TPM context and background threads, so it has to be
+    // destroyed rather than just freed.
+    delete static_cast<AttestationClientImpl*>(attestation_client);
     attestation_client = nullptr;
     return;
 }
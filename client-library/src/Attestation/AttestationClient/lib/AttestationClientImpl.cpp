@@ -7,14 +7,18 @@
 #include <iostream>
 #include <fstream>
 #include <chrono>
+#include <future>
 #include <thread>
 #include <algorithm>
 #include <math.h>
 #include <numeric>
+#include <atomic>
 #include <cstring>
+#include <cerrno>
 #ifdef PLATFORM_UNIX
 #include <unistd.h>
 #else
+#include <io.h>
 #include <windows.h>
 #include <versionhelpers.h>
 #endif
@@ -26,6 +30,7 @@
 #include <openssl/x509v3.h> 
 #include <openssl/evp.h>
 #include <openssl/rsa.h>
+#include <openssl/rand.h>
 #include "Exceptions.h"
 #include "AttestationHelper.h"
 
@@ -34,12 +39,45 @@
 #include "AttestationLibUtils.h"
 #include "AttestationLibConst.h"
 #include "TpmUnseal.h"
+#include "MaaResponseParser.h"
 #include "ImdsOperations.h"
 #include "HclReportParser.h"
 #include "TpmCertOperations.h"
+#include "VcekCertCache.h"
+#include "NonceMerkleTree.h"
 
 #define MAX_ATTESTATION_RETRIES 3
 
+// Worker threads running the TPM and evidence collection work of AttestAsync()
+// requests. The TPM serializes most of that work anyway.
+#define ASYNC_ATTESTATION_THREADS 2
+
+// Largest batch accepted by AttestBatch(). Proofs grow with the log of the batch size.
+#define MAX_NONCE_BATCH_SIZE 65536
+
+// Number of buffers of an EncryptBatch() handed to a thread at once. Large enough that
+// handing out blocks costs nothing next to the RSA operations.
+#define ENCRYPT_BATCH_BLOCK_SIZE 64
+
+// Number of envelope chunks handed to a thread at once when decrypting, 1 MiB with
+// the default chunk size. Messages of a single block are decrypted on the calling thread.
+#define DECRYPT_BLOCK_CHUNKS 16
+
+// Amount of encrypted data DecryptStream() reads and decrypts at once. Two batches
+// are held in memory.
+#define DECRYPT_STREAM_BATCH_SIZE (8 * 1024 * 1024)
+
+// How long a successful AK cert renewal check is trusted before the cert is read again.
+constexpr std::chrono::hours g_ak_cert_check_interval(12);
+
+// Delay before retrying a failed background AK cert renewal. It doubles on every
+// failure up to the maximum.
+constexpr std::chrono::minutes g_ak_cert_renewal_initial_retry_delay(5);
+constexpr std::chrono::minutes g_ak_cert_renewal_max_retry_delay(6 * 60);
+
+// A cached VCek cert chain is refreshed in the background once it gets this close to expiry.
+constexpr std::chrono::hours g_vcek_cert_refresh_window(24 * 7);
+
 #ifdef PLATFORM_UNIX
 
 
@@ -64,100 +102,743 @@ constexpr char g_distro_name_str[] = "Microsoft";
 
 constexpr char azure_guest_protocol[] = "https://";
 constexpr char azure_guest_url[] = "/attest/AzureGuest?api-version=2020-10-01";
+constexpr char nonce_batch_root_key[] = "nonce_batch_root";
 
 using namespace attest;
 
-AttestationClientImpl::AttestationClientImpl(const std::shared_ptr<AttestationLogger>& logger) {
+/**
+ * @brief Copies a token into memory the caller frees with Free().
+ * @param[in] token The token.
+ * @return The null terminated copy.
+ */
+static unsigned char* allocateToken(const std::string& token) {
+    unsigned char *token_out = (unsigned char*) malloc((sizeof(unsigned char) * token.size()) + 1); // allocating an extra byte for the null char at the end
+    std::memcpy(token_out, token.data(), token.size());
+    token_out[token.size()] = '\0';
+    return token_out;
+}
+
+/**
+ * @brief Reads from a file descriptor until the buffer is full or the end of file.
+ * @param[in] fd The file descriptor.
+ * @param[out] buffer The buffer.
+ * @param[in] size The size of the buffer.
+ * @param[out] read_size The number of bytes read, less than size only at end of file.
+ * @return false on a read error, with errno set.
+ */
+static bool readFull(int fd, unsigned char* buffer, size_t size, size_t& read_size) {
+    read_size = 0;
+    while (read_size < size) {
+#ifdef PLATFORM_UNIX
+        ssize_t count = read(fd, buffer + read_size, size - read_size);
+#else
+        int count = _read(fd, buffer + read_size, static_cast<unsigned int>(size - read_size));
+#endif
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (count == 0) {
+            break;
+        }
+        read_size += count;
+    }
+    return true;
+}
+
+/**
+ * @brief Writes a whole buffer to a file descriptor.
+ * @param[in] fd The file descriptor.
+ * @param[in] buffer The buffer.
+ * @param[in] size The size of the buffer.
+ * @return false on a write error, with errno set.
+ */
+static bool writeFull(int fd, const unsigned char* buffer, size_t size) {
+    while (size > 0) {
+#ifdef PLATFORM_UNIX
+        ssize_t count = write(fd, buffer, size);
+#else
+        int count = _write(fd, buffer, static_cast<unsigned int>(size));
+#endif
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        buffer += count;
+        size -= count;
+    }
+    return true;
+}
+
+AttestationClientImpl::AttestationClientImpl(const std::shared_ptr<AttestationLogger>& logger,
+                                             const ClientOptions& options)
+    : options_(options),
+      ak_cert_renewal_retry_delay_(g_ak_cert_renewal_initial_retry_delay) {
     SetLogger(logger);
+
+    if (options_.shared_token_cache) {
+        shared_token_cache_.reset(new SharedTokenCache());
+    }
+
+    if (options_.token_cache_refresh_seconds > 0) {
+        // A refresh must not pick up a shared token that is itself about to be
+        // refreshed, otherwise it would be due again straight away.
+        std::chrono::seconds refresh_margin(options_.token_cache_refresh_seconds);
+        token_cache_.reset(new TokenCache(
+            [this, refresh_margin](const std::string& endpoint_url,
+                                   const std::string& client_payload,
+                                   std::string& jwt_token) {
+                return getToken(endpoint_url, client_payload, refresh_margin, jwt_token);
+            },
+            std::chrono::seconds(options_.token_cache_refresh_seconds)));
+    }
+
+    if (options_.data_key_cache_ttl_seconds > 0) {
+        data_key_cache_.reset(new DataKeyCache(std::chrono::seconds(options_.data_key_cache_ttl_seconds)));
+    }
+}
+
+struct AttestationClientImpl::AsyncAttestation {
+    std::string endpoint_url;
+    std::string client_payload;
+    AttestCallback callback;
+
+    std::string attestation_url;
+    std::string payload;
+    uint8_t http_retries = 0;
+    uint8_t attestation_retries = 0;
+};
+
+AttestationClientImpl::~AttestationClientImpl() {
+    // Stop the async machinery before any member it calls back into is destroyed.
+    // The executor goes first so no task can hand a request to the http client
+    // after it is gone; responses that still arrive cannot be handed back either.
+    if (async_executor_ != nullptr) {
+        async_executor_->Stop();
+    }
+    async_http_client_.reset();
+
+    // Nobody calls Step() anymore, so the callbacks that were queued for it and the
+    // cancelled ones are called right here.
+    std::vector<std::function<void()>> completions;
+    std::unordered_set<std::shared_ptr<AsyncAttestation>> attestations;
+    {
+        std::lock_guard<std::mutex> lock(async_mutex_);
+        async_stopping_ = true;
+        completions.swap(async_completions_);
+        attestations = async_attestations_;
+    }
+    for (auto& completion : completions) {
+        completion();
+    }
+
+    AttestationResult result(AttestationResult::ErrorCode::ERROR_ATTESTATION_CANCELLED);
+    result.description_ = std::string("The attestation client was uninitialized");
+    for (auto& attestation : attestations) {
+        completeAsyncAttestation(attestation, result, std::string());
+    }
 }
 
 AttestationResult AttestationClientImpl::Attest(const ClientParameters& client_params,
                                                 unsigned char** jwt_token_out) noexcept {
 
+    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+    if (jwt_token_out == nullptr) {
+        CLIENT_LOG_ERROR("Invalid input parameter");
+        result.code_ = AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER;
+        result.description_ = std::string("Invalid input parameter");
+        return result;
+    }
+
+    std::string token_decrypted;
+    if ((result = getCachedToken(client_params, token_decrypted)).code_ !=
+                                                    AttestationResult::ErrorCode::SUCCESS) {
+        return result;
+    }
+
+    *jwt_token_out = allocateToken(token_decrypted);
+    return result;
+}
+
+AttestationResult AttestationClientImpl::Attest(const ClientParameters& client_params,
+                                                std::shared_ptr<const AttestationToken>& token) noexcept {
+
+    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+    std::string token_decrypted;
+    if ((result = getCachedToken(client_params, token_decrypted)).code_ !=
+                                                    AttestationResult::ErrorCode::SUCCESS) {
+        return result;
+    }
+
+    try {
+        // The token takes over the string, the jwt is not copied again.
+        token = std::make_shared<const AttestationToken>(std::move(token_decrypted));
+    }
+    catch (const std::bad_alloc&) {
+        CLIENT_LOG_ERROR("Failed to allocate the attestation token");
+        result.code_ = AttestationResult::ErrorCode::ERROR_FAILED_MEMORY_ALLOCATION;
+        result.description_ = std::string("Failed to allocate the attestation token");
+    }
+    return result;
+}
+
+AttestationResult AttestationClientImpl::getCachedToken(const ClientParameters& client_params,
+                                                        std::string& token_decrypted) {
+
     AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
     // Validate the token to make sure that the input parameter is not empty.
     // Check the Version of the structure.
     if (client_params.version != CLIENT_PARAMS_VERSION ||
-        client_params.attestation_endpoint_url == nullptr ||
-        jwt_token_out == nullptr) {
+        client_params.attestation_endpoint_url == nullptr) {
         CLIENT_LOG_ERROR("Invalid input parameter");
         result.code_ = AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER;
         result.description_ = std::string("Invalid input parameter");
         return result;
     }
 
-    TpmCertOperations tpm_cert_ops;
-    bool is_ak_cert_renewal_required = false;
-    if ((result = tpm_cert_ops.IsAkCertRenewalRequired(is_ak_cert_renewal_required)).code_ != AttestationResult::ErrorCode::SUCCESS) {
-        CLIENT_LOG_ERROR("Failure while checking AkCert Renewal state %s", result.description_.c_str());
-        if (result.tpm_error_code_ != 0) {
-            CLIENT_LOG_ERROR("Internal TPM Error occurred, Tpm Error Code: %d", result.tpm_error_code_);
-            return result;
-        } else if (result.code_ == attest::AttestationResult::ErrorCode::ERROR_AK_CERT_PROVISIONING_FAILED) {
-            CLIENT_LOG_ERROR("Attestation Key cert provisioning delayed. Please try attestation after some time.");
-            result.description_ = std::string("AK cert provisioning delayed. Please try attestation after some time.");
+    std::string endpoint_url(reinterpret_cast<const char*>(client_params.attestation_endpoint_url));
+    std::string client_payload;
+    if (client_params.client_payload != nullptr) {
+        client_payload = std::string(reinterpret_cast<const char*>(client_params.client_payload));
+    }
+
+    if (token_cache_ != nullptr &&
+        token_cache_->Get(endpoint_url, client_payload, token_decrypted)) {
+        CLIENT_LOG_INFO("Returning cached attestation token");
+        return result;
+    }
+
+    if ((result = getToken(endpoint_url,
+                           client_payload,
+                           std::chrono::seconds(0),
+                           token_decrypted)).code_ !=
+                                                AttestationResult::ErrorCode::SUCCESS) {
+        return result;
+    }
+
+    if (token_cache_ != nullptr) {
+        token_cache_->Put(endpoint_url, client_payload, token_decrypted);
+    }
+    return result;
+}
+
+AttestationResult AttestationClientImpl::AttestBatch(const ClientParameters& client_params,
+                                                     const unsigned char* const* nonces,
+                                                     uint32_t nonce_count,
+                                                     unsigned char** jwt_token,
+                                                     unsigned char** inclusion_proofs) noexcept {
+
+    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+    bool valid = nonces != nullptr &&
+                 nonce_count > 0 &&
+                 nonce_count <= MAX_NONCE_BATCH_SIZE &&
+                 inclusion_proofs != nullptr;
+    for (uint32_t i = 0; valid && i < nonce_count; i++) {
+        valid = nonces[i] != nullptr;
+    }
+    if (!valid) {
+        CLIENT_LOG_ERROR("Invalid input parameter");
+        result.code_ = AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER;
+        result.description_ = std::string("Invalid input parameter");
+        return result;
+    }
+
+    Json::Value batch_payload(Json::objectValue);
+    if (client_params.client_payload != nullptr) {
+        Json::Reader reader;
+        std::string client_payload(reinterpret_cast<const char*>(client_params.client_payload));
+        if (!reader.parse(client_payload, batch_payload) ||
+            !batch_payload.isObject() ||
+            batch_payload.isMember(nonce_batch_root_key)) {
+            CLIENT_LOG_ERROR("Invalid client payload for a nonce batch");
+            result.code_ = AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER;
+            result.description_ = std::string("Invalid client payload Json");
             return result;
         }
     }
 
-    result = AttestationResult::ErrorCode::SUCCESS;
-    if (is_ak_cert_renewal_required) {
-        if ((result = tpm_cert_ops.RenewAndReplaceAkCert()).code_ != AttestationResult::ErrorCode::SUCCESS) {
-            CLIENT_LOG_ERROR("Failed to renew AkCert, description: %s with error code: %d", result.description_, static_cast<int>(result.code_));
-            if (telemetry_reporting.get() != nullptr) {
-                telemetry_reporting->UpdateEvent("AkRenew", 
-                                                "Failed to renew AkCert, error description: " + result.description_, 
-                                                TelemetryReportingBase::EventLevel::AK_RENEW_UNEXPECTED_ERROR);
+    std::vector<std::string> nonce_list;
+    nonce_list.reserve(nonce_count);
+    for (uint32_t i = 0; i < nonce_count; i++) {
+        nonce_list.push_back(std::string(reinterpret_cast<const char*>(nonces[i])));
+    }
+
+    NonceMerkleTree tree;
+    if (!tree.Build(nonce_list)) {
+        result.code_ = AttestationResult::ErrorCode::ERROR_ATTESTATION_FAILED;
+        result.description_ = std::string("Failed to build the nonce Merkle tree");
+        return result;
+    }
+
+    // The root goes through Attest() like any other client payload entry, so it ends
+    // up in the token and the token caches key on it.
+    batch_payload[nonce_batch_root_key] = tree.GetRootHex();
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    std::string batch_payload_str = Json::writeString(builder, batch_payload);
+
+    ClientParameters batch_params = client_params;
+    batch_params.client_payload = reinterpret_cast<const unsigned char*>(batch_payload_str.c_str());
+    if ((result = Attest(batch_params, jwt_token)).code_ != AttestationResult::ErrorCode::SUCCESS) {
+        return result;
+    }
+
+    for (uint32_t i = 0; i < nonce_count; i++) {
+        inclusion_proofs[i] = allocateToken(tree.GetProof(i));
+    }
+    return result;
+}
+
+AttestationResult AttestationClientImpl::AttestMultiple(const unsigned char* const* endpoint_urls,
+                                                        uint32_t endpoint_count,
+                                                        const unsigned char* client_payload_in,
+                                                        AttestationResult* results,
+                                                        unsigned char** jwt_tokens) noexcept {
+
+    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+    bool valid = endpoint_urls != nullptr &&
+                 endpoint_count > 0 &&
+                 results != nullptr &&
+                 jwt_tokens != nullptr;
+    for (uint32_t i = 0; valid && i < endpoint_count; i++) {
+        valid = endpoint_urls[i] != nullptr;
+    }
+    if (!valid) {
+        CLIENT_LOG_ERROR("Invalid input parameter");
+        result.code_ = AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER;
+        result.description_ = std::string("Invalid input parameter");
+        return result;
+    }
+
+    std::string client_payload;
+    if (client_payload_in != nullptr) {
+        client_payload = std::string(reinterpret_cast<const char*>(client_payload_in));
+    }
+
+    std::vector<std::string> endpoints(endpoint_count);
+    std::vector<std::string> tokens(endpoint_count);
+    std::vector<uint32_t> pending;
+    for (uint32_t i = 0; i < endpoint_count; i++) {
+        endpoints[i] = std::string(reinterpret_cast<const char*>(endpoint_urls[i]));
+        results[i] = AttestationResult(AttestationResult::ErrorCode::SUCCESS);
+        jwt_tokens[i] = nullptr;
+
+        if (token_cache_ != nullptr &&
+            token_cache_->Get(endpoints[i], client_payload, tokens[i])) {
+            CLIENT_LOG_INFO("Returning cached attestation token");
+            continue;
+        }
+        if (shared_token_cache_ != nullptr &&
+            shared_token_cache_->Get(endpoints[i], client_payload, std::chrono::seconds(0), tokens[i])) {
+            CLIENT_LOG_INFO("Using token from the shared token cache");
+            if (token_cache_ != nullptr) {
+                token_cache_->Put(endpoints[i], client_payload, tokens[i]);
             }
+            continue;
         }
+        pending.push_back(i);
     }
 
-    result = AttestationResult::ErrorCode::SUCCESS;
+    if (!pending.empty()) {
+        // The evidence and the key the tokens are encrypted to do not depend on the
+        // endpoint, so they are collected once for all of them.
+        std::string payload;
+        if ((result = prepareAttestationRequest(client_payload, payload)).code_ !=
+                                                    AttestationResult::ErrorCode::SUCCESS) {
+            for (uint32_t i : pending) {
+                results[i] = result;
+            }
+        }
+        else {
+            std::vector<std::future<AttestationResult>> requests(endpoint_count);
+            for (uint32_t i : pending) {
+                requests[i] = std::async(std::launch::async, [this, &endpoints, &payload, &tokens, i]() {
+                    std::string attestation_url;
+                    AttestationResult endpoint_result = getAttestationUrl(endpoints[i], attestation_url);
+                    if (endpoint_result.code_ != AttestationResult::ErrorCode::SUCCESS) {
+                        return endpoint_result;
+                    }
+                    return submitAttestationRequest(attestation_url, payload, tokens[i]);
+                });
+            }
+
+            for (uint32_t i : pending) {
+                results[i] = requests[i].get();
+                if (results[i].code_ != AttestationResult::ErrorCode::SUCCESS) {
+                    CLIENT_LOG_ERROR("Attestation to %s failed with error:%s",
+                                     endpoints[i].c_str(),
+                                     results[i].description_.c_str());
+                    continue;
+                }
+
+                if (shared_token_cache_ != nullptr) {
+                    shared_token_cache_->Put(endpoints[i], client_payload, tokens[i]);
+                }
+                if (token_cache_ != nullptr) {
+                    token_cache_->Put(endpoints[i], client_payload, tokens[i]);
+                }
+            }
+        }
+    }
 
-    std::string url = std::string(const_cast<char*>(reinterpret_cast<const char*>(client_params.attestation_endpoint_url)));
-    // parse the url and extract the dns
-    std::string dns;
-    if ((result = url::ParseURL(url, dns)).code_ != AttestationResult::ErrorCode::SUCCESS) {
+    if (result.code_ != AttestationResult::ErrorCode::SUCCESS) {
+        // Callers that see the call fail are not expected to look at the tokens, so
+        // none are handed out, not even those served from the caches.
+        for (uint32_t i = 0; i < endpoint_count; i++) {
+            results[i] = result;
+        }
         return result;
     }
 
-    // Copy attestation endpoint and access token to member variables.
-    attestation_url_ = std::string(std::string(azure_guest_protocol))
-                                  .append(dns)
-                                  .append(std::string(azure_guest_url));
-    CLIENT_LOG_INFO("Attestation URL - %s", attestation_url_.c_str());
- 
-    AttestationParameters params = {};
-    std::unordered_map<std::string, std::string> client_payload_map;
+    for (uint32_t i = 0; i < endpoint_count; i++) {
+        if (results[i].code_ == AttestationResult::ErrorCode::SUCCESS) {
+            jwt_tokens[i] = allocateToken(tokens[i]);
+        }
+    }
+    return result;
+}
+
+AttestationResult AttestationClientImpl::getToken(const std::string& endpoint_url,
+                                                  const std::string& client_payload,
+                                                  std::chrono::seconds min_validity,
+                                                  std::string& jwt_token) {
+    if (shared_token_cache_ == nullptr) {
+        return attest(endpoint_url, client_payload, jwt_token);
+    }
+
+    return shared_token_cache_->GetOrAttest(endpoint_url,
+                                            client_payload,
+                                            min_validity,
+                                            [this, &endpoint_url, &client_payload](std::string& token) {
+                                                return attest(endpoint_url, client_payload, token);
+                                            },
+                                            jwt_token);
+}
+
+AttestationResult AttestationClientImpl::AttestAsync(const ClientParameters& client_params,
+                                                     AttestCallback callback) noexcept {
+
+    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+    if (client_params.version != CLIENT_PARAMS_VERSION ||
+        client_params.attestation_endpoint_url == nullptr ||
+        !callback) {
+        CLIENT_LOG_ERROR("Invalid input parameter");
+        result.code_ = AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER;
+        result.description_ = std::string("Invalid input parameter");
+        return result;
+    }
+
+    std::shared_ptr<AsyncAttestation> attestation = std::make_shared<AsyncAttestation>();
+    attestation->endpoint_url = std::string(reinterpret_cast<const char*>(client_params.attestation_endpoint_url));
     if (client_params.client_payload != nullptr) {
-        if ((result = ParseClientPayload(client_params.client_payload, client_payload_map)).code_ != 
-                                                    AttestationResult::ErrorCode::SUCCESS) {
-            return result;
+        attestation->client_payload = std::string(reinterpret_cast<const char*>(client_params.client_payload));
+    }
+    attestation->callback = std::move(callback);
+
+    startAsync();
+
+    {
+        std::lock_guard<std::mutex> lock(async_mutex_);
+        async_attestations_.insert(attestation);
+    }
+
+    if (!async_executor_->Post([this, attestation]() { beginAsyncAttestation(attestation); })) {
+        std::lock_guard<std::mutex> lock(async_mutex_);
+        async_attestations_.erase(attestation);
+
+        result.code_ = AttestationResult::ErrorCode::ERROR_ATTESTATION_CANCELLED;
+        result.description_ = std::string("The attestation client is being uninitialized");
+        return result;
+    }
+    return result;
+}
+
+void AttestationClientImpl::startAsync() {
+    std::lock_guard<std::mutex> lock(async_mutex_);
+    if (async_executor_ == nullptr) {
+        if (options_.external_event_loop) {
+            async_notifier_.reset(new EventNotifier());
         }
+        async_http_client_.reset(new AsyncHttpClient(options_.external_event_loop));
+        async_executor_.reset(new TaskExecutor(ASYNC_ATTESTATION_THREADS));
     }
-    if((result = getAttestationParameters(client_payload_map,
-                                          params)).code_ !=
-                                                    AttestationResult::ErrorCode::SUCCESS) {
-        CLIENT_LOG_ERROR("Failed to get attestation parameters with error:%s",
+}
+
+AttestationResult AttestationClientImpl::GetPollDescriptors(std::vector<PollDescriptor>& descriptors,
+                                                            int& timeout_ms) noexcept {
+    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+    if (!options_.external_event_loop) {
+        CLIENT_LOG_ERROR("Client does not use an external event loop");
+        result.code_ = AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER;
+        result.description_ = std::string("Client does not use an external event loop");
+        return result;
+    }
+
+    startAsync();
+
+    descriptors.clear();
+    timeout_ms = -1;
+
+    // Completions of the TPM work done on the executor are signalled through the
+    // notifier, so the event loop never waits on the TPM itself.
+    PollDescriptor completions;
+    completions.fd = async_notifier_->Fd();
+    completions.events = PollDescriptor::Read;
+    descriptors.push_back(completions);
+
+    async_http_client_->GetPollDescriptors(descriptors, timeout_ms);
+
+    std::lock_guard<std::mutex> lock(async_mutex_);
+    if (!async_completions_.empty()) {
+        timeout_ms = 0;
+    }
+    return result;
+}
+
+AttestationResult AttestationClientImpl::Step(const std::vector<PollDescriptor>& ready) noexcept {
+    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+    if (!options_.external_event_loop) {
+        CLIENT_LOG_ERROR("Client does not use an external event loop");
+        result.code_ = AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER;
+        result.description_ = std::string("Client does not use an external event loop");
+        return result;
+    }
+
+    startAsync();
+
+    async_http_client_->Step(ready);
+
+    // Clear before taking the queue, a completion queued after that notifies again.
+    async_notifier_->Clear();
+    std::vector<std::function<void()>> completions;
+    {
+        std::lock_guard<std::mutex> lock(async_mutex_);
+        completions.swap(async_completions_);
+    }
+    for (auto& completion : completions) {
+        completion();
+    }
+    return result;
+}
+
+void AttestationClientImpl::beginAsyncAttestation(const std::shared_ptr<AsyncAttestation>& attestation) {
+    std::string jwt_token;
+    if (token_cache_ != nullptr &&
+        token_cache_->Get(attestation->endpoint_url, attestation->client_payload, jwt_token)) {
+        CLIENT_LOG_INFO("Returning cached attestation token");
+        completeAsyncAttestation(attestation, AttestationResult(AttestationResult::ErrorCode::SUCCESS), jwt_token);
+        return;
+    }
+
+    // The shared cache is only read here: waiting on its lock for another process
+    // to attest would hold up a worker.
+    if (shared_token_cache_ != nullptr &&
+        shared_token_cache_->Get(attestation->endpoint_url,
+                                 attestation->client_payload,
+                                 std::chrono::seconds(0),
+                                 jwt_token)) {
+        CLIENT_LOG_INFO("Using token from the shared token cache");
+        if (token_cache_ != nullptr) {
+            token_cache_->Put(attestation->endpoint_url, attestation->client_payload, jwt_token);
+        }
+        completeAsyncAttestation(attestation, AttestationResult(AttestationResult::ErrorCode::SUCCESS), jwt_token);
+        return;
+    }
+
+    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+    if ((result = getAttestationUrl(attestation->endpoint_url,
+                                    attestation->attestation_url)).code_ != AttestationResult::ErrorCode::SUCCESS ||
+        (result = prepareAttestationRequest(attestation->client_payload,
+                                            attestation->payload)).code_ != AttestationResult::ErrorCode::SUCCESS) {
+        completeAsyncAttestation(attestation, result, std::string());
+        return;
+    }
+
+    sendAsyncAttestationRequest(attestation);
+}
+
+void AttestationClientImpl::sendAsyncAttestationRequest(const std::shared_ptr<AsyncAttestation>& attestation) {
+    bool started = async_http_client_->Post(attestation->attestation_url,
+                                            attestation->payload,
+                                            [this, attestation](CURLcode curl_result,
+                                                                long response_code,
+                                                                const std::string& response,
+                                                                curl_off_t retry_after_seconds) {
+                                                onAsyncAttestationResponse(attestation,
+                                                                           curl_result,
+                                                                           response_code,
+                                                                           response,
+                                                                           retry_after_seconds);
+                                            });
+    if (!started) {
+        AttestationResult result(AttestationResult::ErrorCode::ERROR_CURL_INITIALIZATION);
+        result.description_ = std::string("Failed to initialize curl for http request.");
+        CLIENT_LOG_ERROR("Failed to send attestation request with error:%s",
+                         result.description_.c_str());
+        completeAsyncAttestation(attestation, result, std::string());
+    }
+}
+
+void AttestationClientImpl::onAsyncAttestationResponse(const std::shared_ptr<AsyncAttestation>& attestation,
+                                                       CURLcode curl_result,
+                                                       long response_code,
+                                                       const std::string& response,
+                                                       curl_off_t retry_after_seconds) {
+    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+    if (curl_result != CURLE_OK) {
+        CLIENT_LOG_ERROR("Failed sending curl request with error:%s",
+                         curl_easy_strerror(curl_result));
+
+        result.code_ = AttestationResult::ErrorCode::ERROR_SENDING_CURL_REQUEST_FAILED;
+        result.description_ = std::string("Failed sending curl request with error:") + std::string(curl_easy_strerror(curl_result));
+        completeAsyncAttestation(attestation, result, std::string());
+        return;
+    }
+
+    std::chrono::milliseconds retry_delay(0);
+    if ((result = curl::EvaluateResponse(response_code,
+                                         response,
+                                         static_cast<long long>(retry_after_seconds),
+                                         attestation->http_retries,
+                                         retry_delay)).code_ != AttestationResult::ErrorCode::SUCCESS) {
+        CLIENT_LOG_ERROR("Failed to send attestation request with error:%s",
+                         result.description_.c_str());
+        completeAsyncAttestation(attestation, result, std::string());
+        return;
+    }
+
+    // If the executor is stopped the request is failed by the destructor.
+    if (retry_delay.count() > 0) {
+        async_executor_->PostAfter(retry_delay, [this, attestation]() {
+            sendAsyncAttestationRequest(attestation);
+        });
+        return;
+    }
+
+    // Decrypting the token needs the TPM, keep it off the http client thread.
+    async_executor_->Post([this, attestation, response]() {
+        finishAsyncAttestation(attestation, response);
+    });
+}
+
+void AttestationClientImpl::finishAsyncAttestation(const std::shared_ptr<AsyncAttestation>& attestation,
+                                                   const std::string& maa_response) {
+    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+
+    std::string token_encrypted;
+    if ((result = ParseMaaResponse(maa_response, token_encrypted)).code_ !=
+        AttestationResult::ErrorCode::SUCCESS) {
+        CLIENT_LOG_ERROR("Failed to parse the MAA response: %s",
             result.description_.c_str());
+        completeAsyncAttestation(attestation, result, std::string());
+        return;
+    }
+
+    std::string token_decrypted;
+    if ((result = DecryptMaaToken(token_encrypted, token_decrypted)).code_ != AttestationResult::ErrorCode::SUCCESS) {
+        CLIENT_LOG_ERROR("Failed to Decrypt with error:%d description:%s\n",
+            static_cast<int>(result.code_),
+            result.description_.c_str());
+
+        // Retry the attestation like Attest() does, so a transient failure is not
+        // reported as a VM health issue.
+        if (attestation->attestation_retries < MAX_ATTESTATION_RETRIES) {
+            CLIENT_LOG_INFO("Retrying Attestation");
+            std::chrono::seconds retry_delay(
+                static_cast<long long>(5 * pow(2.0, static_cast<double>(attestation->attestation_retries++))));
+            attestation->http_retries = 0;
+            async_executor_->PostAfter(retry_delay, [this, attestation]() {
+                sendAsyncAttestationRequest(attestation);
+            });
+            return;
+        }
+
+        CLIENT_LOG_ERROR("Maximum attestation retries exceeded");
+        completeAsyncAttestation(attestation, result, std::string());
+        return;
+    }
+
+    CLIENT_LOG_INFO("Successfully attested and decrypted response.");
+
+    if (shared_token_cache_ != nullptr) {
+        shared_token_cache_->Put(attestation->endpoint_url, attestation->client_payload, token_decrypted);
+    }
+    if (token_cache_ != nullptr) {
+        token_cache_->Put(attestation->endpoint_url, attestation->client_payload, token_decrypted);
+    }
+    completeAsyncAttestation(attestation, result, token_decrypted);
+}
+
+void AttestationClientImpl::completeAsyncAttestation(const std::shared_ptr<AsyncAttestation>& attestation,
+                                                     const AttestationResult& result,
+                                                     const std::string& jwt_token) {
+    auto completion = [attestation, result, jwt_token]() {
+        unsigned char* jwt_token_out = nullptr;
+        if (result.code_ == AttestationResult::ErrorCode::SUCCESS) {
+            jwt_token_out = allocateToken(jwt_token);
+        }
+
+        try {
+            attestation->callback(result, jwt_token_out);
+        }
+        catch (const std::exception& e) {
+            CLIENT_LOG_ERROR("Unhandled exception in attestation callback: %s", e.what());
+        }
+    };
+
+    {
+        // Whoever removes the request first completes it.
+        std::lock_guard<std::mutex> lock(async_mutex_);
+        if (async_attestations_.erase(attestation) == 0) {
+            return;
+        }
+
+        if (options_.external_event_loop && !async_stopping_) {
+            async_completions_.push_back(completion);
+            async_notifier_->Notify();
+            return;
+        }
+    }
+    completion();
+}
+
+AttestationResult AttestationClientImpl::attest(const std::string& endpoint_url,
+                                                const std::string& client_payload,
+                                                std::string& jwt_token) {
+
+    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+
+    std::string attestation_url;
+    if ((result = getAttestationUrl(endpoint_url, attestation_url)).code_ !=
+                                                    AttestationResult::ErrorCode::SUCCESS) {
         return result;
     }
 
-    if(!params.Validate()) {
-        // One or more parameters are invalid. Log error indicating validation
-        // failed along with function name and error string.
-        CLIENT_LOG_ERROR("Failed to validate attestation parameters");
-        result = AttestationResult::ErrorCode::ERROR_ATTESTATION_PARAMETERS_VALIDATION_FAILED;
-        result.description_ = std::string("Failed to validate parameters for attestation request.");
+    std::string payload;
+    if ((result = prepareAttestationRequest(client_payload, payload)).code_ !=
+                                                    AttestationResult::ErrorCode::SUCCESS) {
         return result;
     }
 
+    return submitAttestationRequest(attestation_url, payload, jwt_token);
+}
+
+AttestationResult AttestationClientImpl::submitAttestationRequest(const std::string& attestation_url,
+                                                                  const std::string& payload,
+                                                                  std::string& jwt_token) {
+
+    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+
     std::string maa_response;
     std::string token_encrypted;
     std::string token_decrypted;
     uint8_t attestation_retries = 0;
     while(true) {
-        if((result = sendAttestationRequest(params, maa_response)).code_ !=
+        if((result = sendHttpRequest(attestation_url, payload, maa_response)).code_ !=
             AttestationResult::ErrorCode::SUCCESS) {
             CLIENT_LOG_ERROR("Failed to send attestation request with error:%s",
                 result.description_.c_str());
@@ -194,10 +875,84 @@ AttestationResult AttestationClientImpl::Attest(const ClientParameters& client_p
         break;
     }
 
-    unsigned char *jwt_token = (unsigned char*) malloc((sizeof(unsigned char) * token_decrypted.size()) + 1); // allocating an extra byte for the null char at the end
-    std::memcpy(jwt_token, token_decrypted.data(), token_decrypted.size());
-    jwt_token[token_decrypted.size()] = '\0';
-    *jwt_token_out = jwt_token;
+    jwt_token = token_decrypted;
+    return result;
+}
+
+AttestationResult AttestationClientImpl::getAttestationUrl(const std::string& endpoint_url,
+                                                           std::string& attestation_url) {
+
+    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+
+    // parse the url and extract the dns
+    std::string dns;
+    if ((result = url::ParseURL(endpoint_url, dns)).code_ != AttestationResult::ErrorCode::SUCCESS) {
+        return result;
+    }
+
+    attestation_url = std::string(std::string(azure_guest_protocol))
+                      .append(dns)
+                      .append(std::string(azure_guest_url));
+    CLIENT_LOG_INFO("Attestation URL - %s", attestation_url.c_str());
+    return result;
+}
+
+AttestationResult AttestationClientImpl::prepareAttestationRequest(const std::string& client_payload,
+                                                                   std::string& payload) {
+
+    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+
+    std::shared_ptr<Tpm> tpm;
+    try {
+        tpm = getTpm();
+    }
+    catch (const Tss2Exception& e) {
+        result.code_ = AttestationResult::ErrorCode::ERROR_TPM_OPERATION_FAILURE;
+        result.tpm_error_code_ = e.get_rc();
+        result.description_ = std::string(e.what());
+
+        CLIENT_LOG_ERROR("Failed to initialize Tpm:%d Error:%s",
+                          result.tpm_error_code_,
+                          result.description_.c_str());
+        return result;
+    }
+
+    if ((result = checkAkCertRenewal(tpm)).code_ != AttestationResult::ErrorCode::SUCCESS) {
+        return result;
+    }
+
+    AttestationParameters params = {};
+    std::unordered_map<std::string, std::string> client_payload_map;
+    if (!client_payload.empty()) {
+        if ((result = ParseClientPayload(reinterpret_cast<const unsigned char*>(client_payload.c_str()),
+                                         client_payload_map)).code_ != 
+                                                    AttestationResult::ErrorCode::SUCCESS) {
+            return result;
+        }
+    }
+    if((result = getAttestationParameters(client_payload_map,
+                                          params)).code_ !=
+                                                    AttestationResult::ErrorCode::SUCCESS) {
+        CLIENT_LOG_ERROR("Failed to get attestation parameters with error:%s",
+            result.description_.c_str());
+        return result;
+    }
+
+    if(!params.Validate()) {
+        // One or more parameters are invalid. Log error indicating validation
+        // failed along with function name and error string.
+        CLIENT_LOG_ERROR("Failed to validate attestation parameters");
+        result = AttestationResult::ErrorCode::ERROR_ATTESTATION_PARAMETERS_VALIDATION_FAILED;
+        result.description_ = std::string("Failed to validate parameters for attestation request.");
+        return result;
+    }
+
+    if((result = CreatePayload(params, payload)).code_ != AttestationResult::ErrorCode::SUCCESS) {
+        CLIENT_LOG_ERROR("Failed to create attestation payload with error:%s",
+                         result.description_.c_str());
+        return result;
+    }
+
     return result;
 }
 
@@ -212,65 +967,412 @@ AttestationResult AttestationClientImpl::Encrypt(const attest::EncryptionType en
                                                  const attest::RsaScheme rsaWrapAlgId,
                                                  const attest::RsaHashAlg rsaHashAlgId) noexcept {
     AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
-    if (jwt_token == nullptr ||
-        data == nullptr ||
+    if (jwt_token == nullptr) {
+        CLIENT_LOG_ERROR("Invalid input parameter");
+        result.code_ = AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER;
+        result.description_ = std::string("Invalid input parameter");
+        return result;
+    }
+
+    // The other parameters are checked by the overload taking the token.
+    AttestationToken token(std::string(reinterpret_cast<const char*>(jwt_token)));
+    return Encrypt(encryption_type,
+                   token,
+                   data,
+                   data_size,
+                   encrypted_data,
+                   encrypted_data_size,
+                   encryption_metadata,
+                   encryption_metadata_size,
+                   rsaWrapAlgId,
+                   rsaHashAlgId);
+}
+
+AttestationResult AttestationClientImpl::Encrypt(const attest::EncryptionType encryption_type,
+                                                 const AttestationToken& token,
+                                                 const unsigned char* data,
+                                                 uint32_t data_size,
+                                                 unsigned char** encrypted_data,
+                                                 uint32_t* encrypted_data_size,
+                                                 unsigned char** encryption_metadata,
+                                                 uint32_t* encryption_metadata_size,
+                                                 const attest::RsaScheme rsaWrapAlgId,
+                                                 const attest::RsaHashAlg rsaHashAlgId) noexcept {
+    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+    if (data == nullptr ||
         data_size <= 0 ||
         encrypted_data == nullptr ||
         encrypted_data_size == nullptr ||
         encryption_metadata == nullptr ||
         encryption_metadata_size == nullptr ||
-        encryption_type != attest::EncryptionType::NONE) {
+        (encryption_type != attest::EncryptionType::NONE &&
+         encryption_type != attest::EncryptionType::ENVELOPE_AES_GCM)) {
         CLIENT_LOG_ERROR("Invalid input parameter");
         result.code_ = AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER;
         result.description_ = std::string("Invalid input parameter");
         return result;
     }
 
-    std::string jwt_token_str(const_cast<char*>(reinterpret_cast<const char*>(jwt_token)));
-    // Extract JWK info from attestation JWT
+    if (encryption_type == attest::EncryptionType::ENVELOPE_AES_GCM) {
+        return encryptEnvelope(token,
+                               data,
+                               data_size,
+                               encrypted_data,
+                               encrypted_data_size,
+                               encryption_metadata,
+                               encryption_metadata_size,
+                               rsaWrapAlgId,
+                               rsaHashAlgId);
+    }
+
+    // For encryption type 'NONE', the data is expected to be the symmetric key
+    std::vector<unsigned char> out_data;
+    if ((result = wrapKey(token, data, data_size, rsaWrapAlgId, rsaHashAlgId, out_data)).code_ !=
+        AttestationResult::ErrorCode::SUCCESS) {
+        return result;
+    }
+
+    *encrypted_data = (unsigned char*)malloc(sizeof(unsigned char) * out_data.size());
+    std::memcpy((void*)*encrypted_data, (void*)out_data.data(), out_data.size());
+    *encrypted_data_size = out_data.size();
+    *encryption_metadata = nullptr;
+    *encryption_metadata_size = 0;
+    return result;
+}
+
+AttestationResult AttestationClientImpl::EncryptStream(const attest::EncryptionType encryption_type,
+                                                       const AttestationToken& token,
+                                                       int input_fd,
+                                                       int output_fd,
+                                                       unsigned char** encryption_metadata,
+                                                       uint32_t* encryption_metadata_size,
+                                                       const attest::RsaScheme rsaWrapAlgId,
+                                                       const attest::RsaHashAlg rsaHashAlgId) noexcept {
+    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+    if (input_fd < 0 ||
+        output_fd < 0 ||
+        encryption_metadata == nullptr ||
+        encryption_metadata_size == nullptr ||
+        encryption_type != attest::EncryptionType::ENVELOPE_AES_GCM) {
+        CLIENT_LOG_ERROR("Invalid input parameter");
+        result.code_ = AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER;
+        result.description_ = std::string("Invalid input parameter");
+        return result;
+    }
+
+    try {
+        envelope::Metadata metadata;
+        std::unique_ptr<envelope::ChunkCipher> cipher;
+        if ((result = createEnvelope(token, rsaWrapAlgId, rsaHashAlgId, metadata, cipher)).code_ !=
+            AttestationResult::ErrorCode::SUCCESS) {
+            return result;
+        }
+
+        // Chunks are encrypted in place. The next chunk is read before the current
+        // one is written, so that the last chunk is known when it is encrypted.
+        const size_t chunk_size = metadata.chunk_size;
+        std::vector<unsigned char> current(chunk_size + envelope::tag_size);
+        std::vector<unsigned char> next(chunk_size + envelope::tag_size);
+        size_t current_size = 0;
+        bool read_ok = readFull(input_fd, current.data(), chunk_size, current_size);
+        for (uint64_t index = 0; read_ok; index++) {
+            size_t next_size = 0;
+            bool last = current_size < chunk_size;
+            if (!last) {
+                read_ok = readFull(input_fd, next.data(), chunk_size, next_size);
+                last = next_size == 0;
+            }
+            if (!read_ok) {
+                break;
+            }
+
+            if (!cipher->EncryptChunk(index, last, current.data(), current_size, current.data())) {
+                result.code_ = AttestationResult::ErrorCode::ERROR_DATA_ENCRYPTION_FAILED;
+                result.description_ = std::string("Failed to encrypt the data");
+                return result;
+            }
+            if (!writeFull(output_fd, current.data(), current_size + envelope::tag_size)) {
+                CLIENT_LOG_ERROR("Failed to write the encrypted data:%s", strerror(errno));
+                result.code_ = AttestationResult::ErrorCode::ERROR_STREAM_IO_FAILED;
+                result.description_ = std::string("Failed to write the encrypted data");
+                return result;
+            }
+            if (last) {
+                break;
+            }
+            current.swap(next);
+            current_size = next_size;
+        }
+        if (!read_ok) {
+            CLIENT_LOG_ERROR("Failed to read the data to encrypt:%s", strerror(errno));
+            result.code_ = AttestationResult::ErrorCode::ERROR_STREAM_IO_FAILED;
+            result.description_ = std::string("Failed to read the data to encrypt");
+            return result;
+        }
+
+        std::string metadata_str = envelope::SerializeMetadata(metadata);
+        *encryption_metadata = allocateToken(metadata_str);
+        *encryption_metadata_size = metadata_str.size();
+    }
+    catch (const std::exception& e) {
+        CLIENT_LOG_ERROR("Failed to encrypt the stream:%s", e.what());
+        result.code_ = AttestationResult::ErrorCode::ERROR_DATA_ENCRYPTION_FAILED;
+        result.description_ = std::string(e.what());
+    }
+    return result;
+}
+
+AttestationResult AttestationClientImpl::wrapKey(const AttestationToken& token,
+                                                 const unsigned char* key,
+                                                 size_t key_size,
+                                                 const attest::RsaScheme rsaWrapAlgId,
+                                                 const attest::RsaHashAlg rsaHashAlgId,
+                                                 Buffer& wrapped_key) {
+    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+
+    // Extract JWK info from the attestation token, decoded on first use only
     std::string n_base64url, e_base64url;
-    if (!jwt::ExtractJwkInfoFromAttestationJwt(jwt_token_str, n_base64url, e_base64url)) {
+    if (!jwt::ExtractJwkInfoFromAttestationToken(token, n_base64url, e_base64url)) {
         CLIENT_LOG_ERROR("Error while extracting JWK info from JWT");
         result.code_ = AttestationResult::ErrorCode::ERROR_EXTRACTING_JWK_INFO;
         result.description_ = std::string("Error while extracting JWK info from JWT");
         return result;
     }
 
-    // Convert JWK to RSA public key
-    BIO* pkey_bio = BIO_new(BIO_s_mem());
-    if ((result = crypto::ConvertJwkToRsaPubKey(pkey_bio, n_base64url, e_base64url)).code_ != 
-                                                                AttestationResult::ErrorCode::SUCCESS) {
+    // The key and its encryption context are only set up once per token
+    int64_t expiry = 0;
+    if (!token.GetExpiry(expiry)) {
+        expiry = 0;
+    }
+    RsaKeyCache::Context enc_ctx;
+    if ((result = rsa_key_cache_.Acquire(n_base64url,
+                                         e_base64url,
+                                         expiry,
+                                         rsaWrapAlgId,
+                                         rsaHashAlgId,
+                                         enc_ctx)).code_ != AttestationResult::ErrorCode::SUCCESS) {
         CLIENT_LOG_ERROR("Failed to convert JWK to RSA Public key");
-        BIO_free(pkey_bio);
         return result;
     }
 
-    // For encryption type 'NONE', the data is expected to be the symmetric key
-    std::vector<unsigned char> in_data(data, data + data_size);
-    std::vector<unsigned char> out_data;
-    // Use RSA public key to encrypt the input data
-    if ((result = crypto::EncryptDataWithRSAPubKey(pkey_bio, rsaWrapAlgId, rsaHashAlgId, in_data, out_data)).code_ !=
+    // Use RSA public key to encrypt the key
+    std::vector<unsigned char> in_data(key, key + key_size);
+    if ((result = crypto::EncryptDataWithRSAContext(enc_ctx.get(), in_data, wrapped_key)).code_ !=
         AttestationResult::ErrorCode::SUCCESS) {
         CLIENT_LOG_ERROR("Failed to encrypt the buffer");
-        BIO_free(pkey_bio);
         return result;
     }
+    return result;
+}
 
-    *encrypted_data = (unsigned char*)malloc(sizeof(unsigned char) * out_data.size());
-    std::memcpy((void*)*encrypted_data, (void*)out_data.data(), out_data.size());
-    *encrypted_data_size = out_data.size();
-    *encryption_metadata = nullptr;
-    *encryption_metadata_size = 0;
+AttestationResult AttestationClientImpl::createEnvelope(const AttestationToken& token,
+                                                        const attest::RsaScheme rsaWrapAlgId,
+                                                        const attest::RsaHashAlg rsaHashAlgId,
+                                                        envelope::Metadata& metadata,
+                                                        std::unique_ptr<envelope::ChunkCipher>& cipher) {
+    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+    unsigned char dek[envelope::key_size];
+    metadata.nonce_prefix.resize(envelope::nonce_prefix_size);
+    if (RAND_bytes(dek, sizeof(dek)) != 1 ||
+        RAND_bytes(metadata.nonce_prefix.data(), static_cast<int>(metadata.nonce_prefix.size())) != 1) {
+        CLIENT_LOG_ERROR("Failed to generate the data encryption key");
+        result.code_ = AttestationResult::ErrorCode::ERROR_DATA_ENCRYPTION_FAILED;
+        result.description_ = std::string("Failed to generate the data encryption key");
+        return result;
+    }
+
+    if ((result = wrapKey(token, dek, sizeof(dek), rsaWrapAlgId, rsaHashAlgId, metadata.wrapped_key)).code_ ==
+        AttestationResult::ErrorCode::SUCCESS) {
+        cipher.reset(new envelope::ChunkCipher(dek, metadata.nonce_prefix.data()));
+    }
+    OPENSSL_cleanse(dek, sizeof(dek));
+    return result;
+}
+
+AttestationResult AttestationClientImpl::encryptEnvelope(const AttestationToken& token,
+                                                         const unsigned char* data,
+                                                         uint32_t data_size,
+                                                         unsigned char** encrypted_data,
+                                                         uint32_t* encrypted_data_size,
+                                                         unsigned char** encryption_metadata,
+                                                         uint32_t* encryption_metadata_size,
+                                                         const attest::RsaScheme rsaWrapAlgId,
+                                                         const attest::RsaHashAlg rsaHashAlgId) {
+    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+    uint64_t out_size = envelope::EncryptedSize(data_size, envelope::default_chunk_size);
+    if (out_size > UINT32_MAX) {
+        CLIENT_LOG_ERROR("Data too large to encrypt into a buffer");
+        result.code_ = AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER;
+        result.description_ = std::string("Data too large to encrypt into a buffer, use EncryptStream");
+        return result;
+    }
+
+    try {
+        envelope::Metadata metadata;
+        std::unique_ptr<envelope::ChunkCipher> cipher;
+        if ((result = createEnvelope(token, rsaWrapAlgId, rsaHashAlgId, metadata, cipher)).code_ !=
+            AttestationResult::ErrorCode::SUCCESS) {
+            return result;
+        }
+
+        unsigned char* out = (unsigned char*)malloc(sizeof(unsigned char) * out_size);
+        if (out == nullptr) {
+            CLIENT_LOG_ERROR("Failed to allocate the encrypted data");
+            result.code_ = AttestationResult::ErrorCode::ERROR_FAILED_MEMORY_ALLOCATION;
+            result.description_ = std::string("Failed to allocate the encrypted data");
+            return result;
+        }
+
+        uint64_t chunk_count = envelope::ChunkCount(data_size, metadata.chunk_size);
+        for (uint64_t index = 0; index < chunk_count; index++) {
+            size_t offset = index * metadata.chunk_size;
+            size_t size = std::min<size_t>(metadata.chunk_size, data_size - offset);
+            if (!cipher->EncryptChunk(index,
+                                      index + 1 == chunk_count,
+                                      data + offset,
+                                      size,
+                                      out + offset + index * envelope::tag_size)) {
+                free(out);
+                result.code_ = AttestationResult::ErrorCode::ERROR_DATA_ENCRYPTION_FAILED;
+                result.description_ = std::string("Failed to encrypt the data");
+                return result;
+            }
+        }
+
+        std::string metadata_str = envelope::SerializeMetadata(metadata);
+        *encrypted_data = out;
+        *encrypted_data_size = static_cast<uint32_t>(out_size);
+        *encryption_metadata = allocateToken(metadata_str);
+        *encryption_metadata_size = metadata_str.size();
+    }
+    catch (const std::exception& e) {
+        CLIENT_LOG_ERROR("Failed to encrypt the data:%s", e.what());
+        result.code_ = AttestationResult::ErrorCode::ERROR_DATA_ENCRYPTION_FAILED;
+        result.description_ = std::string(e.what());
+    }
+    return result;
+}
+
+AttestationResult AttestationClientImpl::EncryptBatch(const attest::EncryptionType encryption_type,
+                                                      const AttestationToken& token,
+                                                      const unsigned char* const* data,
+                                                      const uint32_t* data_sizes,
+                                                      uint32_t count,
+                                                      unsigned char* const* encrypted_data,
+                                                      uint32_t* encrypted_data_sizes,
+                                                      AttestationResult* results,
+                                                      const attest::RsaScheme rsaWrapAlgId,
+                                                      const attest::RsaHashAlg rsaHashAlgId) noexcept {
+    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+    if (data == nullptr ||
+        data_sizes == nullptr ||
+        count == 0 ||
+        encrypted_data == nullptr ||
+        encrypted_data_sizes == nullptr ||
+        results == nullptr ||
+        encryption_type != attest::EncryptionType::NONE) {
+        CLIENT_LOG_ERROR("Invalid input parameter");
+        result.code_ = AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER;
+        result.description_ = std::string("Invalid input parameter");
+        return result;
+    }
 
-    BIO_free(pkey_bio);
+    std::string n_base64url, e_base64url;
+    if (!jwt::ExtractJwkInfoFromAttestationToken(token, n_base64url, e_base64url)) {
+        CLIENT_LOG_ERROR("Error while extracting JWK info from JWT");
+        result.code_ = AttestationResult::ErrorCode::ERROR_EXTRACTING_JWK_INFO;
+        result.description_ = std::string("Error while extracting JWK info from JWT");
+        return result;
+    }
+
+    int64_t expiry = 0;
+    if (!token.GetExpiry(expiry)) {
+        expiry = 0;
+    }
+
+    // Set the key up once here, so that a key that cannot be used fails the whole
+    // batch, and the threads only lease encryption contexts from the cache.
+    RsaKeyCache::Context enc_ctx;
+    if ((result = rsa_key_cache_.Acquire(n_base64url,
+                                         e_base64url,
+                                         expiry,
+                                         rsaWrapAlgId,
+                                         rsaHashAlgId,
+                                         enc_ctx)).code_ != AttestationResult::ErrorCode::SUCCESS) {
+        CLIENT_LOG_ERROR("Failed to convert JWK to RSA Public key");
+        return result;
+    }
+
+    std::mutex enc_ctx_mutex;
+    auto encrypt_block = [&](size_t begin, size_t end) {
+        RsaKeyCache::Context block_ctx;
+        {
+            // The first block to get here takes over the context set up above.
+            std::lock_guard<std::mutex> lock(enc_ctx_mutex);
+            if (enc_ctx.get() != nullptr) {
+                block_ctx = std::move(enc_ctx);
+            }
+        }
+        AttestationResult block_result(AttestationResult::ErrorCode::SUCCESS);
+        if (block_ctx.get() == nullptr) {
+            block_result = rsa_key_cache_.Acquire(n_base64url,
+                                                  e_base64url,
+                                                  expiry,
+                                                  rsaWrapAlgId,
+                                                  rsaHashAlgId,
+                                                  block_ctx);
+        }
+
+        for (size_t i = begin; i < end; i++) {
+            size_t encrypted_size = encrypted_data_sizes[i];
+            encrypted_data_sizes[i] = 0;
+            if (block_result.code_ != AttestationResult::ErrorCode::SUCCESS) {
+                results[i] = block_result;
+                continue;
+            }
+            results[i] = crypto::EncryptDataWithRSAContext(block_ctx.get(),
+                                                           data[i],
+                                                           data_sizes[i],
+                                                           encrypted_data[i],
+                                                           encrypted_size);
+            if (results[i].code_ == AttestationResult::ErrorCode::SUCCESS) {
+                encrypted_data_sizes[i] = static_cast<uint32_t>(encrypted_size);
+            }
+        }
+    };
+
+    TaskExecutor* executor = nullptr;
+    try {
+        executor = &getCryptoExecutor();
+    }
+    catch (const std::exception& e) {
+        CLIENT_LOG_WARN("Failed to start the crypto threads: %s", e.what());
+    }
+
+    if (executor != nullptr) {
+        executor->ParallelFor(count, ENCRYPT_BATCH_BLOCK_SIZE, encrypt_block);
+    }
+    else {
+        // Without the pool the batch still runs, on the calling thread only.
+        encrypt_block(0, count);
+    }
     return result;
 }
 
+TaskExecutor& AttestationClientImpl::getCryptoExecutor() {
+    std::lock_guard<std::mutex> lock(crypto_executor_mutex_);
+    if (crypto_executor_ == nullptr) {
+        unsigned int cores = std::thread::hardware_concurrency();
+        crypto_executor_.reset(new TaskExecutor(cores > 1 ? cores - 1 : 1));
+    }
+    return *crypto_executor_;
+}
+
 AttestationResult AttestationClientImpl::Decrypt(const attest::EncryptionType encryption_type,
                                                  const unsigned char* encrypted_data,
                                                  uint32_t encrypted_data_size,
-                                                 const unsigned char* ,
-                                                 uint32_t ,
+                                                 const unsigned char* encryption_metadata,
+                                                 uint32_t encryption_metadata_size,
                                                  unsigned char** decrypted_data,
                                                  uint32_t* decrypted_data_size,
                                                  const attest::RsaScheme rsaWrapAlgId,
@@ -280,31 +1382,69 @@ AttestationResult AttestationClientImpl::Decrypt(const attest::EncryptionType en
         encrypted_data_size <= 0  ||
         decrypted_data == nullptr ||
         decrypted_data_size == nullptr ||
-        encryption_type != attest::EncryptionType::NONE) {
+        (encryption_type != attest::EncryptionType::NONE &&
+         encryption_type != attest::EncryptionType::ENVELOPE_AES_GCM)) {
         CLIENT_LOG_ERROR("Invalid input parameter");
         result.code_ = AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER;
         result.description_ = std::string("Invalid input parameter");
         return result;
     }
+
+    if (encryption_type == attest::EncryptionType::ENVELOPE_AES_GCM) {
+        return decryptEnvelope(encrypted_data,
+                               encrypted_data_size,
+                               encryption_metadata,
+                               encryption_metadata_size,
+                               decrypted_data,
+                               decrypted_data_size,
+                               rsaWrapAlgId,
+                               rsaHashAlgId);
+    }
+
+    // For encryption type 'NONE', the encrypted data is expected to be the encrypted symmetric key
+    std::vector<unsigned char> in_data(encrypted_data, encrypted_data + encrypted_data_size);
+    std::vector<unsigned char> out_data;
+    if ((result = unwrapKey(in_data, rsaWrapAlgId, rsaHashAlgId, out_data)).code_ !=
+        AttestationResult::ErrorCode::SUCCESS) {
+        return result;
+    }
+
+    *decrypted_data = (unsigned char*)malloc(sizeof(unsigned char) * out_data.size());
+    std::memcpy((void*)*decrypted_data, (void*)out_data.data(), out_data.size());
+    *decrypted_data_size = out_data.size();
+    OPENSSL_cleanse(out_data.data(), out_data.size());
+    return result;
+}
+
+AttestationResult AttestationClientImpl::unwrapKey(const Buffer& wrapped_key,
+                                                   const attest::RsaScheme rsaWrapAlgId,
+                                                   const attest::RsaHashAlg rsaHashAlgId,
+                                                   Buffer& key) {
+    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
     try {
-        Tpm tpm;
+        std::shared_ptr<Tpm> tpm = getTpm();
         PcrList list = GetAttestationPcrList();
-        PcrSet pcrValues = tpm.GetPCRValues(list, attestation_hash_alg);
+        PcrSet pcrValues = tpm->GetPCRValues(list, attestation_hash_alg);
 
-        // For encryption type 'NONE', the encrypted data is expected to be the encrypted symmetric key
-        std::vector<unsigned char> in_data(encrypted_data, encrypted_data + encrypted_data_size);
-        std::vector<unsigned char> out_data;
-        out_data = tpm.DecryptWithEphemeralKey(pcrValues, in_data, rsaWrapAlgId, rsaHashAlgId);
+        // Reading the PCRs is cheap next to creating the ephemeral key, and tells
+        // whether the cached keys still match what the TPM would unwrap.
+        if (data_key_cache_ != nullptr &&
+            data_key_cache_->Get(wrapped_key, rsaWrapAlgId, rsaHashAlgId, pcrValues, key)) {
+            return result;
+        }
 
-        *decrypted_data = (unsigned char*)malloc(sizeof(unsigned char) * out_data.size());
-        std::memcpy((void*)*decrypted_data, (void*)out_data.data(), out_data.size());
-        *decrypted_data_size = out_data.size();
+        key = tpm->DecryptWithEphemeralKey(pcrValues, wrapped_key, rsaWrapAlgId, rsaHashAlgId);
+
+        if (data_key_cache_ != nullptr) {
+            data_key_cache_->Put(wrapped_key, rsaWrapAlgId, rsaHashAlgId, pcrValues, key);
+        }
     }
     catch (const Tss2Exception& e) {
         // Since tss2 errors are throw Tss2Exception exception. Catch it here.
         result.code_ = AttestationResult::ErrorCode::ERROR_DATA_DECRYPTION_TPM_ERROR;
         result.tpm_error_code_ = e.get_rc();
         result.description_ = std::string(e.what());
+        resetTpm();
 
         CLIENT_LOG_ERROR("Failed Tpm operation:%d Error:%s",
             result.tpm_error_code_,
@@ -332,6 +1472,320 @@ AttestationResult AttestationClientImpl::Decrypt(const attest::EncryptionType en
     return result;
 }
 
+AttestationResult AttestationClientImpl::decryptEnvelope(const unsigned char* encrypted_data,
+                                                         uint32_t encrypted_data_size,
+                                                         const unsigned char* encryption_metadata,
+                                                         uint32_t encryption_metadata_size,
+                                                         unsigned char** decrypted_data,
+                                                         uint32_t* decrypted_data_size,
+                                                         const attest::RsaScheme rsaWrapAlgId,
+                                                         const attest::RsaHashAlg rsaHashAlgId) {
+    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+    envelope::Metadata metadata;
+    uint64_t out_size = 0;
+    if ((result = checkEnvelope(encrypted_data_size, encryption_metadata, encryption_metadata_size, metadata, out_size)).code_ !=
+        AttestationResult::ErrorCode::SUCCESS) {
+        return result;
+    }
+
+    Buffer dek;
+    if ((result = unwrapDataKey(metadata, rsaWrapAlgId, rsaHashAlgId, dek)).code_ !=
+        AttestationResult::ErrorCode::SUCCESS) {
+        return result;
+    }
+
+    // malloc(0) may return nullptr, which callers would take for a failure.
+    unsigned char* out = (unsigned char*)malloc(sizeof(unsigned char) * std::max<uint64_t>(out_size, 1));
+    if (out == nullptr) {
+        OPENSSL_cleanse(dek.data(), dek.size());
+        CLIENT_LOG_ERROR("Failed to allocate the decrypted data");
+        result.code_ = AttestationResult::ErrorCode::ERROR_FAILED_MEMORY_ALLOCATION;
+        result.description_ = std::string("Failed to allocate the decrypted data");
+        return result;
+    }
+
+    result = decryptChunks(dek, metadata, 0, true, encrypted_data, out_size, out, metadata.chunk_size);
+    OPENSSL_cleanse(dek.data(), dek.size());
+    if (result.code_ != AttestationResult::ErrorCode::SUCCESS) {
+        OPENSSL_cleanse(out, out_size);
+        free(out);
+        return result;
+    }
+
+    *decrypted_data = out;
+    *decrypted_data_size = static_cast<uint32_t>(out_size);
+    return result;
+}
+
+AttestationResult AttestationClientImpl::DecryptToBuffer(const attest::EncryptionType encryption_type,
+                                                         const unsigned char* encrypted_data,
+                                                         uint32_t encrypted_data_size,
+                                                         const unsigned char* encryption_metadata,
+                                                         uint32_t encryption_metadata_size,
+                                                         unsigned char* decrypted_data,
+                                                         uint32_t* decrypted_data_size,
+                                                         const attest::RsaScheme rsaWrapAlgId,
+                                                         const attest::RsaHashAlg rsaHashAlgId) noexcept {
+    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+    if (encrypted_data == nullptr ||
+        encrypted_data_size <= 0 ||
+        decrypted_data_size == nullptr ||
+        (decrypted_data == nullptr && *decrypted_data_size > 0) ||
+        (encryption_type != attest::EncryptionType::NONE &&
+         encryption_type != attest::EncryptionType::ENVELOPE_AES_GCM)) {
+        CLIENT_LOG_ERROR("Invalid input parameter");
+        result.code_ = AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER;
+        result.description_ = std::string("Invalid input parameter");
+        return result;
+    }
+
+    if (encryption_type == attest::EncryptionType::NONE) {
+        std::vector<unsigned char> in_data(encrypted_data, encrypted_data + encrypted_data_size);
+        std::vector<unsigned char> out_data;
+        if ((result = unwrapKey(in_data, rsaWrapAlgId, rsaHashAlgId, out_data)).code_ ==
+            AttestationResult::ErrorCode::SUCCESS) {
+            if (out_data.size() > *decrypted_data_size) {
+                CLIENT_LOG_ERROR("Output buffer too small");
+                result.code_ = AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER;
+                result.description_ = std::string("Output buffer too small");
+            }
+            else {
+                std::memcpy(decrypted_data, out_data.data(), out_data.size());
+                *decrypted_data_size = out_data.size();
+            }
+        }
+        OPENSSL_cleanse(out_data.data(), out_data.size());
+        return result;
+    }
+
+    envelope::Metadata metadata;
+    uint64_t out_size = 0;
+    if ((result = checkEnvelope(encrypted_data_size, encryption_metadata, encryption_metadata_size, metadata, out_size)).code_ !=
+        AttestationResult::ErrorCode::SUCCESS) {
+        return result;
+    }
+    if (out_size > *decrypted_data_size) {
+        CLIENT_LOG_ERROR("Output buffer too small");
+        result.code_ = AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER;
+        result.description_ = std::string("Output buffer too small");
+        *decrypted_data_size = static_cast<uint32_t>(out_size);
+        return result;
+    }
+
+    Buffer dek;
+    if ((result = unwrapDataKey(metadata, rsaWrapAlgId, rsaHashAlgId, dek)).code_ !=
+        AttestationResult::ErrorCode::SUCCESS) {
+        return result;
+    }
+    result = decryptChunks(dek, metadata, 0, true, encrypted_data, out_size, decrypted_data, metadata.chunk_size);
+    OPENSSL_cleanse(dek.data(), dek.size());
+    if (result.code_ != AttestationResult::ErrorCode::SUCCESS) {
+        OPENSSL_cleanse(decrypted_data, out_size);
+        return result;
+    }
+    *decrypted_data_size = static_cast<uint32_t>(out_size);
+    return result;
+}
+
+AttestationResult AttestationClientImpl::DecryptStream(const attest::EncryptionType encryption_type,
+                                                       int input_fd,
+                                                       int output_fd,
+                                                       const unsigned char* encryption_metadata,
+                                                       uint32_t encryption_metadata_size,
+                                                       const attest::RsaScheme rsaWrapAlgId,
+                                                       const attest::RsaHashAlg rsaHashAlgId) noexcept {
+    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+    if (input_fd < 0 ||
+        output_fd < 0 ||
+        encryption_type != attest::EncryptionType::ENVELOPE_AES_GCM) {
+        CLIENT_LOG_ERROR("Invalid input parameter");
+        result.code_ = AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER;
+        result.description_ = std::string("Invalid input parameter");
+        return result;
+    }
+
+    envelope::Metadata metadata;
+    if (!envelope::ParseMetadata(encryption_metadata, encryption_metadata_size, metadata)) {
+        CLIENT_LOG_ERROR("Invalid encryption metadata");
+        result.code_ = AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER;
+        result.description_ = std::string("Invalid encryption metadata");
+        return result;
+    }
+
+    Buffer dek;
+    if ((result = unwrapDataKey(metadata, rsaWrapAlgId, rsaHashAlgId, dek)).code_ !=
+        AttestationResult::ErrorCode::SUCCESS) {
+        return result;
+    }
+
+    result = decryptStream(dek, metadata, input_fd, output_fd);
+    OPENSSL_cleanse(dek.data(), dek.size());
+    return result;
+}
+
+AttestationResult AttestationClientImpl::checkEnvelope(uint32_t encrypted_data_size,
+                                                       const unsigned char* encryption_metadata,
+                                                       uint32_t encryption_metadata_size,
+                                                       envelope::Metadata& metadata,
+                                                       uint64_t& decrypted_data_size) {
+    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+    if (!envelope::ParseMetadata(encryption_metadata, encryption_metadata_size, metadata) ||
+        !envelope::DecryptedSize(encrypted_data_size, metadata.chunk_size, decrypted_data_size)) {
+        CLIENT_LOG_ERROR("Invalid encryption metadata or encrypted data");
+        result.code_ = AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER;
+        result.description_ = std::string("Invalid encryption metadata or encrypted data");
+    }
+    return result;
+}
+
+AttestationResult AttestationClientImpl::unwrapDataKey(const envelope::Metadata& metadata,
+                                                       const attest::RsaScheme rsaWrapAlgId,
+                                                       const attest::RsaHashAlg rsaHashAlgId,
+                                                       Buffer& dek) {
+    // The TPM only unwraps the data encryption key, the data never goes through it.
+    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+    if ((result = unwrapKey(metadata.wrapped_key, rsaWrapAlgId, rsaHashAlgId, dek)).code_ !=
+        AttestationResult::ErrorCode::SUCCESS) {
+        return result;
+    }
+    if (dek.size() != envelope::key_size) {
+        OPENSSL_cleanse(dek.data(), dek.size());
+        CLIENT_LOG_ERROR("Unwrapped data encryption key has the wrong size");
+        result.code_ = AttestationResult::ErrorCode::ERROR_DATA_DECRYPTION_FAILED;
+        result.description_ = std::string("Unwrapped data encryption key has the wrong size");
+    }
+    return result;
+}
+
+AttestationResult AttestationClientImpl::decryptChunks(const Buffer& dek,
+                                                       const envelope::Metadata& metadata,
+                                                       uint64_t first_index,
+                                                       bool ends_message,
+                                                       const unsigned char* encrypted_data,
+                                                       uint64_t size,
+                                                       unsigned char* decrypted_data,
+                                                       size_t decrypted_stride) {
+    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+    const size_t frame_size = metadata.chunk_size + envelope::tag_size;
+    const uint64_t chunk_count = envelope::ChunkCount(size, metadata.chunk_size);
+    std::atomic<bool> failed(false);
+
+    // Every range gets a cipher of its own since ChunkCipher is not thread safe.
+    auto decrypt_range = [&](size_t begin, size_t end) {
+        envelope::ChunkCipher cipher(dek.data(), metadata.nonce_prefix.data());
+        for (size_t i = begin; i < end && !failed.load(std::memory_order_relaxed); i++) {
+            uint64_t offset = uint64_t(i) * metadata.chunk_size;
+            size_t chunk = static_cast<size_t>(std::min<uint64_t>(metadata.chunk_size, size - offset));
+            if (!cipher.DecryptChunk(first_index + i,
+                                     ends_message && i + 1 == chunk_count,
+                                     encrypted_data + i * frame_size,
+                                     chunk + envelope::tag_size,
+                                     decrypted_data + i * decrypted_stride)) {
+                failed = true;
+            }
+        }
+    };
+
+    TaskExecutor* executor = nullptr;
+    if (chunk_count > DECRYPT_BLOCK_CHUNKS) {
+        try {
+            executor = &getCryptoExecutor();
+        }
+        catch (const std::exception& e) {
+            CLIENT_LOG_WARN("Failed to start the crypto threads: %s", e.what());
+        }
+    }
+
+    if (executor != nullptr) {
+        executor->ParallelFor(chunk_count, DECRYPT_BLOCK_CHUNKS, decrypt_range);
+    }
+    else {
+        // Small messages are not worth handing to other threads.
+        decrypt_range(0, chunk_count);
+    }
+
+    if (failed) {
+        result.code_ = AttestationResult::ErrorCode::ERROR_DATA_DECRYPTION_FAILED;
+        result.description_ = std::string("The encrypted data failed authentication");
+    }
+    return result;
+}
+
+AttestationResult AttestationClientImpl::decryptStream(const Buffer& dek,
+                                                       const envelope::Metadata& metadata,
+                                                       int input_fd,
+                                                       int output_fd) {
+    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+    try {
+        // The input is read in batches of whole chunks that are decrypted in parallel
+        // and in place. The next batch is read before the current one is decrypted, so
+        // that the last chunk of the message is known.
+        const size_t frame_size = metadata.chunk_size + envelope::tag_size;
+        const size_t batch_size = std::max<size_t>(DECRYPT_STREAM_BATCH_SIZE / frame_size, 1) * frame_size;
+        std::vector<unsigned char> current(batch_size);
+        std::vector<unsigned char> next(batch_size);
+        size_t current_size = 0;
+        bool read_ok = readFull(input_fd, current.data(), batch_size, current_size);
+        for (uint64_t first_index = 0; read_ok; first_index += batch_size / frame_size) {
+            size_t next_size = 0;
+            bool last = current_size < batch_size;
+            if (!last) {
+                read_ok = readFull(input_fd, next.data(), batch_size, next_size);
+                last = next_size == 0;
+            }
+            if (!read_ok) {
+                break;
+            }
+
+            // Only the first batch may end in an empty chunk, and only if it is the whole message.
+            uint64_t size = 0;
+            if (!envelope::DecryptedSize(current_size, metadata.chunk_size, size) ||
+                (size == 0 && first_index > 0) ||
+                first_index + envelope::ChunkCount(size, metadata.chunk_size) > envelope::max_chunk_count) {
+                CLIENT_LOG_ERROR("The encrypted stream is truncated or malformed");
+                result.code_ = AttestationResult::ErrorCode::ERROR_DATA_DECRYPTION_FAILED;
+                result.description_ = std::string("The encrypted stream is truncated or malformed");
+                break;
+            }
+            if ((result = decryptChunks(dek, metadata, first_index, last, current.data(), size, current.data(), frame_size)).code_ !=
+                AttestationResult::ErrorCode::SUCCESS) {
+                break;
+            }
+
+            bool write_ok = true;
+            for (size_t offset = 0; write_ok && offset < size; offset += metadata.chunk_size) {
+                size_t chunk = std::min<size_t>(metadata.chunk_size, size - offset);
+                write_ok = writeFull(output_fd, current.data() + offset / metadata.chunk_size * frame_size, chunk);
+            }
+            OPENSSL_cleanse(current.data(), current_size);
+            if (!write_ok) {
+                CLIENT_LOG_ERROR("Failed to write the decrypted data:%s", strerror(errno));
+                result.code_ = AttestationResult::ErrorCode::ERROR_STREAM_IO_FAILED;
+                result.description_ = std::string("Failed to write the decrypted data");
+                break;
+            }
+            if (last) {
+                break;
+            }
+            current.swap(next);
+            current_size = next_size;
+        }
+        if (!read_ok) {
+            CLIENT_LOG_ERROR("Failed to read the encrypted data:%s", strerror(errno));
+            result.code_ = AttestationResult::ErrorCode::ERROR_STREAM_IO_FAILED;
+            result.description_ = std::string("Failed to read the encrypted data");
+        }
+        OPENSSL_cleanse(current.data(), current.size());
+        OPENSSL_cleanse(next.data(), next.size());
+    }
+    catch (const std::exception& e) {
+        CLIENT_LOG_ERROR("Failed to decrypt the stream:%s", e.what());
+        result.code_ = AttestationResult::ErrorCode::ERROR_DATA_DECRYPTION_FAILED;
+        result.description_ = std::string(e.what());
+    }
+    return result;
+}
+
 void AttestationClientImpl::Free(void* ptr) noexcept {
     if (ptr == nullptr) {
         return;
@@ -355,69 +1809,54 @@ AttestationResult AttestationClientImpl::DecryptMaaToken(const std::string& jwt_
         return result;
     }
     
-    std::string jwt = jwt_token_encrypted;
-
-    // Decode the encrypted jwt since its base64url encoded by the service.
-    attest::Buffer jwt_encrypted_decoded = attest::base64::base64url_to_binary(jwt);
-    std::string jwt_encrypted_str(jwt_encrypted_decoded.begin(), jwt_encrypted_decoded.end());
-
-    Json::Value response;
-    Json::Reader reader;
-    bool success = reader.parse(jwt_encrypted_str.c_str(), response);
-    if(!success) {
-        CLIENT_LOG_ERROR("Failed to parse AAS response");
-        result.code_ = AttestationResult::ErrorCode::ERROR_JWT_DECRYPTION_FAILED;
-        result.description_ = std::string("Failed to parse AAS response");
-        return result;
-    }
-
-    attest::Buffer encrypted_inner_key;
+    // Decode the encrypted jwt since its base64url encoded by the service, and pull the
+    // envelope fields out of it in one pass.
+    MaaEnvelope envelope;
     std::string err;
-    if(!GetEncryptedInnerKey(response,
-                              encrypted_inner_key,
-                              err)){
-        CLIENT_LOG_ERROR("Failed to get encrypted inner key from AAS response");
+    if(!ParseMaaEnvelope(jwt_token_encrypted,
+                         envelope,
+                         err)) {
+        CLIENT_LOG_ERROR("Failed to parse encrypted token envelope from AAS response");
         result.code_ = AttestationResult::ErrorCode::ERROR_JWT_DECRYPTION_FAILED;
         result.description_ = err;
         return result;
     }
 
-    EncryptionParameters encryption_params;
-    if(!GetEncryptionParameters(response,
-                                encryption_params,
-                                err)) {
-        CLIENT_LOG_ERROR("Failed to get encryption parameters for decryption");
-        result.code_ = AttestationResult::ErrorCode::ERROR_JWT_DECRYPTION_FAILED;
-        result.description_ = err;
+    std::shared_ptr<Tpm> tpm;
+    try {
+        tpm = getTpm();
+    }
+    catch (const Tss2Exception& e) {
+        result.code_ = AttestationResult::ErrorCode::ERROR_JWT_DECRYPTION_TPM_ERROR;
+        result.tpm_error_code_ = e.get_rc();
+        result.description_ = std::string(e.what());
+
+        CLIENT_LOG_ERROR("Failed to initialize Tpm:%d Error:%s",
+                          result.tpm_error_code_,
+                          result.description_.c_str());
         return result;
     }
 
     attest::Buffer decrypted_key;
     // MAA uses RSA-ES with SHA256 as the encryption algorithm.
-    if((result = DecryptInnerKey(encrypted_inner_key,
+    if((result = DecryptInnerKey(*tpm,
+                                 envelope.encrypted_inner_key,
                                  decrypted_key,
                                  attest::RsaScheme::RsaEs,
                                  attest::RsaHashAlg::RsaSha256)).code_ !=
                                                             AttestationResult::ErrorCode::SUCCESS) {
         CLIENT_LOG_ERROR("Failed to decrypt inner key");
+        if (result.tpm_error_code_ != 0) {
+            resetTpm();
+        }
         return result;
     }
 
     CLIENT_LOG_INFO("Successfully Decrypted inner key");
 
-    attest::Buffer jwt_encrypted;
-    if(!GetEncryptedJwt(response,
-                        jwt_encrypted,
-                        err)) {
-        CLIENT_LOG_ERROR("Failed to get encrypted jwt from response");
-        result.code_ = AttestationResult::ErrorCode::ERROR_JWT_DECRYPTION_FAILED;
-        result.description_ = err;
-        return result;
-    }
-
-    if(!DecryptJwt(encryption_params,
+    if(!DecryptJwt(envelope.encryption_params,
                    decrypted_key,
-                   jwt_encrypted,
+                   envelope.jwt_encrypted,
                    jwt_token_decrypted,
                    err)) {
         CLIENT_LOG_ERROR("Failed to decrypt jwt");
@@ -465,36 +1904,57 @@ AttestationResult AttestationClientImpl::getAttestationParameters(
 
     AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
 
+    // The isolation info (HCL report read plus the THIM round trip for the VCEK cert)
+    // and the measurement logs do not depend on each other or on the TPM info, so
+    // they are collected on separate threads. TPM commands are still serialized by
+    // the shared Tpm, but the network fetch overlaps with the quote and key
+    // generation done by GetTpmInfo on this thread.
+    IsolationInfo isolation_info;
+    std::future<AttestationResult> isolation_result = std::async(std::launch::async, [this, &isolation_info]() {
+        return GetIsolationInfo(isolation_info);
+    });
+
+    // Create a MeasurementType to indicate we are asking for TCG logs.Going forward,
+    // we can take the log type as an parameter to this function.
+    MeasurementType log_type = MeasurementType::TCG;
+    Buffer tcg_logs;
+    std::future<AttestationResult> measurements_result = std::async(std::launch::async, [this, log_type, &tcg_logs]() {
+        return GetMeasurements(log_type, tcg_logs);
+    });
+
     OsInfo os_info;
-    if((result = GetOSInfo(os_info)).code_ != AttestationResult::ErrorCode::SUCCESS) {
+    AttestationResult os_result = GetOSInfo(os_info);
+
+    TpmInfo tpm_info;
+    AttestationResult tpm_result = GetTpmInfo(tpm_info);
+
+    // Join all collection steps before looking at any of the results so nothing is
+    // left running against the locals above.
+    AttestationResult isolation_info_result = isolation_result.get();
+    AttestationResult measurement_logs_result = measurements_result.get();
+
+    if((result = os_result).code_ != AttestationResult::ErrorCode::SUCCESS) {
         CLIENT_LOG_ERROR("Failed to get OS information with error:%s",
                          result.description_.c_str());
         return result;
     }
 
-    IsolationInfo isolation_info;
-    if ((result = GetIsolationInfo(isolation_info)).code_ != AttestationResult::ErrorCode::SUCCESS) {
+    if ((result = isolation_info_result).code_ != AttestationResult::ErrorCode::SUCCESS) {
         CLIENT_LOG_ERROR("Failed to get the isolation information with error:%s",
             result.description_.c_str());
         return result;
     }
 
-    // Create a MeasurementType to indicate we are asking for TCG logs.Going forward,
-    // we can take the log type as an parameter to this function.
-    MeasurementType log_type = MeasurementType::TCG;
-    Buffer tcg_logs;
-
     // Note: This function should never fail. It will return empty logs in
     // case logs were not found.
-    if((result = GetMeasurements(log_type, tcg_logs)).code_ !=
+    if((result = measurement_logs_result).code_ !=
                                                 AttestationResult::ErrorCode::SUCCESS) {
         CLIENT_LOG_ERROR("Failed to get measurement logs with error:%s",
                          result.description_.c_str());
         return result;
     }
 
-    TpmInfo tpm_info;
-    if((result = GetTpmInfo(tpm_info)).code_ != AttestationResult::ErrorCode::SUCCESS) {
+    if((result = tpm_result).code_ != AttestationResult::ErrorCode::SUCCESS) {
         CLIENT_LOG_ERROR("Failed to get Tpm information with error:%s",
                          result.description_.c_str());
         return result;
@@ -509,34 +1969,6 @@ AttestationResult AttestationClientImpl::getAttestationParameters(
     return result;
 }
 
-AttestationResult AttestationClientImpl::sendAttestationRequest(
-                                                          const AttestationParameters& params,
-                                                          std::string& jwt_token_encrypted) {
-
-    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
-
-    jwt_token_encrypted = std::string();
-
-    std::string payload;
-    if((result = CreatePayload(params, payload)).code_ != AttestationResult::ErrorCode::SUCCESS) {
-        CLIENT_LOG_ERROR("Failed to create attestation payload with error:%s",
-                         result.description_.c_str());
-        return result;
-    }
-
-    std::string response;
-    if((result = sendHttpRequest(payload, response)).code_ !=
-                                                AttestationResult::ErrorCode::SUCCESS) {
-        CLIENT_LOG_ERROR("Failed to send http request with error:%s",
-                         result.description_.c_str());
-        return result;
-    }
-
-    jwt_token_encrypted = response;
-    
-    return result;
-}
-
 AttestationResult AttestationClientImpl::GetMeasurements(
                                             const AttestationClientImpl::MeasurementType& type,
                                             Buffer& measurement_logs) {
@@ -554,8 +1986,7 @@ AttestationResult AttestationClientImpl::GetMeasurements(
         // TCG logs are not present for the OS type.
 
         try {
-            Tpm tpm;
-            measurement_logs = tpm.GetTcgLog();
+            measurement_logs = getTpm()->GetTcgLog();
         }
         catch(...) {
             CLIENT_LOG_WARN("TCG logs not found on device");
@@ -577,23 +2008,24 @@ AttestationResult AttestationClientImpl::GetTpmInfo(TpmInfo& tpm_info) {
 
     try {
 
-        Tpm tpm;
-        Buffer aik_cert = tpm.GetAIKCert();
+        std::shared_ptr<Tpm> tpm = getTpm();
+        Buffer aik_cert = tpm->GetAIKCert();
 
-        Buffer aik_pub = tpm.GetAIKPub();
+        Buffer aik_pub = tpm->GetAIKPub();
 
         attest::PcrList pcrs = GetAttestationPcrList();
 
+        // Get the quote and the values it was taken over in one go. We get the
+        // pcr values from the SHA256 bank since we expect the TCG logs to also
+        // have SHA256 hash entries. The snapshot is reused until a PCR changes.
+        PcrSnapshot pcr_snapshot = tpm->GetPCRSnapshot(pcrs, attestation_hash_alg);
+
         // Unpack the PCR quote to get the raw quote and arrange the quote
         // signature in a format expected by AAS.
-        PcrQuote pcr_quote_marshaled = tpm.GetPCRQuote(pcrs, attestation_hash_alg);
-        PcrQuote pcr_quote = tpm.UnpackPcrQuoteToRSA(pcr_quote_marshaled);
-
-        // We get the pcr values from the SHA256 bank since we expect the TCG logs
-        // to also have SHA256 hash entries.
-        PcrSet pcr_values = tpm.GetPCRValues(pcrs, attestation_hash_alg);
+        PcrQuote pcr_quote = tpm->UnpackPcrQuoteToRSA(pcr_snapshot.quote);
+        PcrSet& pcr_values = pcr_snapshot.pcrSet;
 
-        EphemeralKey enc_key = tpm.GetEphemeralKey(pcr_values);
+        EphemeralKey enc_key = tpm->GetEphemeralKey(pcr_values);
 
         tpm_info.aik_cert_ = aik_cert;
         tpm_info.aik_pub_ = aik_pub;
@@ -605,6 +2037,7 @@ AttestationResult AttestationClientImpl::GetTpmInfo(TpmInfo& tpm_info) {
         result.code_ = AttestationResult::ErrorCode::ERROR_TPM_OPERATION_FAILURE;
         result.tpm_error_code_ = e.get_rc();
         result.description_ = std::string(e.what());
+        resetTpm();
 
         CLIENT_LOG_ERROR("Failed Tpm operation:%d Error:%s",
                           result.tpm_error_code_,
@@ -708,8 +2141,7 @@ AttestationResult AttestationClientImpl::GetIsolationInfo(IsolationInfo& isolati
     Buffer hcl_report;
     std::string isolation_info_str = std::string();
     try {
-        Tpm tpm;
-        hcl_report = tpm.GetHCLReport();
+        hcl_report = getTpm()->GetHCLReport();
         // If HCL report exists, then it's a CVM
         isolation_info.isolation_type_ = attest::IsolationType::SEV_SNP;
         isolation_info_str = "CVM";
@@ -736,11 +2168,30 @@ AttestationResult AttestationClientImpl::GetIsolationInfo(IsolationInfo& isolati
 
         isolation_info.snp_report_ = snp_report;
         isolation_info.runtime_data_ = runtime_data;
-        ImdsOperations imds_ops;
+
+        // The VCek cert chain only changes with the chip or its reported TCB, so
+        // a cached chain that has not expired is used without going to THIM.
+        VcekCertCache vcek_cert_cache;
+        std::string cache_key;
         std::string vcek_cert;
-        if ((result = imds_ops.GetVCekCert(vcek_cert)).code_ != AttestationResult::ErrorCode::SUCCESS) {
-            CLIENT_LOG_ERROR("Failed to retrieve the VCek Cert from THIM");
-            return result;
+        std::chrono::seconds remaining_validity(0);
+        if (VcekCertCache::GetCacheKey(snp_report, cache_key) &&
+            vcek_cert_cache.Get(cache_key, vcek_cert, remaining_validity)) {
+            CLIENT_LOG_INFO("Using cached VCek Cert");
+            if (remaining_validity < g_vcek_cert_refresh_window) {
+                refreshVCekCertInBackground(cache_key);
+            }
+        }
+        else {
+            ImdsOperations imds_ops;
+            if ((result = imds_ops.GetVCekCert(vcek_cert)).code_ != AttestationResult::ErrorCode::SUCCESS) {
+                CLIENT_LOG_ERROR("Failed to retrieve the VCek Cert from THIM");
+                return result;
+            }
+
+            if (!cache_key.empty() && !vcek_cert_cache.Put(cache_key, vcek_cert)) {
+                CLIENT_LOG_WARN("Failed to cache the VCek Cert");
+            }
         }
 
         isolation_info.vcek_cert_ = vcek_cert;
@@ -748,35 +2199,124 @@ AttestationResult AttestationClientImpl::GetIsolationInfo(IsolationInfo& isolati
     return result;
 }
 
+AttestationResult AttestationClientImpl::checkAkCertRenewal(const std::shared_ptr<Tpm>& tpm) {
+    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+
+    std::lock_guard<std::mutex> lock(ak_cert_mutex_);
+    auto now = std::chrono::steady_clock::now();
+    if (!ak_cert_checked_ || now - ak_cert_checked_at_ >= g_ak_cert_check_interval) {
+        TpmCertOperations tpm_cert_ops(tpm);
+        bool is_ak_cert_renewal_required = false;
+        if ((result = tpm_cert_ops.IsAkCertRenewalRequired(is_ak_cert_renewal_required)).code_ != AttestationResult::ErrorCode::SUCCESS) {
+            CLIENT_LOG_ERROR("Failure while checking AkCert Renewal state %s", result.description_.c_str());
+            if (result.tpm_error_code_ != 0) {
+                CLIENT_LOG_ERROR("Internal TPM Error occurred, Tpm Error Code: %d", result.tpm_error_code_);
+                return result;
+            } else if (result.code_ == attest::AttestationResult::ErrorCode::ERROR_AK_CERT_PROVISIONING_FAILED) {
+                CLIENT_LOG_ERROR("Attestation Key cert provisioning delayed. Please try attestation after some time.");
+                result.description_ = std::string("AK cert provisioning delayed. Please try attestation after some time.");
+                return result;
+            }
+
+            // Any other failure does not block attestation. Leave the decision
+            // uncached so the next attestation checks again.
+            return AttestationResult(AttestationResult::ErrorCode::SUCCESS);
+        }
+
+        ak_cert_checked_ = true;
+        ak_cert_checked_at_ = now;
+        ak_cert_renewal_required_ = is_ak_cert_renewal_required;
+    }
+
+    if (ak_cert_renewal_required_ &&
+        now >= ak_cert_next_renewal_ &&
+        !(ak_cert_renewal_.valid() &&
+          ak_cert_renewal_.wait_for(std::chrono::seconds(0)) != std::future_status::ready)) {
+        CLIENT_LOG_INFO("AK cert renewal required, renewing it in the background");
+        ak_cert_renewal_ = std::async(std::launch::async, [this, tpm]() {
+            TpmCertOperations tpm_cert_ops(tpm);
+            AttestationResult renew_result = tpm_cert_ops.RenewAndReplaceAkCert();
+
+            std::lock_guard<std::mutex> renew_lock(ak_cert_mutex_);
+            if (renew_result.code_ == AttestationResult::ErrorCode::SUCCESS) {
+                // Re-read the renewed cert on the next attestation.
+                ak_cert_checked_ = false;
+                ak_cert_renewal_retry_delay_ = g_ak_cert_renewal_initial_retry_delay;
+                return;
+            }
+
+            CLIENT_LOG_ERROR("Failed to renew AkCert, description: %s with error code: %d",
+                             renew_result.description_.c_str(),
+                             static_cast<int>(renew_result.code_));
+            if (telemetry_reporting.get() != nullptr) {
+                telemetry_reporting->UpdateEvent("AkRenew", 
+                                                "Failed to renew AkCert, error description: " + renew_result.description_, 
+                                                TelemetryReportingBase::EventLevel::AK_RENEW_UNEXPECTED_ERROR);
+            }
+
+            ak_cert_next_renewal_ = std::chrono::steady_clock::now() + ak_cert_renewal_retry_delay_;
+            ak_cert_renewal_retry_delay_ = std::min(2 * ak_cert_renewal_retry_delay_,
+                                                    std::chrono::duration_cast<std::chrono::seconds>(g_ak_cert_renewal_max_retry_delay));
+        });
+    }
+
+    return result;
+}
+
+void AttestationClientImpl::refreshVCekCertInBackground(const std::string& cache_key) {
+    std::lock_guard<std::mutex> lock(vcek_cert_refresh_mutex_);
+    if (vcek_cert_refresh_.valid() &&
+        vcek_cert_refresh_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        // A refresh is already in flight.
+        return;
+    }
+
+    CLIENT_LOG_INFO("Cached VCek Cert is close to expiry, refreshing it in the background");
+    vcek_cert_refresh_ = std::async(std::launch::async, [cache_key]() {
+        ImdsOperations imds_ops;
+        std::string vcek_cert;
+        if (imds_ops.GetVCekCert(vcek_cert).code_ != AttestationResult::ErrorCode::SUCCESS) {
+            CLIENT_LOG_WARN("Failed to refresh the cached VCek Cert from THIM");
+            return;
+        }
+
+        VcekCertCache vcek_cert_cache;
+        if (!vcek_cert_cache.Put(cache_key, vcek_cert)) {
+            CLIENT_LOG_WARN("Failed to cache the refreshed VCek Cert");
+        }
+    });
+}
+
 AttestationResult AttestationClientImpl::CreatePayload(const AttestationParameters& params,
                                                        std::string& payload) {
 
     AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
 
-    Json::Value attestation_info = params.ToJson();
-
-    Json::StreamWriterBuilder builder;
-    const std::string attestation_info_str = Json::writeString(builder, attestation_info);
-
-    std::string attestation_info_str_encoded = base64::
-                                               binary_to_base64url(Buffer(attestation_info_str.begin(),
-                                                                          attestation_info_str.end()));
-    Json::Value root;
-    root[JSON_ATTESTATION_INFO_KEY] = attestation_info_str_encoded;
+    // The attestation info is written compact and base64url encoded as it is
+    // generated, straight into the request body.
+    const std::string prefix = std::string("{\"") + JSON_ATTESTATION_INFO_KEY + "\":\"";
+    payload.clear();
+    payload.reserve(prefix.size() +
+                    JsonStreamWriter::EncodedSize(params.JsonSizeHint(), JsonStreamWriter::Output::Base64Url) +
+                    2);
+    payload.append(prefix);
 
-    const std::string payload_str = Json::writeString(builder, root);
+    JsonStreamWriter writer(payload, JsonStreamWriter::Output::Base64Url);
+    params.WriteJson(writer);
+    writer.Finish();
 
-    payload = payload_str;
+    payload.append("\"}");
     return result;
 }
 
-AttestationResult AttestationClientImpl::sendHttpRequest(const std::string& payload,
+AttestationResult AttestationClientImpl::sendHttpRequest(const std::string& attestation_url,
+                                                         const std::string& payload,
                                                          std::string& jwt_encrypted) {
 
     AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
 
     std::string http_response;
-   if((result = curl::SendRequest(attestation_url_,
+   if((result = curl::SendRequest(attestation_url,
                                    payload,
                                    http_response)).code_ != AttestationResult::ErrorCode::SUCCESS) {
         CLIENT_LOG_ERROR("Failed to send http request with error:%s",
@@ -792,6 +2332,26 @@ AttestationResult AttestationClientImpl::sendHttpRequest(const std::string& payl
     return result;
 }
 
+std::shared_ptr<Tpm> AttestationClientImpl::getTpm() {
+    std::lock_guard<std::mutex> lock(tpm_mutex_);
+    if (tpm_ == nullptr) {
+        CLIENT_LOG_INFO("Opening Tpm context");
+        tpm_ = std::make_shared<Tpm>();
+
+        if (options_.ephemeral_key_pool_refresh_seconds > 0) {
+            tpm_->EnableEphemeralKeyPool(GetAttestationPcrList(),
+                                         attestation_hash_alg,
+                                         std::chrono::seconds(options_.ephemeral_key_pool_refresh_seconds));
+        }
+    }
+    return tpm_;
+}
+
+void AttestationClientImpl::resetTpm() {
+    std::lock_guard<std::mutex> lock(tpm_mutex_);
+    tpm_.reset();
+}
+
 AttestationResult AttestationClientImpl::ParseMaaResponse(const std::string& maa_response,
                                                           std::string& token) {
 
@@ -799,21 +2359,13 @@ AttestationResult AttestationClientImpl::ParseMaaResponse(const std::string& maa
 
     // The response from MAA is in the form of a Json string
     // To get the encrypted token we parse the json string and return the token
-    Json::Value response;
-    Json::Reader reader;
-    bool success = reader.parse(maa_response.c_str(), response);
-
-    if (!success) {
+    if (!ExtractMaaToken(maa_response, token)) {
         // Error while parsing the Json
         CLIENT_LOG_ERROR("Failed to parse the Attestation response");
         result.code_ = AttestationResult::ErrorCode::ERROR_PARSING_ATTESTATION_RESPONSE;
         result.description_ = std::string("Failed to parse MAA response Json file");
         return result;
     }
-    const std::string parsed_token = response["token"].asString();
-
-    // return the encrypted token
-    token = parsed_token;
     return result;
 }
 
@@ -6,6 +6,11 @@
 #pragma once
 
 #include <vector>
+#include <memory>
+#include <chrono>
+#include <mutex>
+#include <future>
+#include <unordered_set>
 
 #include "AttestationLibTypes.h"
 #include "AttestationParameters.h"
@@ -13,12 +18,31 @@
 #include "AttestationClient.h"
 #include "IsolationInfo.h"
 #include "AttestationLibTelemetry.h"
+#include "TokenCache.h"
+#include "SharedTokenCache.h"
+#include "RsaKeyCache.h"
+#include "DataKeyCache.h"
+#include "EnvelopeCipher.h"
+#include "TaskExecutor.h"
+#include "AsyncHttpClient.h"
+#include "EventNotifier.h"
+
+#ifdef G_TEST
+namespace AttestationClientLibTest {
+    class ClientLibTests;
+}
+#endif
 
 class AttestationClientImpl : public AttestationClient {
+#ifdef G_TEST
+    friend class AttestationClientLibTest::ClientLibTests;
+#endif
+
 public:
-    AttestationClientImpl(const std::shared_ptr<attest::AttestationLogger>& log_handle);
+    AttestationClientImpl(const std::shared_ptr<attest::AttestationLogger>& log_handle,
+                          const attest::ClientOptions& options = attest::ClientOptions());
 
-    ~AttestationClientImpl() = default;
+    ~AttestationClientImpl();
 
     /**
      * @brief Enum to indicate the type of logs being retrieved.
@@ -44,12 +68,110 @@ public:
     attest::AttestationResult Attest(const attest::ClientParameters& client_params,
                                      unsigned char** jwt_token) noexcept override;
 
+    /**
+     * @brief This function will be used to initiate an attestation request
+     * and get the token as an AttestationToken.
+     * @param[in] client_params Struct ClientParameters object containing the
+     * parameters from the client needed for attestation.
+     * @param[out] token The attestation token returned by MAA.
+     * @return In case of success, AttestationResult object with error code
+     * ErrorCode::Success will be returned.
+     * In case of failure, an appropriate ErrorCode will be set in the
+     * AttestationResult object and error description will be provided.
+     */
+    attest::AttestationResult Attest(const attest::ClientParameters& client_params,
+                                     std::shared_ptr<const attest::AttestationToken>& token) noexcept override;
+
+    /**
+     * @brief This function will be used to attest to several endpoints with the
+     * evidence collected once.
+     * @param[in] endpoint_urls The attestation endpoint urls (null terminated strings).
+     * @param[in] endpoint_count The number of endpoints.
+     * @param[in] client_payload The client payload sent to every endpoint, can be nullptr.
+     * @param[out] results The outcome for each endpoint.
+     * @param[out] jwt_tokens The decrypted jwt token for each endpoint, nullptr if the
+     * attestation to that endpoint failed. The caller is expected to free the tokens by
+     * calling Attest::Free() method
+     * @return In case of success, AttestationResult object with error code
+     * ErrorCode::Success will be returned, even if some endpoints failed.
+     * In case the input is invalid or the evidence could not be collected, an
+     * appropriate ErrorCode will be set in the AttestationResult object and error
+     * description will be provided.
+     */
+    attest::AttestationResult AttestMultiple(const unsigned char* const* endpoint_urls,
+                                             uint32_t endpoint_count,
+                                             const unsigned char* client_payload,
+                                             attest::AttestationResult* results,
+                                             unsigned char** jwt_tokens) noexcept override;
+
+    /**
+     * @brief This function will be used to attest once for a batch of nonces bound
+     * together by a Merkle tree.
+     * @param[in] client_params Struct ClientParameters object containing the
+     * parameters from the client needed for attestation.
+     * @param[in] nonces The nonces (null terminated strings).
+     * @param[in] nonce_count The number of nonces.
+     * @param[out] jwt_token The decrypted jwt token. The caller is expected to free
+     * this memory by calling Attest::Free() method
+     * @param[out] inclusion_proofs The inclusion proof of each nonce. The caller is
+     * expected to free this memory by calling Attest::Free() method
+     * @return In case of success, AttestationResult object with error code
+     * ErrorCode::Success will be returned.
+     * In case of failure, an appropriate ErrorCode will be set in the
+     * AttestationResult object and error description will be provided.
+     */
+    attest::AttestationResult AttestBatch(const attest::ClientParameters& client_params,
+                                          const unsigned char* const* nonces,
+                                          uint32_t nonce_count,
+                                          unsigned char** jwt_token,
+                                          unsigned char** inclusion_proofs) noexcept override;
+
+    /**
+     * @brief This function will be used to start an attestation request with the
+     * Attestation Client lib without waiting for it to complete.
+     * @param[in] client_params Struct ClientParameters object containing the
+     * parameters from the client needed for attestation.
+     * @param[in] callback Called once with the result and, on success, the decrypted
+     * jwt token. The caller is expected to free the token by calling Attest::Free() method
+     * @return In case the request was started, AttestationResult object with error code
+     * ErrorCode::Success will be returned.
+     * In case of failure, an appropriate ErrorCode will be set in the
+     * AttestationResult object and error description will be provided.
+     */
+    attest::AttestationResult AttestAsync(const attest::ClientParameters& client_params,
+                                          AttestCallback callback) noexcept override;
+
+    /**
+     * @brief This function will be used to get what the event loop of the caller has
+     * to wait for before the next call to Step().
+     * @param[out] descriptors The file descriptors to wait on.
+     * @param[out] timeout_ms The longest the caller may wait before calling Step(),
+     * -1 if there is no limit.
+     * @return In case of success, AttestationResult object with error code
+     * ErrorCode::Success will be returned. ErrorCode::ERROR_INVALID_INPUT_PARAMETER
+     * is returned if the client does not use an external event loop.
+     */
+    attest::AttestationResult GetPollDescriptors(std::vector<attest::PollDescriptor>& descriptors,
+                                                 int& timeout_ms) noexcept override;
+
+    /**
+     * @brief This function will be used to perform the pending I/O of AttestAsync()
+     * requests and call the callbacks of the requests that completed.
+     * @param[in] ready The descriptors returned by GetPollDescriptors() with the
+     * events that occurred.
+     * @return In case of success, AttestationResult object with error code
+     * ErrorCode::Success will be returned. ErrorCode::ERROR_INVALID_INPUT_PARAMETER
+     * is returned if the client does not use an external event loop.
+     */
+    attest::AttestationResult Step(const std::vector<attest::PollDescriptor>& ready) noexcept override;
+
     /**
      * @brief This API encrypts the data based on the EncryptionType
      * @param[in] encryption_type: the type of encryption
-     * currently the only encryption type supported is 'NONE', which expects the
-     * caller to pass symmetric key as the data to be encrypted. The RSA Public key
-     * present in the JWT is used to perform the encryption.
+     * 'NONE' expects the caller to pass symmetric key as the data to be encrypted.
+     * The RSA Public key present in the JWT is used to perform the encryption.
+     * 'ENVELOPE_AES_GCM' encrypts the data with a random AES key wrapped with the
+     * RSA Public key, see EnvelopeCipher.h.
      * @param[in] jwt_token: the attestation JWT (null terminated string)
      * @param[in] data: the data to be encrypted
      * @param[in] data_size: the size of the data to be encrypted
@@ -75,12 +197,86 @@ public:
                                       const attest::RsaScheme rsaWrapAlgId = attest::RsaScheme::RsaEs,
                                       const attest::RsaHashAlg rsaHashAlgId = attest::RsaHashAlg::RsaSha1) noexcept override;
 
+    /**
+     * @brief This API encrypts the data based on the EncryptionType with the RSA
+     * Public key present in an attestation token.
+     * @param[in] encryption_type: the type of encryption, see Encrypt() with a jwt.
+     * @param[in] token: the attestation token
+     * The other parameters are the ones of Encrypt() with a jwt.
+     * @return In case of success, AttestationResult object with error code ErrorCode::Success
+     * will be returned. In case of failure, an appropriate ErrorCode and description will be returned.
+     */
+    attest::AttestationResult Encrypt(const attest::EncryptionType encryption_type,
+                                      const attest::AttestationToken& token,
+                                      const unsigned char* data,
+                                      uint32_t data_size,
+                                      unsigned char** encrypted_data,
+                                      uint32_t* encrypted_data_size,
+                                      unsigned char** encryption_metadata,
+                                      uint32_t* encryption_metadata_size,
+                                      const attest::RsaScheme rsaWrapAlgId = attest::RsaScheme::RsaEs,
+                                      const attest::RsaHashAlg rsaHashAlgId = attest::RsaHashAlg::RsaSha1) noexcept override;
+
+    /**
+     * @brief This API encrypts a batch of buffers with the RSA Public key present
+     * in an attestation token, spreading the RSA operations over a thread pool.
+     * @param[in] encryption_type: the type of encryption, only NONE is supported.
+     * @param[in] token: the attestation token
+     * @param[in] data: the buffers to be encrypted
+     * @param[in] data_sizes: the sizes of the buffers to be encrypted
+     * @param[in] count: the number of buffers
+     * @param[out] encrypted_data: the output buffers
+     * @param[in,out] encrypted_data_sizes: the sizes of the output buffers, then of
+     * the encrypted data
+     * @param[out] results: the outcome for each buffer
+     * @param[in] rsaWrapAlgId: Rsa wrap algorithm id.
+     * @param[in] rsaHashAlgId: Rsa hash algorithm id.
+     * @return In case of success, AttestationResult object with error code ErrorCode::Success
+     * will be returned. In case of failure, an appropriate ErrorCode and description will be returned.
+     */
+    attest::AttestationResult EncryptBatch(const attest::EncryptionType encryption_type,
+                                           const attest::AttestationToken& token,
+                                           const unsigned char* const* data,
+                                           const uint32_t* data_sizes,
+                                           uint32_t count,
+                                           unsigned char* const* encrypted_data,
+                                           uint32_t* encrypted_data_sizes,
+                                           attest::AttestationResult* results,
+                                           const attest::RsaScheme rsaWrapAlgId = attest::RsaScheme::RsaEs,
+                                           const attest::RsaHashAlg rsaHashAlgId = attest::RsaHashAlg::RsaSha1) noexcept override;
+
+    /**
+     * @brief This API encrypts a stream with the RSA Public key present in an
+     * attestation token, one chunk at a time.
+     * @param[in] encryption_type: the type of encryption, only ENVELOPE_AES_GCM.
+     * @param[in] token: the attestation token
+     * @param[in] input_fd: the file descriptor read until end of file
+     * @param[in] output_fd: the file descriptor the encrypted data is written to
+     * @param[out] encryption_metadata: the encryption metadata (the memory is
+     * allocated by the method and the caller is expected to free this memory by
+     * calling Attest::Free() method)
+     * @param[out] encryption_metadata_size: the size of the encryption metadata
+     * @param[in] rsaWrapAlgId: Rsa wrap algorithm id.
+     * @param[in] rsaHashAlgId: Rsa hash algorithm id.
+     * @return In case of success, AttestationResult object with error code ErrorCode::Success
+     * will be returned. In case of failure, an appropriate ErrorCode and description will be returned.
+     */
+    attest::AttestationResult EncryptStream(const attest::EncryptionType encryption_type,
+                                            const attest::AttestationToken& token,
+                                            int input_fd,
+                                            int output_fd,
+                                            unsigned char** encryption_metadata,
+                                            uint32_t* encryption_metadata_size,
+                                            const attest::RsaScheme rsaWrapAlgId = attest::RsaScheme::RsaEs,
+                                            const attest::RsaHashAlg rsaHashAlgId = attest::RsaHashAlg::RsaSha1) noexcept override;
+
     /**
      * @brief This API decrypts the data based on the EncryptionType
      * @param[in] encryption_type: the type of encryption
-     * currently the only encryption type supported is 'NONE', which expects the
-     * caller to pass the encrypted symmetric key as input. The RSA Private key
-     * present in the TPM is used to perform the decryption.
+     * 'NONE' expects the caller to pass the encrypted symmetric key as input. The
+     * RSA Private key present in the TPM is used to perform the decryption.
+     * 'ENVELOPE_AES_GCM' expects the output and metadata of Encrypt() or
+     * EncryptStream(); only the AES key is decrypted by the TPM.
      * @param[in] encrypted_data: The encrypted data
      * @param[in] encrypted_data_size: The size of encrypted data
      * @param[in] encryption_metadata: The encryption metadata
@@ -103,6 +299,53 @@ public:
                                       const attest::RsaScheme rsaWrapAlgId = attest::RsaScheme::RsaEs,
                                       const attest::RsaHashAlg rsaHashAlgId = attest::RsaHashAlg::RsaSha1) noexcept override;
 
+    /**
+     * @brief This API decrypts the data based on the EncryptionType into a buffer
+     * of the caller, decrypting ENVELOPE_AES_GCM chunks in parallel.
+     * @param[in] encryption_type: the type of encryption, see Decrypt().
+     * @param[in] encrypted_data: The encrypted data
+     * @param[in] encrypted_data_size: The size of encrypted data
+     * @param[in] encryption_metadata: The encryption metadata
+     * @param[in] encryption_metadata_size: The size of encryption metadata
+     * @param[out] decrypted_data: The buffer receiving the decrypted data
+     * @param[in,out] decrypted_data_size: The size of the buffer, then of the
+     * decrypted data
+     * @param[in] rsaWrapAlgId: Rsa wrap algorithm id.
+     * @param[in] rsaHashAlgId: Rsa hash algorithm id.
+     * @return In case of success, AttestationResult object with error code ErrorCode::Success
+     * will be returned. In case of failure, an appropriate ErrorCode and description will be returned.
+     */
+    attest::AttestationResult DecryptToBuffer(const attest::EncryptionType encryption_type,
+                                              const unsigned char* encrypted_data,
+                                              uint32_t encrypted_data_size,
+                                              const unsigned char* encryption_metadata,
+                                              uint32_t encryption_metadata_size,
+                                              unsigned char* decrypted_data,
+                                              uint32_t* decrypted_data_size,
+                                              const attest::RsaScheme rsaWrapAlgId = attest::RsaScheme::RsaEs,
+                                              const attest::RsaHashAlg rsaHashAlgId = attest::RsaHashAlg::RsaSha1) noexcept override;
+
+    /**
+     * @brief This API decrypts an ENVELOPE_AES_GCM stream from one file descriptor
+     * to another, a batch of chunks at a time.
+     * @param[in] encryption_type: the type of encryption, only ENVELOPE_AES_GCM.
+     * @param[in] input_fd: the file descriptor read until end of file
+     * @param[in] output_fd: the file descriptor the decrypted data is written to
+     * @param[in] encryption_metadata: The encryption metadata
+     * @param[in] encryption_metadata_size: The size of encryption metadata
+     * @param[in] rsaWrapAlgId: Rsa wrap algorithm id.
+     * @param[in] rsaHashAlgId: Rsa hash algorithm id.
+     * @return In case of success, AttestationResult object with error code ErrorCode::Success
+     * will be returned. In case of failure, an appropriate ErrorCode and description will be returned.
+     */
+    attest::AttestationResult DecryptStream(const attest::EncryptionType encryption_type,
+                                            int input_fd,
+                                            int output_fd,
+                                            const unsigned char* encryption_metadata,
+                                            uint32_t encryption_metadata_size,
+                                            const attest::RsaScheme rsaWrapAlgId = attest::RsaScheme::RsaEs,
+                                            const attest::RsaHashAlg rsaHashAlgId = attest::RsaHashAlg::RsaSha1) noexcept override;
+
     /*
      * @brief This API deallocates the memory previously allocated by the library
      * @param[in] ptr: Pointer to memory block previously allocated
@@ -231,23 +474,100 @@ private:
                                                        attest::AttestationParameters& params);
 
     /**
-     * @brief This function will be used to send the attestation request to the
-     * AAS endpoint.
-     * @param[in] params The AttestationParameters structure that contains the
-     * info that needs to be sent with the attestation request..
-     * @param[out] jwt_token_encrypted The jwt token that will be returned by AAS will be
-     * copied to this parameter
+     * @brief This function will be used to run a full attestation: collect the
+     * evidence, send it to the attestation endpoint and decrypt the returned token.
+     * @param[in] endpoint_url The attestation endpoint url passed to Attest().
+     * @param[in] client_payload The client payload passed to Attest(), empty if
+     * there was none.
+     * @param[out] jwt_token The decrypted jwt token.
+     * @return In case of success, AttestationResult object with error code
+     * ErrorCode::Success will be returned.
+     * In case of failure, an appropriate ErrorCode will be set in the
+     * AttestationResult object and error description will be provided.
+     */
+    attest::AttestationResult attest(const std::string& endpoint_url,
+                                     const std::string& client_payload,
+                                     std::string& jwt_token);
+
+    /**
+     * @brief This function will be used to get the token for Attest(): from the
+     * token cache if it is enabled and holds one, from getToken() otherwise.
+     * @param[in] client_params Struct ClientParameters object passed to Attest().
+     * @param[out] jwt_token The decrypted jwt token.
      * @return In case of success, AttestationResult object with error code
      * ErrorCode::Success will be returned.
      * In case of failure, an appropriate ErrorCode will be set in the
      * AttestationResult object and error description will be provided.
      */
-    attest::AttestationResult sendAttestationRequest(const attest::AttestationParameters& params,
-                                                     std::string& jwt_token_encrypted);
+    attest::AttestationResult getCachedToken(const attest::ClientParameters& client_params,
+                                             std::string& jwt_token);
+
+    /**
+     * @brief This function will be used to get a token from the shared token cache
+     * if it is enabled, and to run a full attestation otherwise or on a miss.
+     * @param[in] endpoint_url The attestation endpoint url passed to Attest().
+     * @param[in] client_payload The client payload passed to Attest(), empty if
+     * there was none.
+     * @param[in] min_validity A token from the shared token cache is only used if
+     * it stays valid for at least this long.
+     * @param[out] jwt_token The decrypted jwt token.
+     * @return In case of success, AttestationResult object with error code
+     * ErrorCode::Success will be returned.
+     * In case of failure, an appropriate ErrorCode will be set in the
+     * AttestationResult object and error description will be provided.
+     */
+    attest::AttestationResult getToken(const std::string& endpoint_url,
+                                       const std::string& client_payload,
+                                       std::chrono::seconds min_validity,
+                                       std::string& jwt_token);
+
+    /**
+     * @brief This function will be used to build the AAS url the attestation
+     * request for an endpoint is sent to.
+     * @param[in] endpoint_url The attestation endpoint url passed to Attest().
+     * @param[out] attestation_url The AAS url.
+     * @return In case of success, AttestationResult object with error code
+     * ErrorCode::Success will be returned.
+     * In case of failure, an appropriate ErrorCode will be set in the
+     * AttestationResult object and error description will be provided.
+     */
+    attest::AttestationResult getAttestationUrl(const std::string& endpoint_url,
+                                                std::string& attestation_url);
+
+    /**
+     * @brief This function will be used to collect the evidence for an attestation
+     * and build the request that is sent to AAS. The request does not depend on
+     * the endpoint, so it can be sent to several of them.
+     * @param[in] client_payload The client payload passed to Attest(), empty if
+     * there was none.
+     * @param[out] payload json string that will be sent to AAS for attestation.
+     * @return In case of success, AttestationResult object with error code
+     * ErrorCode::Success will be returned.
+     * In case of failure, an appropriate ErrorCode will be set in the
+     * AttestationResult object and error description will be provided.
+     */
+    attest::AttestationResult prepareAttestationRequest(const std::string& client_payload,
+                                                        std::string& payload);
+
+    /**
+     * @brief This function will be used to send an attestation request to AAS and
+     * decrypt the returned token, retrying if decryption fails.
+     * @param[in] attestation_url The AAS url the request is sent to.
+     * @param[in] payload json string built by prepareAttestationRequest().
+     * @param[out] jwt_token The decrypted jwt token.
+     * @return In case of success, AttestationResult object with error code
+     * ErrorCode::Success will be returned.
+     * In case of failure, an appropriate ErrorCode will be set in the
+     * AttestationResult object and error description will be provided.
+     */
+    attest::AttestationResult submitAttestationRequest(const std::string& attestation_url,
+                                                       const std::string& payload,
+                                                       std::string& jwt_token);
 
     /**
      * @brief This function will be used to create and send a HTTP request to
      * AAS for attestation.
+     * @param[in] attestation_url The AAS url the request is sent to.
      * @param[in] payload json string that will be sent to AAS for
      * attestation.
      * @param[out] response The response string received from AAS.
@@ -256,8 +576,306 @@ private:
      * In case of failure, an appropriate ErrorCode will be set in the
      * AttestationResult object and error description will be provided.
      */
-    attest::AttestationResult sendHttpRequest(const std::string& payload,
+    attest::AttestationResult sendHttpRequest(const std::string& attestation_url,
+                                              const std::string& payload,
                                               std::string& response);  
 
-    std::string attestation_url_;
+    /**
+     * @brief This function will be used to get the Tpm object shared by all the
+     * TPM operations of this client. The TPM context is opened on first use and
+     * kept open for the lifetime of the client.
+     * @return The shared Tpm object. Throws Tss2Exception if the TPM context
+     * could not be initialized.
+     */
+    std::shared_ptr<Tpm> getTpm();
+
+    /**
+     * @brief This function will be used to get the executor running the RSA
+     * operations of EncryptBatch() and the chunk decryption of envelope encrypted
+     * data. It is started on first use with one thread
+     * less than there are cores, since the calling thread takes part as well.
+     * @return The executor.
+     */
+    TaskExecutor& getCryptoExecutor();
+
+    /**
+     * @brief This function will be used to encrypt a key with the RSA Public key
+     * of an attestation token, using the cached encryption contexts.
+     * @param[in] token The attestation token.
+     * @param[in] key The key.
+     * @param[in] key_size The size of the key.
+     * @param[in] rsaWrapAlgId Rsa wrap algorithm id.
+     * @param[in] rsaHashAlgId Rsa hash algorithm id.
+     * @param[out] wrapped_key The encrypted key.
+     * @return In case of success, AttestationResult object with error code
+     * ErrorCode::Success will be returned.
+     */
+    attest::AttestationResult wrapKey(const attest::AttestationToken& token,
+                                      const unsigned char* key,
+                                      size_t key_size,
+                                      const attest::RsaScheme rsaWrapAlgId,
+                                      const attest::RsaHashAlg rsaHashAlgId,
+                                      attest::Buffer& wrapped_key);
+
+    /**
+     * @brief This function will be used to decrypt a key wrapped by wrapKey() with
+     * the ephemeral key of the TPM.
+     * @param[in] wrapped_key The encrypted key.
+     * @param[in] rsaWrapAlgId Rsa wrap algorithm id.
+     * @param[in] rsaHashAlgId Rsa hash algorithm id.
+     * @param[out] key The key.
+     * @return In case of success, AttestationResult object with error code
+     * ErrorCode::Success will be returned.
+     */
+    attest::AttestationResult unwrapKey(const attest::Buffer& wrapped_key,
+                                        const attest::RsaScheme rsaWrapAlgId,
+                                        const attest::RsaHashAlg rsaHashAlgId,
+                                        attest::Buffer& key);
+
+    /**
+     * @brief This function will be used to start an envelope encrypted message:
+     * generate its data encryption key and nonce prefix and wrap the key.
+     * @param[in] token The attestation token.
+     * @param[in] rsaWrapAlgId Rsa wrap algorithm id.
+     * @param[in] rsaHashAlgId Rsa hash algorithm id.
+     * @param[out] metadata The metadata of the message.
+     * @param[out] cipher The cipher for the chunks of the message.
+     * @return In case of success, AttestationResult object with error code
+     * ErrorCode::Success will be returned.
+     */
+    attest::AttestationResult createEnvelope(const attest::AttestationToken& token,
+                                             const attest::RsaScheme rsaWrapAlgId,
+                                             const attest::RsaHashAlg rsaHashAlgId,
+                                             attest::envelope::Metadata& metadata,
+                                             std::unique_ptr<attest::envelope::ChunkCipher>& cipher);
+
+    /**
+     * @brief This function will be used by Encrypt() for ENVELOPE_AES_GCM. The
+     * parameters are the ones of Encrypt(), already checked.
+     */
+    attest::AttestationResult encryptEnvelope(const attest::AttestationToken& token,
+                                              const unsigned char* data,
+                                              uint32_t data_size,
+                                              unsigned char** encrypted_data,
+                                              uint32_t* encrypted_data_size,
+                                              unsigned char** encryption_metadata,
+                                              uint32_t* encryption_metadata_size,
+                                              const attest::RsaScheme rsaWrapAlgId,
+                                              const attest::RsaHashAlg rsaHashAlgId);
+
+    /**
+     * @brief This function will be used to parse the metadata of an envelope
+     * encrypted message and check the size of the message against it.
+     * @param[in] encrypted_data_size The size of the encrypted data.
+     * @param[in] encryption_metadata The encryption metadata.
+     * @param[in] encryption_metadata_size The size of the encryption metadata.
+     * @param[out] metadata The parsed metadata.
+     * @param[out] decrypted_data_size The size of the decrypted data.
+     * @return In case of success, AttestationResult object with error code
+     * ErrorCode::Success will be returned.
+     */
+    attest::AttestationResult checkEnvelope(uint32_t encrypted_data_size,
+                                            const unsigned char* encryption_metadata,
+                                            uint32_t encryption_metadata_size,
+                                            attest::envelope::Metadata& metadata,
+                                            uint64_t& decrypted_data_size);
+
+    /**
+     * @brief This function will be used to unwrap the data encryption key of an
+     * envelope encrypted message with the TPM.
+     * @param[in] metadata The metadata of the message.
+     * @param[in] rsaWrapAlgId Rsa wrap algorithm id.
+     * @param[in] rsaHashAlgId Rsa hash algorithm id.
+     * @param[out] dek The data encryption key, to be cleansed by the caller.
+     * @return In case of success, AttestationResult object with error code
+     * ErrorCode::Success will be returned.
+     */
+    attest::AttestationResult unwrapDataKey(const attest::envelope::Metadata& metadata,
+                                            const attest::RsaScheme rsaWrapAlgId,
+                                            const attest::RsaHashAlg rsaHashAlgId,
+                                            attest::Buffer& dek);
+
+    /**
+     * @brief This function will be used to decrypt consecutive chunks of an
+     * envelope encrypted message, in parallel on the crypto executor when there
+     * are enough of them.
+     * @param[in] dek The data encryption key.
+     * @param[in] metadata The metadata of the message.
+     * @param[in] first_index The index of the first chunk in the message.
+     * @param[in] ends_message Whether the last chunk is the last of the message.
+     * @param[in] encrypted_data The chunks, each followed by its tag.
+     * @param[in] size The size of the plaintext of the chunks.
+     * @param[out] decrypted_data Receives the plaintext of chunk i at i * decrypted_stride.
+     * May be encrypted_data to decrypt in place.
+     * @param[in] decrypted_stride The distance between decrypted chunks.
+     * @return In case every chunk authenticated, AttestationResult object with
+     * error code ErrorCode::Success will be returned.
+     */
+    attest::AttestationResult decryptChunks(const attest::Buffer& dek,
+                                            const attest::envelope::Metadata& metadata,
+                                            uint64_t first_index,
+                                            bool ends_message,
+                                            const unsigned char* encrypted_data,
+                                            uint64_t size,
+                                            unsigned char* decrypted_data,
+                                            size_t decrypted_stride);
+
+    /**
+     * @brief This function will be used by DecryptStream() to decrypt the stream
+     * once the data encryption key is unwrapped.
+     * @param[in] dek The data encryption key.
+     * @param[in] metadata The metadata of the message.
+     * @param[in] input_fd The encrypted data is read from this descriptor.
+     * @param[in] output_fd The decrypted data is written to this descriptor.
+     * @return In case of success, AttestationResult object with error code
+     * ErrorCode::Success will be returned.
+     */
+    attest::AttestationResult decryptStream(const attest::Buffer& dek,
+                                            const attest::envelope::Metadata& metadata,
+                                            int input_fd,
+                                            int output_fd);
+
+    /**
+     * @brief This function will be used by Decrypt() for ENVELOPE_AES_GCM. The
+     * parameters are the ones of Decrypt(), already checked.
+     */
+    attest::AttestationResult decryptEnvelope(const unsigned char* encrypted_data,
+                                              uint32_t encrypted_data_size,
+                                              const unsigned char* encryption_metadata,
+                                              uint32_t encryption_metadata_size,
+                                              unsigned char** decrypted_data,
+                                              uint32_t* decrypted_data_size,
+                                              const attest::RsaScheme rsaWrapAlgId,
+                                              const attest::RsaHashAlg rsaHashAlgId);
+
+    /**
+     * @brief This function will be used to drop the shared Tpm object after a
+     * TPM failure so that the next operation opens a fresh TPM context.
+     */
+    void resetTpm();
+
+    /**
+     * @brief This function will be used to check whether the AK cert needs to be
+     * renewed. The decision is cached for a while, and the renewal itself runs in
+     * the background, with growing delays between failed attempts, so that
+     * attestation never waits on it.
+     * @param[in] tpm The shared Tpm object.
+     * @return In case of success, AttestationResult object with error code
+     * ErrorCode::Success will be returned. A failure is only returned if the TPM
+     * failed or the AK cert has not been provisioned yet.
+     */
+    attest::AttestationResult checkAkCertRenewal(const std::shared_ptr<Tpm>& tpm);
+
+    /**
+     * @brief This function will be used to fetch the VCek cert chain from THIM and
+     * store it in the VCek cert cache without blocking the caller. Only one refresh
+     * runs at a time; the destructor waits for an outstanding refresh.
+     * @param[in] cache_key The VCek cert cache key of the chain being refreshed.
+     */
+    void refreshVCekCertInBackground(const std::string& cache_key);
+
+    /**
+     * State of one AttestAsync() request.
+     */
+    struct AsyncAttestation;
+
+    /**
+     * @brief This function will be used to start the executor and http client
+     * used by AttestAsync() on first use.
+     */
+    void startAsync();
+
+    /**
+     * @brief This function will be used to serve an AttestAsync() request from the
+     * token caches, or to collect its evidence and send it to AAS. Runs on the
+     * executor.
+     * @param[in] attestation The request.
+     */
+    void beginAsyncAttestation(const std::shared_ptr<AsyncAttestation>& attestation);
+
+    /**
+     * @brief This function will be used to send the request of an AttestAsync()
+     * request to AAS without waiting for the response.
+     * @param[in] attestation The request.
+     */
+    void sendAsyncAttestationRequest(const std::shared_ptr<AsyncAttestation>& attestation);
+
+    /**
+     * @brief This function will be used to handle the response to an AttestAsync()
+     * request: schedule a retry, or hand the response over to the executor.
+     * Runs on the http client thread.
+     * @param[in] attestation The request.
+     * @param[in] curl_result The outcome of the http request.
+     * @param[in] response_code The HTTP status code of the response.
+     * @param[in] response The body of the response.
+     * @param[in] retry_after_seconds The Retry-After header of the response.
+     */
+    void onAsyncAttestationResponse(const std::shared_ptr<AsyncAttestation>& attestation,
+                                    CURLcode curl_result,
+                                    long response_code,
+                                    const std::string& response,
+                                    curl_off_t retry_after_seconds);
+
+    /**
+     * @brief This function will be used to decrypt the token of an AttestAsync()
+     * request, retrying the attestation if decryption fails. Runs on the executor.
+     * @param[in] attestation The request.
+     * @param[in] maa_response The response received from AAS.
+     */
+    void finishAsyncAttestation(const std::shared_ptr<AsyncAttestation>& attestation,
+                                const std::string& maa_response);
+
+    /**
+     * @brief This function will be used to call the callback of an AttestAsync()
+     * request, or to queue the call for Step() with an external event loop. Only
+     * the first call for a request has any effect.
+     * @param[in] attestation The request.
+     * @param[in] result The outcome of the request.
+     * @param[in] jwt_token The decrypted jwt token, empty on failure.
+     */
+    void completeAsyncAttestation(const std::shared_ptr<AsyncAttestation>& attestation,
+                                  const attest::AttestationResult& result,
+                                  const std::string& jwt_token);
+
+    attest::ClientOptions options_;
+
+    std::shared_ptr<Tpm> tpm_;
+    std::mutex tpm_mutex_;
+
+    std::mutex ak_cert_mutex_;
+    bool ak_cert_checked_ = false;
+    bool ak_cert_renewal_required_ = false;
+    std::chrono::steady_clock::time_point ak_cert_checked_at_;
+    std::chrono::steady_clock::time_point ak_cert_next_renewal_;
+    std::chrono::seconds ak_cert_renewal_retry_delay_;
+    std::future<void> ak_cert_renewal_;
+
+    std::future<void> vcek_cert_refresh_;
+    std::mutex vcek_cert_refresh_mutex_;
+
+    std::unique_ptr<SharedTokenCache> shared_token_cache_;
+
+    RsaKeyCache rsa_key_cache_;
+
+    // Keys unwrapped by the TPM, only with ClientOptions::data_key_cache_ttl_seconds set.
+    std::unique_ptr<DataKeyCache> data_key_cache_;
+
+    // Runs the RSA operations of EncryptBatch() and envelope chunk decryption,
+    // created on first use.
+    std::mutex crypto_executor_mutex_;
+    std::unique_ptr<TaskExecutor> crypto_executor_;
+
+    std::mutex async_mutex_;
+    std::unique_ptr<TaskExecutor> async_executor_;
+    std::unique_ptr<AsyncHttpClient> async_http_client_;
+    std::unordered_set<std::shared_ptr<AsyncAttestation>> async_attestations_;
+
+    // Callbacks waiting for Step() when the caller runs the event loop.
+    std::unique_ptr<EventNotifier> async_notifier_;
+    std::vector<std::function<void()>> async_completions_;
+    bool async_stopping_ = false;
+
+    // Declared last so that the refresh thread, which calls back into this
+    // object, is stopped before any other member is destroyed.
+    std::unique_ptr<TokenCache> token_cache_;
 };
@@ -11,6 +11,8 @@
 #include <thread>
 #include <climits>
 #include <sstream>
+#include <fstream>
+#include <iterator>
 #include <random>
 #include <curl/curl.h>
 #include <json/json.h>
@@ -22,9 +24,14 @@
 #include <openssl/rsa.h>
 #include <openssl/core_names.h>
 #ifdef PLATFORM_UNIX
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/file.h>
 #include <sys/stat.h>
+#include <unistd.h>
 #endif
 #include "Logging.h"
+#include "HttpTransport.h"
 #include "AttestationLibConst.h"
 #include "AttestationLibUtils.h"
 #include "AttestationHelper.h"
@@ -180,6 +187,141 @@ bool ParseVersionString(const std::string& str,
     return true;
 }
 
+bool CreatePrivateDirectory(const std::string& path) {
+    if(path.empty()) {
+        CLIENT_LOG_ERROR("Invalid input argument");
+        return false;
+    }
+
+    // Create each missing component of the path, parents first.
+    size_t pos = 0;
+    do {
+        pos = path.find('/', pos + 1);
+        std::string component = path.substr(0, pos);
+        if(mkdir(component.c_str(), S_IRWXU) != 0 && errno != EEXIST) {
+            CLIENT_LOG_ERROR("Failed to create directory:%s errno:%d",
+                             component.c_str(),
+                             errno);
+            return false;
+        }
+    } while(pos != std::string::npos);
+
+    // The directory may have existed already, make sure nobody else can use it.
+    struct stat dir_stat;
+    if(lstat(path.c_str(), &dir_stat) != 0 ||
+       !S_ISDIR(dir_stat.st_mode) ||
+       dir_stat.st_uid != geteuid() ||
+       (dir_stat.st_mode & (S_IRWXG | S_IRWXO)) != 0) {
+        CLIENT_LOG_ERROR("Directory:%s is not private to the current user",
+                         path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool ReadFile(const std::string& path, std::string& contents) {
+    std::ifstream input(path, std::ios::in | std::ios::binary);
+    if(input.fail()) {
+        return false;
+    }
+
+    contents.assign(std::istreambuf_iterator<char>(input),
+                    std::istreambuf_iterator<char>());
+    return !input.bad();
+}
+
+bool WriteFileAtomically(const std::string& path, const std::string& contents) {
+    std::string temp_path = path + ".tmp." + std::to_string(getpid());
+
+    int fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if(fd < 0) {
+        CLIENT_LOG_ERROR("Failed to create file:%s errno:%d",
+                         temp_path.c_str(),
+                         errno);
+        return false;
+    }
+
+    size_t written = 0;
+    while(written < contents.size()) {
+        ssize_t ret = write(fd, contents.data() + written, contents.size() - written);
+        if(ret < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        written += static_cast<size_t>(ret);
+    }
+
+    bool success = written == contents.size() && fsync(fd) == 0;
+    success = close(fd) == 0 && success;
+    if(!success ||
+       rename(temp_path.c_str(), path.c_str()) != 0) {
+        CLIENT_LOG_ERROR("Failed to write file:%s errno:%d",
+                         path.c_str(),
+                         errno);
+        unlink(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+int LockFile(const std::string& path) {
+    while(true) {
+        int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+        if(fd < 0) {
+            CLIENT_LOG_ERROR("Failed to open lock file:%s errno:%d",
+                             path.c_str(),
+                             errno);
+            return -1;
+        }
+
+        while(flock(fd, LOCK_EX) != 0) {
+            if(errno != EINTR) {
+                CLIENT_LOG_ERROR("Failed to lock file:%s errno:%d",
+                                 path.c_str(),
+                                 errno);
+                close(fd);
+                return -1;
+            }
+        }
+
+        // RemoveLockFile() unlinks the file while holding the lock, so a lock taken
+        // on a file that is no longer at path does not exclude anyone. Start over on
+        // whatever file is there now.
+        struct stat locked;
+        struct stat current;
+        if(fstat(fd, &locked) == 0 &&
+           stat(path.c_str(), &current) == 0 &&
+           locked.st_dev == current.st_dev &&
+           locked.st_ino == current.st_ino) {
+            return fd;
+        }
+        close(fd);
+    }
+}
+
+void UnlockFile(int fd) {
+    if(fd < 0) {
+        return;
+    }
+
+    // Closing the descriptor releases the lock.
+    close(fd);
+}
+
+bool RemoveLockFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if(fd < 0) {
+        return false;
+    }
+
+    bool removed = flock(fd, LOCK_EX | LOCK_NB) == 0 &&
+                   unlink(path.c_str()) == 0;
+    close(fd);
+    return removed;
+}
+
 #else
 
 bool GetWindowsVersion(uint32_t& major_version,
@@ -278,12 +420,75 @@ static std::string getErrorMessage(const std::string& http_response) {
     return error_str;
 }
 
+AttestationResult EvaluateResponse(long response_code,
+                                   const std::string& response,
+                                   long long retry_after_seconds,
+                                   uint8_t& retries,
+                                   std::chrono::milliseconds& retry_delay) {
+    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+    retry_delay = std::chrono::milliseconds(0);
+
+    if(response_code == HTTP_STATUS_OK) {
+        return result;
+    } else if(response_code == HTTP_STATUS_ATTESTATION_FAILURE) {
+        std::string error_msg = response;
+
+        CLIENT_LOG_ERROR("Attestation failed with error code:%ld description:%s",
+                         response_code,
+                         error_msg.c_str());
+
+        result.code_ = AttestationResult::ErrorCode::ERROR_ATTESTATION_FAILED;
+        result.description_ = error_msg;
+    } else if (response_code == HTTP_STATUS_TOO_MANY_REQUESTS 
+                || response_code == HTTP_STATUS_REQUEST_TIMEOUT
+                || response_code >= HTTP_STATUS_SERVER_ERROR) {
+        std::string error_msg = response;
+
+        CLIENT_LOG_ERROR("Http Request failed with error:%ld description:%s",
+                          response_code,
+                          error_msg.c_str());
+
+        //Retry sending the request since this is a server failure.
+        if(retries == MAX_RETRIES) {
+            CLIENT_LOG_ERROR("Maxinum retries exceeded.");
+
+            result.code_ = AttestationResult::ErrorCode::ERROR_HTTP_REQUEST_EXCEEDED_RETRIES;
+            result.description_ = error_msg;
+            return result;
+        }
+        CLIENT_LOG_INFO("Retrying");
+
+        if (retry_after_seconds) {
+            CLIENT_LOG_INFO("Http Request throttled by MAA, retry-after: %lld", retry_after_seconds);
+        }
+
+        long long exponential_back_off_seconds = static_cast<long long>(BACK_OFF_TIME_SECONDS * pow(2.0, static_cast<double>(retries++)));
+        long long sleep_time_milliseconds = To_MilliSeconds((exponential_back_off_seconds > retry_after_seconds ? 
+                                                exponential_back_off_seconds : 
+                                                retry_after_seconds)) + static_cast<long long>(generateRandomJitter());
+
+        CLIENT_LOG_INFO("Http Request wait time: %lld", sleep_time_milliseconds);
+        retry_delay = std::chrono::milliseconds(sleep_time_milliseconds);
+    } else {
+        std::string error_msg = response;
+
+        CLIENT_LOG_ERROR("Http Request failed with error:%ld description:%s",
+                         response_code,
+                         error_msg.c_str());
+
+        result.code_ = AttestationResult::ErrorCode::ERROR_HTTP_REQUEST_FAILED;
+        result.description_ = error_msg;
+    }
+    return result;
+}
+
 AttestationResult SendRequest(const std::string& url,
                               const std::string& payload,
                               std::string& http_response) {
     AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
 
-    CURL *curl = curl_easy_init();
+    HttpTransport::Handle curl_handle = HttpTransport::GetInstance().AcquireHandle(url);
+    CURL *curl = curl_handle.get();
     if(curl == nullptr) {
         result.code_ = AttestationResult::ErrorCode::ERROR_CURL_INITIALIZATION;
         result.description_ = std::string("Failed to initialize curl for http request.");
@@ -303,21 +508,8 @@ AttestationResult SendRequest(const std::string& url,
     curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload.c_str());
     curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, payload.size());
 
-#ifdef PLATFORM_UNIX
-    char* cainfo = NULL;
-    curl_easy_getinfo(curl, CURLINFO_CAINFO, &cainfo);
-    struct stat buffer;
-    if(cainfo && stat(cainfo, &buffer) == 0) {
-        CLIENT_LOG_INFO("Using default ca info path: %s", cainfo);
-        curl_easy_setopt(curl, CURLOPT_CAINFO, cainfo);
-    } else {
-        CLIENT_LOG_INFO("Using ca-bundle certs");
-        curl_easy_setopt(curl, CURLOPT_CAINFO, "curl-ca-bundle.crt");
-    }
-#else 
-    curl_easy_setopt(curl, CURLOPT_CAINFO, "curl-ca-bundle.crt");
-    curl_easy_setopt(curl, CURLOPT_SSL_OPTIONS, CURLSSLOPT_NATIVE_CA);
-#endif
+    // The CA bundle is set up by the transport.
+
     // Send a pointer to a std::string to hold the response from the end
     // point along with the handler function.
     std::string response;
@@ -331,71 +523,25 @@ AttestationResult SendRequest(const std::string& url,
         long response_code = HTTP_STATUS_OK;
         curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
 
-        if(response_code == HTTP_STATUS_OK) {
-            http_response = response;
-            break;
-        } else if(response_code == HTTP_STATUS_ATTESTATION_FAILURE) {
-                std::string error_msg = response;
-
-                CLIENT_LOG_ERROR("Attestation failed with error code:%ld description:%s",
-                                 response_code,
-                                 error_msg.c_str());
-
-                result.code_ = AttestationResult::ErrorCode::ERROR_ATTESTATION_FAILED;
-                result.description_ = error_msg;
-                break;
-        } else if (response_code == HTTP_STATUS_TOO_MANY_REQUESTS 
-                    || response_code == HTTP_STATUS_REQUEST_TIMEOUT
-                    || response_code >= HTTP_STATUS_SERVER_ERROR) {
-            std::string error_msg = response;
-
-            CLIENT_LOG_ERROR("Http Request failed with error:%ld description:%s",
-                              response_code,
-                              error_msg.c_str());
-            CLIENT_LOG_INFO("Retrying");
-
-            //Retry sending the request since this is a server failure.
-            if(retries == MAX_RETRIES) {
-                CLIENT_LOG_ERROR("Http Request failed with error:%ld description:%s",
-                                 response_code,
-                                 error_msg.c_str());
-                CLIENT_LOG_ERROR("Maxinum retries exceeded.");
-
-                result.code_ = AttestationResult::ErrorCode::ERROR_HTTP_REQUEST_EXCEEDED_RETRIES;
-                result.description_ = error_msg;
-                break;
-            }
-
-            curl_off_t retry_after_seconds = 0;
-            curl_easy_getinfo(curl, CURLINFO_RETRY_AFTER, &retry_after_seconds);
-            if (retry_after_seconds) {
-                CLIENT_LOG_INFO("Http Request throttled by MAA, retry-after: %ld", retry_after_seconds);
+        curl_off_t retry_after_seconds = 0;
+        curl_easy_getinfo(curl, CURLINFO_RETRY_AFTER, &retry_after_seconds);
+
+        std::chrono::milliseconds retry_delay(0);
+        result = EvaluateResponse(response_code,
+                                  response,
+                                  static_cast<long long>(retry_after_seconds),
+                                  retries,
+                                  retry_delay);
+        if(retry_delay.count() == 0) {
+            if(result.code_ == AttestationResult::ErrorCode::SUCCESS) {
+                http_response = response;
             }
-
-            long long exponential_back_off_seconds = static_cast<long long>(BACK_OFF_TIME_SECONDS * pow(2.0, static_cast<double>(retries++)));
-            long long sleep_time_milliseconds = To_MilliSeconds((exponential_back_off_seconds > retry_after_seconds ? 
-                                                    exponential_back_off_seconds : 
-                                                    retry_after_seconds)) + static_cast<long long>(generateRandomJitter());
-
-            CLIENT_LOG_INFO("Http Request wait time: %ld", sleep_time_milliseconds);
-            // Sleep for the backoff period and try again.
-            std::this_thread::sleep_for(
-                std::chrono::milliseconds(
-                    sleep_time_milliseconds
-                ));
-            response = std::string();
-            continue;
-        } else {
-            std::string error_msg = response;
-
-            CLIENT_LOG_ERROR("Http Request failed with error:%ld description:%s",
-                             response_code,
-                             error_msg.c_str());
-
-            result.code_ = AttestationResult::ErrorCode::ERROR_HTTP_REQUEST_FAILED;
-            result.description_ = error_msg;
             break;
         }
+
+        // Sleep for the backoff period and try again.
+        std::this_thread::sleep_for(retry_delay);
+        response = std::string();
     }
     if(res != CURLE_OK) {
         CLIENT_LOG_ERROR("Failed sending curl request with error:%s",
@@ -405,7 +551,6 @@ AttestationResult SendRequest(const std::string& url,
         result.description_ = std::string("Failed sending curl request with error:") + std::string(curl_easy_strerror(res));
     }
 
-    curl_easy_cleanup(curl);
     curl_slist_free_all(headers);
     return result;
 }
@@ -419,48 +564,62 @@ namespace jwt {
             CLIENT_LOG_ERROR("Invalid input argument");
             return false;
         }
-        try {
-            std::vector<std::string> tokens;
-            boost::split(tokens, jwt, [](char c) {return c == '.'; });
-            if (tokens.size() < 3) {
-                CLIENT_LOG_ERROR("Invalid JWT token");
-                return false;
-            }
-            Json::Value root;
-            Json::Reader reader;
-            bool parsing_successful = reader.parse(attest::base64::base64_decode(tokens[1]), root);
-            if (!parsing_successful) {
-                CLIENT_LOG_ERROR("Error parsing the JWT claims");
-                return false;
-            }
+        AttestationToken token(std::move(jwt));
+        return ExtractJwkInfoFromAttestationToken(token, n, e);
+    }
 
-            Json::Value x_ms_runtime = root["x-ms-runtime"];
-            Json::Value keys = x_ms_runtime["keys"];
-            Json::Value key = keys[0];
-            std::string n_base64url = key["n"].asString();
-            std::string e_base64url = key["e"].asString();
-            n = n_base64url;
-            e = e_base64url;
+    bool ExtractJwkInfoFromAttestationToken(const AttestationToken& token,
+                                            std::string& n,
+                                            std::string& e) {
+        if (!token.IsValid()) {
+            CLIENT_LOG_ERROR("Invalid JWT token");
+            return false;
         }
-        catch (...) {
-            CLIENT_LOG_ERROR("Unexpected error while extracting JWK info from JWT");
+
+        const std::vector<RuntimeKey>& keys = token.GetRuntimeKeys();
+        if (keys.empty()) {
+            CLIENT_LOG_ERROR("JWT has no runtime keys");
             return false;
         }
+        n = keys[0].n;
+        e = keys[0].e;
+        return true;
+    }
+
+    bool ExtractValidityFromAttestationJwt(const std::string& jwt,
+                                           int64_t& not_before,
+                                           int64_t& expiry) {
+        if (jwt.empty()) {
+            CLIENT_LOG_ERROR("Invalid input argument");
+            return false;
+        }
+
+        AttestationToken token(jwt);
+        if (!token.IsValid()) {
+            CLIENT_LOG_ERROR("Error parsing the JWT claims");
+            return false;
+        }
+        if (!token.GetExpiry(expiry)) {
+            CLIENT_LOG_ERROR("JWT has no exp claim");
+            return false;
+        }
+        if (!token.GetNotBefore(not_before)) {
+            not_before = 0;
+        }
         return true;
     }
 
 } // jwt
 
 namespace crypto {
-    AttestationResult EncryptDataWithRSAPubKey(BIO* pkey_bio,
-                                               const attest::RsaScheme rsaWrapAlgId,
-                                               const attest::RsaHashAlg rsaHashAlgId,
-                                               const Buffer& input_data,
-                                               Buffer& encrypted_data)
+    AttestationResult CreateRsaEncryptionContext(EVP_PKEY* pkey,
+                                                 const attest::RsaScheme rsaWrapAlgId,
+                                                 const attest::RsaHashAlg rsaHashAlgId,
+                                                 EVP_PKEY_CTX** enc_ctx_out)
     {
         AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
-        if (pkey_bio == NULL ||
-            input_data.empty()) {
+        if (pkey == NULL ||
+            enc_ctx_out == NULL) {
             return LogErrorAndGetResult(AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER,
                                         "Invalid input parameter");
         }
@@ -504,7 +663,6 @@ namespace crypto {
                                      "EncryptDataWithRSAPubKey failed; called with unknown RSA padding algorithm");
         }
 
-        EVP_PKEY* pkey = PEM_read_bio_PUBKEY(pkey_bio, NULL, NULL, NULL);
         EVP_PKEY_CTX* enc_ctx = EVP_PKEY_CTX_new(pkey, NULL);
         if (EVP_PKEY_encrypt_init(enc_ctx) <= 0) {
             EVP_PKEY_CTX_free(enc_ctx);
@@ -555,34 +713,99 @@ namespace crypto {
                                         "Invalid RSA wrap algorithm");
         }
 
-        // Encrypt the data
+        *enc_ctx_out = enc_ctx;
+        return result;
+    }
+
+    AttestationResult EncryptDataWithRSAContext(EVP_PKEY_CTX* enc_ctx,
+                                                const unsigned char* input_data,
+                                                size_t input_size,
+                                                unsigned char* encrypted_data,
+                                                size_t& encrypted_size)
+    {
+        AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+        if (enc_ctx == NULL ||
+            input_data == NULL ||
+            input_size == 0 ||
+            encrypted_data == NULL) {
+            return LogErrorAndGetResult(AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER,
+                                        "Invalid input parameter");
+        }
+
+        size_t outlen;
+        if (EVP_PKEY_encrypt(enc_ctx, NULL, &outlen, input_data, input_size) <= 0) {
+            return LogErrorAndGetResult(AttestationResult::ErrorCode::ERROR_EVP_PKEY_ENCRYPT_FAILED,
+                                        "EVP_PKEY_encrypt failed");
+        }
+        if (outlen > encrypted_size) {
+            return LogErrorAndGetResult(AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER,
+                                        "Output buffer too small for the encrypted data");
+        }
+        if (EVP_PKEY_encrypt(enc_ctx, encrypted_data, &outlen, input_data, input_size) <= 0) {
+            return LogErrorAndGetResult(AttestationResult::ErrorCode::ERROR_EVP_PKEY_ENCRYPT_FAILED,
+                                        "EVP_PKEY_encrypt failed");
+        }
+        encrypted_size = outlen;
+        return result;
+    }
+
+    AttestationResult EncryptDataWithRSAContext(EVP_PKEY_CTX* enc_ctx,
+                                                const Buffer& input_data,
+                                                Buffer& encrypted_data)
+    {
+        AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+        if (enc_ctx == NULL ||
+            input_data.empty()) {
+            return LogErrorAndGetResult(AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER,
+                                        "Invalid input parameter");
+        }
+
+        // Encrypt the data straight into the output buffer, sized by a first call
         size_t outlen;
-        unsigned char* out;
         if (EVP_PKEY_encrypt(enc_ctx, NULL, &outlen, &input_data.front(), input_data.size()) <= 0) {
-            EVP_PKEY_CTX_free(enc_ctx);
             return LogErrorAndGetResult(AttestationResult::ErrorCode::ERROR_EVP_PKEY_ENCRYPT_FAILED,
                                         "EVP_PKEY_encrypt failed");
         }
-        out = (unsigned char*)OPENSSL_malloc(outlen);
-        if (EVP_PKEY_encrypt(enc_ctx, out, &outlen, &input_data.front(), input_data.size()) <= 0) {
-            EVP_PKEY_CTX_free(enc_ctx);
-            OPENSSL_free(out);
+        encrypted_data.resize(outlen);
+        if (EVP_PKEY_encrypt(enc_ctx, encrypted_data.data(), &outlen, &input_data.front(), input_data.size()) <= 0) {
+            encrypted_data.clear();
             return LogErrorAndGetResult(AttestationResult::ErrorCode::ERROR_EVP_PKEY_ENCRYPT_FAILED,
                                         "EVP_PKEY_encrypt failed");
         }
+        encrypted_data.resize(outlen);
+        return result;
+    }
+
+    AttestationResult EncryptDataWithRSAPubKey(BIO* pkey_bio,
+                                               const attest::RsaScheme rsaWrapAlgId,
+                                               const attest::RsaHashAlg rsaHashAlgId,
+                                               const Buffer& input_data,
+                                               Buffer& encrypted_data)
+    {
+        AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+        if (pkey_bio == NULL ||
+            input_data.empty()) {
+            return LogErrorAndGetResult(AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER,
+                                        "Invalid input parameter");
+        }
+
+        EVP_PKEY* pkey = PEM_read_bio_PUBKEY(pkey_bio, NULL, NULL, NULL);
+        EVP_PKEY_CTX* enc_ctx = NULL;
+        if ((result = CreateRsaEncryptionContext(pkey, rsaWrapAlgId, rsaHashAlgId, &enc_ctx)).code_ ==
+                                                                AttestationResult::ErrorCode::SUCCESS) {
+            result = EncryptDataWithRSAContext(enc_ctx, input_data, encrypted_data);
+        }
 
-        Buffer out_data(out, out + outlen);
-        encrypted_data = out_data;
         EVP_PKEY_CTX_free(enc_ctx);
-        OPENSSL_free(out);
+        EVP_PKEY_free(pkey);
         return result;
     }
 
-    AttestationResult ConvertJwkToRsaPubKey(BIO* pkey_bio,
-                                            const std::string& n,
-                                            const std::string& e) {
+    AttestationResult ConvertJwkToEvpPKey(const std::string& n,
+                                          const std::string& e,
+                                          EVP_PKEY** pkey_out) {
         AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
-        if (pkey_bio == NULL ||
+        if (pkey_out == NULL ||
             n.empty() ||
             e.empty()) {
             return LogErrorAndGetResult(AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER,
@@ -590,53 +813,71 @@ namespace crypto {
         }
         EVP_PKEY_CTX* genctx = EVP_PKEY_CTX_new_from_name(NULL, "RSA", NULL);
         EVP_PKEY* pkey = NULL;
+        BIGNUM* modul = NULL;
+        BIGNUM* expon = NULL;
         try {
             auto n_bin = base64::base64url_to_binary(n);
             auto e_bin = base64::base64url_to_binary(e);
-            const BIGNUM* modul = BN_bin2bn(n_bin.data(), n_bin.size(), NULL);
-            const BIGNUM* expon = BN_bin2bn(e_bin.data(), e_bin.size(), NULL);
+            modul = BN_bin2bn(n_bin.data(), n_bin.size(), NULL);
+            expon = BN_bin2bn(e_bin.data(), e_bin.size(), NULL);
             OSSL_PARAM rsa_keygen_params[3] = {
-                { OSSL_PKEY_PARAM_RSA_N, OSSL_PARAM_UNSIGNED_INTEGER, n_bin.data(), BN_num_bytes(modul),  NULL},
-                { OSSL_PKEY_PARAM_RSA_E, OSSL_PARAM_UNSIGNED_INTEGER, e_bin.data(), BN_num_bytes(expon), NULL},
+                { OSSL_PKEY_PARAM_RSA_N, OSSL_PARAM_UNSIGNED_INTEGER, n_bin.data(), static_cast<size_t>(BN_num_bytes(modul)),  NULL},
+                { OSSL_PKEY_PARAM_RSA_E, OSSL_PARAM_UNSIGNED_INTEGER, e_bin.data(), static_cast<size_t>(BN_num_bytes(expon)), NULL},
                 OSSL_PARAM_END
             };
 
-            if (OSSL_PARAM_set_BN(&rsa_keygen_params[0], modul) <= 0) {
-                EVP_PKEY_CTX_free(genctx);
-                return LogErrorAndGetResult(AttestationResult::ErrorCode::ERROR_CONVERTING_JWK_TO_RSA_PUB,
-                    "OSSL_PARAM_set_BN failed");
-            };
-
-            if (OSSL_PARAM_set_BN(&rsa_keygen_params[1], expon) <= 0) {
-                EVP_PKEY_CTX_free(genctx);
-                return LogErrorAndGetResult(AttestationResult::ErrorCode::ERROR_CONVERTING_JWK_TO_RSA_PUB,
+            if (OSSL_PARAM_set_BN(&rsa_keygen_params[0], modul) <= 0 ||
+                OSSL_PARAM_set_BN(&rsa_keygen_params[1], expon) <= 0) {
+                result = LogErrorAndGetResult(AttestationResult::ErrorCode::ERROR_CONVERTING_JWK_TO_RSA_PUB,
                     "OSSL_PARAM_set_BN failed");
             }
-
-            if (EVP_PKEY_fromdata_init(genctx) <= 0) {
-                EVP_PKEY_CTX_free(genctx);
-                return LogErrorAndGetResult(AttestationResult::ErrorCode::ERROR_CONVERTING_JWK_TO_RSA_PUB,
+            else if (EVP_PKEY_fromdata_init(genctx) <= 0) {
+                result = LogErrorAndGetResult(AttestationResult::ErrorCode::ERROR_CONVERTING_JWK_TO_RSA_PUB,
                     "EVP_PKEY_fromdata_init failed");
             }
-
-            if (EVP_PKEY_fromdata(genctx, &pkey, EVP_PKEY_PUBLIC_KEY, rsa_keygen_params) <= 0) {
-                EVP_PKEY_CTX_free(genctx);
-                return LogErrorAndGetResult(AttestationResult::ErrorCode::ERROR_CONVERTING_JWK_TO_RSA_PUB,
+            else if (EVP_PKEY_fromdata(genctx, &pkey, EVP_PKEY_PUBLIC_KEY, rsa_keygen_params) <= 0) {
+                result = LogErrorAndGetResult(AttestationResult::ErrorCode::ERROR_CONVERTING_JWK_TO_RSA_PUB,
                     "EVP_PKEY_fromdata failed");
             }
-
-            if (PEM_write_bio_PUBKEY(pkey_bio, pkey) <= 0) {
-                EVP_PKEY_CTX_free(genctx);
-                return LogErrorAndGetResult(AttestationResult::ErrorCode::ERROR_CONVERTING_JWK_TO_RSA_PUB,
-                    "PEM_write_bio_PUBKEY failed");
-            }
         }
         catch (...) {
             result = LogErrorAndGetResult(AttestationResult::ErrorCode::ERROR_CONVERTING_JWK_TO_RSA_PUB,
                                         "Error while converting JWK to RSA public key");
         }
 
+        BN_free(modul);
+        BN_free(expon);
         EVP_PKEY_CTX_free(genctx);
+        if (result.code_ != AttestationResult::ErrorCode::SUCCESS) {
+            EVP_PKEY_free(pkey);
+            return result;
+        }
+        *pkey_out = pkey;
+        return result;
+    }
+
+    AttestationResult ConvertJwkToRsaPubKey(BIO* pkey_bio,
+                                            const std::string& n,
+                                            const std::string& e) {
+        AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+        if (pkey_bio == NULL ||
+            n.empty() ||
+            e.empty()) {
+            return LogErrorAndGetResult(AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER,
+                                        "Invalid input parameter");
+        }
+
+        EVP_PKEY* pkey = NULL;
+        if ((result = ConvertJwkToEvpPKey(n, e, &pkey)).code_ != AttestationResult::ErrorCode::SUCCESS) {
+            return result;
+        }
+
+        if (PEM_write_bio_PUBKEY(pkey_bio, pkey) <= 0) {
+            result = LogErrorAndGetResult(AttestationResult::ErrorCode::ERROR_CONVERTING_JWK_TO_RSA_PUB,
+                "PEM_write_bio_PUBKEY failed");
+        }
+
+        EVP_PKEY_free(pkey);
         return result;
     }
 } // crypto
@@ -5,12 +5,16 @@
 //-------------------------------------------------------------------------------------------------
 #pragma once
 
+#include <chrono>
 #include <fstream>
 #include <unordered_map>
+#include <openssl/bio.h>
+#include <openssl/evp.h>
 
 #include <AttestationTypes.h>
 
 #include "AttestationLibTypes.h"
+#include "AttestationToken.h"
 
 namespace attest {
 
@@ -53,6 +57,60 @@ bool ParseVersionString(const std::string& str,
                         uint32_t& major_version,
                         uint32_t& minor_version);
 
+/**
+ * @brief This function will be used to create a directory, along with any missing
+ * parent directories, that only the current user can access.
+ * @param[in] path The directory to create.
+ * @return On success, the function returns true. It returns false if the directory
+ * could not be created, or if it already exists but is not owned by the current
+ * user or is accessible by group or others.
+ */
+bool CreatePrivateDirectory(const std::string& path);
+
+/**
+ * @brief This function will be used to read the contents of a file.
+ * @param[in] path The file to read.
+ * @param[out] contents The contents of the file.
+ * @return On success, the function returns true. On failure, false is returned.
+ */
+bool ReadFile(const std::string& path, std::string& contents);
+
+/**
+ * @brief This function will be used to replace the contents of a file atomically.
+ * The contents are written to a temporary file in the same directory that only the
+ * current user can read, flushed to disk and renamed over path.
+ * @param[in] path The file to replace.
+ * @param[in] contents The new contents of the file.
+ * @return On success, the function returns true. On failure, false is returned and
+ * path is left unchanged.
+ */
+bool WriteFileAtomically(const std::string& path, const std::string& contents);
+
+/**
+ * @brief This function will be used to take an exclusive advisory lock that is
+ * shared between processes. The call blocks until the lock is available. If the lock
+ * file is removed with RemoveLockFile() while waiting, the lock is taken on the file
+ * that replaces it.
+ * @param[in] path The lock file, created readable by the current user only if it
+ * does not exist.
+ * @return On success, a file descriptor that holds the lock until it is passed to
+ * UnlockFile(). On failure, -1 is returned.
+ */
+int LockFile(const std::string& path);
+
+/**
+ * @brief This function will be used to release a lock taken with LockFile().
+ * @param[in] fd The file descriptor returned by LockFile().
+ */
+void UnlockFile(int fd);
+
+/**
+ * @brief This function will be used to remove a lock file nobody holds.
+ * @param[in] path The lock file.
+ * @return true if the file was removed, false if it is locked or does not exist.
+ */
+bool RemoveLockFile(const std::string& path);
+
 #else
 
 /**
@@ -74,6 +132,28 @@ bool GetWindowsVersion(uint32_t& major_version,
 
 namespace curl {
 
+/**
+ * @brief This function will be used to decide what to do with the response to
+ * an attestation request: accept it, fail, or send the request again after a
+ * back off.
+ * @param[in] response_code The HTTP status code of the response.
+ * @param[in] response The body of the response.
+ * @param[in] retry_after_seconds The Retry-After header of the response, 0 if
+ * it had none.
+ * @param[in,out] retries The number of retries made so far. It is incremented
+ * when a retry is due.
+ * @param[out] retry_delay How long to wait before sending the request again.
+ * It is set to 0 if the request must not be retried.
+ * @return AttestationResult::ErrorCode::SUCCESS if the response was accepted or
+ * a retry is due. On failure, AttestationResult::ErrorCode is returned with the
+ * response body as description.
+ */
+AttestationResult EvaluateResponse(long response_code,
+                                   const std::string& response,
+                                   long long retry_after_seconds,
+                                   uint8_t& retries,
+                                   std::chrono::milliseconds& retry_delay);
+
 /**
  * @brief Thie function will be used to send a http request to a provided
  * endpoint.
@@ -103,9 +183,90 @@ namespace jwt {
     bool ExtractJwkInfoFromAttestationJwt(std::string jwt,
                                           std::string& n,
                                           std::string& e);
+
+    /**
+     * @brief This function will be used to retrieve the JWK Info
+     * from an attestation token, without decoding it again if it was
+     * accessed before.
+     * @param[in] token The attestation token.
+     * @param[out] n The modulus value of the RSA public key
+     * @param[out] e The exponent value of the RSA public key
+     * @return On success, the function return true and the output parameters are
+     * set to valid values. On failure, it returns false.
+     */
+    bool ExtractJwkInfoFromAttestationToken(const AttestationToken& token,
+                                            std::string& n,
+                                            std::string& e);
+
+    /**
+     * @brief This function will be used to retrieve the validity period
+     * of the attestation JWT
+     * @param[in] jwt The attestation JWT.
+     * @param[out] not_before The nbf claim in seconds since the epoch, 0 if the
+     * token has no nbf claim.
+     * @param[out] expiry The exp claim in seconds since the epoch.
+     * @return On success, the function return true and the output parameters are
+     * set to valid values. It returns false if the JWT cannot be parsed or has no
+     * exp claim.
+     */
+    bool ExtractValidityFromAttestationJwt(const std::string& jwt,
+                                           int64_t& not_before,
+                                           int64_t& expiry);
 } // jwt
 
 namespace crypto {
+    /**
+     * @brief This function will be used to create an RSA encryption
+     * context, set up with the padding and message digest to use.
+     * @param[in] pkey The RSA public key.
+     * @param[in] rsaWrapAlgId: Rsa wrap algorithm id.
+     * @param[in] rsaHashAlgId: Rsa hash algorithm id.
+     * @param[out] enc_ctx The encryption context, freed by the caller
+     * with EVP_PKEY_CTX_free.
+     * @return On sucess, the function returns
+     * AttestationResult::ErrorCode::SUCCESS and enc_ctx is set.
+     * On failure, AttestationResult::ErrorCode is returned.
+     */
+    AttestationResult CreateRsaEncryptionContext(EVP_PKEY* pkey,
+                                                 const attest::RsaScheme rsaWrapAlgId,
+                                                 const attest::RsaHashAlg rsaHashAlgId,
+                                                 EVP_PKEY_CTX** enc_ctx);
+
+    /**
+     * @brief This function will be used to encrypt the input buffer
+     * with an encryption context from CreateRsaEncryptionContext. A context
+     * must not be used by several threads at once.
+     * @param[in] enc_ctx The encryption context.
+     * @param[in] input_data The input buffer to be encrypted
+     * @param[out] encrypted_data The encrypted output buffer
+     * @return On sucess, the function returns
+     * AttestationResult::ErrorCode::SUCCESS and the encrypted_data buffer
+     * is set. On failure, AttestationResult::ErrorCode is
+     * returned.
+     */
+    AttestationResult EncryptDataWithRSAContext(EVP_PKEY_CTX* enc_ctx,
+                                                const Buffer& input_data,
+                                                Buffer& encrypted_data);
+
+    /**
+     * @brief This function will be used to encrypt the input buffer with an
+     * encryption context, writing straight into a buffer of the caller.
+     * @param[in] enc_ctx The encryption context.
+     * @param[in] input_data The input buffer to be encrypted
+     * @param[in] input_size The size of the input buffer
+     * @param[out] encrypted_data The encrypted output buffer
+     * @param[in,out] encrypted_size The size of the output buffer on input,
+     * the size of the encrypted data on output.
+     * @return On sucess, the function returns
+     * AttestationResult::ErrorCode::SUCCESS. If the output buffer is smaller
+     * than the RSA modulus, ERROR_INVALID_INPUT_PARAMETER is returned.
+     */
+    AttestationResult EncryptDataWithRSAContext(EVP_PKEY_CTX* enc_ctx,
+                                                const unsigned char* input_data,
+                                                size_t input_size,
+                                                unsigned char* encrypted_data,
+                                                size_t& encrypted_size);
+
     /**
      * @brief This function will be used to encrypt the input buffer
      * using the RSA public key 
@@ -139,6 +300,21 @@ namespace crypto {
     AttestationResult ConvertJwkToRsaPubKey(BIO* pkey_bio,
                                             const std::string& n,
                                             const std::string& e);
+
+    /**
+     * @brief This function will be used to convert the JWK to an RSA
+     * public key without going through PEM
+     * @param[in] n The modulus value of the RSA public key
+     * @param[in] e The exponent value of the RSA public key
+     * @param[out] pkey The RSA public key, freed by the caller with
+     * EVP_PKEY_free.
+     * @return On sucess, the function returns
+     * AttestationResult::ErrorCode::SUCCESS and pkey is set.
+     * On failure, AttestationResult::ErrorCode is returned.
+     */
+    AttestationResult ConvertJwkToEvpPKey(const std::string& n,
+                                          const std::string& e,
+                                          EVP_PKEY** pkey);
 } // crypto
 
 namespace url {
@@ -3,8 +3,8 @@
 // Copyright (c) Microsoft Corporation.  All rights reserved.
 // </copyright>
 //-------------------------------------------------------------------------------------------------
-#include "AttestationHelper.h"
-
+#include <algorithm>
+#include <vector>
 #include "AttestationParameters.h"
 #include "AttestationLibConst.h"
 
@@ -43,33 +43,66 @@ bool AttestationParameters::Validate() const {
     return true;
 }
 
-Json::Value AttestationParameters::ToJson() const {
-    Json::Value attestation_info;
+void AttestationParameters::WriteJson(JsonStreamWriter& writer) const {
     std::string os_type_str = getOSTypeStr(os_info_.type);
 
-    std::string os_type_encoded = base64::binary_to_base64(Buffer(os_type_str.begin(), os_type_str.end()));
-    std::string os_distro_encoded = base64::binary_to_base64(Buffer(os_info_.distro_name.begin(), os_info_.distro_name.end()));
-    std::string os_build_encoded = base64::binary_to_base64(Buffer(os_info_.build.begin(), os_info_.build.end()));
-
-    attestation_info[JSON_PROTOCOL_VERSION_KEY] = attestation_protocol_ver_;
-    attestation_info[JSON_OS_TYPE_KEY] = os_type_encoded;
-    attestation_info[JSON_OS_DISTRO_KEY] = os_distro_encoded;
-    attestation_info[JSON_OS_VERSION_MAJOR_KEY] = os_info_.distro_version_major;
-    attestation_info[JSON_OS_VERSION_MINOR_KEY] = os_info_.distro_version_minor;
-    attestation_info[JSON_OS_BUILD_KEY] = os_build_encoded;
+    writer.BeginObject();
+    writer.Key(JSON_PROTOCOL_VERSION_KEY);
+    writer.String(attestation_protocol_ver_);
+    writer.Key(JSON_OS_TYPE_KEY);
+    writer.Base64(reinterpret_cast<const unsigned char*>(os_type_str.data()),
+                  os_type_str.size(),
+                  base64::Alphabet::Standard);
+    writer.Key(JSON_OS_DISTRO_KEY);
+    writer.Base64(reinterpret_cast<const unsigned char*>(os_info_.distro_name.data()),
+                  os_info_.distro_name.size(),
+                  base64::Alphabet::Standard);
+    writer.Key(JSON_OS_VERSION_MAJOR_KEY);
+    writer.UInt(os_info_.distro_version_major);
+    writer.Key(JSON_OS_VERSION_MINOR_KEY);
+    writer.UInt(os_info_.distro_version_minor);
+    writer.Key(JSON_OS_BUILD_KEY);
+    writer.Base64(reinterpret_cast<const unsigned char*>(os_info_.build.data()),
+                  os_info_.build.size(),
+                  base64::Alphabet::Standard);
 
-    attestation_info[JSON_TCG_LOGS_KEY] = base64::binary_to_base64(tcg_logs_);
+    writer.Key(JSON_TCG_LOGS_KEY);
+    writer.Base64(tcg_logs_.data(), tcg_logs_.size(), base64::Alphabet::Standard);
 
-    Json::Value client_payload;
+    // Sorted so the same parameters always give the same request.
+    std::vector<const std::pair<const std::string, std::string>*> client_payload;
     for(auto const& entry: client_payload_) {
-        std::string value = base64::binary_to_base64(Buffer(entry.second.begin(), entry.second.end()));
-        client_payload[entry.first.c_str()] = value;
+        client_payload.push_back(&entry);
     }
-    attestation_info[JSON_CLIENT_PAYLOAD_KEY] = client_payload;
+    std::sort(client_payload.begin(),
+              client_payload.end(),
+              [](const std::pair<const std::string, std::string>* a,
+                 const std::pair<const std::string, std::string>* b) {
+                  return a->first < b->first;
+              });
 
-    attestation_info[JSON_TPM_INFO_KEY] = tpm_info_.ToJson();
-    attestation_info[JSON_ISOLATION_INFO_KEY] = isolation_info_.ToJson();
+    writer.Key(JSON_CLIENT_PAYLOAD_KEY);
+    writer.BeginObject();
+    for(auto const* entry: client_payload) {
+        writer.Key(entry->first);
+        writer.Base64(reinterpret_cast<const unsigned char*>(entry->second.data()),
+                      entry->second.size(),
+                      base64::Alphabet::Standard);
+    }
+    writer.EndObject();
 
-    return attestation_info;
+    writer.Key(JSON_TPM_INFO_KEY);
+    tpm_info_.WriteJson(writer);
+    writer.Key(JSON_ISOLATION_INFO_KEY);
+    isolation_info_.WriteJson(writer);
+    writer.EndObject();
+}
+
+size_t AttestationParameters::JsonSizeHint() const {
+    size_t size = os_info_.distro_name.size() + os_info_.build.size() + tcg_logs_.size();
+    for(auto const& entry: client_payload_) {
+        size += entry.first.size() + entry.second.size() + 8;
+    }
+    return size * 4 / 3 + tpm_info_.JsonSizeHint() + isolation_info_.JsonSizeHint() + 256;
 }
 } // attest
@@ -8,12 +8,12 @@
 #include <string>
 #include <map>
 
-#include <json/json.h>
 #include <AttestationTypes.h>
 
 #include "AttestationLibTypes.h"
 #include "TpmInfo.h"
 #include "IsolationInfo.h"
+#include "JsonStreamWriter.h"
 
 namespace attest {
 
@@ -30,7 +30,13 @@ class AttestationParameters {
 public:
 
     bool Validate() const;
-    Json::Value ToJson() const;
+    void WriteJson(JsonStreamWriter& writer) const;
+
+    /**
+     * @brief Returns roughly how many bytes WriteJson() writes, so the output can be
+     * reserved up front.
+     */
+    size_t JsonSizeHint() const;
 
     OsInfo os_info_; /**< Struct to hold OS information like name and version */
     Buffer tcg_logs_; /**< tcg logs from the client system */
@@ -0,0 +1,156 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="AttestationToken.cpp" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+#include <json/json.h>
+#include "AttestationToken.h"
+#include "Base64Codec.h"
+#include "Logging.h"
+
+using namespace attest;
+
+constexpr char isolation_tee_claim[] = "x-ms-isolation-tee";
+constexpr char attestation_type_claim[] = "x-ms-attestation-type";
+constexpr char compliance_status_claim[] = "x-ms-compliance-status";
+constexpr char runtime_claim[] = "x-ms-runtime";
+constexpr char runtime_keys_claim[] = "keys";
+constexpr char expiry_claim[] = "exp";
+constexpr char not_before_claim[] = "nbf";
+
+struct AttestationToken::Decoded {
+    bool valid = false;
+    Json::Value header;
+    Json::Value claims;
+    std::vector<RuntimeKey> runtime_keys;
+};
+
+namespace {
+
+/**
+ * Decodes a base64url encoded JSON object from a part of the jwt, without copying the part out.
+ */
+bool decodeJsonPart(const char* data, size_t size, Json::Value& value) {
+    std::vector<unsigned char> json(base64::MaxDecodedSize(size));
+    size_t json_size = 0;
+    if (json.empty() ||
+        !base64::Decode(data, size, json.data(), json_size, base64::Alphabet::Url)) {
+        return false;
+    }
+
+    Json::Reader reader;
+    const char* begin = reinterpret_cast<const char*>(json.data());
+    return reader.parse(begin, begin + json_size, value, false) && value.isObject();
+}
+
+bool getString(const Json::Value& object, const char* name, std::string& value) {
+    if (!object.isObject()) {
+        return false;
+    }
+    const Json::Value& member = object[name];
+    if (!member.isString()) {
+        return false;
+    }
+    value = member.asString();
+    return true;
+}
+
+bool getInt64(const Json::Value& object, const char* name, int64_t& value) {
+    if (!object.isObject()) {
+        return false;
+    }
+    const Json::Value& member = object[name];
+    if (!member.isNumeric()) {
+        return false;
+    }
+    try {
+        value = member.asInt64();
+    }
+    catch (...) {
+        // A number out of the range of int64_t.
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+AttestationToken::AttestationToken(std::string jwt)
+    : jwt_(std::move(jwt)) {}
+
+AttestationToken::~AttestationToken() = default;
+
+const AttestationToken::Decoded& AttestationToken::decoded() const {
+    std::call_once(decode_once_, [this]() {
+        std::unique_ptr<Decoded> decoded(new Decoded());
+
+        // The parts are located in place rather than split into copies.
+        size_t header_end = jwt_.find('.');
+        size_t claims_end = header_end == std::string::npos ? std::string::npos : jwt_.find('.', header_end + 1);
+        if (claims_end == std::string::npos) {
+            CLIENT_LOG_ERROR("Invalid JWT token");
+        }
+        else if (!decodeJsonPart(jwt_.data(), header_end, decoded->header) ||
+                 !decodeJsonPart(jwt_.data() + header_end + 1, claims_end - header_end - 1, decoded->claims)) {
+            CLIENT_LOG_ERROR("Error parsing the JWT claims");
+            decoded->header = Json::Value();
+            decoded->claims = Json::Value();
+        }
+        else {
+            decoded->valid = true;
+        }
+
+        const Json::Value& claims = decoded->claims;
+        if (claims.isObject() && claims[runtime_claim].isObject()) {
+            const Json::Value& keys = claims[runtime_claim][runtime_keys_claim];
+            if (keys.isArray()) {
+                for (const auto& key : keys) {
+                    RuntimeKey runtime_key;
+                    getString(key, "kid", runtime_key.kid);
+                    getString(key, "kty", runtime_key.kty);
+                    getString(key, "n", runtime_key.n);
+                    getString(key, "e", runtime_key.e);
+                    decoded->runtime_keys.push_back(std::move(runtime_key));
+                }
+            }
+        }
+
+        decoded_ = std::move(decoded);
+    });
+    return *decoded_;
+}
+
+bool AttestationToken::IsValid() const {
+    return decoded().valid;
+}
+
+bool AttestationToken::GetClaim(const std::string& name, std::string& value) const {
+    return getString(decoded().claims, name.c_str(), value);
+}
+
+bool AttestationToken::GetHeader(const std::string& name, std::string& value) const {
+    return getString(decoded().header, name.c_str(), value);
+}
+
+bool AttestationToken::GetIsolationType(std::string& isolation_type) const {
+    const Json::Value& claims = decoded().claims;
+    return claims.isObject() && getString(claims[isolation_tee_claim], attestation_type_claim, isolation_type);
+}
+
+bool AttestationToken::GetComplianceStatus(std::string& compliance_status) const {
+    const Json::Value& claims = decoded().claims;
+    return claims.isObject() && getString(claims[isolation_tee_claim], compliance_status_claim, compliance_status);
+}
+
+const std::vector<RuntimeKey>& AttestationToken::GetRuntimeKeys() const {
+    return decoded().runtime_keys;
+}
+
+bool AttestationToken::GetExpiry(int64_t& expiry) const {
+    return getInt64(decoded().claims, expiry_claim, expiry);
+}
+
+bool AttestationToken::GetNotBefore(int64_t& not_before) const {
+    return getInt64(decoded().claims, not_before_claim, not_before);
+}
@@ -0,0 +1,388 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="Base64Codec.cpp" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+#include <cstdint>
+#include <cstring>
+#include "Base64Codec.h"
+
+// The vector paths are compiled per function with target attributes and picked at run
+// time, so the library still runs on processors without SSSE3 or AVX2.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BASE64_X86_SIMD
+#include <immintrin.h>
+#endif
+
+// Marks a byte that is not part of the alphabet in the decode tables.
+#define BASE64_INVALID 0xff
+
+constexpr char standard_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+constexpr char url_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+namespace attest {
+namespace base64 {
+
+namespace {
+
+struct DecodeTable {
+    explicit DecodeTable(const char* alphabet) {
+        memset(values, BASE64_INVALID, sizeof(values));
+        for (uint8_t i = 0; i < 64; i++) {
+            values[static_cast<unsigned char>(alphabet[i])] = i;
+        }
+    }
+
+    uint8_t values[256];
+};
+
+const char* getAlphabet(Alphabet alphabet) {
+    return alphabet == Alphabet::Url ? url_alphabet : standard_alphabet;
+}
+
+const DecodeTable& getDecodeTable(Alphabet alphabet) {
+    static const DecodeTable standard_table(standard_alphabet);
+    static const DecodeTable url_table(url_alphabet);
+    return alphabet == Alphabet::Url ? url_table : standard_table;
+}
+
+// Each vector routine handles whole blocks only and returns how much input it consumed,
+// the scalar code finishes the rest.
+using EncodeBlocks = size_t (*)(const unsigned char* data, size_t size, char* out, Alphabet alphabet);
+using DecodeBlocks = size_t (*)(const char* data, size_t size, unsigned char* out, Alphabet alphabet);
+
+size_t encodeBlocksScalar(const unsigned char* data, size_t size, char* out, Alphabet alphabet) {
+    const char* chars = getAlphabet(alphabet);
+    size_t consumed = 0;
+    for (; consumed + 3 <= size; consumed += 3, out += 4) {
+        uint32_t triple = (static_cast<uint32_t>(data[consumed]) << 16) |
+                          (static_cast<uint32_t>(data[consumed + 1]) << 8) |
+                          static_cast<uint32_t>(data[consumed + 2]);
+        out[0] = chars[(triple >> 18) & 0x3f];
+        out[1] = chars[(triple >> 12) & 0x3f];
+        out[2] = chars[(triple >> 6) & 0x3f];
+        out[3] = chars[triple & 0x3f];
+    }
+    return consumed;
+}
+
+size_t decodeBlocksScalar(const char* data, size_t size, unsigned char* out, Alphabet alphabet) {
+    const uint8_t* values = getDecodeTable(alphabet).values;
+    size_t consumed = 0;
+    for (; consumed + 4 <= size; consumed += 4, out += 3) {
+        uint8_t a = values[static_cast<unsigned char>(data[consumed])];
+        uint8_t b = values[static_cast<unsigned char>(data[consumed + 1])];
+        uint8_t c = values[static_cast<unsigned char>(data[consumed + 2])];
+        uint8_t d = values[static_cast<unsigned char>(data[consumed + 3])];
+        // Every value of the alphabet fits in 6 bits, BASE64_INVALID does not.
+        if (((a | b | c | d) & 0xc0) != 0) {
+            break;
+        }
+        uint32_t triple = (static_cast<uint32_t>(a) << 18) |
+                          (static_cast<uint32_t>(b) << 12) |
+                          (static_cast<uint32_t>(c) << 6) |
+                          static_cast<uint32_t>(d);
+        out[0] = static_cast<unsigned char>(triple >> 16);
+        out[1] = static_cast<unsigned char>(triple >> 8);
+        out[2] = static_cast<unsigned char>(triple);
+    }
+    return consumed;
+}
+
+#ifdef BASE64_X86_SIMD
+// The vector code follows the multiply-shift and pshufb lookup scheme of Mula and
+// Lemire, "Faster Base64 Encoding and Decoding using AVX2 Instructions".
+
+__attribute__((target("ssse3")))
+inline __m128i encodeLookupSsse3(__m128i indices, Alphabet alphabet) {
+    // Map every 6 bit index to the offset that turns it into its character: 0-25 go
+    // to 'A', 26-51 to 'a', 52-61 to '0' and 62 and 63 to their own characters.
+    char char_62 = alphabet == Alphabet::Url ? '-' : '+';
+    char char_63 = alphabet == Alphabet::Url ? '_' : '/';
+    const __m128i shift_lut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '0' - 52, static_cast<char>(char_62 - 62),
+                                            static_cast<char>(char_63 - 63), 'A', 0, 0);
+    __m128i result = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    result = _mm_or_si128(result, _mm_and_si128(less, _mm_set1_epi8(13)));
+    result = _mm_shuffle_epi8(shift_lut, result);
+    return _mm_add_epi8(result, indices);
+}
+
+__attribute__((target("ssse3")))
+inline __m128i encodeSplitSsse3(__m128i input) {
+    // Spread 12 bytes over 16 lanes, then move each 6 bit group into its own byte.
+    input = _mm_shuffle_epi8(input, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    const __m128i t0 = _mm_and_si128(input, _mm_set1_epi32(0x0fc0fc00));
+    const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    const __m128i t2 = _mm_and_si128(input, _mm_set1_epi32(0x003f03f0));
+    const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t1, t3);
+}
+
+__attribute__((target("ssse3")))
+size_t encodeBlocksSsse3(const unsigned char* data, size_t size, char* out, Alphabet alphabet) {
+    size_t consumed = 0;
+    // 12 bytes are encoded per round but 16 are loaded.
+    for (; consumed + 16 <= size; consumed += 12, out += 16) {
+        __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + consumed));
+        __m128i result = encodeLookupSsse3(encodeSplitSsse3(input), alphabet);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), result);
+    }
+    return consumed;
+}
+
+__attribute__((target("ssse3")))
+inline bool decodeTranslateSsse3(__m128i input, Alphabet alphabet, __m128i& values) {
+    // Bytes above 0x7f compare as negative and so fall outside every range.
+    const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(input, _mm_set1_epi8('A' - 1)),
+                                        _mm_cmpgt_epi8(_mm_set1_epi8('Z' + 1), input));
+    const __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(input, _mm_set1_epi8('a' - 1)),
+                                        _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), input));
+    const __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(input, _mm_set1_epi8('0' - 1)),
+                                        _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), input));
+    char char_62 = alphabet == Alphabet::Url ? '-' : '+';
+    char char_63 = alphabet == Alphabet::Url ? '_' : '/';
+    const __m128i is_62 = _mm_cmpeq_epi8(input, _mm_set1_epi8(char_62));
+    const __m128i is_63 = _mm_cmpeq_epi8(input, _mm_set1_epi8(char_63));
+
+    const __m128i valid = _mm_or_si128(_mm_or_si128(upper, lower),
+                                       _mm_or_si128(digit, _mm_or_si128(is_62, is_63)));
+    if (_mm_movemask_epi8(valid) != 0xffff) {
+        return false;
+    }
+
+    __m128i shift = _mm_and_si128(upper, _mm_set1_epi8(-'A'));
+    shift = _mm_or_si128(shift, _mm_and_si128(lower, _mm_set1_epi8(26 - 'a')));
+    shift = _mm_or_si128(shift, _mm_and_si128(digit, _mm_set1_epi8(52 - '0')));
+    shift = _mm_or_si128(shift, _mm_and_si128(is_62, _mm_set1_epi8(static_cast<char>(62 - char_62))));
+    shift = _mm_or_si128(shift, _mm_and_si128(is_63, _mm_set1_epi8(static_cast<char>(63 - char_63))));
+    values = _mm_add_epi8(input, shift);
+    return true;
+}
+
+__attribute__((target("ssse3")))
+inline __m128i decodePackSsse3(__m128i values) {
+    // Join 4 x 6 bits into 24 bits per 32 bit lane, then gather the 3 bytes of every lane.
+    const __m128i merge_ab_and_bc = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    const __m128i merged = _mm_madd_epi16(merge_ab_and_bc, _mm_set1_epi32(0x00011000));
+    return _mm_shuffle_epi8(merged, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+__attribute__((target("ssse3")))
+size_t decodeBlocksSsse3(const char* data, size_t size, unsigned char* out, Alphabet alphabet) {
+    size_t consumed = 0;
+    for (; consumed + 16 <= size; consumed += 16, out += 12) {
+        __m128i values;
+        __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + consumed));
+        if (!decodeTranslateSsse3(input, alphabet, values)) {
+            break;
+        }
+        unsigned char bytes[16];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(bytes), decodePackSsse3(values));
+        memcpy(out, bytes, 12);
+    }
+    return consumed;
+}
+
+__attribute__((target("avx2")))
+size_t encodeBlocksAvx2(const unsigned char* data, size_t size, char* out, Alphabet alphabet) {
+    char char_62 = alphabet == Alphabet::Url ? '-' : '+';
+    char char_63 = alphabet == Alphabet::Url ? '_' : '/';
+    const __m256i shift_lut = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52,
+                                               '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                               '0' - 52, '0' - 52, '0' - 52, static_cast<char>(char_62 - 62),
+                                               static_cast<char>(char_63 - 63), 'A', 0, 0,
+                                               'a' - 26, '0' - 52, '0' - 52, '0' - 52,
+                                               '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                               '0' - 52, '0' - 52, '0' - 52, static_cast<char>(char_62 - 62),
+                                               static_cast<char>(char_63 - 63), 'A', 0, 0);
+    const __m256i spread = _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+                                           10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+
+    size_t consumed = 0;
+    // 24 bytes are encoded per round, 12 per 128 bit lane, but 28 are loaded.
+    for (; consumed + 28 <= size; consumed += 24, out += 32) {
+        __m256i input = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + consumed))),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + consumed + 12)),
+            1);
+        input = _mm256_shuffle_epi8(input, spread);
+        const __m256i t0 = _mm256_and_si256(input, _mm256_set1_epi32(0x0fc0fc00));
+        const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+        const __m256i t2 = _mm256_and_si256(input, _mm256_set1_epi32(0x003f03f0));
+        const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+        const __m256i indices = _mm256_or_si256(t1, t3);
+
+        __m256i result = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+        result = _mm256_or_si256(result, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+        result = _mm256_shuffle_epi8(shift_lut, result);
+        result = _mm256_add_epi8(result, indices);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), result);
+    }
+
+    // Leave the last few whole blocks to the SSSE3 loop.
+    return consumed + encodeBlocksSsse3(data + consumed, size - consumed, out, alphabet);
+}
+
+__attribute__((target("avx2")))
+size_t decodeBlocksAvx2(const char* data, size_t size, unsigned char* out, Alphabet alphabet) {
+    char char_62 = alphabet == Alphabet::Url ? '-' : '+';
+    char char_63 = alphabet == Alphabet::Url ? '_' : '/';
+    const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                          2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+    size_t consumed = 0;
+    for (; consumed + 32 <= size; consumed += 32, out += 24) {
+        const __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + consumed));
+        const __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(input, _mm256_set1_epi8('A' - 1)),
+                                               _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), input));
+        const __m256i lower = _mm256_and_si256(_mm256_cmpgt_epi8(input, _mm256_set1_epi8('a' - 1)),
+                                               _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), input));
+        const __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(input, _mm256_set1_epi8('0' - 1)),
+                                               _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), input));
+        const __m256i is_62 = _mm256_cmpeq_epi8(input, _mm256_set1_epi8(char_62));
+        const __m256i is_63 = _mm256_cmpeq_epi8(input, _mm256_set1_epi8(char_63));
+
+        const __m256i valid = _mm256_or_si256(_mm256_or_si256(upper, lower),
+                                              _mm256_or_si256(digit, _mm256_or_si256(is_62, is_63)));
+        if (_mm256_movemask_epi8(valid) != -1) {
+            break;
+        }
+
+        __m256i shift = _mm256_and_si256(upper, _mm256_set1_epi8(-'A'));
+        shift = _mm256_or_si256(shift, _mm256_and_si256(lower, _mm256_set1_epi8(26 - 'a')));
+        shift = _mm256_or_si256(shift, _mm256_and_si256(digit, _mm256_set1_epi8(52 - '0')));
+        shift = _mm256_or_si256(shift, _mm256_and_si256(is_62, _mm256_set1_epi8(static_cast<char>(62 - char_62))));
+        shift = _mm256_or_si256(shift, _mm256_and_si256(is_63, _mm256_set1_epi8(static_cast<char>(63 - char_63))));
+        const __m256i values = _mm256_add_epi8(input, shift);
+
+        const __m256i merge_ab_and_bc = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+        const __m256i merged = _mm256_madd_epi16(merge_ab_and_bc, _mm256_set1_epi32(0x00011000));
+        const __m256i packed = _mm256_shuffle_epi8(merged, pack);
+
+        unsigned char bytes[32];
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(bytes), packed);
+        memcpy(out, bytes, 12);
+        memcpy(out + 12, bytes + 16, 12);
+    }
+
+    return consumed + decodeBlocksSsse3(data + consumed, size - consumed, out, alphabet);
+}
+#endif // BASE64_X86_SIMD
+
+struct Codec {
+    Codec() {
+        encode_blocks = encodeBlocksScalar;
+        decode_blocks = decodeBlocksScalar;
+#ifdef BASE64_X86_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            encode_blocks = encodeBlocksAvx2;
+            decode_blocks = decodeBlocksAvx2;
+        }
+        else if (__builtin_cpu_supports("ssse3")) {
+            encode_blocks = encodeBlocksSsse3;
+            decode_blocks = decodeBlocksSsse3;
+        }
+#endif
+    }
+
+    EncodeBlocks encode_blocks;
+    DecodeBlocks decode_blocks;
+};
+
+const Codec& getCodec() {
+    static const Codec codec;
+    return codec;
+}
+
+} // namespace
+
+size_t EncodedSize(size_t size, Alphabet alphabet) {
+    if (alphabet == Alphabet::Url) {
+        return (size / 3) * 4 + (size % 3 == 0 ? 0 : size % 3 + 1);
+    }
+    return ((size + 2) / 3) * 4;
+}
+
+size_t Encode(const unsigned char* data, size_t size, char* out, Alphabet alphabet) {
+    size_t consumed = getCodec().encode_blocks(data, size, out, alphabet);
+    char* cursor = out + (consumed / 3) * 4;
+    consumed += encodeBlocksScalar(data + consumed, size - consumed, cursor, alphabet);
+    cursor = out + (consumed / 3) * 4;
+
+    size_t remaining = size - consumed;
+    if (remaining > 0) {
+        const char* chars = getAlphabet(alphabet);
+        uint32_t triple = static_cast<uint32_t>(data[consumed]) << 16;
+        if (remaining == 2) {
+            triple |= static_cast<uint32_t>(data[consumed + 1]) << 8;
+        }
+        *cursor++ = chars[(triple >> 18) & 0x3f];
+        *cursor++ = chars[(triple >> 12) & 0x3f];
+        if (remaining == 2) {
+            *cursor++ = chars[(triple >> 6) & 0x3f];
+        }
+        if (alphabet == Alphabet::Standard) {
+            if (remaining == 1) {
+                *cursor++ = '=';
+            }
+            *cursor++ = '=';
+        }
+    }
+    return static_cast<size_t>(cursor - out);
+}
+
+size_t MaxDecodedSize(size_t size) {
+    return (size / 4) * 3 + (size % 4 == 0 ? 0 : size % 4 - 1);
+}
+
+bool Decode(const char* data, size_t size, unsigned char* out, size_t& out_size, Alphabet alphabet) {
+    out_size = 0;
+
+    // Up to two padding characters, and only where they complete the last quantum.
+    size_t padding = 0;
+    while (size > 0 && padding < 2 && data[size - 1] == '=') {
+        size--;
+        padding++;
+    }
+    if (size % 4 == 1 || (padding > 0 && (size + padding) % 4 != 0)) {
+        return false;
+    }
+
+    size_t consumed = getCodec().decode_blocks(data, size, out, alphabet);
+    consumed += decodeBlocksScalar(data + consumed, size - consumed, out + (consumed / 4) * 3, alphabet);
+    unsigned char* cursor = out + (consumed / 4) * 3;
+
+    // Whatever is left is either a character outside the alphabet or the last
+    // two or three characters of unpadded or padded input.
+    size_t remaining = size - consumed;
+    if (remaining >= 4) {
+        return false;
+    }
+    if (remaining > 0) {
+        const uint8_t* values = getDecodeTable(alphabet).values;
+        uint32_t triple = 0;
+        for (size_t i = 0; i < remaining; i++) {
+            uint8_t value = values[static_cast<unsigned char>(data[consumed + i])];
+            if (value == BASE64_INVALID) {
+                return false;
+            }
+            triple |= static_cast<uint32_t>(value) << (18 - 6 * i);
+        }
+        *cursor++ = static_cast<unsigned char>(triple >> 16);
+        if (remaining == 3) {
+            *cursor++ = static_cast<unsigned char>(triple >> 8);
+        }
+    }
+
+    out_size = static_cast<size_t>(cursor - out);
+    return true;
+}
+
+} // base64
+} // attest
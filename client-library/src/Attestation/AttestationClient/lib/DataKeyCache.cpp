@@ -0,0 +1,223 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="DataKeyCache.cpp" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#ifdef PLATFORM_UNIX
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include "Logging.h"
+#include "DataKeyCache.h"
+
+// Upper bound on the number of keys held at once.
+#define MAX_DATA_KEY_CACHE_ENTRIES 64
+
+// Size of the arena slot holding one key. Large enough for anything an RSA 4096 key
+// can wrap, the TPM ephemeral key is RSA 2048.
+#define DATA_KEY_SLOT_SIZE 512
+
+using namespace attest;
+
+DataKeyCache::DataKeyCache(std::chrono::seconds ttl) : ttl_(ttl) {
+#ifdef PLATFORM_UNIX
+    long page_size = sysconf(_SC_PAGESIZE);
+    size_t size = MAX_DATA_KEY_CACHE_ENTRIES * DATA_KEY_SLOT_SIZE;
+    if (page_size > 0) {
+        size = (size + page_size - 1) / page_size * page_size;
+    }
+
+    void* arena = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena == MAP_FAILED) {
+        CLIENT_LOG_WARN("Failed to allocate the data key cache: %s", strerror(errno));
+        return;
+    }
+
+    // Keys must never reach swap or a core dump, without that the cache stays off.
+    if (mlock(arena, size) != 0) {
+        CLIENT_LOG_WARN("Failed to lock the data key cache in memory, check RLIMIT_MEMLOCK: %s", strerror(errno));
+        munmap(arena, size);
+        return;
+    }
+    if (madvise(arena, size, MADV_DONTDUMP) != 0) {
+        CLIENT_LOG_WARN("Failed to exclude the data key cache from core dumps: %s", strerror(errno));
+        munlock(arena, size);
+        munmap(arena, size);
+        return;
+    }
+#ifdef MADV_WIPEONFORK
+    // Forked children start without the keys. Older kernels do not know the flag.
+    madvise(arena, size, MADV_WIPEONFORK);
+#endif
+
+    arena_ = static_cast<unsigned char*>(arena);
+    arena_size_ = size;
+    free_slots_.reserve(MAX_DATA_KEY_CACHE_ENTRIES);
+    for (size_t i = MAX_DATA_KEY_CACHE_ENTRIES; i-- > 0;) {
+        free_slots_.push_back(i);
+    }
+#else
+    CLIENT_LOG_WARN("The data key cache is not supported on this platform");
+#endif
+}
+
+DataKeyCache::~DataKeyCache() {
+#ifdef PLATFORM_UNIX
+    if (arena_ != nullptr) {
+        OPENSSL_cleanse(arena_, arena_size_);
+        munlock(arena_, arena_size_);
+        munmap(arena_, arena_size_);
+    }
+#endif
+}
+
+bool DataKeyCache::Get(const Buffer& wrapped_key,
+                       const RsaScheme rsaWrapAlgId,
+                       const RsaHashAlg rsaHashAlgId,
+                       const PcrSet& pcrs,
+                       Buffer& key) {
+    if (arena_ == nullptr) {
+        return false;
+    }
+    std::string cache_key = getKey(wrapped_key, rsaWrapAlgId, rsaHashAlgId);
+    std::string pcr_digest = getPcrDigest(pcrs);
+    if (cache_key.empty() || pcr_digest.empty()) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    checkPcrs(pcr_digest);
+    auto it = entries_.find(cache_key);
+    if (it == entries_.end()) {
+        return false;
+    }
+    if (std::chrono::steady_clock::now() >= it->second.expiry) {
+        evict(it);
+        return false;
+    }
+    const unsigned char* data = slot(it->second.slot);
+    key.assign(data, data + it->second.size);
+    return true;
+}
+
+void DataKeyCache::Put(const Buffer& wrapped_key,
+                       const RsaScheme rsaWrapAlgId,
+                       const RsaHashAlg rsaHashAlgId,
+                       const PcrSet& pcrs,
+                       const Buffer& key) {
+    if (arena_ == nullptr || key.empty() || key.size() > DATA_KEY_SLOT_SIZE) {
+        return;
+    }
+    std::string cache_key = getKey(wrapped_key, rsaWrapAlgId, rsaHashAlgId);
+    std::string pcr_digest = getPcrDigest(pcrs);
+    if (cache_key.empty() || pcr_digest.empty()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    checkPcrs(pcr_digest);
+    auto now = std::chrono::steady_clock::now();
+    auto it = entries_.find(cache_key);
+    if (it != entries_.end()) {
+        evict(it);
+    }
+
+    if (free_slots_.empty()) {
+        // Make room by dropping the expired keys, or else the one that expires first.
+        for (auto entry = entries_.begin(); entry != entries_.end();) {
+            auto current = entry++;
+            if (now >= current->second.expiry) {
+                evict(current);
+            }
+        }
+        if (free_slots_.empty()) {
+            evict(std::min_element(entries_.begin(),
+                                   entries_.end(),
+                                   [](const std::pair<const std::string, Entry>& a,
+                                      const std::pair<const std::string, Entry>& b) {
+                                       return a.second.expiry < b.second.expiry;
+                                   }));
+        }
+    }
+
+    Entry entry;
+    entry.slot = free_slots_.back();
+    entry.size = key.size();
+    entry.expiry = now + ttl_;
+    free_slots_.pop_back();
+    std::memcpy(slot(entry.slot), key.data(), key.size());
+    entries_[cache_key] = entry;
+}
+
+std::string DataKeyCache::getKey(const Buffer& wrapped_key,
+                                 const RsaScheme rsaWrapAlgId,
+                                 const RsaHashAlg rsaHashAlgId) {
+    // The same wrapped key unwraps differently under another scheme, so it is part of the key.
+    Buffer input;
+    input.reserve(wrapped_key.size() + 4);
+    input.push_back(static_cast<unsigned char>(static_cast<uint16_t>(rsaWrapAlgId) >> 8));
+    input.push_back(static_cast<unsigned char>(rsaWrapAlgId));
+    input.push_back(static_cast<unsigned char>(static_cast<uint16_t>(rsaHashAlgId) >> 8));
+    input.push_back(static_cast<unsigned char>(rsaHashAlgId));
+    input.insert(input.end(), wrapped_key.begin(), wrapped_key.end());
+
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digest_size = 0;
+    if (!EVP_Digest(input.data(), input.size(), digest, &digest_size, EVP_sha256(), nullptr)) {
+        CLIENT_LOG_ERROR("Failed to hash the data key cache key");
+        return std::string();
+    }
+    return std::string(reinterpret_cast<const char*>(digest), digest_size);
+}
+
+std::string DataKeyCache::getPcrDigest(const PcrSet& pcrs) {
+    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digest_size = 0;
+    bool ok = ctx != nullptr && EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr) == 1;
+    const unsigned char hash_alg = static_cast<unsigned char>(pcrs.hashAlg);
+    ok = ok && EVP_DigestUpdate(ctx, &hash_alg, 1) == 1;
+    for (const PcrValue& pcr : pcrs.pcrs) {
+        const unsigned char size = static_cast<unsigned char>(pcr.digest.size());
+        ok = ok &&
+             EVP_DigestUpdate(ctx, &pcr.index, 1) == 1 &&
+             EVP_DigestUpdate(ctx, &size, 1) == 1 &&
+             EVP_DigestUpdate(ctx, pcr.digest.data(), pcr.digest.size()) == 1;
+    }
+    ok = ok && EVP_DigestFinal_ex(ctx, digest, &digest_size) == 1;
+    EVP_MD_CTX_free(ctx);
+    if (!ok) {
+        CLIENT_LOG_ERROR("Failed to hash the PCR values");
+        return std::string();
+    }
+    return std::string(reinterpret_cast<const char*>(digest), digest_size);
+}
+
+void DataKeyCache::checkPcrs(const std::string& pcr_digest) {
+    if (pcr_digest == pcr_digest_) {
+        return;
+    }
+    if (!entries_.empty()) {
+        CLIENT_LOG_INFO("PCR values changed, dropping %zu cached data keys", entries_.size());
+    }
+    while (!entries_.empty()) {
+        evict(entries_.begin());
+    }
+    pcr_digest_ = pcr_digest;
+}
+
+void DataKeyCache::evict(std::map<std::string, Entry>::iterator it) {
+    OPENSSL_cleanse(slot(it->second.slot), DATA_KEY_SLOT_SIZE);
+    free_slots_.push_back(it->second.slot);
+    entries_.erase(it);
+}
+
+unsigned char* DataKeyCache::slot(size_t index) const {
+    return arena_ + index * DATA_KEY_SLOT_SIZE;
+}
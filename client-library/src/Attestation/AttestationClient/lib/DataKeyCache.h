@@ -0,0 +1,115 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="DataKeyCache.h" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "AttestationLibTypes.h"
+#include "AttestationTypes.h"
+
+/**
+ * In memory cache of keys unwrapped by the TPM, keyed by a hash of the wrapped key.
+ *
+ * Unwrapping a key creates an ephemeral primary key and a PCR policy session in the TPM,
+ * which takes hundreds of milliseconds, so callers that decrypt the same wrapped key
+ * repeatedly can have the plaintext key kept for a while instead. The keys live in an
+ * arena that is locked into memory, excluded from core dumps and zeroed when a key is
+ * evicted. The PCR values a key was unwrapped under are part of the lookup: once they
+ * change, every key is dropped, since the TPM would no longer unwrap them.
+ *
+ * Only available on Linux. If the arena cannot be set up, for example because of the
+ * RLIMIT_MEMLOCK limit, the cache stays disabled and nothing is ever stored.
+ */
+class DataKeyCache {
+public:
+    /**
+     * @brief Sets up the locked arena.
+     * @param[in] ttl How long a key is kept after it was unwrapped.
+     */
+    explicit DataKeyCache(std::chrono::seconds ttl);
+
+    /**
+     * @brief Zeroes and releases the arena.
+     */
+    ~DataKeyCache();
+
+    DataKeyCache(const DataKeyCache&) = delete;
+    DataKeyCache& operator=(const DataKeyCache&) = delete;
+
+    /**
+     * @brief Returns whether the arena could be set up.
+     */
+    bool Enabled() const { return arena_ != nullptr; }
+
+    /**
+     * @brief This function will be used to look up an unwrapped key.
+     * @param[in] wrapped_key The wrapped key.
+     * @param[in] rsaWrapAlgId Rsa wrap algorithm id the key is wrapped with.
+     * @param[in] rsaHashAlgId Rsa hash algorithm id the key is wrapped with.
+     * @param[in] pcrs The current values of the PCRs the TPM key is bound to.
+     * All the keys are dropped if they differ from the values of the cached keys.
+     * @param[out] key The unwrapped key, to be cleansed by the caller.
+     * @return true if the key was found and has not expired.
+     */
+    bool Get(const attest::Buffer& wrapped_key,
+             const attest::RsaScheme rsaWrapAlgId,
+             const attest::RsaHashAlg rsaHashAlgId,
+             const attest::PcrSet& pcrs,
+             attest::Buffer& key);
+
+    /**
+     * @brief This function will be used to store a key the TPM unwrapped.
+     * @param[in] wrapped_key The wrapped key.
+     * @param[in] rsaWrapAlgId Rsa wrap algorithm id the key is wrapped with.
+     * @param[in] rsaHashAlgId Rsa hash algorithm id the key is wrapped with.
+     * @param[in] pcrs The PCR values the key was unwrapped under.
+     * @param[in] key The unwrapped key. Keys larger than a slot are not cached.
+     */
+    void Put(const attest::Buffer& wrapped_key,
+             const attest::RsaScheme rsaWrapAlgId,
+             const attest::RsaHashAlg rsaHashAlgId,
+             const attest::PcrSet& pcrs,
+             const attest::Buffer& key);
+
+private:
+    struct Entry {
+        size_t slot;
+        size_t size;
+        std::chrono::steady_clock::time_point expiry;
+    };
+
+    static std::string getKey(const attest::Buffer& wrapped_key,
+                              const attest::RsaScheme rsaWrapAlgId,
+                              const attest::RsaHashAlg rsaHashAlgId);
+
+    static std::string getPcrDigest(const attest::PcrSet& pcrs);
+
+    /**
+     * Drops the keys unwrapped under other PCR values. Called with mutex_ held.
+     */
+    void checkPcrs(const std::string& pcr_digest);
+
+    /**
+     * Zeroes the slot of an entry and frees it. Called with mutex_ held.
+     */
+    void evict(std::map<std::string, Entry>::iterator it);
+
+    unsigned char* slot(size_t index) const;
+
+    std::chrono::seconds ttl_;
+    unsigned char* arena_ = nullptr;
+    size_t arena_size_ = 0;
+
+    std::mutex mutex_;
+    std::string pcr_digest_;
+    std::map<std::string, Entry> entries_;
+    std::vector<size_t> free_slots_;
+};
@@ -0,0 +1,207 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="EnvelopeCipher.cpp" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+#include <cstring>
+#include <json/json.h>
+#include <openssl/crypto.h>
+#include "AttestationHelper.h"
+#include "Base64Codec.h"
+#include "EnvelopeCipher.h"
+#include "Logging.h"
+
+constexpr char metadata_version_key[] = "version";
+constexpr char metadata_algorithm_key[] = "alg";
+constexpr char metadata_chunk_size_key[] = "chunk_size";
+constexpr char metadata_nonce_prefix_key[] = "nonce_prefix";
+constexpr char metadata_wrapped_key_key[] = "wrapped_key";
+constexpr char metadata_algorithm[] = "A256GCM";
+
+using namespace attest;
+using namespace attest::envelope;
+
+namespace {
+
+/**
+ * Decodes a base64url encoded member of the metadata.
+ */
+bool getBinary(const Json::Value& object, const char* name, Buffer& value) {
+    const Json::Value& member = object[name];
+    if (!member.isString()) {
+        return false;
+    }
+    const std::string encoded = member.asString();
+    value.resize(base64::MaxDecodedSize(encoded.size()));
+    size_t size = 0;
+    if (!base64::Decode(encoded.data(), encoded.size(), value.data(), size, base64::Alphabet::Url)) {
+        return false;
+    }
+    value.resize(size);
+    return true;
+}
+
+} // namespace
+
+std::string attest::envelope::SerializeMetadata(const Metadata& metadata) {
+    Json::Value root(Json::objectValue);
+    root[metadata_version_key] = metadata.version;
+    root[metadata_algorithm_key] = metadata_algorithm;
+    root[metadata_chunk_size_key] = metadata.chunk_size;
+    root[metadata_nonce_prefix_key] = base64::binary_to_base64url(metadata.nonce_prefix);
+    root[metadata_wrapped_key_key] = base64::binary_to_base64url(metadata.wrapped_key);
+
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    std::string json = Json::writeString(builder, root);
+    return base64::binary_to_base64(Buffer(json.begin(), json.end()));
+}
+
+bool attest::envelope::ParseMetadata(const unsigned char* data, size_t size, Metadata& metadata) {
+    if (data == nullptr) {
+        return false;
+    }
+    if (size > 0 && data[size - 1] == '\0') {
+        size--;
+    }
+
+    Buffer json(base64::MaxDecodedSize(size));
+    size_t json_size = 0;
+    if (json.empty() ||
+        !base64::Decode(reinterpret_cast<const char*>(data), size, json.data(), json_size, base64::Alphabet::Standard)) {
+        CLIENT_LOG_ERROR("Encryption metadata is not base64 encoded");
+        return false;
+    }
+
+    Json::Value root;
+    Json::Reader reader;
+    const char* begin = reinterpret_cast<const char*>(json.data());
+    if (!reader.parse(begin, begin + json_size, root, false) || !root.isObject()) {
+        CLIENT_LOG_ERROR("Error parsing the encryption metadata");
+        return false;
+    }
+
+    if (!root[metadata_version_key].isUInt() ||
+        root[metadata_version_key].asUInt() != 1 ||
+        !root[metadata_algorithm_key].isString() ||
+        root[metadata_algorithm_key].asString() != metadata_algorithm) {
+        CLIENT_LOG_ERROR("Unsupported encryption metadata version or algorithm");
+        return false;
+    }
+
+    metadata.version = root[metadata_version_key].asUInt();
+    if (!root[metadata_chunk_size_key].isUInt() ||
+        (metadata.chunk_size = root[metadata_chunk_size_key].asUInt()) == 0 ||
+        metadata.chunk_size > max_chunk_size ||
+        !getBinary(root, metadata_nonce_prefix_key, metadata.nonce_prefix) ||
+        metadata.nonce_prefix.size() != nonce_prefix_size ||
+        !getBinary(root, metadata_wrapped_key_key, metadata.wrapped_key) ||
+        metadata.wrapped_key.empty()) {
+        CLIENT_LOG_ERROR("Invalid encryption metadata");
+        return false;
+    }
+    return true;
+}
+
+uint64_t attest::envelope::ChunkCount(uint64_t size, uint32_t chunk_size) {
+    return size == 0 ? 1 : (size + chunk_size - 1) / chunk_size;
+}
+
+uint64_t attest::envelope::EncryptedSize(uint64_t size, uint32_t chunk_size) {
+    return size + ChunkCount(size, chunk_size) * tag_size;
+}
+
+bool attest::envelope::DecryptedSize(uint64_t encrypted_size, uint32_t chunk_size, uint64_t& size) {
+    if (chunk_size == 0 || encrypted_size < tag_size) {
+        return false;
+    }
+    uint64_t frame_size = uint64_t(chunk_size) + tag_size;
+    uint64_t full_chunks = encrypted_size / frame_size;
+    uint64_t remainder = encrypted_size % frame_size;
+    if (remainder == 0) {
+        size = full_chunks * chunk_size;
+    }
+    else if (remainder >= tag_size) {
+        size = full_chunks * chunk_size + (remainder - tag_size);
+    }
+    else {
+        return false;
+    }
+    // Data that fills its last chunk has no trailing empty chunk, except empty data.
+    return (size == 0 || remainder != tag_size) &&
+           ChunkCount(size, chunk_size) <= max_chunk_count;
+}
+
+ChunkCipher::ChunkCipher(const unsigned char* key, const unsigned char* nonce_prefix) {
+    std::memcpy(key_, key, key_size);
+    std::memcpy(nonce_, nonce_prefix, nonce_prefix_size);
+}
+
+ChunkCipher::~ChunkCipher() {
+    EVP_CIPHER_CTX_free(encrypt_ctx_);
+    EVP_CIPHER_CTX_free(decrypt_ctx_);
+    OPENSSL_cleanse(key_, sizeof(key_));
+}
+
+bool ChunkCipher::setNonce(uint64_t index, bool encrypt) {
+    if (index >= max_chunk_count) {
+        return false;
+    }
+    nonce_[nonce_prefix_size] = static_cast<unsigned char>(index >> 24);
+    nonce_[nonce_prefix_size + 1] = static_cast<unsigned char>(index >> 16);
+    nonce_[nonce_prefix_size + 2] = static_cast<unsigned char>(index >> 8);
+    nonce_[nonce_prefix_size + 3] = static_cast<unsigned char>(index);
+
+    // The key schedule is only set up the first time, later chunks just change the nonce.
+    EVP_CIPHER_CTX*& ctx = encrypt ? encrypt_ctx_ : decrypt_ctx_;
+    if (ctx == nullptr) {
+        ctx = EVP_CIPHER_CTX_new();
+        if (ctx == nullptr ||
+            EVP_CipherInit_ex(ctx, EVP_aes_256_gcm(), NULL, key_, nonce_, encrypt ? 1 : 0) != 1) {
+            CLIENT_LOG_ERROR("Openssl Error: Failed to initialize evp cipher");
+            EVP_CIPHER_CTX_free(ctx);
+            ctx = nullptr;
+            return false;
+        }
+        return true;
+    }
+    return EVP_CipherInit_ex(ctx, NULL, NULL, NULL, nonce_, encrypt ? 1 : 0) == 1;
+}
+
+bool ChunkCipher::EncryptChunk(uint64_t index, bool last, const unsigned char* in, size_t size, unsigned char* out) {
+    const unsigned char aad = last ? 1 : 0;
+    int out_bytes = 0;
+    if (!setNonce(index, true) ||
+        EVP_EncryptUpdate(encrypt_ctx_, NULL, &out_bytes, &aad, 1) != 1 ||
+        (size > 0 && EVP_EncryptUpdate(encrypt_ctx_, out, &out_bytes, in, static_cast<int>(size)) != 1) ||
+        EVP_EncryptFinal_ex(encrypt_ctx_, out + size, &out_bytes) != 1 ||
+        EVP_CIPHER_CTX_ctrl(encrypt_ctx_, EVP_CTRL_GCM_GET_TAG, static_cast<int>(tag_size), out + size) != 1) {
+        CLIENT_LOG_ERROR("Openssl Error: Failed to encrypt chunk %llu", static_cast<unsigned long long>(index));
+        return false;
+    }
+    return true;
+}
+
+bool ChunkCipher::DecryptChunk(uint64_t index, bool last, const unsigned char* in, size_t size, unsigned char* out) {
+    if (size < tag_size) {
+        return false;
+    }
+    size -= tag_size;
+
+    // The tag is copied out first since out may overwrite in.
+    unsigned char tag[tag_size];
+    std::memcpy(tag, in + size, tag_size);
+
+    const unsigned char aad = last ? 1 : 0;
+    int out_bytes = 0;
+    if (!setNonce(index, false) ||
+        EVP_DecryptUpdate(decrypt_ctx_, NULL, &out_bytes, &aad, 1) != 1 ||
+        (size > 0 && EVP_DecryptUpdate(decrypt_ctx_, out, &out_bytes, in, static_cast<int>(size)) != 1) ||
+        EVP_CIPHER_CTX_ctrl(decrypt_ctx_, EVP_CTRL_GCM_SET_TAG, static_cast<int>(tag_size), tag) != 1 ||
+        EVP_DecryptFinal_ex(decrypt_ctx_, out + size, &out_bytes) != 1) {
+        CLIENT_LOG_ERROR("Failed to authenticate chunk %llu", static_cast<unsigned long long>(index));
+        return false;
+    }
+    return true;
+}
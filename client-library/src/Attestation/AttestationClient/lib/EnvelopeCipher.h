@@ -0,0 +1,139 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="EnvelopeCipher.h" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <openssl/evp.h>
+#include "AttestationTypes.h"
+
+namespace attest {
+namespace envelope {
+
+/**
+ * Format of EncryptionType::ENVELOPE_AES_GCM.
+ *
+ * The data is encrypted with a random AES-256 data encryption key (DEK) in chunks of
+ * chunk_size bytes, the last one possibly shorter. Every chunk is a separate AES-GCM
+ * message followed by its 16 byte tag, so chunk i starts at i * (chunk_size + 16) and
+ * chunks can be processed independently. Empty data is encrypted to a single empty chunk.
+ *
+ * The nonce of chunk i is the 8 byte random nonce prefix of the message followed by i as
+ * a 32 bit big endian integer. The additional authenticated data of a chunk is 1 for the
+ * last chunk and 0 for the others, so dropping chunks off the end is detected.
+ *
+ * The metadata is a base64 encoded JSON object holding the version, the chunk size, the
+ * nonce prefix and the DEK wrapped with the RSA key of the attestation token.
+ */
+constexpr size_t key_size = 32;
+constexpr size_t nonce_prefix_size = 8;
+constexpr size_t tag_size = 16;
+constexpr uint32_t default_chunk_size = 64 * 1024;
+constexpr uint32_t max_chunk_size = 16 * 1024 * 1024;
+constexpr uint64_t max_chunk_count = uint64_t(1) << 32;
+
+/**
+ * @brief The metadata of an envelope encrypted message.
+ */
+struct Metadata {
+    uint32_t version = 1; /**< The version of the format. */
+    uint32_t chunk_size = default_chunk_size; /**< The size of the plaintext of a full chunk. */
+    Buffer nonce_prefix; /**< The nonce prefix of the message. */
+    Buffer wrapped_key; /**< The DEK, encrypted with the RSA key of the token. */
+};
+
+/**
+ * @brief This function will be used to serialize the metadata to base64 encoded JSON.
+ * @param[in] metadata The metadata.
+ * @return The base64 encoded JSON.
+ */
+std::string SerializeMetadata(const Metadata& metadata);
+
+/**
+ * @brief This function will be used to parse metadata created by SerializeMetadata.
+ * @param[in] data The base64 encoded JSON.
+ * @param[in] size The size of data, a trailing null character is ignored.
+ * @param[out] metadata The metadata.
+ * @return true if the metadata is valid and of a supported version.
+ */
+bool ParseMetadata(const unsigned char* data, size_t size, Metadata& metadata);
+
+/**
+ * @brief Returns the number of chunks data of size bytes is encrypted to.
+ */
+uint64_t ChunkCount(uint64_t size, uint32_t chunk_size);
+
+/**
+ * @brief Returns the size data of size bytes is encrypted to.
+ */
+uint64_t EncryptedSize(uint64_t size, uint32_t chunk_size);
+
+/**
+ * @brief This function will be used to find the size of the plaintext of an encrypted
+ * message.
+ * @param[in] encrypted_size The size of the encrypted message.
+ * @param[in] chunk_size The chunk size of the message.
+ * @param[out] size The size of the plaintext.
+ * @return false if no plaintext encrypts to encrypted_size bytes.
+ */
+bool DecryptedSize(uint64_t encrypted_size, uint32_t chunk_size, uint64_t& size);
+
+/**
+ * AES-256-GCM cipher for the chunks of one message. The OpenSSL context is set up with
+ * the key once and reused for every chunk. A cipher must not be used by several threads
+ * at once; create one per thread instead.
+ */
+class ChunkCipher {
+public:
+    /**
+     * @brief Creates a cipher for a message.
+     * @param[in] key The DEK, key_size bytes.
+     * @param[in] nonce_prefix The nonce prefix of the message, nonce_prefix_size bytes.
+     */
+    ChunkCipher(const unsigned char* key, const unsigned char* nonce_prefix);
+
+    ~ChunkCipher();
+
+    ChunkCipher(const ChunkCipher&) = delete;
+    ChunkCipher& operator=(const ChunkCipher&) = delete;
+
+    /**
+     * @brief This function will be used to encrypt a chunk.
+     * @param[in] index The index of the chunk in the message.
+     * @param[in] last Whether the chunk is the last of the message.
+     * @param[in] in The plaintext of the chunk.
+     * @param[in] size The size of the plaintext, at most the chunk size.
+     * @param[out] out Receives the ciphertext followed by the tag, size + tag_size bytes.
+     * May be the same as in.
+     * @return false if OpenSSL failed.
+     */
+    bool EncryptChunk(uint64_t index, bool last, const unsigned char* in, size_t size, unsigned char* out);
+
+    /**
+     * @brief This function will be used to decrypt and authenticate a chunk.
+     * @param[in] index The index of the chunk in the message.
+     * @param[in] last Whether the chunk is the last of the message.
+     * @param[in] in The ciphertext followed by the tag.
+     * @param[in] size The size of in, at least tag_size.
+     * @param[out] out Receives the plaintext, size - tag_size bytes. May be the same as in.
+     * @return false if the chunk does not authenticate or OpenSSL failed. out must not be
+     * used then.
+     */
+    bool DecryptChunk(uint64_t index, bool last, const unsigned char* in, size_t size, unsigned char* out);
+
+private:
+    bool setNonce(uint64_t index, bool encrypt);
+
+    EVP_CIPHER_CTX* encrypt_ctx_ = nullptr;
+    EVP_CIPHER_CTX* decrypt_ctx_ = nullptr;
+    unsigned char key_[key_size];
+    unsigned char nonce_[nonce_prefix_size + 4];
+};
+
+} // envelope
+} // attest
@@ -0,0 +1,61 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="EventNotifier.cpp" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+#include <cstdint>
+#ifdef PLATFORM_UNIX
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+#include "Logging.h"
+#include "EventNotifier.h"
+
+EventNotifier::EventNotifier() {
+#ifdef PLATFORM_UNIX
+    fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd_ < 0) {
+        CLIENT_LOG_ERROR("Failed to create event notifier");
+    }
+#endif
+}
+
+EventNotifier::~EventNotifier() {
+#ifdef PLATFORM_UNIX
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+#endif
+}
+
+int EventNotifier::Fd() const {
+    return fd_;
+}
+
+void EventNotifier::Notify() {
+#ifdef PLATFORM_UNIX
+    if (fd_ < 0) {
+        return;
+    }
+
+    // Can only fail if the counter is about to overflow, in which case the
+    // descriptor is readable anyway.
+    uint64_t one = 1;
+    ssize_t written = write(fd_, &one, sizeof(one));
+    (void)written;
+#endif
+}
+
+void EventNotifier::Clear() {
+#ifdef PLATFORM_UNIX
+    if (fd_ < 0) {
+        return;
+    }
+
+    // Reading resets the counter; it fails with EAGAIN if there was no notification.
+    uint64_t count = 0;
+    ssize_t read_size = read(fd_, &count, sizeof(count));
+    (void)read_size;
+#endif
+}
@@ -0,0 +1,43 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="EventNotifier.h" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+#pragma once
+
+/**
+ * File descriptor that becomes readable when another thread has work for an event loop.
+ *
+ * Notifications do not queue up: any number of Notify() calls before Clear() wake up the
+ * loop once. Linux only, elsewhere Fd() returns -1 and Notify() does nothing.
+ */
+class EventNotifier {
+public:
+    EventNotifier();
+
+    ~EventNotifier();
+
+    EventNotifier(const EventNotifier&) = delete;
+    EventNotifier& operator=(const EventNotifier&) = delete;
+
+    /**
+     * @brief Returns the descriptor to wait on for reading, -1 if it could not be created.
+     */
+    int Fd() const;
+
+    /**
+     * @brief This function will be used to make the descriptor readable. It can be
+     * called from any thread.
+     */
+    void Notify();
+
+    /**
+     * @brief This function will be used to make the descriptor non-readable again.
+     * It never blocks.
+     */
+    void Clear();
+
+private:
+    int fd_ = -1;
+};
@@ -15,6 +15,7 @@
 #include <stdio.h>
 #include "Logging.h"
 #include "HttpClient.h"
+#include "HttpTransport.h"
 #include "Exceptions.h"
 #include "AttestationHelper.h"
 #include "AttestationClientImpl.h"
@@ -36,7 +37,8 @@ attest::AttestationResult HttpClient::InvokeHttpImdsRequest(std::string& http_re
     const std::string& content_type) {
     AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
 
-    CURL* curl = curl_easy_init();
+    HttpTransport::Handle curl_handle = HttpTransport::GetInstance().AcquireHandle(url);
+    CURL* curl = curl_handle.get();
     if (curl == nullptr) {
         CLIENT_LOG_ERROR("Failed to initialize curl for http request.");
         result.code_ = AttestationResult::ErrorCode::ERROR_CURL_INITIALIZATION;
@@ -136,7 +138,6 @@ attest::AttestationResult HttpClient::InvokeHttpImdsRequest(std::string& http_re
         result.description_ = std::string("Failed sending curl request with error:") + std::string(curl_easy_strerror(res));
     }
 
-    curl_easy_cleanup(curl);
     curl_slist_free_all(headers);
     return result;
 }
@@ -0,0 +1,183 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="HttpTransport.cpp" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+#include <cctype>
+#include <fstream>
+#include <iterator>
+#ifdef PLATFORM_UNIX
+#include <sys/stat.h>
+#endif
+#include "Logging.h"
+#include "HttpTransport.h"
+
+// Number of idle handles, and so open connections, kept per host.
+#define MAX_IDLE_HANDLES_PER_HOST 4
+
+constexpr char default_ca_bundle[] = "curl-ca-bundle.crt";
+
+HttpTransport& HttpTransport::GetInstance() {
+    // Never destroyed: handles may still be returned by detached threads while the
+    // process exits, and curl must not be torn down after the TLS library.
+    static HttpTransport* instance = new HttpTransport();
+    return *instance;
+}
+
+HttpTransport::HttpTransport() {
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
+    share_ = curl_share_init();
+    if (share_ != nullptr) {
+        curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, lockShare);
+        curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, unlockShare);
+        curl_share_setopt(share_, CURLSHOPT_USERDATA, this);
+        curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        // The connection cache is not shared: curl does not support sharing connections
+        // between threads, so every pooled handle keeps its own connection instead.
+    }
+    else {
+        CLIENT_LOG_WARN("Failed to create curl share object, connections will not be shared");
+    }
+
+    loadCaBundle();
+}
+
+HttpTransport::Handle HttpTransport::AcquireHandle(const std::string& url) {
+    std::string pool_key = getPoolKey(url);
+
+    CURL* curl = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        auto it = idle_handles_.find(pool_key);
+        if (it != idle_handles_.end() && !it->second.empty()) {
+            curl = it->second.back();
+            it->second.pop_back();
+        }
+    }
+
+    if (curl == nullptr) {
+        curl = curl_easy_init();
+        if (curl == nullptr) {
+            CLIENT_LOG_ERROR("Failed to initialize curl for http request.");
+            return Handle(nullptr, [](CURL*) {});
+        }
+    }
+
+    if (share_ != nullptr) {
+        curl_easy_setopt(curl, CURLOPT_SHARE, share_);
+    }
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+
+    // Timeouts must not rely on signals since requests run on several threads.
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+
+    if (pool_key.compare(0, 8, "https://") == 0) {
+        setCaOptions(curl);
+    }
+
+    return Handle(curl, [this, pool_key](CURL* handle) {
+        releaseHandle(pool_key, handle);
+    });
+}
+
+std::string HttpTransport::getPoolKey(const std::string& url) {
+    // scheme://host[:port] in lower case, everything after it is ignored.
+    size_t host_start = url.find("://");
+    host_start = host_start == std::string::npos ? 0 : host_start + 3;
+    size_t host_end = url.find_first_of("/?#", host_start);
+
+    std::string pool_key = url.substr(0, host_end);
+    for (auto& c : pool_key) {
+        c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+    }
+    return pool_key;
+}
+
+void HttpTransport::lockShare(CURL* handle, curl_lock_data data, curl_lock_access access, void* user_ptr) {
+    (void)handle;
+    (void)access;
+    static_cast<HttpTransport*>(user_ptr)->share_mutexes_[data].lock();
+}
+
+void HttpTransport::unlockShare(CURL* handle, curl_lock_data data, void* user_ptr) {
+    (void)handle;
+    static_cast<HttpTransport*>(user_ptr)->share_mutexes_[data].unlock();
+}
+
+void HttpTransport::releaseHandle(const std::string& pool_key, CURL* curl) {
+    if (curl == nullptr) {
+        return;
+    }
+
+    // Reset drops the options of the last request but keeps the open connection.
+    curl_easy_reset(curl);
+
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        std::vector<CURL*>& idle = idle_handles_[pool_key];
+        if (idle.size() < MAX_IDLE_HANDLES_PER_HOST) {
+            idle.push_back(curl);
+            return;
+        }
+    }
+    curl_easy_cleanup(curl);
+}
+
+void HttpTransport::loadCaBundle() {
+#ifdef PLATFORM_UNIX
+    ca_info_path_ = default_ca_bundle;
+
+    CURL* curl = curl_easy_init();
+    if (curl != nullptr) {
+        char* cainfo = NULL;
+        curl_easy_getinfo(curl, CURLINFO_CAINFO, &cainfo);
+        struct stat buffer;
+        if (cainfo && stat(cainfo, &buffer) == 0) {
+            ca_info_path_ = cainfo;
+        }
+        curl_easy_cleanup(curl);
+    }
+    CLIENT_LOG_INFO("Using ca info path: %s", ca_info_path_.c_str());
+
+#if LIBCURL_VERSION_NUM >= 0x074d00
+    // Keep the bundle in memory so it is not read from disk for every new connection.
+    std::ifstream ca_file(ca_info_path_, std::ios::in | std::ios::binary);
+    if (!ca_file.fail()) {
+        ca_bundle_.assign(std::istreambuf_iterator<char>(ca_file),
+                          std::istreambuf_iterator<char>());
+    }
+#endif
+#else
+    ca_info_path_ = default_ca_bundle;
+#endif
+}
+
+void HttpTransport::setCaOptions(CURL* curl) {
+#if defined(PLATFORM_UNIX) && LIBCURL_VERSION_NUM >= 0x074d00
+    if (!ca_bundle_.empty()) {
+        struct curl_blob blob;
+        blob.data = const_cast<char*>(ca_bundle_.data());
+        blob.len = ca_bundle_.size();
+        // The transport outlives every handle so curl does not need its own copy.
+        blob.flags = CURL_BLOB_NOCOPY;
+        curl_easy_setopt(curl, CURLOPT_CAINFO_BLOB, &blob);
+    }
+    else {
+        curl_easy_setopt(curl, CURLOPT_CAINFO, ca_info_path_.c_str());
+    }
+#else
+    curl_easy_setopt(curl, CURLOPT_CAINFO, ca_info_path_.c_str());
+#endif
+
+#ifndef PLATFORM_UNIX
+    curl_easy_setopt(curl, CURLOPT_SSL_OPTIONS, CURLSSLOPT_NATIVE_CA);
+#endif
+
+#if LIBCURL_VERSION_NUM >= 0x075700
+    // Keep the parsed CA store of a pooled handle instead of rebuilding it per connection.
+    curl_easy_setopt(curl, CURLOPT_CA_CACHE_TIMEOUT, 24L * 60 * 60);
+#endif
+}
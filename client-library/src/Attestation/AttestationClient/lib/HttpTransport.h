@@ -0,0 +1,71 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="HttpTransport.h" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <curl/curl.h>
+
+/**
+ * Library wide pool of curl easy handles.
+ *
+ * Handles are pooled per scheme and host and are reset rather than cleaned up after a
+ * request, so the connection they hold stays open and the next request to the same host
+ * skips the TCP and TLS handshakes. All handles are attached to one curl share object
+ * holding the DNS cache and TLS sessions, so a new connection can also reuse what another
+ * handle resolved or negotiated. The CA bundle is located and read once.
+ */
+class HttpTransport {
+public:
+    using Handle = std::unique_ptr<CURL, std::function<void(CURL*)>>;
+
+    /**
+     * @brief Returns the transport shared by all the HTTP clients of the library.
+     */
+    static HttpTransport& GetInstance();
+
+    HttpTransport(const HttpTransport&) = delete;
+    HttpTransport& operator=(const HttpTransport&) = delete;
+
+    /**
+     * @brief This function will be used to get a curl handle for a request to url.
+     * The handle comes with the share object, TCP keep-alive and, for https, the CA
+     * bundle already set. All other options are at their defaults.
+     * @param[in] url The url the request will be sent to.
+     * @return A handle that goes back to the pool when it is destroyed, or nullptr
+     * if no handle could be created.
+     */
+    Handle AcquireHandle(const std::string& url);
+
+private:
+    HttpTransport();
+
+    static std::string getPoolKey(const std::string& url);
+
+    static void lockShare(CURL* handle, curl_lock_data data, curl_lock_access access, void* user_ptr);
+
+    static void unlockShare(CURL* handle, curl_lock_data data, void* user_ptr);
+
+    void releaseHandle(const std::string& pool_key, CURL* curl);
+
+    void loadCaBundle();
+
+    void setCaOptions(CURL* curl);
+
+    CURLSH* share_ = nullptr;
+    std::mutex share_mutexes_[CURL_LOCK_DATA_LAST];
+
+    std::mutex pool_mutex_;
+    std::unordered_map<std::string, std::vector<CURL*>> idle_handles_;
+
+    std::string ca_info_path_;
+    std::string ca_bundle_;
+};
@@ -17,6 +17,7 @@
 #include <boost/uuid/uuid_io.hpp>
 #include "Logging.h"
 #include "ImdsClient.h"
+#include "HttpTransport.h"
 #include <stdio.h>
 #include <openssl/pem.h>
 #include <openssl/x509.h>
@@ -196,7 +197,8 @@ std::string ImdsClient::InvokeHttpRequest(
 		return http_response;
 	}
 
-	CURL* curl = curl_easy_init();
+	HttpTransport::Handle curl_handle = HttpTransport::GetInstance().AcquireHandle(url);
+	CURL* curl = curl_handle.get();
 	if (curl == nullptr) {
 		CLIENT_LOG_ERROR("Failed to initialize curl for http request.");
 		return http_response;
@@ -284,7 +286,6 @@ std::string ImdsClient::InvokeHttpRequest(
 		CLIENT_LOG_ERROR("curl_easy_perform() failed:%s", curl_easy_strerror(res));
 	}
 
-	curl_easy_cleanup(curl);
 	curl_slist_free_all(headers);
 	return http_response;
 }
@@ -4,11 +4,9 @@
 // </copyright>
 //-------------------------------------------------------------------------------------------------
 
-#include <json/json.h>
 #include <AttestationTypes.h>
 #include "IsolationInfo.h"
 #include "AttestationLibConst.h"
-#include "AttestationHelper.h"
 
 namespace attest {
     bool IsolationInfo::Validate() const {
@@ -20,27 +18,45 @@ namespace attest {
         return true;
     }
 
-    Json::Value IsolationInfo::ToJson() const {
-        Json::Value isolation_info;
+    void IsolationInfo::WriteJson(JsonStreamWriter& writer) const {
+        writer.BeginObject();
+        writer.Key(JSON_ISOLATION_TYPE_KEY);
         if (isolation_type_ == IsolationType::TRUSTED_LAUNCH) {
-            isolation_info[JSON_ISOLATION_TYPE_KEY] = JSON_ISOLATION_TYPE_TVM;
+            writer.String(JSON_ISOLATION_TYPE_TVM);
         }
         else {
-            isolation_info[JSON_ISOLATION_TYPE_KEY] = JSON_ISOLATION_TYPE_SEVSNP;
-
-            Json::Value isolation_evidence;
-            Json::Value proof;
-            proof[JSON_ISOLATION_EVIDENCE_SNPREPORT] = base64::binary_to_base64url(snp_report_);
-            proof[JSON_ISOLATION_EVIDENCE_VCEKCERT] = vcek_cert_;
-
-            Json::StreamWriterBuilder builder;
-            const std::string proof_str = Json::writeString(builder, proof);
-            isolation_evidence[JSON_ISOLATION_PROOF_KEY] = base64::base64_encode(proof_str);
-            isolation_evidence[JSON_ISOLATION_RUNTIME_DATA_KEY] = base64::binary_to_base64(runtime_data_);
-
-            isolation_info[JSON_ISOLATION_EVIDENCE_KEY] = isolation_evidence;
+            writer.String(JSON_ISOLATION_TYPE_SEVSNP);
+
+            // The proof is a document of its own, sent base64 encoded.
+            std::string proof;
+            proof.reserve(JsonStreamWriter::EncodedSize(snp_report_.size() * 4 / 3 + vcek_cert_.size() + 64,
+                                                        JsonStreamWriter::Output::Base64));
+            JsonStreamWriter proof_writer(proof, JsonStreamWriter::Output::Base64);
+            proof_writer.BeginObject();
+            proof_writer.Key(JSON_ISOLATION_EVIDENCE_SNPREPORT);
+            proof_writer.Base64(snp_report_.data(), snp_report_.size(), base64::Alphabet::Url);
+            proof_writer.Key(JSON_ISOLATION_EVIDENCE_VCEKCERT);
+            proof_writer.String(vcek_cert_);
+            proof_writer.EndObject();
+            proof_writer.Finish();
+
+            writer.Key(JSON_ISOLATION_EVIDENCE_KEY);
+            writer.BeginObject();
+            writer.Key(JSON_ISOLATION_PROOF_KEY);
+            writer.String(proof);
+            writer.Key(JSON_ISOLATION_RUNTIME_DATA_KEY);
+            writer.Base64(runtime_data_.data(), runtime_data_.size(), base64::Alphabet::Standard);
+            writer.EndObject();
         }
+        writer.EndObject();
+    }
 
-        return isolation_info;
+    size_t IsolationInfo::JsonSizeHint() const {
+        if (isolation_type_ == IsolationType::TRUSTED_LAUNCH) {
+            return 64;
+        }
+        // The report is encoded twice, the certificate once.
+        return (snp_report_.size() * 4 / 3 + vcek_cert_.size()) * 4 / 3 +
+               runtime_data_.size() * 4 / 3 + 256;
     }
 }// attest
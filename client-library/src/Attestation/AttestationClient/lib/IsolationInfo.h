@@ -5,8 +5,8 @@
 //-------------------------------------------------------------------------------------------------
 #pragma once
 
-#include <json/json.h>
 #include <AttestationTypes.h>
+#include "JsonStreamWriter.h"
 
 namespace attest {
     enum class IsolationType {
@@ -21,7 +21,12 @@ namespace attest {
     public:
 
         bool Validate() const;
-        Json::Value ToJson() const;
+        void WriteJson(JsonStreamWriter& writer) const;
+
+        /**
+         * @brief Returns roughly how many bytes WriteJson() writes.
+         */
+        size_t JsonSizeHint() const;
 
         IsolationType isolation_type_ = IsolationType::TRUSTED_LAUNCH;
         Buffer snp_report_;
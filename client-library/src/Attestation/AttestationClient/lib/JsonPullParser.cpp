@@ -0,0 +1,395 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="JsonPullParser.cpp" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include "JsonPullParser.h"
+
+bool JsonPullParser::Span::Equals(const char* value) const {
+    if (!escaped) {
+        return strlen(value) == size && memcmp(data, value, size) == 0;
+    }
+    std::string unescaped;
+    return Unescape(*this, unescaped) && unescaped == value;
+}
+
+JsonPullParser::JsonPullParser(const char* data, size_t size)
+    : cursor_(data),
+      end_(data + size) {}
+
+bool JsonPullParser::BeginObject() {
+    if (failed_) {
+        return false;
+    }
+    if (depth_ >= JSON_PULL_MAX_DEPTH || !consume('{')) {
+        return fail();
+    }
+    members_seen_ &= ~(1ULL << depth_);
+    depth_++;
+    return true;
+}
+
+bool JsonPullParser::NextMember(Span& key) {
+    if (failed_ || depth_ == 0) {
+        return fail();
+    }
+
+    uint64_t level_bit = 1ULL << (depth_ - 1);
+    bool seen = (members_seen_ & level_bit) != 0;
+    skipWhitespace();
+    if (cursor_ < end_ && *cursor_ == '}') {
+        cursor_++;
+        depth_--;
+        return false;
+    }
+    if (seen && !consume(',')) {
+        return fail();
+    }
+    members_seen_ |= level_bit;
+
+    skipWhitespace();
+    if (!scanString(key) || !consume(':')) {
+        return fail();
+    }
+    return true;
+}
+
+bool JsonPullParser::ReadString(Span& value) {
+    if (failed_) {
+        return false;
+    }
+    skipWhitespace();
+    return scanString(value) || fail();
+}
+
+bool JsonPullParser::ReadString(std::string& value) {
+    Span span;
+    if (!ReadString(span)) {
+        return false;
+    }
+    return Unescape(span, value) || fail();
+}
+
+bool JsonPullParser::ReadInt(int64_t& value) {
+    if (failed_) {
+        return false;
+    }
+    skipWhitespace();
+    const char* start = cursor_;
+    if (!scanNumber()) {
+        return fail();
+    }
+
+    // The number is not null terminated in the input, copy it out for strtoll.
+    std::string number(start, cursor_);
+    if (number.find_first_of(".eE") != std::string::npos) {
+        return fail();
+    }
+    errno = 0;
+    long long parsed = strtoll(number.c_str(), nullptr, 10);
+    if (errno != 0) {
+        return fail();
+    }
+    value = static_cast<int64_t>(parsed);
+    return true;
+}
+
+char JsonPullParser::Peek() {
+    skipWhitespace();
+    return cursor_ < end_ ? *cursor_ : '\0';
+}
+
+bool JsonPullParser::SkipValue() {
+    if (failed_) {
+        return false;
+    }
+
+    // Walk nested containers with an explicit stack, so a hostile document cannot
+    // exhaust the call stack.
+    char closers[JSON_PULL_MAX_DEPTH];
+    size_t depth = 0;
+    Span span;
+
+    while (true) {
+        skipWhitespace();
+        if (cursor_ >= end_) {
+            return fail();
+        }
+
+        // Read one value.
+        char c = *cursor_;
+        if (c == '{' || c == '[') {
+            if (depth_ + depth >= JSON_PULL_MAX_DEPTH) {
+                return fail();
+            }
+            cursor_++;
+            closers[depth] = c == '{' ? '}' : ']';
+            depth++;
+
+            skipWhitespace();
+            if (cursor_ < end_ && *cursor_ == closers[depth - 1]) {
+                cursor_++;
+                depth--;
+            }
+            else {
+                if (closers[depth - 1] == '}' && (!scanString(span) || !consume(':'))) {
+                    return fail();
+                }
+                continue;
+            }
+        }
+        else if (c == '"') {
+            if (!scanString(span)) {
+                return fail();
+            }
+        }
+        else if (c == 't') {
+            if (!scanLiteral("true")) {
+                return fail();
+            }
+        }
+        else if (c == 'f') {
+            if (!scanLiteral("false")) {
+                return fail();
+            }
+        }
+        else if (c == 'n') {
+            if (!scanLiteral("null")) {
+                return fail();
+            }
+        }
+        else if (!scanNumber()) {
+            return fail();
+        }
+
+        // Close every container the value completed, then move to the next item.
+        while (depth > 0) {
+            skipWhitespace();
+            if (consume(',')) {
+                if (closers[depth - 1] == '}') {
+                    skipWhitespace();
+                    if (!scanString(span) || !consume(':')) {
+                        return fail();
+                    }
+                }
+                break;
+            }
+            if (!consume(closers[depth - 1])) {
+                return fail();
+            }
+            depth--;
+        }
+        if (depth == 0) {
+            return true;
+        }
+    }
+}
+
+bool JsonPullParser::Finish() {
+    if (failed_ || depth_ != 0) {
+        return fail();
+    }
+    skipWhitespace();
+    return cursor_ == end_ || fail();
+}
+
+bool JsonPullParser::Unescape(const Span& span, std::string& value) {
+    if (!span.escaped) {
+        value.assign(span.data, span.size);
+        return true;
+    }
+
+    value.clear();
+    value.reserve(span.size);
+    const char* cursor = span.data;
+    const char* end = span.data + span.size;
+    while (cursor < end) {
+        if (*cursor != '\\') {
+            value.push_back(*cursor++);
+            continue;
+        }
+        if (++cursor >= end) {
+            return false;
+        }
+
+        char escape = *cursor++;
+        switch (escape) {
+            case '"': value.push_back('"'); break;
+            case '\\': value.push_back('\\'); break;
+            case '/': value.push_back('/'); break;
+            case 'b': value.push_back('\b'); break;
+            case 'f': value.push_back('\f'); break;
+            case 'n': value.push_back('\n'); break;
+            case 'r': value.push_back('\r'); break;
+            case 't': value.push_back('\t'); break;
+            case 'u': {
+                uint32_t code_point = 0;
+                for (int unit = 0; unit < 2; unit++) {
+                    if (end - cursor < 4) {
+                        return false;
+                    }
+                    uint32_t code_unit = 0;
+                    for (int i = 0; i < 4; i++) {
+                        char h = *cursor++;
+                        code_unit <<= 4;
+                        if (h >= '0' && h <= '9') code_unit |= static_cast<uint32_t>(h - '0');
+                        else if (h >= 'a' && h <= 'f') code_unit |= static_cast<uint32_t>(h - 'a' + 10);
+                        else if (h >= 'A' && h <= 'F') code_unit |= static_cast<uint32_t>(h - 'A' + 10);
+                        else return false;
+                    }
+
+                    if (unit == 0) {
+                        code_point = code_unit;
+                        // A high surrogate must be followed by an escaped low surrogate.
+                        if (code_unit < 0xd800 || code_unit > 0xdbff) {
+                            break;
+                        }
+                        if (end - cursor < 2 || cursor[0] != '\\' || cursor[1] != 'u') {
+                            return false;
+                        }
+                        cursor += 2;
+                    }
+                    else {
+                        if (code_unit < 0xdc00 || code_unit > 0xdfff) {
+                            return false;
+                        }
+                        code_point = 0x10000 + ((code_point - 0xd800) << 10) + (code_unit - 0xdc00);
+                    }
+                }
+
+                if (code_point < 0x80) {
+                    value.push_back(static_cast<char>(code_point));
+                }
+                else if (code_point < 0x800) {
+                    value.push_back(static_cast<char>(0xc0 | (code_point >> 6)));
+                    value.push_back(static_cast<char>(0x80 | (code_point & 0x3f)));
+                }
+                else if (code_point < 0x10000) {
+                    value.push_back(static_cast<char>(0xe0 | (code_point >> 12)));
+                    value.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3f)));
+                    value.push_back(static_cast<char>(0x80 | (code_point & 0x3f)));
+                }
+                else {
+                    value.push_back(static_cast<char>(0xf0 | (code_point >> 18)));
+                    value.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3f)));
+                    value.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3f)));
+                    value.push_back(static_cast<char>(0x80 | (code_point & 0x3f)));
+                }
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+bool JsonPullParser::fail() {
+    failed_ = true;
+    return false;
+}
+
+void JsonPullParser::skipWhitespace() {
+    while (cursor_ < end_ && (*cursor_ == ' ' || *cursor_ == '\t' || *cursor_ == '\n' || *cursor_ == '\r')) {
+        cursor_++;
+    }
+}
+
+bool JsonPullParser::consume(char c) {
+    skipWhitespace();
+    if (cursor_ < end_ && *cursor_ == c) {
+        cursor_++;
+        return true;
+    }
+    return false;
+}
+
+bool JsonPullParser::scanString(Span& span) {
+    if (cursor_ >= end_ || *cursor_ != '"') {
+        return false;
+    }
+
+    const char* start = ++cursor_;
+    bool escaped = false;
+    while (true) {
+        // Jump to the next quote, backslash or control character.
+        while (cursor_ < end_ &&
+               *cursor_ != '"' &&
+               *cursor_ != '\\' &&
+               static_cast<unsigned char>(*cursor_) >= 0x20) {
+            cursor_++;
+        }
+        if (cursor_ >= end_ || static_cast<unsigned char>(*cursor_) < 0x20) {
+            return false;
+        }
+        if (*cursor_ == '"') {
+            break;
+        }
+        // Escapes are only checked for their extent here, Unescape() validates them.
+        if (end_ - cursor_ < 2) {
+            return false;
+        }
+        escaped = true;
+        cursor_ += 2;
+    }
+
+    span.data = start;
+    span.size = static_cast<size_t>(cursor_ - start);
+    span.escaped = escaped;
+    cursor_++;
+    return true;
+}
+
+bool JsonPullParser::scanNumber() {
+    const char* start = cursor_;
+    if (cursor_ < end_ && *cursor_ == '-') {
+        cursor_++;
+    }
+
+    const char* digits = cursor_;
+    while (cursor_ < end_ && *cursor_ >= '0' && *cursor_ <= '9') {
+        cursor_++;
+    }
+    if (cursor_ == digits || (*digits == '0' && cursor_ - digits > 1)) {
+        cursor_ = start;
+        return false;
+    }
+
+    if (cursor_ < end_ && *cursor_ == '.') {
+        digits = ++cursor_;
+        while (cursor_ < end_ && *cursor_ >= '0' && *cursor_ <= '9') {
+            cursor_++;
+        }
+        if (cursor_ == digits) {
+            return false;
+        }
+    }
+
+    if (cursor_ < end_ && (*cursor_ == 'e' || *cursor_ == 'E')) {
+        cursor_++;
+        if (cursor_ < end_ && (*cursor_ == '+' || *cursor_ == '-')) {
+            cursor_++;
+        }
+        digits = cursor_;
+        while (cursor_ < end_ && *cursor_ >= '0' && *cursor_ <= '9') {
+            cursor_++;
+        }
+        if (cursor_ == digits) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool JsonPullParser::scanLiteral(const char* literal) {
+    size_t length = strlen(literal);
+    if (static_cast<size_t>(end_ - cursor_) < length || memcmp(cursor_, literal, length) != 0) {
+        return false;
+    }
+    cursor_ += length;
+    return true;
+}
@@ -0,0 +1,118 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="JsonPullParser.h" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Deepest nesting SkipValue() accepts.
+#define JSON_PULL_MAX_DEPTH 64
+
+/**
+ * Forward only JSON reader for pulling a few known fields out of a document.
+ *
+ * Nothing is allocated while reading: strings are returned as spans into the input and
+ * only unescaped when asked to, values the caller is not interested in are skipped
+ * without being materialized. The whole document is still checked for well formedness
+ * as it is walked.
+ *
+ * Once a call fails the parser stays failed and every further call returns false.
+ */
+class JsonPullParser {
+public:
+    /**
+     * A string value as it appears in the input, without the quotes.
+     */
+    struct Span {
+        const char* data = nullptr;
+        size_t size = 0;
+        bool escaped = false; /**< The span contains escape sequences. */
+
+        bool Equals(const char* value) const;
+    };
+
+    /**
+     * @brief Creates a parser over the given input. The input must outlive the parser.
+     */
+    JsonPullParser(const char* data, size_t size);
+
+    /**
+     * @brief This function will be used to step into an object.
+     * @return true if the next value is an object, which is consumed up to its first member.
+     */
+    bool BeginObject();
+
+    /**
+     * @brief This function will be used to move to the next member of the current object.
+     * @param[out] key The key of the member. Its value is read next.
+     * @return true if there is another member, false at the end of the object, which is
+     * then consumed, or on error.
+     */
+    bool NextMember(Span& key);
+
+    /**
+     * @brief This function will be used to read a string value as a span of the input.
+     */
+    bool ReadString(Span& value);
+
+    /**
+     * @brief This function will be used to read a string value, unescaped.
+     */
+    bool ReadString(std::string& value);
+
+    /**
+     * @brief This function will be used to read an integer value.
+     */
+    bool ReadInt(int64_t& value);
+
+    /**
+     * @brief Returns the first character of the next value, '\0' at the end of the input.
+     * Lets the caller check a value's type before reading it.
+     */
+    char Peek();
+
+    /**
+     * @brief This function will be used to skip over the next value, whatever its type.
+     */
+    bool SkipValue();
+
+    /**
+     * @brief This function will be used to check that nothing but white space follows
+     * the document.
+     */
+    bool Finish();
+
+    /**
+     * @brief Returns true once the input was found to be malformed.
+     */
+    bool Failed() const { return failed_; }
+
+    /**
+     * @brief This function will be used to unescape a string span.
+     */
+    static bool Unescape(const Span& span, std::string& value);
+
+private:
+    bool fail();
+
+    void skipWhitespace();
+
+    bool consume(char c);
+
+    bool scanString(Span& span);
+
+    bool scanNumber();
+
+    bool scanLiteral(const char* literal);
+
+    const char* cursor_;
+    const char* end_;
+    // Whether a member was already read in each open object, bit per nesting level.
+    uint64_t members_seen_ = 0;
+    size_t depth_ = 0;
+    bool failed_ = false;
+};
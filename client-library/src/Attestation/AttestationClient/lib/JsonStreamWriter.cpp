@@ -0,0 +1,212 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="JsonStreamWriter.cpp" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "JsonStreamWriter.h"
+
+using namespace attest;
+
+JsonStreamWriter::JsonStreamWriter(std::string& out, Output output)
+    : out_(out),
+      output_(output) {}
+
+void JsonStreamWriter::BeginObject() {
+    beginValue();
+    write('{');
+    scopes_.push_back({ false, true });
+}
+
+void JsonStreamWriter::EndObject() {
+    write('}');
+    scopes_.pop_back();
+}
+
+void JsonStreamWriter::BeginArray() {
+    beginValue();
+    write('[');
+    scopes_.push_back({ true, true });
+}
+
+void JsonStreamWriter::EndArray() {
+    write(']');
+    scopes_.pop_back();
+}
+
+void JsonStreamWriter::Key(const std::string& key) {
+    if (!scopes_.empty()) {
+        if (!scopes_.back().empty) {
+            write(',');
+        }
+        scopes_.back().empty = false;
+    }
+    writeEscaped(key);
+    write(':');
+    after_key_ = true;
+}
+
+void JsonStreamWriter::String(const std::string& value) {
+    beginValue();
+    writeEscaped(value);
+}
+
+void JsonStreamWriter::Base64(const unsigned char* data, size_t size, base64::Alphabet alphabet) {
+    beginValue();
+    write('"');
+
+    if (output_ == Output::Json) {
+        size_t offset = out_.size();
+        out_.resize(offset + base64::EncodedSize(size, alphabet));
+        base64::Encode(data, size, &out_[offset], alphabet);
+    }
+    else {
+        // Encode straight into the staging chunk, 3 input bytes per 4 characters, so
+        // the value is never held as a separate string.
+        while (size > 0) {
+            if (pending_size_ + 4 > sizeof(pending_)) {
+                flush(false);
+            }
+            size_t input_size = std::min(size, ((sizeof(pending_) - pending_size_) / 4) * 3);
+            pending_size_ += base64::Encode(data, input_size, pending_ + pending_size_, alphabet);
+            data += input_size;
+            size -= input_size;
+        }
+    }
+
+    write('"');
+}
+
+void JsonStreamWriter::Int(int64_t value) {
+    beginValue();
+    char buffer[24];
+    int length = snprintf(buffer, sizeof(buffer), "%lld", static_cast<long long>(value));
+    write(buffer, static_cast<size_t>(length));
+}
+
+void JsonStreamWriter::UInt(uint64_t value) {
+    beginValue();
+    char buffer[24];
+    int length = snprintf(buffer, sizeof(buffer), "%llu", static_cast<unsigned long long>(value));
+    write(buffer, static_cast<size_t>(length));
+}
+
+void JsonStreamWriter::Finish() {
+    flush(true);
+}
+
+size_t JsonStreamWriter::EncodedSize(size_t size, Output output) {
+    switch (output) {
+        case Output::Base64:
+            return base64::EncodedSize(size, base64::Alphabet::Standard);
+        case Output::Base64Url:
+            return base64::EncodedSize(size, base64::Alphabet::Url);
+        default:
+            return size;
+    }
+}
+
+void JsonStreamWriter::beginValue() {
+    if (after_key_) {
+        after_key_ = false;
+        return;
+    }
+    if (!scopes_.empty()) {
+        if (!scopes_.back().empty) {
+            write(',');
+        }
+        scopes_.back().empty = false;
+    }
+}
+
+void JsonStreamWriter::write(const char* data, size_t size) {
+    if (output_ == Output::Json) {
+        out_.append(data, size);
+        return;
+    }
+
+    while (size > 0) {
+        // A full chunk is only flushed once more data arrives, Base64() may leave it full.
+        if (pending_size_ == sizeof(pending_)) {
+            flush(false);
+        }
+        size_t chunk = std::min(size, sizeof(pending_) - pending_size_);
+        memcpy(pending_ + pending_size_, data, chunk);
+        pending_size_ += chunk;
+        data += chunk;
+        size -= chunk;
+    }
+}
+
+void JsonStreamWriter::write(char c) {
+    if (output_ == Output::Json) {
+        out_.push_back(c);
+        return;
+    }
+
+    if (pending_size_ == sizeof(pending_)) {
+        flush(false);
+    }
+    pending_[pending_size_++] = c;
+}
+
+void JsonStreamWriter::writeEscaped(const std::string& value) {
+    static const char hex_digits[] = "0123456789abcdef";
+
+    write('"');
+    size_t run_start = 0;
+    for (size_t i = 0; i < value.size(); i++) {
+        unsigned char c = static_cast<unsigned char>(value[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+
+        // Copy the run of plain characters in one go, then the escape.
+        write(value.data() + run_start, i - run_start);
+        run_start = i + 1;
+        switch (c) {
+            case '"':
+                write("\\\"", 2);
+                break;
+            case '\\':
+                write("\\\\", 2);
+                break;
+            case '\n':
+                write("\\n", 2);
+                break;
+            case '\r':
+                write("\\r", 2);
+                break;
+            case '\t':
+                write("\\t", 2);
+                break;
+            default: {
+                char escape[6] = { '\\', 'u', '0', '0', hex_digits[c >> 4], hex_digits[c & 0x0f] };
+                write(escape, sizeof(escape));
+                break;
+            }
+        }
+    }
+    write(value.data() + run_start, value.size() - run_start);
+    write('"');
+}
+
+void JsonStreamWriter::flush(bool last) {
+    if (output_ == Output::Json || pending_size_ == 0) {
+        return;
+    }
+
+    // Only the last flush may leave a partial group of 3 bytes, which is padded.
+    size_t size = last ? pending_size_ : (pending_size_ / 3) * 3;
+    base64::Alphabet alphabet = output_ == Output::Base64Url ? base64::Alphabet::Url : base64::Alphabet::Standard;
+
+    size_t offset = out_.size();
+    out_.resize(offset + base64::EncodedSize(size, alphabet));
+    base64::Encode(reinterpret_cast<const unsigned char*>(pending_), size, &out_[offset], alphabet);
+
+    memmove(pending_, pending_ + size, pending_size_ - size);
+    pending_size_ -= size;
+}
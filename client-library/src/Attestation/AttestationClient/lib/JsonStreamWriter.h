@@ -0,0 +1,108 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="JsonStreamWriter.h" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Base64Codec.h"
+
+// Raw bytes staged before they are base64 encoded into the output. A multiple of 3 so
+// only the last chunk can need padding.
+#define JSON_STREAM_CHUNK_SIZE (3 * 4096)
+
+/**
+ * Writes compact JSON straight into an output string, without building a document first.
+ *
+ * The JSON text can be base64 or base64url encoded on the fly: it is staged in a fixed
+ * chunk and every full chunk is encoded onto the end of the output, so the plain text
+ * never exists as a whole. Binary values are written as base64 strings the same way.
+ * The output is appended to, so the caller can write a prefix, reserve the space it
+ * expects and wrap the stream in an outer document.
+ *
+ * The writer does not check that the calls form a valid document.
+ */
+class JsonStreamWriter {
+public:
+    enum class Output {
+        Json,
+        Base64,
+        Base64Url
+    };
+
+    /**
+     * @brief Creates a writer appending to out.
+     * @param[in] out The string the output is appended to. Must outlive the writer.
+     * @param[in] output Whether the JSON text is written as is or base64 encoded.
+     */
+    JsonStreamWriter(std::string& out, Output output);
+
+    void BeginObject();
+
+    void EndObject();
+
+    void BeginArray();
+
+    void EndArray();
+
+    /**
+     * @brief Writes the key of the next object member.
+     */
+    void Key(const std::string& key);
+
+    /**
+     * @brief Writes a string value, escaped as needed.
+     */
+    void String(const std::string& value);
+
+    /**
+     * @brief Writes binary data as a base64 string value.
+     * @param[in] data The data to encode.
+     * @param[in] size The number of bytes in data.
+     * @param[in] alphabet The alphabet to encode with.
+     */
+    void Base64(const unsigned char* data, size_t size, attest::base64::Alphabet alphabet);
+
+    void Int(int64_t value);
+
+    void UInt(uint64_t value);
+
+    /**
+     * @brief This function will be used to flush the staged text once the document
+     * is complete. Nothing may be written afterwards.
+     */
+    void Finish();
+
+    /**
+     * @brief Returns the number of characters an encoded document of size bytes takes.
+     * Useful to reserve the output before writing.
+     */
+    static size_t EncodedSize(size_t size, Output output);
+
+private:
+    struct Scope {
+        bool array;
+        bool empty;
+    };
+
+    void beginValue();
+
+    void write(const char* data, size_t size);
+
+    void write(char c);
+
+    void writeEscaped(const std::string& value);
+
+    void flush(bool last);
+
+    std::string& out_;
+    Output output_;
+    std::vector<Scope> scopes_;
+    bool after_key_ = false;
+    size_t pending_size_ = 0;
+    char pending_[JSON_STREAM_CHUNK_SIZE];
+};
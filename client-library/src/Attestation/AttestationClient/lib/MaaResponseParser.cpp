@@ -0,0 +1,292 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="MaaResponseParser.cpp" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+#include "AttestationLibConst.h"
+#include "Base64Codec.h"
+#include "JsonPullParser.h"
+#include "MaaResponseParser.h"
+#include "NativeConverter.h"
+#include "Logging.h"
+
+using namespace attest;
+
+constexpr char maa_token_key[] = "token";
+
+namespace {
+
+/**
+ * Reads a string member value. Values of any other type are skipped and reported as
+ * absent, the same way a missing member is.
+ */
+bool readStringMember(JsonPullParser& parser,
+                      JsonPullParser::Span& value) {
+    if (parser.Peek() != '"') {
+        value = JsonPullParser::Span();
+        return parser.SkipValue();
+    }
+    return parser.ReadString(value);
+}
+
+/**
+ * Base64 decodes a string value into buffer, sized once up front. Escaped values (a
+ * serializer may write "/" as "\/") are unescaped first.
+ */
+bool decodeSpan(const JsonPullParser::Span& value,
+                base64::Alphabet alphabet,
+                attest::Buffer& buffer) {
+    std::string unescaped;
+    const char* data = value.data;
+    size_t size = value.size;
+    if (value.escaped) {
+        if (!JsonPullParser::Unescape(value, unescaped)) {
+            return false;
+        }
+        data = unescaped.data();
+        size = unescaped.size();
+    }
+
+    buffer.resize(base64::MaxDecodedSize(size));
+    size_t decoded_size = 0;
+    if (!buffer.empty() &&
+        !base64::Decode(data, size, buffer.data(), decoded_size, alphabet)) {
+        buffer.clear();
+        return false;
+    }
+    buffer.resize(decoded_size);
+    return true;
+}
+
+std::string toString(const JsonPullParser::Span& value) {
+    std::string str;
+    JsonPullParser::Unescape(value, str);
+    return str;
+}
+
+/**
+ * Spans of the envelope fields, pointing into the decoded token.
+ */
+struct EnvelopeFields {
+    JsonPullParser::Span encrypted_inner_key;
+    JsonPullParser::Span jwt;
+    JsonPullParser::Span authentication_data;
+    bool has_encryption_params = false;
+    JsonPullParser::Span block_mode;
+    JsonPullParser::Span block_padding;
+    JsonPullParser::Span cipher;
+    JsonPullParser::Span iv;
+    int64_t key_bits = 0;
+};
+
+bool readEncryptionParams(JsonPullParser& parser,
+                          EnvelopeFields& fields) {
+    if (parser.Peek() != '{') {
+        return parser.SkipValue();
+    }
+
+    fields.has_encryption_params = true;
+    parser.BeginObject();
+    JsonPullParser::Span key;
+    while (parser.NextMember(key)) {
+        bool read = true;
+        if (key.Equals(JSON_RESPONSE_BLOCK_MODE_KEY)) {
+            read = readStringMember(parser, fields.block_mode);
+        }
+        else if (key.Equals(JSON_RESPONSE_BLOCK_PADDING_KEY)) {
+            read = readStringMember(parser, fields.block_padding);
+        }
+        else if (key.Equals(JSON_RESPONSE_CIPHER_KEY)) {
+            read = readStringMember(parser, fields.cipher);
+        }
+        else if (key.Equals(JSON_RESPONSE_IV_KEY)) {
+            read = readStringMember(parser, fields.iv);
+        }
+        else if (key.Equals(JSON_RESPONSE_BLOCK_KEY_SIZE_KEY)) {
+            char next = parser.Peek();
+            if (next == '-' || (next >= '0' && next <= '9')) {
+                read = parser.ReadInt(fields.key_bits);
+            }
+            else {
+                fields.key_bits = 0;
+                read = parser.SkipValue();
+            }
+        }
+        else {
+            read = parser.SkipValue();
+        }
+
+        if (!read) {
+            return false;
+        }
+    }
+    return !parser.Failed();
+}
+
+} // namespace
+
+bool attest::ExtractMaaToken(const std::string& response,
+                             std::string& token) {
+    token.clear();
+
+    JsonPullParser parser(response.data(), response.size());
+    if (!parser.BeginObject()) {
+        return false;
+    }
+
+    JsonPullParser::Span key;
+    JsonPullParser::Span token_value;
+    while (parser.NextMember(key)) {
+        bool read = key.Equals(maa_token_key) ? readStringMember(parser, token_value) : parser.SkipValue();
+        if (!read) {
+            return false;
+        }
+    }
+    if (!parser.Finish() ||
+        !JsonPullParser::Unescape(token_value, token)) {
+        token.clear();
+        return false;
+    }
+    return true;
+}
+
+bool attest::ParseMaaEnvelope(const std::string& token,
+                              MaaEnvelope& envelope,
+                              std::string& err) {
+    err.clear();
+
+    // Decode the token into a buffer that every span below points into.
+    attest::Buffer decoded(base64::MaxDecodedSize(token.size()));
+    size_t decoded_size = 0;
+    if (!decoded.empty() &&
+        !base64::Decode(token.data(), token.size(), decoded.data(), decoded_size, base64::Alphabet::Url)) {
+        CLIENT_LOG_ERROR("Failed to decode AAS response");
+        err = std::string("Failed to parse AAS response");
+        return false;
+    }
+
+    EnvelopeFields fields;
+    JsonPullParser parser(reinterpret_cast<const char*>(decoded.data()), decoded_size);
+    if (!parser.BeginObject()) {
+        CLIENT_LOG_ERROR("Failed to parse AAS response");
+        err = std::string("Failed to parse AAS response");
+        return false;
+    }
+
+    JsonPullParser::Span key;
+    while (parser.NextMember(key)) {
+        bool read = true;
+        if (key.Equals(JSON_RESPONSE_ENC_INNER_KEY_KEY)) {
+            read = readStringMember(parser, fields.encrypted_inner_key);
+        }
+        else if (key.Equals(JSON_RESPONSE_JWT_KEY)) {
+            read = readStringMember(parser, fields.jwt);
+        }
+        else if (key.Equals(JSON_RESPONSE_AUTHENTICATION_DATA_KEY)) {
+            read = readStringMember(parser, fields.authentication_data);
+        }
+        else if (key.Equals(JSON_RESPONSE_EXCRYPTION_PARAMETERS_KEY)) {
+            read = readEncryptionParams(parser, fields);
+        }
+        else {
+            read = parser.SkipValue();
+        }
+
+        if (!read) {
+            break;
+        }
+    }
+    if (!parser.Finish()) {
+        CLIENT_LOG_ERROR("Failed to parse AAS response");
+        err = std::string("Failed to parse AAS response");
+        return false;
+    }
+
+    // Check the fields in the order the response was always validated in, so callers
+    // keep seeing the same errors.
+    if (fields.encrypted_inner_key.size == 0) {
+        CLIENT_LOG_ERROR("Failed to get encrypted inner key from response.");
+        err = std::string("Failed to get encrypted inner key from response.");
+        return false;
+    }
+
+    if (!fields.has_encryption_params) {
+        CLIENT_LOG_ERROR("Encryption parameters not found in response");
+        err = std::string("Failed to get encryption parameters from response.");
+        return false;
+    }
+
+    EncryptionParameters& params = envelope.encryption_params;
+    if (fields.block_mode.size == 0) {
+        CLIENT_LOG_ERROR("Block mode not found encryption parameters");
+        err = std::string("Failed to get block mode from encryption parameters");
+        return false;
+    }
+
+    if (!toNative(toString(fields.block_mode), params.block_mode)) {
+        CLIENT_LOG_ERROR("Unsupported block mode");
+        err = std::string("Unsupported block mode:") + toString(fields.block_mode);
+        return false;
+    }
+
+    if (fields.block_padding.size == 0) {
+        CLIENT_LOG_ERROR("Block padding not found encryption parameters");
+        err = std::string("Failed to get block padding from encryption parameters");
+        return false;
+    }
+
+    if (!toNative(toString(fields.block_padding), params.block_padding)) {
+        CLIENT_LOG_ERROR("Unsupported block padding");
+        err = std::string("Unsupported block padding:") + toString(fields.block_padding);
+        return false;
+    }
+
+    if (fields.cipher.size == 0) {
+        CLIENT_LOG_ERROR("Cipher algorithm not found encryption parameters");
+        err = std::string("Failed to get cipher algorithm from encryption parameters");
+        return false;
+    }
+
+    if (!toNative(toString(fields.cipher), params.cipher_alg)) {
+        CLIENT_LOG_ERROR("Unsupported cipher algorithm");
+        err = std::string("Unsupported cipher algorithm:") + toString(fields.cipher);
+        return false;
+    }
+
+    if (fields.key_bits <= 0) {
+        CLIENT_LOG_ERROR("Failed to get key bits from encryption parameters");
+        err = std::string("Failed to get key bits from encryption parameters");
+        return false;
+    }
+    params.key_size = static_cast<size_t>(fields.key_bits);
+
+    if (fields.iv.size == 0 ||
+        !decodeSpan(fields.iv, base64::Alphabet::Standard, params.iv)) {
+        CLIENT_LOG_ERROR("Failed to get iv from encryption parameters");
+        err = std::string("Failed to get iv from encryption parameters");
+        return false;
+    }
+
+    if (fields.authentication_data.size == 0 ||
+        !decodeSpan(fields.authentication_data, base64::Alphabet::Standard, params.authentication_data)) {
+        CLIENT_LOG_ERROR("Failed to get authentication data response");
+        err = std::string("Failed to get authentication data response");
+        return false;
+    }
+
+    if (!decodeSpan(fields.encrypted_inner_key, base64::Alphabet::Standard, envelope.encrypted_inner_key)) {
+        CLIENT_LOG_ERROR("Failed to get encrypted inner key from response.");
+        err = std::string("Failed to get encrypted inner key from response.");
+        return false;
+    }
+
+    if (fields.jwt.size == 0 ||
+        !decodeSpan(fields.jwt, base64::Alphabet::Standard, envelope.jwt_encrypted)) {
+        CLIENT_LOG_ERROR("Failed to get jwt from response.");
+        err = std::string("Failed to get jwt from response.");
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,47 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="MaaResponseParser.h" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <string>
+#include "TpmUnseal.h"
+
+namespace attest {
+
+/**
+ * @brief The fields of the encrypted token envelope returned by MAA that are needed to
+ * decrypt the jwt, with the binary fields already base64 decoded.
+ */
+struct MaaEnvelope {
+    attest::Buffer encrypted_inner_key; /**< The symmetric inner key, encrypted to the TPM ephemeral key. */
+    EncryptionParameters encryption_params; /**< Parameters the jwt was encrypted with. */
+    attest::Buffer jwt_encrypted; /**< The encrypted jwt. */
+};
+
+/**
+ * @brief This function will be used to extract the token from the json response from MAA.
+ * The response is read in a single pass, members other than the token are skipped over
+ * without being materialized.
+ * @param[in] response The json response from MAA.
+ * @param[out] token The token. Empty if the response does not contain one.
+ * @return true if the response is well formed json, false otherwise.
+ */
+bool ExtractMaaToken(const std::string& response,
+                     std::string& token);
+
+/**
+ * @brief This function will be used to parse the encrypted token envelope returned by MAA.
+ * The token is base64url decoded once and read in a single pass. Binary fields are base64
+ * decoded straight from the decoded token into the envelope buffers.
+ * @param[in] token The base64url encoded token.
+ * @param[out] envelope The MaaEnvelope object that will hold the parsed fields.
+ * @param[out] err In case of failure scenarios, err will be used to return the error description.
+ * @return On success, true will be returned and false will be returned on failure.
+ */
+bool ParseMaaEnvelope(const std::string& token,
+                      MaaEnvelope& envelope,
+                      std::string& err);
+}// attest
@@ -0,0 +1,215 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="NonceMerkleTree.cpp" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+#include <json/json.h>
+#include <openssl/evp.h>
+#include "Logging.h"
+#include "NonceMerkleTree.h"
+
+// Domain separation prefixes of the leaf and inner node hashes.
+#define MERKLE_LEAF_PREFIX 0x00
+#define MERKLE_NODE_PREFIX 0x01
+
+constexpr char proof_alg_key[] = "alg";
+constexpr char proof_alg_sha256[] = "sha256";
+constexpr char proof_leaf_index_key[] = "leaf_index";
+constexpr char proof_leaf_count_key[] = "leaf_count";
+constexpr char proof_root_key[] = "root";
+constexpr char proof_path_key[] = "path";
+constexpr char proof_position_key[] = "position";
+constexpr char proof_hash_key[] = "hash";
+constexpr char proof_position_left[] = "left";
+constexpr char proof_position_right[] = "right";
+
+bool NonceMerkleTree::Build(const std::vector<std::string>& nonces) {
+    levels_.clear();
+    if (nonces.empty()) {
+        return false;
+    }
+
+    std::vector<Hash> leaves(nonces.size());
+    for (size_t i = 0; i < nonces.size(); i++) {
+        if (!hashLeaf(nonces[i], leaves[i])) {
+            return false;
+        }
+    }
+    levels_.push_back(std::move(leaves));
+
+    while (levels_.back().size() > 1) {
+        const std::vector<Hash>& level = levels_.back();
+        std::vector<Hash> parents((level.size() + 1) / 2);
+        for (size_t i = 0; i + 1 < level.size(); i += 2) {
+            if (!hashNode(level[i], level[i + 1], parents[i / 2])) {
+                levels_.clear();
+                return false;
+            }
+        }
+        if (level.size() % 2 == 1) {
+            parents.back() = level.back();
+        }
+        levels_.push_back(std::move(parents));
+    }
+    return true;
+}
+
+std::string NonceMerkleTree::GetRootHex() const {
+    if (levels_.empty()) {
+        return std::string();
+    }
+    return toHex(levels_.back().front());
+}
+
+std::string NonceMerkleTree::GetProof(size_t index) const {
+    if (levels_.empty() || index >= levels_.front().size()) {
+        return std::string();
+    }
+
+    Json::Value path(Json::arrayValue);
+    size_t position = index;
+    for (size_t level = 0; level + 1 < levels_.size(); level++) {
+        size_t sibling = position ^ 1;
+        // The last node of an odd level has no sibling and moves up unchanged.
+        if (sibling < levels_[level].size()) {
+            Json::Value step;
+            step[proof_position_key] = sibling < position ? proof_position_left : proof_position_right;
+            step[proof_hash_key] = toHex(levels_[level][sibling]);
+            path.append(step);
+        }
+        position /= 2;
+    }
+
+    Json::Value proof;
+    proof[proof_alg_key] = proof_alg_sha256;
+    proof[proof_leaf_index_key] = static_cast<Json::UInt64>(index);
+    proof[proof_leaf_count_key] = static_cast<Json::UInt64>(levels_.front().size());
+    proof[proof_root_key] = GetRootHex();
+    proof[proof_path_key] = path;
+
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    return Json::writeString(builder, proof);
+}
+
+bool NonceMerkleTree::VerifyProof(const std::string& nonce,
+                                  const std::string& proof,
+                                  const std::string& root_hex) {
+    Json::Value root;
+    Json::Reader reader;
+    if (!reader.parse(proof, root) ||
+        !root.isObject() ||
+        !root[proof_alg_key].isString() ||
+        root[proof_alg_key].asString() != proof_alg_sha256 ||
+        !root[proof_root_key].isString() ||
+        root[proof_root_key].asString() != root_hex ||
+        !root[proof_path_key].isArray()) {
+        return false;
+    }
+
+    Hash hash;
+    if (!hashLeaf(nonce, hash)) {
+        return false;
+    }
+
+    for (const Json::Value& step : root[proof_path_key]) {
+        if (!step.isObject() ||
+            !step[proof_hash_key].isString() ||
+            !step[proof_position_key].isString()) {
+            return false;
+        }
+
+        Hash sibling;
+        if (!fromHex(step[proof_hash_key].asString(), sibling) ||
+            sibling.size() != hash.size()) {
+            return false;
+        }
+
+        std::string position = step[proof_position_key].asString();
+        Hash parent;
+        if (position == proof_position_left) {
+            if (!hashNode(sibling, hash, parent)) {
+                return false;
+            }
+        }
+        else if (position == proof_position_right) {
+            if (!hashNode(hash, sibling, parent)) {
+                return false;
+            }
+        }
+        else {
+            return false;
+        }
+        hash = parent;
+    }
+
+    return toHex(hash) == root_hex;
+}
+
+bool NonceMerkleTree::hashLeaf(const std::string& nonce, Hash& hash) {
+    std::string input(1, static_cast<char>(MERKLE_LEAF_PREFIX));
+    input.append(nonce);
+
+    hash.resize(EVP_MAX_MD_SIZE);
+    unsigned int hash_size = 0;
+    if (!EVP_Digest(input.data(), input.size(), hash.data(), &hash_size, EVP_sha256(), nullptr)) {
+        CLIENT_LOG_ERROR("Failed to hash nonce");
+        return false;
+    }
+    hash.resize(hash_size);
+    return true;
+}
+
+bool NonceMerkleTree::hashNode(const Hash& left, const Hash& right, Hash& hash) {
+    Hash input(1, MERKLE_NODE_PREFIX);
+    input.insert(input.end(), left.begin(), left.end());
+    input.insert(input.end(), right.begin(), right.end());
+
+    hash.resize(EVP_MAX_MD_SIZE);
+    unsigned int hash_size = 0;
+    if (!EVP_Digest(input.data(), input.size(), hash.data(), &hash_size, EVP_sha256(), nullptr)) {
+        CLIENT_LOG_ERROR("Failed to hash Merkle tree node");
+        return false;
+    }
+    hash.resize(hash_size);
+    return true;
+}
+
+std::string NonceMerkleTree::toHex(const Hash& hash) {
+    static const char hex_digits[] = "0123456789abcdef";
+    std::string hex;
+    hex.reserve(2 * hash.size());
+    for (unsigned char c : hash) {
+        hex.push_back(hex_digits[c >> 4]);
+        hex.push_back(hex_digits[c & 0x0f]);
+    }
+    return hex;
+}
+
+bool NonceMerkleTree::fromHex(const std::string& hex, Hash& hash) {
+    if (hex.size() % 2 != 0) {
+        return false;
+    }
+
+    auto nibble = [](char c) -> int {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        }
+        if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        }
+        return -1;
+    };
+
+    hash.clear();
+    for (size_t i = 0; i < hex.size(); i += 2) {
+        int high = nibble(hex[i]);
+        int low = nibble(hex[i + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        hash.push_back(static_cast<unsigned char>((high << 4) | low));
+    }
+    return true;
+}
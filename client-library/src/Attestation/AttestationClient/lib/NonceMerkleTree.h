@@ -0,0 +1,71 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="NonceMerkleTree.h" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+/**
+ * SHA-256 Merkle tree over a batch of nonces, used to bind many nonces into one token.
+ *
+ * Leaves are SHA-256(0x00 || nonce) and inner nodes SHA-256(0x01 || left || right), so a
+ * leaf can never be passed off as an inner node. A node without a sibling is carried up to
+ * the next level as is. The root goes into the client payload as lower case hex.
+ *
+ * The inclusion proof of a nonce is a JSON object:
+ *   {"alg":"sha256","leaf_index":i,"leaf_count":n,"root":"<hex>",
+ *    "path":[{"position":"left"|"right","hash":"<hex>"},...]}
+ * The path lists the siblings from the leaf up, with the side they are on. Hashing the
+ * leaf with each of them in turn gives the root.
+ */
+class NonceMerkleTree {
+public:
+    using Hash = std::vector<unsigned char>;
+
+    /**
+     * @brief This function will be used to build the tree.
+     * @param[in] nonces The nonces, in leaf order. Must not be empty.
+     * @return true on success, false if nonces is empty or hashing failed.
+     */
+    bool Build(const std::vector<std::string>& nonces);
+
+    /**
+     * @brief Returns the root of the tree as lower case hex.
+     */
+    std::string GetRootHex() const;
+
+    /**
+     * @brief This function will be used to get the inclusion proof of a nonce.
+     * @param[in] index The position of the nonce passed to Build().
+     * @return The proof as a JSON string, empty if index is out of range.
+     */
+    std::string GetProof(size_t index) const;
+
+    /**
+     * @brief This function will be used to check that a nonce is included under
+     * a root.
+     * @param[in] nonce The nonce.
+     * @param[in] proof The inclusion proof returned by GetProof().
+     * @param[in] root_hex The root bound into the token, as lower case hex.
+     * @return true if the proof is well formed and leads from the nonce to root_hex.
+     */
+    static bool VerifyProof(const std::string& nonce,
+                            const std::string& proof,
+                            const std::string& root_hex);
+
+private:
+    static bool hashLeaf(const std::string& nonce, Hash& hash);
+
+    static bool hashNode(const Hash& left, const Hash& right, Hash& hash);
+
+    static std::string toHex(const Hash& hash);
+
+    static bool fromHex(const std::string& hex, Hash& hash);
+
+    // levels_[0] holds the leaves, the last level holds the root.
+    std::vector<std::vector<Hash>> levels_;
+};
@@ -0,0 +1,152 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="RsaKeyCache.cpp" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include "Logging.h"
+#include "AttestationLibUtils.h"
+#include "RsaKeyCache.h"
+
+// Upper bound on the number of distinct keys held at once.
+#define MAX_RSA_KEY_CACHE_ENTRIES 16
+
+// Upper bound on the number of idle encryption contexts kept per key and scheme.
+#define MAX_RSA_KEY_IDLE_CONTEXTS 64
+
+using namespace attest;
+
+RsaKeyCache::Entry::~Entry() {
+    for (auto& idle : idle_contexts) {
+        for (EVP_PKEY_CTX* ctx : idle.second) {
+            EVP_PKEY_CTX_free(ctx);
+        }
+    }
+    EVP_PKEY_free(pkey);
+}
+
+RsaKeyCache::Context::~Context() {
+    release();
+}
+
+RsaKeyCache::Context::Context(Context&& other) noexcept
+    : entry_(std::move(other.entry_)),
+      scheme_(other.scheme_),
+      ctx_(other.ctx_) {
+    other.ctx_ = nullptr;
+}
+
+RsaKeyCache::Context& RsaKeyCache::Context::operator=(Context&& other) noexcept {
+    if (this != &other) {
+        release();
+        entry_ = std::move(other.entry_);
+        scheme_ = other.scheme_;
+        ctx_ = other.ctx_;
+        other.ctx_ = nullptr;
+    }
+    return *this;
+}
+
+void RsaKeyCache::Context::release() {
+    if (ctx_ != nullptr) {
+        std::lock_guard<std::mutex> lock(entry_->mutex);
+        std::vector<EVP_PKEY_CTX*>& idle = entry_->idle_contexts[scheme_];
+        if (idle.size() < MAX_RSA_KEY_IDLE_CONTEXTS) {
+            idle.push_back(ctx_);
+        }
+        else {
+            EVP_PKEY_CTX_free(ctx_);
+        }
+        ctx_ = nullptr;
+    }
+    entry_.reset();
+}
+
+AttestationResult RsaKeyCache::Acquire(const std::string& n,
+                                       const std::string& e,
+                                       int64_t expiry,
+                                       const RsaScheme rsaWrapAlgId,
+                                       const RsaHashAlg rsaHashAlgId,
+                                       Context& context) {
+    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+    auto now = std::chrono::system_clock::now();
+    auto key_expiry = std::chrono::system_clock::from_time_t(static_cast<time_t>(expiry));
+    bool cacheable = expiry > 0 && key_expiry > now;
+    std::string key = getKey(n, e);
+
+    std::shared_ptr<Entry> entry;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(key);
+        if (it != entries_.end()) {
+            if (now < it->second->expiry) {
+                entry = it->second;
+            }
+            else {
+                // Contexts still leased keep the key alive until they are released.
+                entries_.erase(it);
+            }
+        }
+    }
+
+    if (entry == nullptr) {
+        std::shared_ptr<Entry> new_entry = std::make_shared<Entry>();
+        if ((result = crypto::ConvertJwkToEvpPKey(n, e, &new_entry->pkey)).code_ !=
+                                                        AttestationResult::ErrorCode::SUCCESS) {
+            return result;
+        }
+        new_entry->expiry = key_expiry;
+        entry = new_entry;
+
+        if (cacheable) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = entries_.find(key);
+            if (it != entries_.end() && now < it->second->expiry) {
+                // Another caller converted the same key meanwhile, share theirs.
+                entry = it->second;
+            }
+            else {
+                if (it == entries_.end() && entries_.size() >= MAX_RSA_KEY_CACHE_ENTRIES) {
+                    // Make room by dropping the key that expires first.
+                    auto oldest = std::min_element(entries_.begin(),
+                                                   entries_.end(),
+                                                   [](const std::pair<const std::string, std::shared_ptr<Entry>>& a,
+                                                      const std::pair<const std::string, std::shared_ptr<Entry>>& b) {
+                                                       return a.second->expiry < b.second->expiry;
+                                                   });
+                    entries_.erase(oldest);
+                }
+                entries_[key] = entry;
+            }
+        }
+    }
+
+    std::pair<RsaScheme, RsaHashAlg> scheme(rsaWrapAlgId, rsaHashAlgId);
+    EVP_PKEY_CTX* ctx = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        std::vector<EVP_PKEY_CTX*>& idle = entry->idle_contexts[scheme];
+        if (!idle.empty()) {
+            ctx = idle.back();
+            idle.pop_back();
+        }
+    }
+
+    if (ctx == nullptr &&
+        (result = crypto::CreateRsaEncryptionContext(entry->pkey, rsaWrapAlgId, rsaHashAlgId, &ctx)).code_ !=
+                                                        AttestationResult::ErrorCode::SUCCESS) {
+        return result;
+    }
+
+    context.release();
+    context.entry_ = std::move(entry);
+    context.scheme_ = scheme;
+    context.ctx_ = ctx;
+    return result;
+}
+
+std::string RsaKeyCache::getKey(const std::string& n, const std::string& e) {
+    // base64url cannot contain a null character so the key is unambiguous.
+    return std::string(n).append(1, '\0').append(e);
+}
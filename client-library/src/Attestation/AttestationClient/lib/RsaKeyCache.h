@@ -0,0 +1,97 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="RsaKeyCache.h" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <openssl/evp.h>
+#include "AttestationLibTypes.h"
+
+/**
+ * In memory cache of the RSA public keys found in attestation tokens, keyed by the JWK.
+ *
+ * Converting a JWK to an EVP_PKEY and setting up an encryption context costs far more
+ * than the RSA operation itself, so a key and its encryption contexts are kept until the
+ * token they came from expires. Contexts are leased to one caller at a time and returned
+ * to the key once the lease ends, so concurrent Encrypt calls never share a context.
+ */
+class RsaKeyCache {
+private:
+    struct Entry;
+
+public:
+    /**
+     * Lease of an encryption context. The context goes back to its key on destruction.
+     */
+    class Context {
+    public:
+        Context() = default;
+        ~Context();
+
+        Context(const Context&) = delete;
+        Context& operator=(const Context&) = delete;
+        Context(Context&& other) noexcept;
+        Context& operator=(Context&& other) noexcept;
+
+        EVP_PKEY_CTX* get() const { return ctx_; }
+
+    private:
+        friend class RsaKeyCache;
+
+        void release();
+
+        std::shared_ptr<Entry> entry_;
+        std::pair<attest::RsaScheme, attest::RsaHashAlg> scheme_;
+        EVP_PKEY_CTX* ctx_ = nullptr;
+    };
+
+    RsaKeyCache() = default;
+
+    RsaKeyCache(const RsaKeyCache&) = delete;
+    RsaKeyCache& operator=(const RsaKeyCache&) = delete;
+
+    /**
+     * @brief This function will be used to get an encryption context for a JWK,
+     * converting the JWK and creating the context only if none is cached.
+     * @param[in] n The base64url encoded modulus of the RSA public key.
+     * @param[in] e The base64url encoded exponent of the RSA public key.
+     * @param[in] expiry The exp claim of the token the key comes from, in seconds
+     * since the epoch. Keys with no expiry (0) are used once and not cached.
+     * @param[in] rsaWrapAlgId Rsa wrap algorithm id.
+     * @param[in] rsaHashAlgId Rsa hash algorithm id.
+     * @param[out] context The leased encryption context.
+     * @return On sucess, AttestationResult::ErrorCode::SUCCESS and context is set.
+     * On failure, the error of the JWK conversion or context creation.
+     */
+    attest::AttestationResult Acquire(const std::string& n,
+                                      const std::string& e,
+                                      int64_t expiry,
+                                      const attest::RsaScheme rsaWrapAlgId,
+                                      const attest::RsaHashAlg rsaHashAlgId,
+                                      Context& context);
+
+private:
+    struct Entry {
+        ~Entry();
+
+        EVP_PKEY* pkey = nullptr;
+        std::chrono::system_clock::time_point expiry;
+
+        std::mutex mutex;
+        std::map<std::pair<attest::RsaScheme, attest::RsaHashAlg>, std::vector<EVP_PKEY_CTX*>> idle_contexts;
+    };
+
+    static std::string getKey(const std::string& n, const std::string& e);
+
+    std::mutex mutex_;
+    std::map<std::string, std::shared_ptr<Entry>> entries_;
+};
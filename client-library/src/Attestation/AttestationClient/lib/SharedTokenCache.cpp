@@ -0,0 +1,225 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="SharedTokenCache.cpp" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+#include <ctime>
+#include <openssl/evp.h>
+#ifdef PLATFORM_UNIX
+#include <dirent.h>
+#include <unistd.h>
+#endif
+#include "Logging.h"
+#include "AttestationLibUtils.h"
+#include "SharedTokenCache.h"
+
+constexpr char default_token_cache_dir[] = "/var/cache/azguestattestation/tokens";
+constexpr char token_cache_file_prefix[] = "token-";
+constexpr char token_cache_file_suffix[] = ".cache";
+constexpr char token_cache_lock_prefix[] = "lock-";
+
+using namespace attest;
+
+SharedTokenCache::SharedTokenCache() : cache_dir_(default_token_cache_dir) {}
+
+SharedTokenCache::SharedTokenCache(const std::string& cache_dir) : cache_dir_(cache_dir) {}
+
+AttestationResult SharedTokenCache::GetOrAttest(const std::string& endpoint_url,
+                                                const std::string& client_payload,
+                                                std::chrono::seconds min_validity,
+                                                const Attester& attest,
+                                                std::string& jwt_token) const {
+#ifdef PLATFORM_UNIX
+    if (!os::CreatePrivateDirectory(cache_dir_)) {
+        CLIENT_LOG_WARN("Token cache directory is not available, skipping cache");
+        return attest(jwt_token);
+    }
+
+    std::string key = getKey(endpoint_url, client_payload);
+    if (key.empty()) {
+        return attest(jwt_token);
+    }
+
+    if (getEntry(key, min_validity, jwt_token)) {
+        CLIENT_LOG_INFO("Using token from the shared token cache");
+        return AttestationResult(AttestationResult::ErrorCode::SUCCESS);
+    }
+
+    // Serialize attestation for this entry across processes. Whoever gets the lock
+    // first attests, everyone queued behind it finds the token on the second look.
+    int lock_fd = os::LockFile(getLockPath(key));
+    if (lock_fd >= 0 && getEntry(key, min_validity, jwt_token)) {
+        os::UnlockFile(lock_fd);
+        CLIENT_LOG_INFO("Using token from the shared token cache");
+        return AttestationResult(AttestationResult::ErrorCode::SUCCESS);
+    }
+
+    AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+    try {
+        result = attest(jwt_token);
+    }
+    catch (...) {
+        os::UnlockFile(lock_fd);
+        throw;
+    }
+
+    if (result.code_ == AttestationResult::ErrorCode::SUCCESS) {
+        putEntry(key, jwt_token);
+        evictExpired();
+    }
+    os::UnlockFile(lock_fd);
+    return result;
+#else
+    return attest(jwt_token);
+#endif
+}
+
+bool SharedTokenCache::Get(const std::string& endpoint_url,
+                           const std::string& client_payload,
+                           std::chrono::seconds min_validity,
+                           std::string& jwt_token) const {
+#ifdef PLATFORM_UNIX
+    // Only trust entries from a directory nobody else can write to.
+    if (!os::CreatePrivateDirectory(cache_dir_)) {
+        return false;
+    }
+
+    std::string key = getKey(endpoint_url, client_payload);
+    return !key.empty() && getEntry(key, min_validity, jwt_token);
+#else
+    return false;
+#endif
+}
+
+void SharedTokenCache::Put(const std::string& endpoint_url,
+                           const std::string& client_payload,
+                           const std::string& jwt_token) const {
+#ifdef PLATFORM_UNIX
+    if (!os::CreatePrivateDirectory(cache_dir_)) {
+        return;
+    }
+
+    std::string key = getKey(endpoint_url, client_payload);
+    if (key.empty()) {
+        return;
+    }
+    putEntry(key, jwt_token);
+    evictExpired();
+#endif
+}
+
+std::string SharedTokenCache::getKey(const std::string& endpoint_url,
+                                     const std::string& client_payload) {
+    // The endpoint URL cannot contain a null character so the input is unambiguous.
+    std::string input = std::string(endpoint_url).append(1, '\0').append(client_payload);
+
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digest_size = 0;
+    if (!EVP_Digest(input.data(), input.size(), digest, &digest_size, EVP_sha256(), nullptr)) {
+        CLIENT_LOG_ERROR("Failed to hash the token cache key");
+        return std::string();
+    }
+
+    static const char hex_digits[] = "0123456789abcdef";
+    std::string key;
+    key.reserve(2 * digest_size);
+    for (unsigned int i = 0; i < digest_size; i++) {
+        key.push_back(hex_digits[digest[i] >> 4]);
+        key.push_back(hex_digits[digest[i] & 0x0f]);
+    }
+    return key;
+}
+
+bool SharedTokenCache::getEntry(const std::string& key,
+                                std::chrono::seconds min_validity,
+                                std::string& jwt_token) const {
+#ifdef PLATFORM_UNIX
+    std::string cached_token;
+    if (!os::ReadFile(getEntryPath(key), cached_token) ||
+        cached_token.empty()) {
+        return false;
+    }
+
+    int64_t not_before = 0;
+    int64_t expiry = 0;
+    if (!jwt::ExtractValidityFromAttestationJwt(cached_token, not_before, expiry)) {
+        return false;
+    }
+
+    int64_t now = static_cast<int64_t>(time(nullptr));
+    if (now < not_before || now + min_validity.count() >= expiry) {
+        return false;
+    }
+
+    jwt_token = cached_token;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void SharedTokenCache::putEntry(const std::string& key, const std::string& jwt_token) const {
+#ifdef PLATFORM_UNIX
+    if (!os::WriteFileAtomically(getEntryPath(key), jwt_token)) {
+        CLIENT_LOG_WARN("Failed to store token in the shared token cache");
+    }
+#endif
+}
+
+void SharedTokenCache::evictExpired() const {
+#ifdef PLATFORM_UNIX
+    DIR* dir = opendir(cache_dir_.c_str());
+    if (dir == nullptr) {
+        return;
+    }
+
+    const std::string prefix(token_cache_file_prefix);
+    const std::string suffix(token_cache_file_suffix);
+    const std::string lock_prefix(token_cache_lock_prefix);
+    int64_t now = static_cast<int64_t>(time(nullptr));
+    struct dirent* dir_entry = nullptr;
+    while ((dir_entry = readdir(dir)) != nullptr) {
+        std::string name(dir_entry->d_name);
+        if (name.size() > lock_prefix.size() &&
+            name.compare(0, lock_prefix.size(), lock_prefix) == 0) {
+            // Lock files of attestations that never stored a token.
+            std::string key = name.substr(lock_prefix.size());
+            if (access(getEntryPath(key).c_str(), F_OK) != 0) {
+                os::RemoveLockFile(getLockPath(key));
+            }
+            continue;
+        }
+
+        if (name.size() <= prefix.size() + suffix.size() ||
+            name.compare(0, prefix.size(), prefix) != 0 ||
+            name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0) {
+            continue;
+        }
+
+        // Entries are only ever replaced by rename, so a concurrent refresh at worst
+        // turns into a cache miss for the next reader.
+        std::string path = cache_dir_ + "/" + name;
+        std::string cached_token;
+        int64_t not_before = 0;
+        int64_t expiry = 0;
+        if (!os::ReadFile(path, cached_token) ||
+            !jwt::ExtractValidityFromAttestationJwt(cached_token, not_before, expiry) ||
+            now >= expiry) {
+            unlink(path.c_str());
+            // A lock that is held stays behind and is picked up by a later sweep.
+            std::string key = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+            os::RemoveLockFile(getLockPath(key));
+        }
+    }
+    closedir(dir);
+#endif
+}
+
+std::string SharedTokenCache::getEntryPath(const std::string& key) const {
+    return cache_dir_ + "/" + token_cache_file_prefix + key + token_cache_file_suffix;
+}
+
+std::string SharedTokenCache::getLockPath(const std::string& key) const {
+    return cache_dir_ + "/" + token_cache_lock_prefix + key;
+}
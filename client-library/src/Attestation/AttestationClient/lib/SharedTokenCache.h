@@ -0,0 +1,104 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="SharedTokenCache.h" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include "AttestationLibTypes.h"
+
+/**
+ * On disk cache of attestation tokens shared by all the processes on the machine.
+ *
+ * Entries are keyed by a hash of the attestation endpoint and client payload. A token
+ * is served while the current time is between its nbf and exp claims. Processes that
+ * miss take a file lock for the entry before attesting, so when several processes ask
+ * for the same token at once only one of them attests and the others read its result.
+ * Entries are replaced atomically. Whenever a new token is stored, expired entries are
+ * removed together with their lock files, as are lock files of attestations that
+ * failed.
+ *
+ * The cache lives in a directory readable by root only; if the directory cannot be
+ * created or is not private to the current user the cache is bypassed.
+ */
+class SharedTokenCache {
+public:
+    using Attester = std::function<attest::AttestationResult(std::string& jwt_token)>;
+
+    /**
+     * @brief Creates a cache backed by the default root-only cache directory.
+     */
+    SharedTokenCache();
+
+    /**
+     * @brief Creates a cache backed by the given directory.
+     * @param[in] cache_dir The directory the entries are stored in.
+     */
+    explicit SharedTokenCache(const std::string& cache_dir);
+
+    /**
+     * @brief This function will be used to get a token from the cache, or to attest
+     * and store the token if there is no usable cached token.
+     * @param[in] endpoint_url The attestation endpoint the token is issued by.
+     * @param[in] client_payload The client payload the token is issued for.
+     * @param[in] min_validity A cached token is only used if it stays valid for at
+     * least this long.
+     * @param[in] attest Performs the attestation on a miss.
+     * @param[out] jwt_token The token.
+     * @return The result of attest on a miss. On a hit, AttestationResult object
+     * with error code ErrorCode::Success.
+     */
+    attest::AttestationResult GetOrAttest(const std::string& endpoint_url,
+                                          const std::string& client_payload,
+                                          std::chrono::seconds min_validity,
+                                          const Attester& attest,
+                                          std::string& jwt_token) const;
+
+    /**
+     * @brief This function will be used to look up a token without taking the
+     * entry lock, for callers that must not block on another process.
+     * @param[in] endpoint_url The attestation endpoint the token is issued by.
+     * @param[in] client_payload The client payload the token is issued for.
+     * @param[in] min_validity A cached token is only used if it stays valid for at
+     * least this long.
+     * @param[out] jwt_token The cached token.
+     * @return true if a usable token was found.
+     */
+    bool Get(const std::string& endpoint_url,
+             const std::string& client_payload,
+             std::chrono::seconds min_validity,
+             std::string& jwt_token) const;
+
+    /**
+     * @brief This function will be used to store a token attested without going
+     * through GetOrAttest().
+     * @param[in] endpoint_url The attestation endpoint the token is issued by.
+     * @param[in] client_payload The client payload the token is issued for.
+     * @param[in] jwt_token The token.
+     */
+    void Put(const std::string& endpoint_url,
+             const std::string& client_payload,
+             const std::string& jwt_token) const;
+
+private:
+    static std::string getKey(const std::string& endpoint_url,
+                              const std::string& client_payload);
+
+    bool getEntry(const std::string& key,
+                  std::chrono::seconds min_validity,
+                  std::string& jwt_token) const;
+
+    void putEntry(const std::string& key, const std::string& jwt_token) const;
+
+    void evictExpired() const;
+
+    std::string getEntryPath(const std::string& key) const;
+
+    std::string getLockPath(const std::string& key) const;
+
+    std::string cache_dir_;
+};
@@ -0,0 +1,147 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="TaskExecutor.cpp" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include "Logging.h"
+#include "TaskExecutor.h"
+
+TaskExecutor::TaskExecutor(size_t thread_count) {
+    for (size_t i = 0; i < thread_count; i++) {
+        workers_.emplace_back(&TaskExecutor::run, this);
+    }
+}
+
+TaskExecutor::~TaskExecutor() {
+    Stop();
+}
+
+bool TaskExecutor::Post(Task task) {
+    return PostAfter(std::chrono::milliseconds(0), std::move(task));
+}
+
+bool TaskExecutor::PostAfter(std::chrono::milliseconds delay, Task task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stop_requested_) {
+            return false;
+        }
+        // Equal keys are inserted after the existing ones, which keeps tasks due at
+        // the same time in posting order.
+        tasks_.emplace(std::chrono::steady_clock::now() + delay, std::move(task));
+    }
+    wake_up_.notify_one();
+    return true;
+}
+
+void TaskExecutor::ParallelFor(size_t count, size_t block_size, const RangeTask& task) {
+    // Shared with the helpers so that a helper which only gets to run after the loop
+    // is over finds it closed instead of touching the task of a returned call.
+    struct Loop {
+        std::mutex mutex;
+        std::condition_variable done;
+        size_t active = 0;
+        bool closed = false;
+        std::atomic<size_t> next{0};
+    };
+    auto loop = std::make_shared<Loop>();
+    block_size = std::max<size_t>(block_size, 1);
+
+    auto work = [count, block_size, &task](Loop& state) {
+        for (;;) {
+            size_t begin = state.next.fetch_add(block_size);
+            if (begin >= count) {
+                break;
+            }
+            task(begin, std::min(begin + block_size, count));
+        }
+    };
+
+    size_t blocks = (count + block_size - 1) / block_size;
+    size_t helpers = std::min(workers_.size(), blocks > 0 ? blocks - 1 : 0);
+    for (size_t i = 0; i < helpers; i++) {
+        bool posted = false;
+        try {
+            posted = Post([loop, work]() {
+                {
+                    std::lock_guard<std::mutex> lock(loop->mutex);
+                    if (loop->closed) {
+                        return;
+                    }
+                    loop->active++;
+                }
+                work(*loop);
+                std::lock_guard<std::mutex> lock(loop->mutex);
+                if (--loop->active == 0) {
+                    loop->done.notify_all();
+                }
+            });
+        }
+        catch (const std::exception& e) {
+            CLIENT_LOG_WARN("Failed to post a parallel loop task: %s", e.what());
+        }
+        if (!posted) {
+            // The calling thread picks up the blocks the missing helpers would have run.
+            break;
+        }
+    }
+
+    work(*loop);
+
+    std::unique_lock<std::mutex> lock(loop->mutex);
+    loop->closed = true;
+    loop->done.wait(lock, [&loop]() { return loop->active == 0; });
+}
+
+void TaskExecutor::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_requested_ = true;
+    }
+    wake_up_.notify_all();
+
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    std::multimap<std::chrono::steady_clock::time_point, Task> dropped;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        dropped.swap(tasks_);
+    }
+}
+
+void TaskExecutor::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_requested_) {
+        if (tasks_.empty()) {
+            wake_up_.wait(lock);
+            continue;
+        }
+
+        auto next = tasks_.begin();
+        if (std::chrono::steady_clock::now() < next->first) {
+            wake_up_.wait_until(lock, next->first);
+            continue;
+        }
+
+        Task task = std::move(next->second);
+        tasks_.erase(next);
+
+        // Let the other workers pick up tasks while this one runs.
+        lock.unlock();
+        try {
+            task();
+        }
+        catch (const std::exception& e) {
+            CLIENT_LOG_ERROR("Unhandled exception in background task: %s", e.what());
+        }
+        lock.lock();
+    }
+}
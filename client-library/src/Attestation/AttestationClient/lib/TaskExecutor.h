@@ -0,0 +1,85 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="TaskExecutor.h" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Small fixed size pool of threads running posted tasks.
+ *
+ * Tasks can be delayed, which is how retries wait out their back off without holding
+ * on to a thread. Tasks that are due at the same time run in the order they were
+ * posted. Tasks still queued when the executor stops are dropped without running.
+ */
+class TaskExecutor {
+public:
+    using Task = std::function<void()>;
+    using RangeTask = std::function<void(size_t begin, size_t end)>;
+
+    /**
+     * @brief Starts the worker threads.
+     * @param[in] thread_count The number of worker threads.
+     */
+    explicit TaskExecutor(size_t thread_count);
+
+    /**
+     * @brief Stops the executor, see Stop().
+     */
+    ~TaskExecutor();
+
+    TaskExecutor(const TaskExecutor&) = delete;
+    TaskExecutor& operator=(const TaskExecutor&) = delete;
+
+    /**
+     * @brief This function will be used to run a task as soon as a worker is free.
+     * @param[in] task The task to run.
+     * @return false if the executor was stopped and the task will not run.
+     */
+    bool Post(Task task);
+
+    /**
+     * @brief This function will be used to run a task once a delay has passed.
+     * @param[in] delay How long to wait before running the task.
+     * @param[in] task The task to run.
+     * @return false if the executor was stopped and the task will not run.
+     */
+    bool PostAfter(std::chrono::milliseconds delay, Task task);
+
+    /**
+     * @brief This function will be used to run a task over the indices [0, count),
+     * handed out in blocks to the calling thread and to the workers that are free. It
+     * returns once every block has run. The calling thread takes part, so the loop
+     * completes even when all workers are busy or the executor is stopped.
+     * @param[in] count The number of indices.
+     * @param[in] block_size The number of indices handed out at once.
+     * @param[in] task Runs a block [begin, end). It must not throw.
+     */
+    void ParallelFor(size_t count, size_t block_size, const RangeTask& task);
+
+    /**
+     * @brief This function will be used to stop the executor. It waits for the
+     * running tasks to finish and drops the queued ones. It must not be called
+     * from a task.
+     */
+    void Stop();
+
+private:
+    void run();
+
+    std::mutex mutex_;
+    std::condition_variable wake_up_;
+    bool stop_requested_ = false;
+    std::multimap<std::chrono::steady_clock::time_point, Task> tasks_;
+    std::vector<std::thread> workers_;
+};
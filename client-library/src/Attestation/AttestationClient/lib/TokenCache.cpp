@@ -0,0 +1,178 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="TokenCache.cpp" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <exception>
+#include "Logging.h"
+#include "AttestationLibUtils.h"
+#include "TokenCache.h"
+
+// Upper bound on the number of distinct endpoint and client payload pairs held at once.
+#define MAX_TOKEN_CACHE_ENTRIES 32
+
+// How long to wait before retrying a failed background refresh.
+constexpr std::chrono::seconds token_refresh_retry_interval(30);
+
+using namespace attest;
+
+TokenCache::TokenCache(Attester attest, std::chrono::seconds refresh_margin)
+    : attest_(attest),
+      refresh_margin_(refresh_margin) {
+    worker_ = std::thread(&TokenCache::run, this);
+}
+
+TokenCache::~TokenCache() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_requested_ = true;
+    }
+    wake_up_.notify_all();
+
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+bool TokenCache::Get(const std::string& endpoint_url,
+                     const std::string& client_payload,
+                     std::string& jwt_token) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(getKey(endpoint_url, client_payload));
+    if (it == entries_.end()) {
+        return false;
+    }
+
+    auto now = std::chrono::system_clock::now();
+    if (now < it->second.not_before || now >= it->second.expiry) {
+        return false;
+    }
+
+    it->second.used = true;
+    jwt_token = it->second.jwt_token;
+    return true;
+}
+
+void TokenCache::Put(const std::string& endpoint_url,
+                     const std::string& client_payload,
+                     const std::string& jwt_token) {
+    Entry entry;
+    if (!makeEntry(endpoint_url, client_payload, jwt_token, entry)) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::string key = getKey(endpoint_url, client_payload);
+        if (entries_.find(key) == entries_.end() &&
+            entries_.size() >= MAX_TOKEN_CACHE_ENTRIES) {
+            // Make room by dropping the entry that expires first.
+            auto oldest = std::min_element(entries_.begin(),
+                                           entries_.end(),
+                                           [](const std::pair<const std::string, Entry>& a,
+                                              const std::pair<const std::string, Entry>& b) {
+                                               return a.second.expiry < b.second.expiry;
+                                           });
+            entries_.erase(oldest);
+        }
+        entries_[key] = entry;
+    }
+    wake_up_.notify_all();
+}
+
+std::string TokenCache::getKey(const std::string& endpoint_url,
+                               const std::string& client_payload) {
+    // The endpoint URL cannot contain a null character so the key is unambiguous.
+    return std::string(endpoint_url).append(1, '\0').append(client_payload);
+}
+
+bool TokenCache::makeEntry(const std::string& endpoint_url,
+                           const std::string& client_payload,
+                           const std::string& jwt_token,
+                           Entry& entry) const {
+    int64_t not_before = 0;
+    int64_t expiry = 0;
+    if (!jwt::ExtractValidityFromAttestationJwt(jwt_token, not_before, expiry)) {
+        CLIENT_LOG_WARN("Token has no validity period, not caching it");
+        return false;
+    }
+
+    entry.endpoint_url = endpoint_url;
+    entry.client_payload = client_payload;
+    entry.jwt_token = jwt_token;
+    entry.not_before = std::chrono::system_clock::from_time_t(static_cast<time_t>(not_before));
+    entry.expiry = std::chrono::system_clock::from_time_t(static_cast<time_t>(expiry));
+    entry.next_refresh = entry.expiry - refresh_margin_;
+    entry.used = false;
+    return entry.expiry > std::chrono::system_clock::now();
+}
+
+void TokenCache::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_requested_) {
+        auto now = std::chrono::system_clock::now();
+
+        // Drop expired entries and entries nobody asked for since the last refresh,
+        // then pick the entry that is due for a refresh first.
+        auto due = entries_.end();
+        for (auto it = entries_.begin(); it != entries_.end();) {
+            if (now >= it->second.expiry ||
+                (now >= it->second.next_refresh && !it->second.used)) {
+                it = entries_.erase(it);
+                continue;
+            }
+            if (due == entries_.end() || it->second.next_refresh < due->second.next_refresh) {
+                due = it;
+            }
+            ++it;
+        }
+
+        if (due == entries_.end()) {
+            wake_up_.wait(lock);
+            continue;
+        }
+
+        if (now < due->second.next_refresh) {
+            wake_up_.wait_until(lock, due->second.next_refresh);
+            continue;
+        }
+
+        std::string key = due->first;
+        std::string endpoint_url = due->second.endpoint_url;
+        std::string client_payload = due->second.client_payload;
+
+        // Attest without holding the lock so Get never blocks on a refresh.
+        lock.unlock();
+        std::string jwt_token;
+        AttestationResult result(AttestationResult::ErrorCode::SUCCESS);
+        try {
+            result = attest_(endpoint_url, client_payload, jwt_token);
+        }
+        catch (const std::exception& e) {
+            result.code_ = AttestationResult::ErrorCode::ERROR_ATTESTATION_FAILED;
+            result.description_ = e.what();
+        }
+
+        Entry entry;
+        bool refreshed = result.code_ == AttestationResult::ErrorCode::SUCCESS &&
+                         makeEntry(endpoint_url, client_payload, jwt_token, entry);
+        lock.lock();
+
+        auto it = entries_.find(key);
+        if (it == entries_.end()) {
+            continue;
+        }
+
+        if (refreshed) {
+            CLIENT_LOG_INFO("Refreshed cached attestation token");
+            it->second = entry;
+        }
+        else {
+            CLIENT_LOG_WARN("Failed to refresh cached attestation token: %s",
+                            result.description_.c_str());
+            it->second.next_refresh = std::chrono::system_clock::now() + token_refresh_retry_interval;
+        }
+    }
+}
@@ -0,0 +1,99 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="TokenCache.h" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "AttestationLibTypes.h"
+
+/**
+ * In memory cache of attestation tokens keyed by attestation endpoint and client payload.
+ *
+ * A token is served while the current time is between its nbf and exp claims. A
+ * background thread re-attests an entry once it is within the refresh margin of its exp,
+ * so callers that keep asking for the same token never wait on attestation. Entries
+ * that were not requested since their last refresh are left to expire instead of being
+ * refreshed.
+ */
+class TokenCache {
+public:
+    using Attester = std::function<attest::AttestationResult(const std::string& endpoint_url,
+                                                             const std::string& client_payload,
+                                                             std::string& jwt_token)>;
+
+    /**
+     * @brief Starts the background refresh thread.
+     * @param[in] attest Performs an attestation and returns the decrypted token.
+     * @param[in] refresh_margin How long before exp a token is refreshed.
+     */
+    TokenCache(Attester attest, std::chrono::seconds refresh_margin);
+
+    /**
+     * @brief Stops and joins the background refresh thread.
+     */
+    ~TokenCache();
+
+    TokenCache(const TokenCache&) = delete;
+    TokenCache& operator=(const TokenCache&) = delete;
+
+    /**
+     * @brief This function will be used to look up a token.
+     * @param[in] endpoint_url The attestation endpoint the token was issued by.
+     * @param[in] client_payload The client payload the token was issued for.
+     * @param[out] jwt_token The cached token.
+     * @return true if a token that is currently valid was found.
+     */
+    bool Get(const std::string& endpoint_url,
+             const std::string& client_payload,
+             std::string& jwt_token);
+
+    /**
+     * @brief This function will be used to store a freshly issued token.
+     * @param[in] endpoint_url The attestation endpoint the token was issued by.
+     * @param[in] client_payload The client payload the token was issued for.
+     * @param[in] jwt_token The token. Tokens without an exp claim are not cached.
+     */
+    void Put(const std::string& endpoint_url,
+             const std::string& client_payload,
+             const std::string& jwt_token);
+
+private:
+    struct Entry {
+        std::string endpoint_url;
+        std::string client_payload;
+        std::string jwt_token;
+        std::chrono::system_clock::time_point not_before;
+        std::chrono::system_clock::time_point expiry;
+        std::chrono::system_clock::time_point next_refresh;
+        bool used = false;
+    };
+
+    static std::string getKey(const std::string& endpoint_url,
+                              const std::string& client_payload);
+
+    bool makeEntry(const std::string& endpoint_url,
+                   const std::string& client_payload,
+                   const std::string& jwt_token,
+                   Entry& entry) const;
+
+    void run();
+
+    Attester attest_;
+    std::chrono::seconds refresh_margin_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_up_;
+    bool stop_requested_ = false;
+    std::map<std::string, Entry> entries_;
+
+    std::thread worker_;
+};
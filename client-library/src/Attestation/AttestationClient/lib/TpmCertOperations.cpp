@@ -37,6 +37,15 @@ constexpr char CERTIFICATE_FOOTER[] = "\n-----END CERTIFICATE-----";
 constexpr char ak_renew_sync_api_version[] = "2023-07-01";
 constexpr char ak_renew_async_api_version[] = "2021-12-01";
 
+TpmCertOperations::TpmCertOperations(const std::shared_ptr<Tpm>& tpm) : tpm_(tpm) {}
+
+const Tpm& TpmCertOperations::getTpm() {
+	if (tpm_ == nullptr) {
+		tpm_ = std::make_shared<Tpm>();
+	}
+	return *tpm_;
+}
+
 AttestationResult TpmCertOperations::IsAkCertRenewalRequired(bool& is_ak_renewal_required) {
 	AttestationResult result = AttestationResult(AttestationResult::ErrorCode::SUCCESS);
 	try {
@@ -131,7 +140,6 @@ AttestationResult TpmCertOperations::RenewAndReplaceAkCert() {
 			return result;
 		}
 
-		Tpm tpm;
 		std::string request_id = attest::utils::Uuid();
 		std::string ak_cert;
 		if ((result = ReadAkCertFromTpm(ak_cert)).code_ != AttestationResult::ErrorCode::SUCCESS) {
@@ -206,7 +214,7 @@ AttestationResult TpmCertOperations::RenewAndReplaceAkCert() {
 		// write renewed cert to TPM
 		std::vector<unsigned char> cert_der = attest::base64::base64_to_binary(
 			RemoveCertHeaderAndFooter(renewed_cert));
-		tpm.WriteAikCert(cert_der);
+		getTpm().WriteAikCert(cert_der);
 		CLIENT_LOG_INFO("Successfully renewed AK cert");
 		if(telemetry_reporting.get() != nullptr) {
         	telemetry_reporting->UpdateEvent("AkRenew", 
@@ -233,9 +241,8 @@ AttestationResult TpmCertOperations::ReadAkCertFromTpm(std::string& ak_cert) {
 	AttestationResult result = AttestationResult(AttestationResult::ErrorCode::SUCCESS);
 
 	try {
-		Tpm tpm;
 		ak_cert = std::string(CERTIFICATE_HEADER)  + 
-			attest::base64::binary_to_base64(tpm.GetAIKCert()) + 
+			attest::base64::binary_to_base64(getTpm().GetAIKCert()) + 
 			std::string(CERTIFICATE_FOOTER);
 		
 		if (telemetry_reporting.get() != nullptr) {
@@ -347,9 +354,7 @@ AttestationResult TpmCertOperations::IsAkCertProvisioned(X509* ak_cert_x509) {
 AttestationResult TpmCertOperations::ReadAikPubFromTpm(std::string& ak_pub) {
 	AttestationResult result= AttestationResult(AttestationResult::ErrorCode::SUCCESS);
 	try{
-		Tpm tpm;
-		
-		Buffer aik_pub = tpm.GetAIKPub();
+		Buffer aik_pub = getTpm().GetAIKPub();
 		CLIENT_LOG_INFO("Successfully fetched Aikpub from Tpm");
 
 		ak_pub = base64::binary_to_base64(aik_pub);
@@ -15,6 +15,7 @@
 #include <fstream>
 #include <iostream>
 #include <unordered_map>
+#include <memory>
 #include <stdio.h>
 #include <openssl/pem.h>
 #include <openssl/ossl_typ.h>
@@ -26,6 +27,15 @@
 
 class TpmCertOperations {
 public:
+    TpmCertOperations() = default;
+
+    /**
+     * @brief Creates the cert operations on top of an already opened Tpm so the
+     * caller's TPM context is reused instead of opening a new one.
+     * @param[in] tpm The shared Tpm object.
+     */
+    explicit TpmCertOperations(const std::shared_ptr<Tpm>& tpm);
+
     /**
      * @brief This function is used to check if AK cert renewal is required or not for the VM
      * @param[out] True, if the renewal is required. False, if renewal is not required
@@ -88,4 +98,12 @@ private:
      * AttestationResult object and error description will be provided.
     */
     attest::AttestationResult IsAkCertProvisioned(X509* ak_cert_x509);
+
+    /**
+     * @brief Returns the Tpm used by this object, opening one on first use if
+     * none was provided at construction.
+     */
+    const Tpm& getTpm();
+
+    std::shared_ptr<Tpm> tpm_;
 };
\ No newline at end of file
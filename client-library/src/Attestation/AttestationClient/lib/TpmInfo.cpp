@@ -4,8 +4,6 @@
 // </copyright>
 //-------------------------------------------------------------------------------------------------
 
-#include "AttestationHelper.h"
-
 #include "TpmInfo.h"
 #include "AttestationLibConst.h"
 
@@ -24,39 +22,62 @@ bool TpmInfo::Validate() const {
     return true;
 }
 
-Json::Value TpmInfo::ToJson() const {
-    Json::Value tpm_info;
-    std::string aik_cert_encoded = base64::binary_to_base64(aik_cert_);
-    std::string aik_pub_encoded = base64::binary_to_base64(aik_pub_);
-    std::string pcr_quote_encoded = base64::binary_to_base64(pcr_quote_.quote);
-    std::string pcr_signature_encoded = base64::binary_to_base64(pcr_quote_.signature);
-    std::string enc_key_encoded = base64::binary_to_base64(encryption_key_.encryptionKey);
-    std::string enc_key_certify_info_encoded = base64::binary_to_base64(
-                                                        encryption_key_.certifyInfo);
-    std::string enc_key_certify_info_sig_encoded = base64::binary_to_base64(
-                                                        encryption_key_.certifyInfoSignature);
+void TpmInfo::WriteJson(JsonStreamWriter& writer) const {
+    writer.BeginObject();
+    writer.Key(JSON_AIK_CERT_KEY);
+    writer.Base64(aik_cert_.data(), aik_cert_.size(), base64::Alphabet::Standard);
+    writer.Key(JSON_AIK_PUB_KEY);
+    writer.Base64(aik_pub_.data(), aik_pub_.size(), base64::Alphabet::Standard);
+    writer.Key(JSON_PCR_QUOTE_KEY);
+    writer.Base64(pcr_quote_.quote.data(), pcr_quote_.quote.size(), base64::Alphabet::Standard);
+    writer.Key(JSON_PCR_SIGNATURE_KEY);
+    writer.Base64(pcr_quote_.signature.data(), pcr_quote_.signature.size(), base64::Alphabet::Standard);
+    writer.Key(JSON_ENC_PUB_KEY);
+    writer.Base64(encryption_key_.encryptionKey.data(),
+                  encryption_key_.encryptionKey.size(),
+                  base64::Alphabet::Standard);
+    writer.Key(JSON_ENC_KEY_CERTIFY_INFO);
+    writer.Base64(encryption_key_.certifyInfo.data(),
+                  encryption_key_.certifyInfo.size(),
+                  base64::Alphabet::Standard);
+    writer.Key(JSON_ENC_KEY_CERTIFY_INFO_SIGNATURE);
+    writer.Base64(encryption_key_.certifyInfoSignature.data(),
+                  encryption_key_.certifyInfoSignature.size(),
+                  base64::Alphabet::Standard);
 
-    tpm_info[JSON_AIK_CERT_KEY] = aik_cert_encoded;
-    tpm_info[JSON_AIK_PUB_KEY] = aik_pub_encoded;
-    tpm_info[JSON_PCR_QUOTE_KEY] = pcr_quote_encoded;
-    tpm_info[JSON_PCR_SIGNATURE_KEY] = pcr_signature_encoded;
-    tpm_info[JSON_ENC_PUB_KEY] = enc_key_encoded;
-    tpm_info[JSON_ENC_KEY_CERTIFY_INFO] = enc_key_certify_info_encoded;
-    tpm_info[JSON_ENC_KEY_CERTIFY_INFO_SIGNATURE] = enc_key_certify_info_sig_encoded;
+    writer.Key(JSON_PCR_SET_KEY);
+    writer.BeginArray();
+    for(auto const& pcr: pcr_values_.pcrs) {
+        writer.UInt(pcr.index);
+    }
+    writer.EndArray();
 
-    Json::Value pcr_set(Json::arrayValue);
-    Json::Value pcrs(Json::arrayValue);
+    writer.Key(JSON_PCRS_KEY);
+    writer.BeginArray();
     for(auto const& pcr: pcr_values_.pcrs) {
-        Json::Value pcr_obj;
-        pcr_obj[JSON_PCR_INDEX_KEY] = pcr.index;
+        writer.BeginObject();
+        writer.Key(JSON_PCR_INDEX_KEY);
+        writer.UInt(pcr.index);
+        writer.Key(JSON_PCR_DIGEST_KEY);
+        writer.Base64(pcr.digest.data(), pcr.digest.size(), base64::Alphabet::Standard);
+        writer.EndObject();
+    }
+    writer.EndArray();
+    writer.EndObject();
+}
 
-        std::string digest_encoded = base64::binary_to_base64(pcr.digest);
-        pcr_obj[JSON_PCR_DIGEST_KEY] = digest_encoded;
-        pcr_set.append(pcr.index);
-        pcrs.append(pcr_obj);
+size_t TpmInfo::JsonSizeHint() const {
+    size_t size = aik_cert_.size() +
+                  aik_pub_.size() +
+                  pcr_quote_.quote.size() +
+                  pcr_quote_.signature.size() +
+                  encryption_key_.encryptionKey.size() +
+                  encryption_key_.certifyInfo.size() +
+                  encryption_key_.certifyInfoSignature.size();
+    for(auto const& pcr: pcr_values_.pcrs) {
+        size += pcr.digest.size() + 32;
     }
-    tpm_info[JSON_PCR_SET_KEY] = pcr_set;
-    tpm_info[JSON_PCRS_KEY] = pcrs;
-    return tpm_info;
+    // Base64 grows the binary fields by a third, keys and punctuation take the rest.
+    return size * 4 / 3 + 256;
 }
 }// attest
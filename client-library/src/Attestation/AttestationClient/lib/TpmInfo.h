@@ -5,8 +5,8 @@
 //-------------------------------------------------------------------------------------------------
 #pragma once
 
-#include <json/json.h>
 #include <AttestationTypes.h>
+#include "JsonStreamWriter.h"
 
 namespace attest {
 
@@ -17,7 +17,12 @@ class TpmInfo {
 public:
 
     bool Validate() const;
-    Json::Value ToJson() const;
+    void WriteJson(JsonStreamWriter& writer) const;
+
+    /**
+     * @brief Returns roughly how many bytes WriteJson() writes.
+     */
+    size_t JsonSizeHint() const;
 
     Buffer aik_cert_; /**< Client Tpm's aik cert */
     Buffer aik_pub_; /**< Client Tpm's aik publick key */
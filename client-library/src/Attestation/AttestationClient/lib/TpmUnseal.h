@@ -8,6 +8,7 @@
 #include <json/json.h>
 #include <Exceptions.h>
 #include <AttestationTypes.h>
+#include <Tpm.h>
 
 #include "AttestationHelper.h"
 #include "AttestationLibTypes.h"
@@ -50,31 +51,9 @@ struct EncryptionParameters {
     attest::Buffer authentication_data; /**< Auth data used for encryption of the jwt */
 };
 
-/**
- * @brief The function will be used to extract the Encryption parameters from the json response from AAS.
- * @param[in] json_obj The Json::Value object that represents the encryption parameter element in the json response.
- * @param[out] encryption_params The EncryptionParameter object that will hold the encryption parameters to be used for
- * decryption of the jwt.
- * @param[out] err In case of failure scenarios, err will be used to return the error description.
- * @return On success, true will be returned and false will be returned on failure.
- */
-bool GetEncryptionParameters(const Json::Value& json_obj,
-                             EncryptionParameters& encryption_params,
-                             std::string& err);
-
-/**
- * @brief The function will be used to extract the encrypted jwt from the json response from AAS.
- * @param[in] json_obj The Json::Value object that represents the jwt element in the json response.
- * @param[out] jwt_encrypted The Buffer object that will hold the encrypted jwt extracted from the response.
- * @param[out] err In case of failure scenarios, err will be used to return the error description.
- * @return On success, true will be returned and false will be returned on failure.
- */
-bool GetEncryptedJwt(const Json::Value& json_obj,
-                     attest::Buffer& jwt_encrypted,
-                     std::string& err);
-
 /**
  * @brief The function will be used to decrypt the inner symmetric key that was used to encrypt the jwt.
+ * @param[in] tpm The Tpm object whose ephemeral key will be used for the decryption.
  * @param[in] encrypted_inner_key The encrypted symmetric inner key that was used to encrypt the jwt.
  * @param[out] decrypted_key The Buffer object that will hold the decrypted symmetric key.
  * @param[in] rsaWrapAlgId The Rsa wrap algorithm enum value that represents the RSA scheme used for encryption.
@@ -82,7 +61,8 @@ bool GetEncryptedJwt(const Json::Value& json_obj,
  * @return On success, AttestatitionResult object is returned with error_code set to ErrorCode::SUCCESS. On failure,
  * AttestationResult object is returned with appropriate error code set.
  */
-attest::AttestationResult DecryptInnerKey(const attest::Buffer& encrypted_inner_key,
+attest::AttestationResult DecryptInnerKey(const Tpm& tpm,
+                                          const attest::Buffer& encrypted_inner_key,
                                           attest::Buffer& decrypted_key,
                                           const attest::RsaScheme rsaWrapAlgId = attest::RsaScheme::RsaEs,
                                           const attest::RsaHashAlg rsaHashAlgId = attest::RsaHashAlg::RsaSha1);
@@ -102,14 +82,4 @@ bool DecryptJwt(const EncryptionParameters& encryption_params,
                 std::string& jwt_decrypted,
                 std::string& err);
 
-/**
- * @brief The function will be used to extract the symmetric inner key in the AAS response.
- * @param[in] json_obj The Json::Value object that represent the symmetric inner key element in the json response.
- * @param[out] encrypted_inner_key The Buffer that will hold the encrypted symmetric inner key.
- * @param[out] err In case of failure scenarios, err will be used to return the error description.
- * @return On success, true will be returned and false will be returned on failure.
- */
-bool GetEncryptedInnerKey(const Json::Value& json_obj,
-                          attest::Buffer& encrypted_inner_key,
-                          std::string& err);
 }// attest
@@ -0,0 +1,139 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="VcekCertCache.cpp" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+#include <memory>
+#include <sstream>
+#include <iomanip>
+#include <openssl/bio.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include "Logging.h"
+#include "AttestationHelper.h"
+#include "AttestationLibUtils.h"
+#include "SnpVmReport.h"
+#include "VcekCertCache.h"
+
+constexpr char default_vcek_cache_dir[] = "/var/cache/azguestattestation/vcek";
+constexpr char vcek_cache_file_prefix[] = "vcek-";
+constexpr char vcek_cache_file_suffix[] = ".cache";
+
+/**
+ * @brief Hex encodes a byte range.
+ */
+static std::string toHex(const uint8_t* data, size_t size) {
+    std::stringstream ss;
+    ss << std::hex << std::setfill('0');
+    for (size_t i = 0; i < size; i++) {
+        ss << std::setw(2) << static_cast<int>(data[i]);
+    }
+    return ss.str();
+}
+
+VcekCertCache::VcekCertCache() : cache_dir_(default_vcek_cache_dir) {}
+
+VcekCertCache::VcekCertCache(const std::string& cache_dir) : cache_dir_(cache_dir) {}
+
+bool VcekCertCache::GetCacheKey(const attest::Buffer& snp_report, std::string& key) {
+    if (snp_report.size() < sizeof(SNP_VM_REPORT)) {
+        return false;
+    }
+
+    const SNP_VM_REPORT* report = reinterpret_cast<const SNP_VM_REPORT*>(snp_report.data());
+    uint64_t reported_tcb = report->SnpReportedTcb.Asuint64_t;
+
+    key = toHex(report->SnpChipId, sizeof(report->SnpChipId)) +
+          "-" +
+          toHex(reinterpret_cast<const uint8_t*>(&reported_tcb), sizeof(reported_tcb));
+    return true;
+}
+
+bool VcekCertCache::Get(const std::string& key,
+                        std::string& vcek_cert,
+                        std::chrono::seconds& remaining_validity) const {
+#ifdef PLATFORM_UNIX
+    std::string cached_cert;
+    if (key.empty() ||
+        !attest::os::ReadFile(getEntryPath(key), cached_cert) ||
+        cached_cert.empty()) {
+        return false;
+    }
+
+    if (!GetRemainingValidity(cached_cert, remaining_validity)) {
+        CLIENT_LOG_WARN("Ignoring unreadable VCek cert cache entry");
+        return false;
+    }
+
+    if (remaining_validity <= std::chrono::seconds::zero()) {
+        CLIENT_LOG_INFO("Cached VCek cert has expired");
+        return false;
+    }
+
+    vcek_cert = cached_cert;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool VcekCertCache::Put(const std::string& key, const std::string& vcek_cert) const {
+#ifdef PLATFORM_UNIX
+    if (key.empty() || vcek_cert.empty()) {
+        return false;
+    }
+
+    if (!attest::os::CreatePrivateDirectory(cache_dir_)) {
+        CLIENT_LOG_WARN("VCek cert cache directory is not available, skipping cache");
+        return false;
+    }
+
+    return attest::os::WriteFileAtomically(getEntryPath(key), vcek_cert);
+#else
+    return false;
+#endif
+}
+
+bool VcekCertCache::GetRemainingValidity(const std::string& vcek_cert,
+                                         std::chrono::seconds& remaining_validity) {
+    std::string cert_chain = attest::base64::base64_decode(vcek_cert);
+
+    std::unique_ptr<BIO, decltype(&BIO_free)> bio(BIO_new_mem_buf(cert_chain.data(),
+                                                                  static_cast<int>(cert_chain.size())),
+                                                  &BIO_free);
+    if (bio == nullptr) {
+        return false;
+    }
+
+    bool found = false;
+    while (true) {
+        std::unique_ptr<X509, decltype(&X509_free)> cert(PEM_read_bio_X509(bio.get(), nullptr, nullptr, nullptr),
+                                                         &X509_free);
+        if (cert == nullptr) {
+            break;
+        }
+
+        // Difference between now and notAfter, negative once the certificate has expired.
+        int days = 0;
+        int seconds = 0;
+        if (!ASN1_TIME_diff(&days, &seconds, nullptr, X509_get0_notAfter(cert.get()))) {
+            return false;
+        }
+
+        std::chrono::seconds cert_validity(static_cast<int64_t>(days) * 24 * 60 * 60 + seconds);
+        if (!found || cert_validity < remaining_validity) {
+            remaining_validity = cert_validity;
+        }
+        found = true;
+    }
+
+    // Reaching the end of the chain leaves a PEM "no start line" error behind.
+    ERR_clear_error();
+    return found;
+}
+
+std::string VcekCertCache::getEntryPath(const std::string& key) const {
+    return cache_dir_ + "/" + vcek_cache_file_prefix + key + vcek_cache_file_suffix;
+}
@@ -0,0 +1,77 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="VcekCertCache.h" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <chrono>
+#include <string>
+#include "AttestationLibTypes.h"
+
+/**
+ * Persistent cache of the VCEK certificate chain returned by THIM.
+ *
+ * The VCEK is derived from the chip and its reported TCB, so the chain only changes
+ * with a firmware or TCB update. Entries are keyed by the chip ID and reported TCB
+ * from the SNP report and are only served until the first certificate in the chain
+ * expires. The cache lives in a directory readable by root only; if the directory
+ * cannot be created or written the cache is silently bypassed.
+ */
+class VcekCertCache {
+public:
+    /**
+     * @brief Creates a cache backed by the default root-only cache directory.
+     */
+    VcekCertCache();
+
+    /**
+     * @brief Creates a cache backed by the given directory.
+     * @param[in] cache_dir The directory the entries are stored in.
+     */
+    explicit VcekCertCache(const std::string& cache_dir);
+
+    /**
+     * @brief This function will be used to derive the cache key from the SNP report.
+     * @param[in] snp_report The SNP report extracted from the HCL report.
+     * @param[out] key The hex encoded chip ID and reported TCB.
+     * @return true if the SNP report was large enough to contain both fields.
+     */
+    static bool GetCacheKey(const attest::Buffer& snp_report, std::string& key);
+
+    /**
+     * @brief This function will be used to look up a cached VCEK certificate chain.
+     * @param[in] key The key returned by GetCacheKey.
+     * @param[out] vcek_cert base64 encoded certificate chain.
+     * @param[out] remaining_validity Time left until the first certificate in the chain expires.
+     * @return true if a chain that has not yet expired was found.
+     */
+    bool Get(const std::string& key,
+             std::string& vcek_cert,
+             std::chrono::seconds& remaining_validity) const;
+
+    /**
+     * @brief This function will be used to store a VCEK certificate chain. The entry
+     * is written to a temporary file and renamed so readers never see a partial entry.
+     * @param[in] key The key returned by GetCacheKey.
+     * @param[in] vcek_cert base64 encoded certificate chain.
+     * @return true if the entry was stored.
+     */
+    bool Put(const std::string& key, const std::string& vcek_cert) const;
+
+    /**
+     * @brief This function will be used to find when a certificate chain expires.
+     * @param[in] vcek_cert base64 encoded PEM certificate chain.
+     * @param[out] remaining_validity Time left until the first certificate in the chain
+     * expires. Negative if one of them has already expired.
+     * @return true if at least one certificate could be parsed from the chain.
+     */
+    static bool GetRemainingValidity(const std::string& vcek_cert,
+                                     std::chrono::seconds& remaining_validity);
+
+private:
+    std::string getEntryPath(const std::string& key) const;
+
+    std::string cache_dir_;
+};
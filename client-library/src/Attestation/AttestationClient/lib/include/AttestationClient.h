@@ -5,10 +5,13 @@
 //-------------------------------------------------------------------------------------------------
 #pragma once
 
+#include <functional>
 #include <memory>
+#include <vector>
 
 #include "AttestationLogger.h"
 #include "AttestationLibTypes.h"
+#include "AttestationToken.h"
 #include "TelemetryReportingBase.h"
 
 #ifdef ATTESTATIONLIB_EXPORTS
@@ -34,12 +37,21 @@ public:
     virtual attest::AttestationResult Attest(const attest::ClientParameters& client_params,
                                              unsigned char** jwt_token) noexcept = 0;
 
+    /**
+     * Completion of AttestAsync(). On success jwt_token is the decrypted jwt token (null
+     * terminated string), the caller owns it and is expected to free it by calling
+     * Attest::Free() method. On failure jwt_token is nullptr.
+     */
+    using AttestCallback = std::function<void(const attest::AttestationResult& result,
+                                              unsigned char* jwt_token)>;
+
     /**
      * @brief This API encrypts the data based on the EncryptionType paramter
      * @param[in] encryption_type: the type of encryption
-     * currently the only encryption type supported is 'NONE', which expects the caller to pass
-     * symmetric key as the data to be encrypted. The RSA Public key present in the JWT will be 
-     * used to perform the encryption.
+     * 'NONE' expects the caller to pass symmetric key as the data to be encrypted. The RSA Public
+     * key present in the JWT will be used to perform the encryption, and there is no metadata.
+     * 'ENVELOPE_AES_GCM' encrypts data of any size with a random AES-256-GCM key, and only that key
+     * is encrypted with the RSA Public key. The metadata is needed to decrypt the data.
      * @param[in] jwt_token: the attestation JWT (null terminated string)
      * @param[in] data: the data to be encrypted
      * @param[in] data_size: the size of the data to be encrypted
@@ -69,9 +81,10 @@ public:
     /**
      * @brief This API decrypts the data based on the EncryptionType paramter
      * @param[in] encryption_type: the type of encryption
-     * currently the only encryption type supported is 'NONE', which expects the
-     * caller to pass the encrypted symmetric key as input. The RSA Private key
+     * 'NONE' expects the caller to pass the encrypted symmetric key as input. The RSA Private key
      * present in the TPM will be used to perform the decryption.
+     * 'ENVELOPE_AES_GCM' expects the output and metadata of Encrypt() or EncryptStream(). Only the
+     * AES key is decrypted by the TPM, and every chunk of the data is authenticated.
      * @param[in] encrypted_data: The encrypted data
      * @param[in] encrypted_data_size: The size of encrypted data
      * @param[in] encryption_metadata: The encryption metadata
@@ -99,6 +112,267 @@ public:
      * @param[in] ptr: Pointer to memory block previously allocated
      */
     virtual void Free(void* ptr) noexcept = 0;
+
+    // Methods added after the first release go below, so that the vtable slots of the
+    // methods above stay where existing binaries expect them.
+
+    /**
+     * @brief This API initiates an attestation request to Microsoft Azure Attestation Service (MAA)
+     * and returns the token as an AttestationToken rather than a string. The token keeps the jwt
+     * once and decodes its claims on first access, so it can be checked and passed to Encrypt()
+     * repeatedly without being parsed again.
+     * @param[in] client_params: ClientParameters object containing the following parameters needed
+     * for attestation - attestation url and client payload.
+     * @param[out] token: The attestation token returned by MAA. It is reference counted and freed
+     * with its last reference, it does not need to be freed with Attest::Free() method.
+     * @return In case of success, AttestationResult object with error code ErrorCode::Success is
+     * returned. In case of failure, an appropriate ErrorCode will be set in the AttestationResult
+     * object and error description will be provided.
+     */
+    virtual attest::AttestationResult Attest(const attest::ClientParameters& client_params,
+                                             std::shared_ptr<const attest::AttestationToken>& token) noexcept = 0;
+
+    /**
+     * @brief This API sends the same attestation evidence to several attestation endpoints, for
+     * example instances of MAA in different regions or with different policies. The evidence is
+     * collected from the TPM once and the endpoints are contacted concurrently, so every additional
+     * endpoint only costs a network round trip.
+     * @param[in] endpoint_urls: The attestation endpoint urls (null terminated strings).
+     * @param[in] endpoint_count: The number of endpoints.
+     * @param[in] client_payload: The client payload (null terminated JSON string) sent to every
+     * endpoint, can be nullptr.
+     * @param[out] results: Array of endpoint_count AttestationResult objects that receive the outcome
+     * for each endpoint.
+     * @param[out] jwt_tokens: Array of endpoint_count pointers that receive the decrypted jwt token
+     * (null terminated string) returned by each endpoint, nullptr if the attestation to that endpoint
+     * failed. The memory for the tokens is allocated by the method and the caller is expected to free
+     * it by calling Attest::Free() method
+     * @return In case the evidence was collected, AttestationResult object with error code
+     * ErrorCode::Success is returned, even if some of the endpoints failed. In case the input is
+     * invalid or the evidence could not be collected, an appropriate ErrorCode will be set in the
+     * AttestationResult object and error description will be provided, and every entry of
+     * jwt_tokens is nullptr, including endpoints whose token was cached.
+     */
+    virtual attest::AttestationResult AttestMultiple(const unsigned char* const* endpoint_urls,
+                                                     uint32_t endpoint_count,
+                                                     const unsigned char* client_payload,
+                                                     attest::AttestationResult* results,
+                                                     unsigned char** jwt_tokens) noexcept = 0;
+
+    /**
+     * @brief This API binds a batch of nonces into a single attestation. The library builds a SHA-256
+     * Merkle tree over the nonces and attests once with its root, as lower case hex, under the
+     * "nonce_batch_root" key of the client payload. Each nonce gets an inclusion proof that lets its
+     * relying party check the nonce is covered by the root in the token.
+     * @param[in] client_params: ClientParameters object containing the attestation url and an
+     * optional client payload. The client payload must be a JSON object without a
+     * "nonce_batch_root" key.
+     * @param[in] nonces: The nonces (null terminated strings).
+     * @param[in] nonce_count: The number of nonces.
+     * @param[out] jwt_token: The decrypted jwt token (null terminated string) shared by all nonces.
+     * The memory is allocated by the method and the caller is expected to free it by calling
+     * Attest::Free() method
+     * @param[out] inclusion_proofs: Array of nonce_count pointers that receive the inclusion proof
+     * (null terminated JSON string) of each nonce. The memory is allocated by the method and the
+     * caller is expected to free it by calling Attest::Free() method
+     * @return In case of success, AttestationResult object with error code ErrorCode::Success is
+     * returned. In case of failure, an appropriate ErrorCode will be set in the AttestationResult
+     * object and error description will be provided.
+     */
+    virtual attest::AttestationResult AttestBatch(const attest::ClientParameters& client_params,
+                                                  const unsigned char* const* nonces,
+                                                  uint32_t nonce_count,
+                                                  unsigned char** jwt_token,
+                                                  unsigned char** inclusion_proofs) noexcept = 0;
+
+    /**
+     * @brief This API starts an attestation request to Microsoft Azure Attestation Service (MAA)
+     * and returns without waiting for it to complete. Requests are driven by a small pool of
+     * library threads, so many of them can be in flight at once and retries do not hold a
+     * thread while they back off.
+     * @param[in] client_params: ClientParameters object containing the following parameters needed
+     * for attestation - attestation url and client payload. The parameters are copied and do not
+     * need to outlive the call.
+     * @param[in] callback: Called exactly once with the outcome of the request, from a library
+     * thread, or from Step() when ClientOptions::external_event_loop is set. It should return
+     * quickly and must not uninitialize the library. If the library is uninitialized first, it is
+     * called with ErrorCode::ERROR_ATTESTATION_CANCELLED.
+     * @return In case the request was started, AttestationResult object with error code
+     * ErrorCode::Success is returned. Otherwise an appropriate ErrorCode and description are
+     * returned and callback is not called.
+     */
+    virtual attest::AttestationResult AttestAsync(const attest::ClientParameters& client_params,
+                                                  AttestCallback callback) noexcept = 0;
+
+    /**
+     * @brief This API returns what the event loop of the caller has to wait for before the next
+     * call to Step(). Only available with ClientOptions::external_event_loop set. The descriptors
+     * change as requests come and go, so this API is expected to be called before every wait.
+     * @param[out] descriptors: The file descriptors to wait on.
+     * @param[out] timeout_ms: The longest the caller may wait before calling Step(), -1 if there
+     * is no limit.
+     * @return In case of success, AttestationResult object with error code ErrorCode::Success is
+     * returned. In case of failure, an appropriate ErrorCode and description will be returned.
+     */
+    virtual attest::AttestationResult GetPollDescriptors(std::vector<attest::PollDescriptor>& descriptors,
+                                                         int& timeout_ms) noexcept = 0;
+
+    /**
+     * @brief This API performs the pending I/O of AttestAsync() requests and calls the callbacks
+     * of the requests that completed. It never blocks. Only available with
+     * ClientOptions::external_event_loop set, and must be called from one thread at a time.
+     * @param[in] ready: The descriptors returned by GetPollDescriptors() with revents set to the
+     * events that occurred. It is empty when the timeout expired.
+     * @return In case of success, AttestationResult object with error code ErrorCode::Success is
+     * returned. In case of failure, an appropriate ErrorCode and description will be returned.
+     */
+    virtual attest::AttestationResult Step(const std::vector<attest::PollDescriptor>& ready) noexcept = 0;
+
+    /**
+     * @brief This API encrypts the data based on the EncryptionType paramter with the RSA Public
+     * key present in an attestation token. It behaves like Encrypt() with a jwt, except that the
+     * token is only decoded the first time it is used.
+     * @param[in] encryption_type: the type of encryption, see Encrypt() with a jwt.
+     * @param[in] token: the attestation token
+     * @param[in] data: the data to be encrypted
+     * @param[in] data_size: the size of the data to be encrypted
+     * @param[out] encrypted_data: the encrypted data (the memory is allocated by the method and
+     * the caller is expected to free this memory by calling Attest::Free() method)
+     * @param[out] encrypted_data_size: the size of the encrypted data
+     * @param[out] encryption_metadata: the encryption metadata (the memory is allocated by the
+     * method and the caller is expected to free this memory by calling Attest::Free() method)
+     * @param[out] encryption_metadata_size: the size of the encryption metadata
+     * @param[in] rsaWrapAlgId: Rsa wrap algorithm id.
+     * @param[in] rsaHashAlgId: Rsa hash algorithm id.
+     * @return In case of success, AttestationResult object with error code ErrorCode::Success is
+     * returned. In case of failure, an appropriate ErrorCode and description will be returned.
+     */
+    virtual attest::AttestationResult Encrypt(const attest::EncryptionType encryption_type,
+                                              const attest::AttestationToken& token,
+                                              const unsigned char* data,
+                                              uint32_t data_size,
+                                              unsigned char** encrypted_data,
+                                              uint32_t* encrypted_data_size,
+                                              unsigned char** encryption_metadata,
+                                              uint32_t* encryption_metadata_size,
+                                              const attest::RsaScheme tpm2RsaAlgId = attest::RsaScheme::RsaEs,
+                                              const attest::RsaHashAlg tpm2HashAlgId = attest::RsaHashAlg::RsaSha1) noexcept = 0;
+
+    /**
+     * @brief This API encrypts a batch of buffers with the RSA Public key present in an attestation
+     * token, for example to wrap many data keys at once. The RSA operations are spread over a pool
+     * of library threads and the calling thread, and the results are written into buffers of the
+     * caller, so no memory needs to be freed afterwards.
+     * @param[in] encryption_type: the type of encryption, only 'NONE' is supported. Every buffer is
+     * expected to be a symmetric key and there is no encryption metadata.
+     * @param[in] token: the attestation token
+     * @param[in] data: Array of count buffers to be encrypted
+     * @param[in] data_sizes: Array of count sizes of the buffers to be encrypted
+     * @param[in] count: the number of buffers
+     * @param[out] encrypted_data: Array of count output buffers, each at least the size of the RSA
+     * modulus (256 bytes for the TPM ephemeral key)
+     * @param[in,out] encrypted_data_sizes: Array of count sizes, the size of each output buffer on
+     * input and the size of the encrypted data on output (0 if that buffer failed)
+     * @param[out] results: Array of count AttestationResult objects that receive the outcome for each
+     * buffer
+     * @param[in] rsaWrapAlgId: Rsa wrap algorithm id.
+     * @param[in] rsaHashAlgId: Rsa hash algorithm id.
+     * @return In case the key of the token could be used, AttestationResult object with error code
+     * ErrorCode::Success is returned, even if some of the buffers failed. In case the input is
+     * invalid or the key cannot be used, an appropriate ErrorCode and description will be returned.
+     */
+    virtual attest::AttestationResult EncryptBatch(const attest::EncryptionType encryption_type,
+                                                   const attest::AttestationToken& token,
+                                                   const unsigned char* const* data,
+                                                   const uint32_t* data_sizes,
+                                                   uint32_t count,
+                                                   unsigned char* const* encrypted_data,
+                                                   uint32_t* encrypted_data_sizes,
+                                                   attest::AttestationResult* results,
+                                                   const attest::RsaScheme tpm2RsaAlgId = attest::RsaScheme::RsaEs,
+                                                   const attest::RsaHashAlg tpm2HashAlgId = attest::RsaHashAlg::RsaSha1) noexcept = 0;
+
+    /**
+     * @brief This API encrypts a stream with the RSA Public key present in an attestation token,
+     * without holding more than two chunks of it in memory. The output can be decrypted with
+     * Decrypt() and the same encryption metadata.
+     * @param[in] encryption_type: the type of encryption, only 'ENVELOPE_AES_GCM' is supported.
+     * @param[in] token: the attestation token
+     * @param[in] input_fd: the file descriptor the data is read from until end of file
+     * @param[in] output_fd: the file descriptor the encrypted data is written to
+     * @param[out] encryption_metadata: the encryption metadata in form of base64 encoded JSON
+     * (the memory is allocated by the method and the caller is expected to free this memory by
+     * calling Attest::Free() method)
+     * @param[out] encryption_metadata_size: the size of the encryption metadata
+     * @param[in] rsaWrapAlgId: Rsa wrap algorithm id.
+     * @param[in] rsaHashAlgId: Rsa hash algorithm id.
+     * @return In case of success, AttestationResult object with error code ErrorCode::Success is
+     * returned. In case of failure, an appropriate ErrorCode and description will be returned, and
+     * part of the encrypted data may have been written already.
+     */
+    virtual attest::AttestationResult EncryptStream(const attest::EncryptionType encryption_type,
+                                                    const attest::AttestationToken& token,
+                                                    int input_fd,
+                                                    int output_fd,
+                                                    unsigned char** encryption_metadata,
+                                                    uint32_t* encryption_metadata_size,
+                                                    const attest::RsaScheme tpm2RsaAlgId = attest::RsaScheme::RsaEs,
+                                                    const attest::RsaHashAlg tpm2HashAlgId = attest::RsaHashAlg::RsaSha1) noexcept = 0;
+
+    /**
+     * @brief This API decrypts the data based on the EncryptionType paramter into a buffer of the
+     * caller. For 'ENVELOPE_AES_GCM' the AES key is decrypted by the TPM once, and the chunks of the
+     * data are then decrypted in parallel on a pool of library threads and the calling thread.
+     * @param[in] encryption_type: the type of encryption, see Decrypt().
+     * @param[in] encrypted_data: The encrypted data
+     * @param[in] encrypted_data_size: The size of encrypted data
+     * @param[in] encryption_metadata: The encryption metadata
+     * @param[in] encryption_metadata_size: The size of encryption metadata
+     * @param[out] decrypted_data: The buffer receiving the decrypted data
+     * @param[in,out] decrypted_data_size: The size of the buffer on input and the size of the
+     * decrypted data on output. If the buffer is too small for 'ENVELOPE_AES_GCM', the size needed
+     * is returned along with ErrorCode::ERROR_INVALID_INPUT_PARAMETER.
+     * @param[in] rsaWrapAlgId: Rsa wrap algorithm id.
+     * @param[in] rsaHashAlgId: Rsa hash algorithm id.
+     * @return In case of success, AttestationResult object with error code ErrorCode::Success
+     * will be returned. In case of failure, an appropriate ErrorCode and description will be
+     * returned and the buffer holds no decrypted data.
+     */
+    virtual attest::AttestationResult DecryptToBuffer(const attest::EncryptionType encryption_type,
+                                                      const unsigned char* encrypted_data,
+                                                      uint32_t encrypted_data_size,
+                                                      const unsigned char* encryption_metadata,
+                                                      uint32_t encryption_metadata_size,
+                                                      unsigned char* decrypted_data,
+                                                      uint32_t* decrypted_data_size,
+                                                      const attest::RsaScheme tpm2RsaAlgId = attest::RsaScheme::RsaEs,
+                                                      const attest::RsaHashAlg tpm2HashAlgId = attest::RsaHashAlg::RsaSha1) noexcept = 0;
+
+    /**
+     * @brief This API decrypts a stream written by EncryptStream(), or the output of Encrypt(),
+     * from one file descriptor to another. The AES key is decrypted by the TPM once and the
+     * chunks are decrypted in parallel, a few megabytes at a time, so data of any size can be
+     * decrypted in bounded memory.
+     * @param[in] encryption_type: the type of encryption, only 'ENVELOPE_AES_GCM' is supported.
+     * @param[in] input_fd: the file descriptor the encrypted data is read from until end of file
+     * @param[in] output_fd: the file descriptor the decrypted data is written to
+     * @param[in] encryption_metadata: The encryption metadata
+     * @param[in] encryption_metadata_size: The size of encryption metadata
+     * @param[in] rsaWrapAlgId: Rsa wrap algorithm id.
+     * @param[in] rsaHashAlgId: Rsa hash algorithm id.
+     * @return In case of success, AttestationResult object with error code ErrorCode::Success
+     * will be returned. Data is only written once it has been authenticated, but a stream that is
+     * truncated or tampered with further on is only detected there: in case of failure, an
+     * appropriate ErrorCode and description will be returned and everything written to output_fd
+     * must be discarded.
+     */
+    virtual attest::AttestationResult DecryptStream(const attest::EncryptionType encryption_type,
+                                                    int input_fd,
+                                                    int output_fd,
+                                                    const unsigned char* encryption_metadata,
+                                                    uint32_t encryption_metadata_size,
+                                                    const attest::RsaScheme tpm2RsaAlgId = attest::RsaScheme::RsaEs,
+                                                    const attest::RsaHashAlg tpm2HashAlgId = attest::RsaHashAlg::RsaSha1) noexcept = 0;
 };
 
 extern "C" {
@@ -117,6 +391,22 @@ extern "C" {
     bool Initialize(attest::AttestationLogger* attestation_logger,
                     AttestationClient** client);
 
+    /**
+     * @brief This function intializes the attestation client library with
+     * non-default options. It behaves like Initialize() otherwise.
+     * @param[in] attestation_logger: The handle that will be used for logging.
+     * @param[in] options: ClientOptions object that selects the optional behaviour of the
+     * library.
+     * @param[out] client: AttestationClient object that will be populated and
+     * returned when InitializeWithOptions() succeeds.
+     * @return In case the initialization is successful, return True.
+     * Otherwise, return False.
+     */
+    DllExports
+    bool InitializeWithOptions(attest::AttestationLogger* attestation_logger,
+                               const attest::ClientOptions* options,
+                               AttestationClient** client);
+
     /**
      * @brief This API uninitializes or deallocates the AttestationClient object
      */
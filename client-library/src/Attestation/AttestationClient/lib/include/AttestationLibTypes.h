@@ -10,6 +10,8 @@
 #include <unordered_map>
 
 #define CLIENT_PARAMS_VERSION 1 // V1 contains version, attestation_endpoint_url, client_payload
+#define CLIENT_OPTIONS_VERSION 1 // V1 contains version, ephemeral_key_pool_refresh_seconds, token_cache_refresh_seconds,
+                                 // shared_token_cache, external_event_loop, data_key_cache_ttl_seconds
 
 namespace attest {
 
@@ -52,7 +54,11 @@ namespace attest {
             ERROR_AK_CERT_PROVISIONING_FAILED = -29,
             ERROR_EMPTY_TD_QUOTE = -30,
             ERROR_AK_CERT_PARSING = -31,
-            ERROR_AK_CERT_RENEW = -32
+            ERROR_AK_CERT_RENEW = -32,
+            ERROR_ATTESTATION_CANCELLED = -33,
+            ERROR_DATA_ENCRYPTION_FAILED = -34,
+            ERROR_DATA_DECRYPTION_FAILED = -35,
+            ERROR_STREAM_IO_FAILED = -36
         };
 
         AttestationResult() = default;
@@ -90,6 +96,86 @@ namespace attest {
         const unsigned char* client_payload = nullptr;
     };
 
+    /**
+     * @brief Structure to hold the optional behaviour of the client lib that is
+     * set once when the library is initialized.
+     */
+    struct ClientOptions {
+        /**
+         * Struct version
+         */
+        uint32_t version = CLIENT_OPTIONS_VERSION;
+
+        /**
+         * Interval in seconds at which the library checks the PCR values and
+         * pre-generates a certified ephemeral key for them in the background, so
+         * that attestation does not wait on TPM key generation. 0 disables
+         * pre-generation.
+         */
+        uint32_t ephemeral_key_pool_refresh_seconds = 0;
+
+        /**
+         * Enables the in memory token cache. Attest() returns a cached token that
+         * is still within its nbf and exp claims when it is called again with the
+         * same endpoint and client payload. Cached tokens that are in use are
+         * re-attested in the background this many seconds before they expire.
+         * 0 disables the cache.
+         */
+        uint32_t token_cache_refresh_seconds = 0;
+
+        /**
+         * Enables the token cache shared by all the processes on the machine that
+         * enable it. Only one of the processes asking for the same endpoint and
+         * client payload attests, the others read the token it stored. The cache
+         * is kept in a directory only root can access and is skipped when the
+         * library does not run as root.
+         */
+        bool shared_token_cache = false;
+
+        /**
+         * Drives AttestAsync() requests from the event loop of the caller instead
+         * of a library thread. The caller waits on the descriptors returned by
+         * AttestationClient::GetPollDescriptors() and calls AttestationClient::Step()
+         * when one of them is ready or the timeout expires. The callbacks of
+         * AttestAsync() are then called from Step(). Linux only.
+         */
+        bool external_event_loop = false;
+
+        /**
+         * Enables the cache of keys unwrapped by the TPM in Decrypt(). A wrapped key
+         * that is decrypted again within this many seconds is served from memory
+         * locked into RAM and excluded from core dumps, without creating a TPM key.
+         * Cached keys are dropped as soon as the PCR values change. Linux only.
+         * 0 disables the cache.
+         */
+        uint32_t data_key_cache_ttl_seconds = 0;
+    };
+
+    /**
+     * @brief A file descriptor the event loop of the caller has to watch on
+     * behalf of the library, see AttestationClient::GetPollDescriptors().
+     */
+    struct PollDescriptor {
+        enum Events : short {
+            Read = 0x1,
+            Write = 0x2,
+            Error = 0x4
+        };
+
+        int fd = -1;
+
+        /**
+         * The events the library waits for.
+         */
+        short events = 0;
+
+        /**
+         * The events that occurred, set by the caller before passing the
+         * descriptor to AttestationClient::Step().
+         */
+        short revents = 0;
+    };
+
     enum class OsType {
         LINUX,
         WINDOWS,
@@ -116,7 +202,11 @@ namespace attest {
 #endif
 
     enum class EncryptionType {
-        NONE
+        NONE,
+        // The data is encrypted with a random AES-256-GCM key in chunks, and only that
+        // key is wrapped with the RSA key. Any amount of data costs a single RSA
+        // operation, and the metadata carries the wrapped key.
+        ENVELOPE_AES_GCM
     };
 
     /**
@@ -0,0 +1,120 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="AttestationToken.h" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace attest {
+
+/**
+ * @brief A public key published in the x-ms-runtime claim of an attestation token, as a JWK.
+ */
+struct RuntimeKey {
+    std::string kid; /**< The key id. */
+    std::string kty; /**< The key type, RSA for the TPM ephemeral key. */
+    std::string n; /**< The base64url encoded modulus of an RSA key. */
+    std::string e; /**< The base64url encoded exponent of an RSA key. */
+};
+
+/**
+ * @brief An attestation token returned by Microsoft Azure Attestation Service (MAA).
+ *
+ * The token holds the jwt once. Its header and claims are decoded the first time any of them
+ * is accessed and kept for later calls, so the token can be handed around, checked and used
+ * for encryption repeatedly without being parsed again. Tokens are immutable and are shared
+ * by std::shared_ptr, all methods may be called from several threads at once.
+ *
+ * The token is not verified: the signature is not checked and the accessors only report
+ * what the token claims.
+ */
+class AttestationToken {
+public:
+    /**
+     * @brief Creates a token from a jwt. The jwt is not decoded until it is accessed.
+     * @param[in] jwt The jwt (header.claims.signature).
+     */
+    explicit AttestationToken(std::string jwt);
+
+    ~AttestationToken();
+
+    AttestationToken(const AttestationToken&) = delete;
+    AttestationToken& operator=(const AttestationToken&) = delete;
+
+    /**
+     * @brief Returns the jwt the token was created from.
+     */
+    const std::string& Jwt() const { return jwt_; }
+
+    /**
+     * @brief Returns true if the jwt has three parts and its header and claims are base64url
+     * encoded JSON objects.
+     */
+    bool IsValid() const;
+
+    /**
+     * @brief Retrieves a top level string claim.
+     * @param[in] name The name of the claim.
+     * @param[out] value The value of the claim.
+     * @return true if the token has a string claim of that name, false otherwise.
+     */
+    bool GetClaim(const std::string& name, std::string& value) const;
+
+    /**
+     * @brief Retrieves a string member of the jwt header, for example alg or kid.
+     * @param[in] name The name of the header member.
+     * @param[out] value The value of the header member.
+     * @return true if the header has a string member of that name, false otherwise.
+     */
+    bool GetHeader(const std::string& name, std::string& value) const;
+
+    /**
+     * @brief Retrieves the attestation type of the isolated environment, the
+     * x-ms-isolation-tee.x-ms-attestation-type claim, for example sevsnpvm.
+     * @return true if the token has the claim, false otherwise.
+     */
+    bool GetIsolationType(std::string& isolation_type) const;
+
+    /**
+     * @brief Retrieves the compliance status of the isolated environment, the
+     * x-ms-isolation-tee.x-ms-compliance-status claim, for example azure-compliant-cvm.
+     * @return true if the token has the claim, false otherwise.
+     */
+    bool GetComplianceStatus(std::string& compliance_status) const;
+
+    /**
+     * @brief Returns the keys of the x-ms-runtime claim, in the order of the token. Empty if the
+     * token has none or cannot be decoded.
+     */
+    const std::vector<RuntimeKey>& GetRuntimeKeys() const;
+
+    /**
+     * @brief Retrieves the exp claim.
+     * @param[out] expiry The expiry in seconds since the epoch.
+     * @return true if the token has an exp claim, false otherwise.
+     */
+    bool GetExpiry(int64_t& expiry) const;
+
+    /**
+     * @brief Retrieves the nbf claim.
+     * @param[out] not_before The start of the validity in seconds since the epoch.
+     * @return true if the token has an nbf claim, false otherwise.
+     */
+    bool GetNotBefore(int64_t& not_before) const;
+
+private:
+    struct Decoded;
+
+    const Decoded& decoded() const;
+
+    const std::string jwt_;
+    mutable std::once_flag decode_once_;
+    mutable std::unique_ptr<Decoded> decoded_;
+};
+} // attest
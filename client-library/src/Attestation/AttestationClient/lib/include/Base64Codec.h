@@ -0,0 +1,63 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="Base64Codec.h" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+
+namespace attest {
+namespace base64 {
+
+/**
+ * The two alphabets of RFC 4648. Standard output is padded with '=', url output is not.
+ * Decoding accepts input with or without padding in both alphabets.
+ */
+enum class Alphabet {
+    Standard,
+    Url
+};
+
+/**
+ * @brief Returns the number of characters Encode() writes for size bytes.
+ * @param[in] size The number of bytes to encode.
+ * @param[in] alphabet The alphabet to encode with.
+ */
+size_t EncodedSize(size_t size, Alphabet alphabet);
+
+/**
+ * @brief This function will be used to encode binary data in one pass.
+ * On x86 processors with SSSE3 or AVX2 support the bulk of the data is encoded
+ * with vector instructions.
+ * @param[in] data The data to encode.
+ * @param[in] size The number of bytes in data.
+ * @param[out] out Receives the encoded characters, must hold EncodedSize(size, alphabet)
+ * characters. No null terminator is written.
+ * @param[in] alphabet The alphabet to encode with.
+ * @return The number of characters written.
+ */
+size_t Encode(const unsigned char* data, size_t size, char* out, Alphabet alphabet);
+
+/**
+ * @brief Returns an upper bound on the number of bytes Decode() writes for size characters.
+ * @param[in] size The number of characters to decode.
+ */
+size_t MaxDecodedSize(size_t size);
+
+/**
+ * @brief This function will be used to decode base64 data in one pass, without
+ * building any intermediate string.
+ * @param[in] data The characters to decode.
+ * @param[in] size The number of characters in data.
+ * @param[out] out Receives the decoded bytes, must hold MaxDecodedSize(size) bytes.
+ * @param[out] out_size The number of bytes written.
+ * @param[in] alphabet The alphabet data is encoded with.
+ * @return true on success, false if data contains a character outside the alphabet,
+ * misplaced padding or has an impossible length.
+ */
+bool Decode(const char* data, size_t size, unsigned char* out, size_t& out_size, Alphabet alphabet);
+
+} // base64
+} // attest
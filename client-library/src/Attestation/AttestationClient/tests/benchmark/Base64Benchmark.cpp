@@ -0,0 +1,109 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="Base64Benchmark.cpp" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+// Compares the library base64 codec with the boost iterator implementation it replaced.
+// Usage: Base64Benchmark [iterations]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include <boost/archive/iterators/base64_from_binary.hpp>
+#include <boost/archive/iterators/binary_from_base64.hpp>
+#include <boost/archive/iterators/transform_width.hpp>
+#include <boost/algorithm/string.hpp>
+#include "Base64Codec.h"
+
+using namespace attest;
+
+namespace {
+
+std::string boostEncodeUrl(const std::vector<unsigned char>& data) {
+    using namespace boost::archive::iterators;
+    using It = base64_from_binary<transform_width<std::vector<unsigned char>::const_iterator, 6, 8>>;
+    auto tmp = std::string(It(std::begin(data)), It(std::end(data)));
+    boost::replace_all(tmp, "+", "-");
+    boost::replace_all(tmp, "/", "_");
+    return tmp;
+}
+
+std::vector<unsigned char> boostDecodeUrl(const std::string& data) {
+    using namespace boost::archive::iterators;
+    using It = transform_width<binary_from_base64<std::string::const_iterator>, 8, 6>;
+    std::string string_data = data;
+    boost::replace_all(string_data, "-", "+");
+    boost::replace_all(string_data, "_", "/");
+    return std::vector<unsigned char>(It(std::begin(string_data)), It(std::end(string_data)));
+}
+
+std::string codecEncodeUrl(const std::vector<unsigned char>& data) {
+    std::string encoded(base64::EncodedSize(data.size(), base64::Alphabet::Url), '\0');
+    base64::Encode(data.data(), data.size(), &encoded[0], base64::Alphabet::Url);
+    return encoded;
+}
+
+std::vector<unsigned char> codecDecodeUrl(const std::string& data) {
+    std::vector<unsigned char> decoded(base64::MaxDecodedSize(data.size()));
+    size_t decoded_size = 0;
+    if (!base64::Decode(data.data(), data.size(), decoded.data(), decoded_size, base64::Alphabet::Url)) {
+        fprintf(stderr, "Decode failed\n");
+        exit(1);
+    }
+    decoded.resize(decoded_size);
+    return decoded;
+}
+
+// Returns the throughput of fn in MB/s of input.
+template <typename Fn>
+double measure(size_t input_size, int iterations, Fn fn) {
+    size_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        sink += fn().size();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if (sink == 0) {
+        fprintf(stderr, "Empty result\n");
+    }
+    return static_cast<double>(input_size) * iterations / elapsed.count() / 1e6;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 200;
+    if (iterations <= 0) {
+        fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    std::mt19937 rng(42);
+    printf("%10s %16s %16s %16s %16s\n", "bytes", "boost enc MB/s", "codec enc MB/s", "boost dec MB/s", "codec dec MB/s");
+
+    // A typical evidence field, a TCG log and a whole attestation request.
+    for (size_t size : { 64, 1024, 16 * 1024, 256 * 1024, 1024 * 1024 }) {
+        std::vector<unsigned char> data(size);
+        for (auto& byte : data) {
+            byte = static_cast<unsigned char>(rng());
+        }
+        std::string encoded = codecEncodeUrl(data);
+        if (encoded != boostEncodeUrl(data) || codecDecodeUrl(encoded) != data) {
+            fprintf(stderr, "Codec output differs from boost for %zu bytes\n", size);
+            return 1;
+        }
+
+        int rounds = std::max(1, static_cast<int>(iterations * (1024 * 1024 / size) / 64));
+        double boost_encode = measure(size, rounds, [&]() { return boostEncodeUrl(data); });
+        double codec_encode = measure(size, rounds, [&]() { return codecEncodeUrl(data); });
+        double boost_decode = measure(encoded.size(), rounds, [&]() { return boostDecodeUrl(encoded); });
+        double codec_decode = measure(encoded.size(), rounds, [&]() { return codecDecodeUrl(encoded); });
+        printf("%10zu %16.1f %16.1f %16.1f %16.1f\n", size, boost_encode, codec_encode, boost_decode, codec_decode);
+    }
+    return 0;
+}
@@ -0,0 +1,149 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="MaaResponseBenchmark.cpp" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+// Compares the single pass MAA response parser with the Json::Reader based path it replaced.
+// Usage: MaaResponseBenchmark [iterations]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include <json/json.h>
+#include "AttestationHelper.h"
+#include "AttestationLibConst.h"
+#include "MaaResponseParser.h"
+
+using namespace attest;
+
+namespace {
+
+std::string randomBase64(std::mt19937& rng, size_t size) {
+    attest::Buffer data(size);
+    for (auto& byte : data) {
+        byte = static_cast<unsigned char>(rng());
+    }
+    return base64::binary_to_base64(data);
+}
+
+// Builds an MAA response the way the service lays it out, with a jwt of jwt_size bytes.
+std::string makeResponse(std::mt19937& rng, size_t jwt_size) {
+    std::string envelope = std::string("{\"") +
+        JSON_RESPONSE_ENC_INNER_KEY_KEY + "\":\"" + randomBase64(rng, 256) + "\",\"" +
+        JSON_RESPONSE_EXCRYPTION_PARAMETERS_KEY + "\":{\"" +
+            JSON_RESPONSE_BLOCK_MODE_KEY + "\":\"" + JSON_RESPONSE_BLOCK_MODE_CHAINING_GCM_VALUE + "\",\"" +
+            JSON_RESPONSE_BLOCK_PADDING_KEY + "\":\"" + JSON_RESPONSE_BLOCK_PADDING_PKCS7_VALUE + "\",\"" +
+            JSON_RESPONSE_CIPHER_KEY + "\":\"AES\",\"" +
+            JSON_RESPONSE_BLOCK_KEY_SIZE_KEY + "\":256,\"" +
+            JSON_RESPONSE_IV_KEY + "\":\"" + randomBase64(rng, 12) + "\"},\"" +
+        JSON_RESPONSE_AUTHENTICATION_DATA_KEY + "\":\"" + randomBase64(rng, 16) + "\",\"" +
+        JSON_RESPONSE_JWT_KEY + "\":\"" + randomBase64(rng, jwt_size) + "\"}";
+
+    attest::Buffer envelope_bytes(envelope.begin(), envelope.end());
+    return "{\"token\":\"" + base64::binary_to_base64url(envelope_bytes) + "\"}";
+}
+
+// The path ParseMaaResponse and DecryptMaaToken used to take: two Json::Reader parses and
+// a lookup and decode per field.
+bool readerParse(const std::string& response, MaaEnvelope& envelope) {
+    Json::Value root;
+    Json::Reader reader;
+    if (!reader.parse(response.c_str(), root)) {
+        return false;
+    }
+    std::string token = root["token"].asString();
+
+    attest::Buffer decoded = base64::base64url_to_binary(token);
+    std::string decoded_str(decoded.begin(), decoded.end());
+    Json::Value json_obj;
+    if (!reader.parse(decoded_str.c_str(), json_obj)) {
+        return false;
+    }
+
+    Json::Value params = json_obj.get(JSON_RESPONSE_EXCRYPTION_PARAMETERS_KEY, Json::Value());
+    if (params.isNull()) {
+        return false;
+    }
+    std::string block_mode = params.get(JSON_RESPONSE_BLOCK_MODE_KEY, "").asString();
+    std::string block_padding = params.get(JSON_RESPONSE_BLOCK_PADDING_KEY, "").asString();
+    std::string cipher = params.get(JSON_RESPONSE_CIPHER_KEY, "").asString();
+    if (block_mode.empty() || block_padding.empty() || cipher.empty()) {
+        return false;
+    }
+    envelope.encryption_params.key_size = static_cast<size_t>(params.get(JSON_RESPONSE_BLOCK_KEY_SIZE_KEY, 0).asInt());
+    envelope.encryption_params.iv = base64::base64_to_binary(params.get(JSON_RESPONSE_IV_KEY, "").asString());
+    envelope.encryption_params.authentication_data =
+        base64::base64_to_binary(json_obj.get(JSON_RESPONSE_AUTHENTICATION_DATA_KEY, "").asString());
+    envelope.encrypted_inner_key = base64::base64_to_binary(json_obj.get(JSON_RESPONSE_ENC_INNER_KEY_KEY, "").asString());
+    envelope.jwt_encrypted = base64::base64_to_binary(json_obj.get(JSON_RESPONSE_JWT_KEY, "").asString());
+    return true;
+}
+
+bool pullParse(const std::string& response, MaaEnvelope& envelope) {
+    std::string token;
+    std::string err;
+    return ExtractMaaToken(response, token) &&
+           ParseMaaEnvelope(token, envelope, err);
+}
+
+// Returns the number of responses parsed per second by fn.
+template <typename Fn>
+double measure(const std::string& response, int iterations, Fn fn) {
+    size_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        MaaEnvelope envelope;
+        if (!fn(response, envelope)) {
+            fprintf(stderr, "Parse failed\n");
+            exit(1);
+        }
+        sink += envelope.jwt_encrypted.size();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if (sink == 0) {
+        fprintf(stderr, "Empty result\n");
+    }
+    return iterations / elapsed.count();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 2000;
+    if (iterations <= 0) {
+        fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    std::mt19937 rng(42);
+    printf("%10s %14s %16s %16s\n", "jwt bytes", "response bytes", "reader parses/s", "pull parses/s");
+
+    // A bare token, a typical token and one carrying a large set of claims.
+    for (size_t jwt_size : { 512, 4 * 1024, 64 * 1024 }) {
+        std::string response = makeResponse(rng, jwt_size);
+
+        MaaEnvelope expected;
+        MaaEnvelope actual;
+        if (!readerParse(response, expected) ||
+            !pullParse(response, actual) ||
+            expected.jwt_encrypted != actual.jwt_encrypted ||
+            expected.encrypted_inner_key != actual.encrypted_inner_key ||
+            expected.encryption_params.iv != actual.encryption_params.iv ||
+            expected.encryption_params.authentication_data != actual.encryption_params.authentication_data ||
+            expected.encryption_params.key_size != actual.encryption_params.key_size) {
+            fprintf(stderr, "Pull parser output differs from Json::Reader for a %zu byte jwt\n", jwt_size);
+            return 1;
+        }
+
+        int rounds = std::max(1, static_cast<int>(iterations * 4096 / (jwt_size + 4096)));
+        double reader_rate = measure(response, rounds, readerParse);
+        double pull_rate = measure(response, rounds, pullParse);
+        printf("%10zu %14zu %16.0f %16.0f\n", jwt_size, response.size(), reader_rate, pull_rate);
+    }
+    return 0;
+}
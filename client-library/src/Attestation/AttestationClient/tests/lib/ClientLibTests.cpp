@@ -6,13 +6,26 @@
 #include <stdio.h>
 #include <gtest/gtest.h>
 #include <cstring>
+#include <unistd.h>
+#include <dirent.h>
+#include <poll.h>
 #include <iostream>
 #include <fstream>
 #include <streambuf>
 #include <numeric>
+#include <algorithm>
+#include <stdexcept>
 #include <random>
+#include <atomic>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <json/json.h>
 #include <openssl/bio.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
 
 #include "AttestationHelper.h"
 #include <Logging.h>
@@ -20,6 +33,22 @@
 #include <AttestationLibConst.h>
 #include <HclReportParser.h>
 #include <AttestationLibUtils.h>
+#include <SnpVmReport.h>
+#include <VcekCertCache.h>
+#include <TokenCache.h>
+#include <SharedTokenCache.h>
+#include <RsaKeyCache.h>
+#include <DataKeyCache.h>
+#include <EnvelopeCipher.h>
+#include <HttpTransport.h>
+#include <TaskExecutor.h>
+#include <AsyncHttpClient.h>
+#include <EventNotifier.h>
+#include <NonceMerkleTree.h>
+#include <Base64Codec.h>
+#include <JsonStreamWriter.h>
+#include <JsonPullParser.h>
+#include <MaaResponseParser.h>
 
 constexpr char test_os_release[] = "test-os-release";
 constexpr char valid_version_entries[] = "NAME=\"Test-OS\"\nVERSION_ID=\"1.10\"";
@@ -46,6 +75,88 @@ static void deleteFile(const char* file_name) {
     EXPECT_EQ(remove(file_name), 0);
 }
 
+/**
+ * @brief Creates a base64 encoded PEM self signed certificate that expires after
+ * valid_seconds.
+ */
+static std::string createCertificate(long valid_seconds) {
+    EVP_PKEY* pkey = nullptr;
+    EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, nullptr);
+    EXPECT_EQ(EVP_PKEY_keygen_init(ctx), 1);
+    EXPECT_EQ(EVP_PKEY_CTX_set_rsa_keygen_bits(ctx, 2048), 1);
+    EXPECT_EQ(EVP_PKEY_keygen(ctx, &pkey), 1);
+    EVP_PKEY_CTX_free(ctx);
+
+    X509* cert = X509_new();
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), -60);
+    X509_gmtime_adj(X509_getm_notAfter(cert), valid_seconds);
+    X509_set_pubkey(cert, pkey);
+    X509_NAME_add_entry_by_txt(X509_get_subject_name(cert), "CN", MBSTRING_ASC,
+                               (const unsigned char*)"VCEK", -1, -1, 0);
+    X509_set_issuer_name(cert, X509_get_subject_name(cert));
+    EXPECT_NE(X509_sign(cert, pkey, EVP_sha256()), 0);
+
+    BIO* bio = BIO_new(BIO_s_mem());
+    PEM_write_bio_X509(bio, cert);
+    char* pem = nullptr;
+    long pem_size = BIO_get_mem_data(bio, &pem);
+    std::string pem_str(pem, pem_size);
+    BIO_free(bio);
+    X509_free(cert);
+    EVP_PKEY_free(pkey);
+
+    return attest::base64::base64_encode(pem_str);
+}
+
+/**
+ * @brief Removes a directory along with the files in it.
+ */
+static void deleteDirectory(const std::string& path) {
+    DIR* dir = opendir(path.c_str());
+    ASSERT_NE(dir, nullptr);
+    struct dirent* entry = nullptr;
+    while ((entry = readdir(dir)) != nullptr) {
+        std::string name(entry->d_name);
+        if (name != "." && name != "..") {
+            deleteFile((path + "/" + name).c_str());
+        }
+    }
+    closedir(dir);
+    EXPECT_EQ(rmdir(path.c_str()), 0);
+}
+
+/**
+ * @brief Creates an unsigned JWT with the given nbf and exp claims relative to now.
+ */
+static std::string createJwt(long nbf_offset_seconds, long exp_offset_seconds, const std::string& id) {
+    time_t now = time(nullptr);
+    std::string header = "{\"alg\":\"none\"}";
+    std::string claims = "{\"nbf\":" + std::to_string(now + nbf_offset_seconds) +
+                         ",\"exp\":" + std::to_string(now + exp_offset_seconds) +
+                         ",\"jti\":\"" + id + "\"}";
+    return attest::base64::binary_to_base64url(attest::Buffer(header.begin(), header.end())) + "." +
+           attest::base64::binary_to_base64url(attest::Buffer(claims.begin(), claims.end())) + ".sig";
+}
+
+/**
+ * @brief Encrypts plaintext in the ENVELOPE_AES_GCM format with the given key.
+ */
+static std::vector<unsigned char> encryptChunks(const attest::Buffer& key,
+                                                const attest::envelope::Metadata& metadata,
+                                                const std::vector<unsigned char>& plaintext) {
+    using namespace attest::envelope;
+    uint64_t chunk_count = ChunkCount(plaintext.size(), metadata.chunk_size);
+    std::vector<unsigned char> ciphertext(EncryptedSize(plaintext.size(), metadata.chunk_size));
+    ChunkCipher cipher(key.data(), metadata.nonce_prefix.data());
+    for (uint64_t i = 0; i < chunk_count; i++) {
+        size_t size = std::min<size_t>(metadata.chunk_size, plaintext.size() - i * metadata.chunk_size);
+        EXPECT_TRUE(cipher.EncryptChunk(i, i + 1 == chunk_count, plaintext.data() + i * metadata.chunk_size, size,
+                                        ciphertext.data() + i * (metadata.chunk_size + tag_size)));
+    }
+    return ciphertext;
+}
+
 class Logger : public attest::AttestationLogger {
 public:
 
@@ -86,6 +197,46 @@ namespace AttestationClientLibTest {
             hcl_report_parser.reset();
         }
 
+        void putCachedToken(AttestationClientImpl& attestation_client,
+                            const std::string& endpoint_url,
+                            const std::string& client_payload,
+                            const std::string& jwt_token) {
+            attestation_client.token_cache_->Put(endpoint_url, client_payload, jwt_token);
+        }
+
+        attest::AttestationResult decryptChunks(const attest::Buffer& dek,
+                                                const attest::envelope::Metadata& metadata,
+                                                uint64_t first_index,
+                                                bool ends_message,
+                                                const unsigned char* encrypted_data,
+                                                uint64_t size,
+                                                unsigned char* decrypted_data,
+                                                size_t decrypted_stride) {
+            return client->decryptChunks(dek, metadata, first_index, ends_message, encrypted_data, size,
+                                         decrypted_data, decrypted_stride);
+        }
+
+        attest::AttestationResult decryptStream(const attest::Buffer& dek,
+                                                const attest::envelope::Metadata& metadata,
+                                                const std::vector<unsigned char>& encrypted_data,
+                                                std::vector<unsigned char>& decrypted_data) {
+            FILE* input = tmpfile();
+            FILE* output = tmpfile();
+            EXPECT_NE(input, nullptr);
+            EXPECT_NE(output, nullptr);
+            EXPECT_EQ(fwrite(encrypted_data.data(), 1, encrypted_data.size(), input), encrypted_data.size());
+            fflush(input);
+            rewind(input);
+
+            attest::AttestationResult result = client->decryptStream(dek, metadata, fileno(input), fileno(output));
+            decrypted_data.resize(lseek(fileno(output), 0, SEEK_END));
+            rewind(output);
+            EXPECT_EQ(fread(decrypted_data.data(), 1, decrypted_data.size(), output), decrypted_data.size());
+            fclose(input);
+            fclose(output);
+            return result;
+        }
+
         void getAttestationParameters(attest::AttestationParameters& params, attest::IsolationType isolation_type);
         attest::AttestationResult getTpmInfo(attest::TpmInfo& tpm_info);
         attest::AttestationResult getIsolationInfo(attest::IsolationInfo& isolation_info, attest::IsolationType isolation_type);
@@ -442,6 +593,187 @@ namespace AttestationClientLibTest {
         params.isolation_info_ = isolation_info;
     }
 
+    TEST_F(ClientLibTests, TestJsonStreamWriter_encoded_output) {
+        // Values large enough to cross several staging chunks.
+        attest::Buffer small_value = { 0x00, 0xff, 0x10 };
+        attest::Buffer large_value(40000);
+        for (size_t i = 0; i < large_value.size(); i++) {
+            large_value[i] = static_cast<unsigned char>(i * 7);
+        }
+        std::string text = "quote \" backslash \\ newline \n control \x01 end";
+
+        std::string outputs[3];
+        JsonStreamWriter::Output modes[3] = { JsonStreamWriter::Output::Json,
+                                              JsonStreamWriter::Output::Base64,
+                                              JsonStreamWriter::Output::Base64Url };
+        for (int i = 0; i < 3; i++) {
+            JsonStreamWriter writer(outputs[i], modes[i]);
+            writer.BeginObject();
+            writer.Key("text");
+            writer.String(text);
+            writer.Key("small");
+            writer.Base64(small_value.data(), small_value.size(), attest::base64::Alphabet::Standard);
+            writer.Key("large");
+            writer.Base64(large_value.data(), large_value.size(), attest::base64::Alphabet::Url);
+            writer.Key("numbers");
+            writer.BeginArray();
+            writer.Int(-5);
+            writer.UInt(18446744073709551615ULL);
+            writer.BeginObject();
+            writer.EndObject();
+            writer.EndArray();
+            writer.EndObject();
+            writer.Finish();
+        }
+
+        const std::string& json = outputs[0];
+        EXPECT_EQ(json.find_first_of(" \t\n", json.find("\"small\"")), std::string::npos);
+        EXPECT_EQ(attest::base64::base64_decode(outputs[1]), json);
+        attest::Buffer url_decoded = attest::base64::base64url_to_binary(outputs[2]);
+        EXPECT_EQ(std::string(url_decoded.begin(), url_decoded.end()), json);
+
+        Json::Value root;
+        Json::Reader reader;
+        ASSERT_TRUE(reader.parse(json, root));
+        EXPECT_EQ(root["text"].asString(), text);
+        EXPECT_EQ(attest::base64::base64_to_binary(root["small"].asString()), small_value);
+        EXPECT_EQ(attest::base64::base64url_to_binary(root["large"].asString()), large_value);
+        ASSERT_EQ(root["numbers"].size(), 3);
+        EXPECT_EQ(root["numbers"][0].asInt(), -5);
+        EXPECT_EQ(root["numbers"][1].asUInt64(), 18446744073709551615ULL);
+        EXPECT_TRUE(root["numbers"][2].isObject());
+    }
+
+    TEST_F(ClientLibTests, TestJsonStreamWriter_full_chunk) {
+        // "{\"abc\":\"" is 8 bytes, so a 9210 byte value encodes to exactly fill the
+        // 12288 byte staging chunk before the closing quote. The sizes around it cover
+        // the chunk filling up in Base64(), in write(char) and in write(const char*).
+        for (size_t size = 9200; size < 9220; size++) {
+            attest::Buffer value(size, 0x5a);
+            std::string text(JSON_STREAM_CHUNK_SIZE - 8 - (size - 9200), 'x');
+            std::string outputs[2];
+            JsonStreamWriter::Output modes[2] = { JsonStreamWriter::Output::Json,
+                                                  JsonStreamWriter::Output::Base64 };
+            for (int i = 0; i < 2; i++) {
+                JsonStreamWriter writer(outputs[i], modes[i]);
+                writer.BeginObject();
+                writer.Key("abc");
+                writer.Base64(value.data(), value.size(), attest::base64::Alphabet::Standard);
+                writer.Key("text");
+                writer.String(text);
+                writer.EndObject();
+                writer.Finish();
+            }
+            EXPECT_EQ(attest::base64::base64_decode(outputs[1]), outputs[0]) << size;
+
+            Json::Value root;
+            Json::Reader reader;
+            ASSERT_TRUE(reader.parse(outputs[0], root)) << size;
+            EXPECT_EQ(attest::base64::base64_to_binary(root["abc"].asString()), value) << size;
+            EXPECT_EQ(root["text"].asString(), text) << size;
+        }
+    }
+
+    TEST_F(ClientLibTests, TestJsonPullParser_skip_and_unescape) {
+        std::string json = "{ \"skip\": {\"a\": [1, -2.5e3, true, false, null, {\"b\": []}], \"c\": {}},"
+                           " \"text\": \"line\\nquote\\\" slash\\/ \\u00e9\\ud83d\\ude00\","
+                           " \"number\": 42, \"empty\": [] }";
+        JsonPullParser parser(json.data(), json.size());
+        ASSERT_TRUE(parser.BeginObject());
+
+        JsonPullParser::Span key;
+        ASSERT_TRUE(parser.NextMember(key));
+        EXPECT_TRUE(key.Equals("skip"));
+        EXPECT_EQ(parser.Peek(), '{');
+        ASSERT_TRUE(parser.SkipValue());
+
+        ASSERT_TRUE(parser.NextMember(key));
+        EXPECT_TRUE(key.Equals("text"));
+        std::string text;
+        ASSERT_TRUE(parser.ReadString(text));
+        EXPECT_EQ(text, "line\nquote\" slash/ \xc3\xa9\xf0\x9f\x98\x80");
+
+        ASSERT_TRUE(parser.NextMember(key));
+        EXPECT_TRUE(key.Equals("number"));
+        int64_t number = 0;
+        ASSERT_TRUE(parser.ReadInt(number));
+        EXPECT_EQ(number, 42);
+
+        ASSERT_TRUE(parser.NextMember(key));
+        ASSERT_TRUE(parser.SkipValue());
+        EXPECT_FALSE(parser.NextMember(key));
+        EXPECT_FALSE(parser.Failed());
+        EXPECT_TRUE(parser.Finish());
+
+        // Malformed documents fail wherever the error is, including in skipped values.
+        std::vector<std::string> malformed = {
+            "{\"key\":\"value\"]",
+            "{\"a\":1,}",
+            "{\"a\":[1,]}",
+            "{\"a\":01}",
+            "{\"a\":tru}",
+            "{\"a\":\"\\x\"}",
+            "{\"a\":\"\\ud83d\"}",
+            "{\"a\":1} trailing",
+            "{\"a\":" + std::string(JSON_PULL_MAX_DEPTH, '[') + std::string(JSON_PULL_MAX_DEPTH, ']') + "}"
+        };
+        for (const auto& input : malformed) {
+            JsonPullParser p(input.data(), input.size());
+            bool ok = p.BeginObject();
+            while (ok && p.NextMember(key)) {
+                std::string value;
+                ok = p.Peek() == '"' ? p.ReadString(value) : p.SkipValue();
+            }
+            EXPECT_FALSE(ok && p.Finish()) << input;
+        }
+    }
+
+    TEST_F(ClientLibTests, TestParseMaaEnvelope) {
+        attest::Buffer inner_key(256, 0x11);
+        attest::Buffer iv(12, 0x22);
+        attest::Buffer auth_data(16, 0x33);
+        attest::Buffer jwt(1000, 0x44);
+
+        // The slashes in the jwt are escaped the way some serializers write them.
+        std::string jwt_base64 = attest::base64::binary_to_base64(jwt);
+        std::string escaped_jwt;
+        for (char c : jwt_base64) {
+            escaped_jwt += c == '/' ? std::string("\\/") : std::string(1, c);
+        }
+        auto make_token = [&](const std::string& params, bool with_jwt) {
+            std::string envelope = "{\"Unknown\":[{\"x\":1}],\"EncryptedInnerKey\":\"" +
+                attest::base64::binary_to_base64(inner_key) + "\",\"EncryptionParams\":" + params +
+                ",\"AuthenticationData\":\"" + attest::base64::binary_to_base64(auth_data) + "\"" +
+                (with_jwt ? ",\"Jwt\":\"" + escaped_jwt + "\"" : std::string()) + "}";
+            return attest::base64::binary_to_base64url(attest::Buffer(envelope.begin(), envelope.end()));
+        };
+        std::string params = "{\"BlockMode\":\"ChainingModeGCM\",\"BlockPadding\":\"PKCS7\",\"Cipher\":\"AES\","
+                             "\"KeySizeInBits\":256,\"Iv\":\"" + attest::base64::binary_to_base64(iv) + "\"}";
+
+        attest::MaaEnvelope envelope;
+        std::string err;
+        ASSERT_TRUE(attest::ParseMaaEnvelope(make_token(params, true), envelope, err)) << err;
+        EXPECT_EQ(envelope.encrypted_inner_key, inner_key);
+        EXPECT_EQ(envelope.encryption_params.iv, iv);
+        EXPECT_EQ(envelope.encryption_params.authentication_data, auth_data);
+        EXPECT_EQ(envelope.encryption_params.key_size, 256);
+        EXPECT_EQ(envelope.encryption_params.block_mode, attest::BlockCipherMode::CHAINING_MODE_GCM);
+        EXPECT_EQ(envelope.jwt_encrypted, jwt);
+
+        EXPECT_FALSE(attest::ParseMaaEnvelope(make_token(params, false), envelope, err));
+        EXPECT_EQ(err, "Failed to get jwt from response.");
+        EXPECT_FALSE(attest::ParseMaaEnvelope(make_token("\"not an object\"", true), envelope, err));
+        EXPECT_EQ(err, "Failed to get encryption parameters from response.");
+        EXPECT_FALSE(attest::ParseMaaEnvelope(make_token("{\"BlockMode\":\"CBC\"}", true), envelope, err));
+        EXPECT_EQ(err, "Unsupported block mode:CBC");
+        EXPECT_FALSE(attest::ParseMaaEnvelope("e30", envelope, err));
+        EXPECT_EQ(err, "Failed to get encrypted inner key from response.");
+        EXPECT_FALSE(attest::ParseMaaEnvelope("not base64!", envelope, err));
+        EXPECT_EQ(err, "Failed to parse AAS response");
+        EXPECT_FALSE(attest::ParseMaaEnvelope("e30x", envelope, err));
+        EXPECT_EQ(err, "Failed to parse AAS response");
+    }
+
     TEST_F(ClientLibTests, TestCreatePayloadTvm) {
         attest::AttestationParameters params;
         getAttestationParameters(params, attest::IsolationType::TRUSTED_LAUNCH);
@@ -620,6 +952,41 @@ namespace AttestationClientLibTest {
         EXPECT_EQ(binaryToBase64, base64String);
     }
 
+    TEST_F(ClientLibTests, TestBase64Codec_block_boundaries) {
+        // Lengths around the 12 and 24 byte blocks of the vector paths.
+        std::mt19937 rng(7);
+        for (size_t size = 0; size < 100; size++) {
+            attest::Buffer data(size);
+            for (auto& byte : data) {
+                byte = static_cast<unsigned char>(rng());
+            }
+
+            std::string encoded = attest::base64::binary_to_base64(data);
+            EXPECT_EQ(encoded.size(), attest::base64::EncodedSize(size, attest::base64::Alphabet::Standard));
+            EXPECT_EQ(attest::base64::base64_to_binary(encoded), data);
+
+            std::string url_encoded = attest::base64::binary_to_base64url(data);
+            EXPECT_EQ(url_encoded.find_first_of("+/="), std::string::npos);
+            EXPECT_EQ(attest::base64::base64url_to_binary(url_encoded), data);
+
+            std::string padded_url_encoded = encoded;
+            std::replace(padded_url_encoded.begin(), padded_url_encoded.end(), '+', '-');
+            std::replace(padded_url_encoded.begin(), padded_url_encoded.end(), '/', '_');
+            EXPECT_EQ(attest::base64::base64url_to_binary(padded_url_encoded), data);
+        }
+
+        std::string long_input(64, 'A');
+        long_input[40] = '-';
+        EXPECT_THROW(attest::base64::base64_to_binary(long_input), std::invalid_argument);
+        long_input[40] = '+';
+        EXPECT_THROW(attest::base64::base64url_to_binary(long_input), std::invalid_argument);
+        long_input[40] = '\x80';
+        EXPECT_THROW(attest::base64::base64_to_binary(long_input), std::invalid_argument);
+        EXPECT_THROW(attest::base64::base64_to_binary("Zm9v=mFy"), std::invalid_argument);
+        EXPECT_THROW(attest::base64::base64_to_binary("Zm9vY"), std::invalid_argument);
+        EXPECT_THROW(attest::base64::base64_to_binary("Zm9vYg="), std::invalid_argument);
+    }
+
     TEST_F(ClientLibTests, TestEncryptDataWithRSAPubKey) {
         const char k[] =
             "-----BEGIN PUBLIC KEY-----\n"
@@ -759,6 +1126,86 @@ namespace AttestationClientLibTest {
         EXPECT_FALSE(res);
     }
 
+    TEST_F(ClientLibTests, TestAttestationToken_claims) {
+        // The "~~~" subject encodes to base64url characters outside of the standard alphabet.
+        std::string header = "{\"alg\":\"RS256\",\"kid\":\"key-1\"}";
+        std::string claims = "{\"exp\":1650008580,\"nbf\":1649979780,\"sub\":\"~~~\","
+                             "\"x-ms-isolation-tee\":{\"x-ms-attestation-type\":\"sevsnpvm\","
+                             "\"x-ms-compliance-status\":\"azure-compliant-cvm\"},"
+                             "\"x-ms-runtime\":{\"keys\":[{\"kid\":\"TpmEphemeralEncryptionKey\",\"kty\":\"RSA\","
+                             "\"n\":\"modulus\",\"e\":\"AQAB\"},{\"kid\":\"second\"}]}}";
+        std::string jwt = attest::base64::binary_to_base64url(attest::Buffer(header.begin(), header.end())) + "." +
+                          attest::base64::binary_to_base64url(attest::Buffer(claims.begin(), claims.end())) + ".signature";
+        ASSERT_NE(jwt.find_first_of("-_"), std::string::npos);
+
+        auto token = std::make_shared<const attest::AttestationToken>(jwt);
+        EXPECT_EQ(token->Jwt(), jwt);
+
+        // The claims are decoded once, whichever thread gets to them first.
+        std::vector<std::thread> threads;
+        std::atomic<int> isolated(0);
+        for (int i = 0; i < 4; i++) {
+            threads.emplace_back([&]() {
+                std::string isolation_type;
+                if (token->GetIsolationType(isolation_type) && isolation_type == "sevsnpvm") {
+                    isolated++;
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        EXPECT_EQ(isolated.load(), 4);
+
+        EXPECT_TRUE(token->IsValid());
+        std::string value;
+        EXPECT_TRUE(token->GetComplianceStatus(value));
+        EXPECT_EQ(value, "azure-compliant-cvm");
+        EXPECT_TRUE(token->GetHeader("kid", value));
+        EXPECT_EQ(value, "key-1");
+        EXPECT_TRUE(token->GetClaim("sub", value));
+        EXPECT_EQ(value, "~~~");
+        EXPECT_FALSE(token->GetClaim("exp", value));
+
+        int64_t expiry = 0, not_before = 0;
+        EXPECT_TRUE(token->GetExpiry(expiry));
+        EXPECT_EQ(expiry, 1650008580);
+        EXPECT_TRUE(token->GetNotBefore(not_before));
+        EXPECT_EQ(not_before, 1649979780);
+
+        const std::vector<attest::RuntimeKey>& keys = token->GetRuntimeKeys();
+        ASSERT_EQ(keys.size(), 2);
+        EXPECT_EQ(keys[0].kid, "TpmEphemeralEncryptionKey");
+        EXPECT_EQ(keys[0].kty, "RSA");
+        EXPECT_EQ(keys[0].n, "modulus");
+        EXPECT_EQ(keys[0].e, "AQAB");
+        EXPECT_EQ(keys[1].kid, "second");
+        EXPECT_TRUE(keys[1].n.empty());
+
+        std::string n, e;
+        EXPECT_TRUE(attest::jwt::ExtractJwkInfoFromAttestationToken(*token, n, e));
+        EXPECT_EQ(n, "modulus");
+        EXPECT_TRUE(attest::jwt::ExtractValidityFromAttestationJwt(jwt, not_before, expiry));
+        EXPECT_EQ(expiry, 1650008580);
+
+        // Malformed tokens are reported by the accessors, not on construction.
+        for (const std::string& invalid : { std::string("no-dots"), std::string("e30.e30"), std::string("e30.!!.sig"),
+                                            std::string("W10.e30.sig") }) {
+            attest::AttestationToken invalid_token(invalid);
+            EXPECT_FALSE(invalid_token.IsValid()) << invalid;
+            EXPECT_FALSE(invalid_token.GetIsolationType(value)) << invalid;
+            EXPECT_FALSE(invalid_token.GetExpiry(expiry)) << invalid;
+            EXPECT_TRUE(invalid_token.GetRuntimeKeys().empty()) << invalid;
+        }
+
+        // A valid token without the optional claims.
+        attest::AttestationToken bare("e30.e30.sig");
+        EXPECT_TRUE(bare.IsValid());
+        EXPECT_FALSE(bare.GetIsolationType(value));
+        EXPECT_FALSE(bare.GetNotBefore(not_before));
+        EXPECT_FALSE(attest::jwt::ExtractJwkInfoFromAttestationToken(bare, n, e));
+    }
+
     TEST_F(ClientLibTests, ConvertJwkToRsaPubKey_positive) {
         const std::string n = "sn9xSwAADYOp0X4HGCWfu2B9GnvCc6jNhAKmbd7epP4AwV7pFtcaeQCeUzF_8Znm98q0hlN9NiP_a_0ud1ZbodDDkq3h69zSDXhk5"
             "9K1NudHpnZuxhNd2REDyZI1QaCGKd17Eqb7Zt1WOrn8jFQci-106W6ufKUeBZKa2lD8MvXjM_vJyxJyrPboCAWZkmjvfWZPEFFgbsg"
@@ -858,6 +1305,376 @@ namespace AttestationClientLibTest {
         EXPECT_EQ(encrypted_data_size, 256);
     }
 
+    TEST_F(ClientLibTests, RsaKeyCache_positive) {
+        const std::string n = "qoOpjgAAp0_c_hhBU63bUbLGuuIPq3dFkpZbpHEZXubkDzRL9XzL3GzOEdAX1v0wF0qNteJwcTRQ2Q2F9yozHqzD-anbjBXvONpMYVyQuw2oEwSFuSB7eyrN1Emlc7dI1E7ZKCR-5_K3m6j2p10-5Swbmb3Ri2wkLI1kKmzXF4uZZWN6LDW9m0vpDW_53krrAwCCGgW6pW7W7K6gerdFwGT2rkUCNuYW0E0ie0Q1Q2hJdbfF8qHbML23ufmgDnq23YGSEbuXPUv8mgdDCeKhPB2WrkBdX7x-chTxRU9uO8yRDsCb6lAeHbvhOW1CbbWZIVctTe3T5hiwsC4BdbVGKQ";
+        const std::string e = "AQAB";
+        int64_t expiry = static_cast<int64_t>(time(nullptr)) + 3600;
+        RsaKeyCache cache;
+
+        // A released context is handed out again, a context still leased is not.
+        EVP_PKEY_CTX* first = nullptr;
+        {
+            RsaKeyCache::Context context;
+            ASSERT_EQ(cache.Acquire(n, e, expiry, RsaScheme::RsaOaep, RsaHashAlg::RsaSha256, context).code_,
+                      attest::AttestationResult::ErrorCode::SUCCESS);
+            first = context.get();
+            ASSERT_NE(first, nullptr);
+
+            RsaKeyCache::Context other;
+            ASSERT_EQ(cache.Acquire(n, e, expiry, RsaScheme::RsaOaep, RsaHashAlg::RsaSha256, other).code_,
+                      attest::AttestationResult::ErrorCode::SUCCESS);
+            EXPECT_NE(other.get(), first);
+
+            attest::Buffer encrypted_data;
+            EXPECT_EQ(attest::crypto::EncryptDataWithRSAContext(context.get(), attest::Buffer(32), encrypted_data).code_,
+                      attest::AttestationResult::ErrorCode::SUCCESS);
+            EXPECT_EQ(encrypted_data.size(), 256);
+        }
+        RsaKeyCache::Context context;
+        ASSERT_EQ(cache.Acquire(n, e, expiry, RsaScheme::RsaOaep, RsaHashAlg::RsaSha256, context).code_,
+                  attest::AttestationResult::ErrorCode::SUCCESS);
+        EXPECT_EQ(context.get(), first);
+
+        // Another scheme gets a context of its own.
+        RsaKeyCache::Context pkcs1;
+        ASSERT_EQ(cache.Acquire(n, e, expiry, RsaScheme::RsaEs, RsaHashAlg::RsaSha256, pkcs1).code_,
+                  attest::AttestationResult::ErrorCode::SUCCESS);
+        EXPECT_NE(pkcs1.get(), context.get());
+
+        // Keys of tokens that have expired or have no exp claim still work.
+        RsaKeyCache::Context uncached;
+        EXPECT_EQ(cache.Acquire(n, e, 0, RsaScheme::RsaEs, RsaHashAlg::RsaSha256, uncached).code_,
+                  attest::AttestationResult::ErrorCode::SUCCESS);
+        EXPECT_EQ(cache.Acquire(n, e, 1, RsaScheme::RsaEs, RsaHashAlg::RsaSha256, uncached).code_,
+                  attest::AttestationResult::ErrorCode::SUCCESS);
+        EXPECT_NE(uncached.get(), nullptr);
+
+        const std::string garbage_n = "sn9xSwAADYOp0X4HGCWfu2B9GnvCc6jNhAKmbd7epP4AwV7pFtcaeQCeUzF_8Znm98q0hlN9NiP_a_0ud1ZbodDDkq3h69zSDXhk5";
+        EXPECT_EQ(cache.Acquire(garbage_n, e, expiry, RsaScheme::RsaEs, RsaHashAlg::RsaSha256, uncached).code_,
+                  attest::AttestationResult::ErrorCode::ERROR_CONVERTING_JWK_TO_RSA_PUB);
+        EXPECT_NE(uncached.get(), nullptr);
+    }
+
+    TEST_F(ClientLibTests, EncryptBatch_NONE) {
+        std::string header = "{\"alg\":\"RS256\"}";
+        std::string claims = "{\"exp\":" + std::to_string(time(nullptr) + 3600) + ",\"x-ms-runtime\":{\"keys\":[{\"kty\":\"RSA\","
+                             "\"n\":\"qoOpjgAAp0_c_hhBU63bUbLGuuIPq3dFkpZbpHEZXubkDzRL9XzL3GzOEdAX1v0wF0qNteJwcTRQ2Q2F9yozHqzD-anbjBXvONpMYVyQuw2oEwSFuSB7eyrN1Emlc7dI1E7ZKCR-5_K3m6j2p10-5Swbmb3Ri2wkLI1kKmzXF4uZZWN6LDW9m0vpDW_53krrAwCCGgW6pW7W7K6gerdFwGT2rkUCNuYW0E0ie0Q1Q2hJdbfF8qHbML23ufmgDnq23YGSEbuXPUv8mgdDCeKhPB2WrkBdX7x-chTxRU9uO8yRDsCb6lAeHbvhOW1CbbWZIVctTe3T5hiwsC4BdbVGKQ\","
+                             "\"e\":\"AQAB\"}]}}";
+        attest::AttestationToken token(attest::base64::binary_to_base64url(attest::Buffer(header.begin(), header.end())) + "." +
+                                       attest::base64::binary_to_base64url(attest::Buffer(claims.begin(), claims.end())) + ".sig");
+
+        const uint32_t count = 300;
+        std::vector<std::vector<unsigned char>> keys(count, std::vector<unsigned char>(32, 0x5a));
+        std::vector<std::vector<unsigned char>> outputs(count, std::vector<unsigned char>(256));
+        std::vector<const unsigned char*> data(count);
+        std::vector<uint32_t> data_sizes(count, 32);
+        std::vector<unsigned char*> encrypted_data(count);
+        std::vector<uint32_t> encrypted_data_sizes(count, 256);
+        std::vector<attest::AttestationResult> results(count);
+        for (uint32_t i = 0; i < count; i++) {
+            data[i] = keys[i].data();
+            encrypted_data[i] = outputs[i].data();
+        }
+        // One buffer without input and one with an output slot that is too small.
+        data[10] = nullptr;
+        encrypted_data_sizes[20] = 128;
+
+        attest::AttestationResult result = client->EncryptBatch(attest::EncryptionType::NONE,
+            token,
+            data.data(),
+            data_sizes.data(),
+            count,
+            encrypted_data.data(),
+            encrypted_data_sizes.data(),
+            results.data(),
+            attest::RsaScheme::RsaOaep,
+            attest::RsaHashAlg::RsaSha256);
+        EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::SUCCESS);
+        for (uint32_t i = 0; i < count; i++) {
+            if (i == 10 || i == 20) {
+                EXPECT_EQ(results[i].code_, attest::AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER) << i;
+                EXPECT_EQ(encrypted_data_sizes[i], 0) << i;
+            }
+            else {
+                EXPECT_EQ(results[i].code_, attest::AttestationResult::ErrorCode::SUCCESS) << i;
+                EXPECT_EQ(encrypted_data_sizes[i], 256) << i;
+            }
+        }
+        // OAEP is randomized, so two wraps of the same key differ.
+        EXPECT_NE(outputs[0], outputs[1]);
+
+        result = client->EncryptBatch(attest::EncryptionType::NONE, token, data.data(), data_sizes.data(), 0,
+                                      encrypted_data.data(), encrypted_data_sizes.data(), results.data());
+        EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER);
+
+        attest::AttestationToken no_key("e30.e30.sig");
+        result = client->EncryptBatch(attest::EncryptionType::NONE, no_key, data.data(), data_sizes.data(), count,
+                                      encrypted_data.data(), encrypted_data_sizes.data(), results.data());
+        EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::ERROR_EXTRACTING_JWK_INFO);
+    }
+
+    TEST_F(ClientLibTests, EnvelopeCipher_positive) {
+        using namespace attest::envelope;
+        const uint32_t chunk_size = 100;
+        unsigned char key[key_size];
+        unsigned char nonce_prefix[nonce_prefix_size];
+        std::memset(key, 0x11, sizeof(key));
+        std::memset(nonce_prefix, 0x22, sizeof(nonce_prefix));
+
+        std::vector<unsigned char> plaintext(250);
+        std::iota(plaintext.begin(), plaintext.end(), 0);
+        uint64_t chunk_count = ChunkCount(plaintext.size(), chunk_size);
+        ASSERT_EQ(chunk_count, 3);
+        std::vector<unsigned char> ciphertext(EncryptedSize(plaintext.size(), chunk_size));
+        ASSERT_EQ(ciphertext.size(), 250 + 3 * tag_size);
+
+        ChunkCipher cipher(key, nonce_prefix);
+        for (uint64_t i = 0; i < chunk_count; i++) {
+            size_t size = std::min<size_t>(chunk_size, plaintext.size() - i * chunk_size);
+            ASSERT_TRUE(cipher.EncryptChunk(i, i + 1 == chunk_count, plaintext.data() + i * chunk_size, size,
+                                            ciphertext.data() + i * (chunk_size + tag_size)));
+        }
+
+        uint64_t size = 0;
+        ASSERT_TRUE(DecryptedSize(ciphertext.size(), chunk_size, size));
+        EXPECT_EQ(size, plaintext.size());
+
+        // Chunks decrypt independently, in any order and in place.
+        std::vector<unsigned char> decrypted(ciphertext);
+        ChunkCipher other(key, nonce_prefix);
+        for (uint64_t i = chunk_count; i-- > 0;) {
+            size_t chunk = std::min<size_t>(chunk_size, size - i * chunk_size);
+            unsigned char* frame = decrypted.data() + i * (chunk_size + tag_size);
+            ASSERT_TRUE(other.DecryptChunk(i, i + 1 == chunk_count, frame, chunk + tag_size, frame));
+            EXPECT_TRUE(std::equal(frame, frame + chunk, plaintext.begin() + i * chunk_size));
+        }
+
+        // A flipped bit, a swapped chunk and a truncated message are detected.
+        std::vector<unsigned char> out(chunk_size);
+        ciphertext[5] ^= 1;
+        EXPECT_FALSE(other.DecryptChunk(0, false, ciphertext.data(), chunk_size + tag_size, out.data()));
+        ciphertext[5] ^= 1;
+        EXPECT_TRUE(other.DecryptChunk(0, false, ciphertext.data(), chunk_size + tag_size, out.data()));
+        EXPECT_FALSE(other.DecryptChunk(1, false, ciphertext.data(), chunk_size + tag_size, out.data()));
+        EXPECT_FALSE(other.DecryptChunk(1, true, ciphertext.data() + chunk_size + tag_size, chunk_size + tag_size, out.data()));
+
+        // Empty data is a single empty chunk.
+        EXPECT_EQ(EncryptedSize(0, chunk_size), tag_size);
+        EXPECT_TRUE(DecryptedSize(tag_size, chunk_size, size));
+        EXPECT_EQ(size, 0);
+        EXPECT_FALSE(DecryptedSize(tag_size - 1, chunk_size, size));
+        EXPECT_FALSE(DecryptedSize(chunk_size + tag_size + 3, chunk_size, size));
+        EXPECT_FALSE(DecryptedSize(chunk_size + 2 * tag_size, chunk_size, size));
+
+        Metadata metadata;
+        metadata.chunk_size = chunk_size;
+        metadata.nonce_prefix.assign(nonce_prefix, nonce_prefix + sizeof(nonce_prefix));
+        metadata.wrapped_key.assign(256, 0x33);
+        std::string serialized = SerializeMetadata(metadata);
+        Metadata parsed;
+        ASSERT_TRUE(ParseMetadata(reinterpret_cast<const unsigned char*>(serialized.c_str()), serialized.size() + 1, parsed));
+        EXPECT_EQ(parsed.chunk_size, chunk_size);
+        EXPECT_EQ(parsed.nonce_prefix, metadata.nonce_prefix);
+        EXPECT_EQ(parsed.wrapped_key, metadata.wrapped_key);
+
+        std::string garbage = "e30=";
+        EXPECT_FALSE(ParseMetadata(reinterpret_cast<const unsigned char*>(garbage.data()), garbage.size(), parsed));
+    }
+
+    TEST_F(ClientLibTests, DecryptChunks_known_key) {
+        attest::Buffer dek(attest::envelope::key_size, 0x11);
+        attest::envelope::Metadata metadata;
+        metadata.chunk_size = 100;
+        metadata.nonce_prefix.assign(attest::envelope::nonce_prefix_size, 0x22);
+        const size_t frame_size = metadata.chunk_size + attest::envelope::tag_size;
+
+        // More chunks than one parallel block, the last one short.
+        std::vector<unsigned char> plaintext(40 * metadata.chunk_size + 37);
+        std::iota(plaintext.begin(), plaintext.end(), 0);
+        std::vector<unsigned char> ciphertext = encryptChunks(dek, metadata, plaintext);
+
+        std::vector<unsigned char> decrypted(plaintext.size());
+        attest::AttestationResult result = decryptChunks(dek, metadata, 0, true, ciphertext.data(), plaintext.size(),
+                                                         decrypted.data(), metadata.chunk_size);
+        ASSERT_EQ(result.code_, attest::AttestationResult::ErrorCode::SUCCESS);
+        EXPECT_EQ(decrypted, plaintext);
+
+        // In place, with the plaintext left in the frames.
+        std::vector<unsigned char> frames(ciphertext);
+        result = decryptChunks(dek, metadata, 0, true, frames.data(), plaintext.size(), frames.data(), frame_size);
+        ASSERT_EQ(result.code_, attest::AttestationResult::ErrorCode::SUCCESS);
+        for (size_t i = 0; i < 41; i++) {
+            size_t chunk = std::min<size_t>(metadata.chunk_size, plaintext.size() - i * metadata.chunk_size);
+            EXPECT_TRUE(std::equal(frames.begin() + i * frame_size, frames.begin() + i * frame_size + chunk,
+                                   plaintext.begin() + i * metadata.chunk_size));
+        }
+
+        // A range in the middle of the message.
+        result = decryptChunks(dek, metadata, 16, false, ciphertext.data() + 16 * frame_size, 20 * metadata.chunk_size,
+                               decrypted.data(), metadata.chunk_size);
+        EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::SUCCESS);
+        result = decryptChunks(dek, metadata, 16, true, ciphertext.data() + 16 * frame_size, 20 * metadata.chunk_size,
+                               decrypted.data(), metadata.chunk_size);
+        EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::ERROR_DATA_DECRYPTION_FAILED);
+
+        // A flipped bit past the first block and a message cut after a full chunk.
+        ciphertext[30 * frame_size + 5] ^= 1;
+        result = decryptChunks(dek, metadata, 0, true, ciphertext.data(), plaintext.size(),
+                               decrypted.data(), metadata.chunk_size);
+        EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::ERROR_DATA_DECRYPTION_FAILED);
+        ciphertext[30 * frame_size + 5] ^= 1;
+        result = decryptChunks(dek, metadata, 0, true, ciphertext.data(), 40 * metadata.chunk_size,
+                               decrypted.data(), metadata.chunk_size);
+        EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::ERROR_DATA_DECRYPTION_FAILED);
+
+        attest::Buffer other_dek(attest::envelope::key_size, 0x12);
+        result = decryptChunks(other_dek, metadata, 0, true, ciphertext.data(), plaintext.size(),
+                               decrypted.data(), metadata.chunk_size);
+        EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::ERROR_DATA_DECRYPTION_FAILED);
+    }
+
+    TEST_F(ClientLibTests, DecryptStream_batches) {
+        attest::Buffer dek(attest::envelope::key_size, 0x11);
+        attest::envelope::Metadata metadata;
+        metadata.nonce_prefix.assign(attest::envelope::nonce_prefix_size, 0x22);
+        // 256KiB frames, so that a batch of DecryptStream() is 32 chunks.
+        metadata.chunk_size = 256 * 1024 - attest::envelope::tag_size;
+        const size_t batch_chunks = 32;
+
+        std::mt19937 generator(7);
+        std::vector<unsigned char> plaintext(3 * batch_chunks * metadata.chunk_size);
+        std::generate(plaintext.begin(), plaintext.end(), [&]() { return static_cast<unsigned char>(generator()); });
+
+        // A message that ends exactly on a batch boundary, one that ends a little
+        // past it and one that fits in the first batch.
+        for (size_t size : { 2 * batch_chunks * metadata.chunk_size,
+                             2 * batch_chunks * metadata.chunk_size + 10,
+                             size_t(5) }) {
+            std::vector<unsigned char> message(plaintext.begin(), plaintext.begin() + size);
+            std::vector<unsigned char> decrypted;
+            attest::AttestationResult result = decryptStream(dek, metadata, encryptChunks(dek, metadata, message), decrypted);
+            EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::SUCCESS) << size;
+            EXPECT_TRUE(decrypted == message) << size;
+        }
+
+        // A message cut at a batch boundary ends in a chunk not encrypted as the last one.
+        std::vector<unsigned char> ciphertext = encryptChunks(dek, metadata, plaintext);
+        ciphertext.resize(2 * batch_chunks * (metadata.chunk_size + attest::envelope::tag_size));
+        std::vector<unsigned char> decrypted;
+        attest::AttestationResult result = decryptStream(dek, metadata, ciphertext, decrypted);
+        EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::ERROR_DATA_DECRYPTION_FAILED);
+
+        // A partial frame after a batch boundary is malformed.
+        ciphertext.resize(ciphertext.size() + 3);
+        result = decryptStream(dek, metadata, ciphertext, decrypted);
+        EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::ERROR_DATA_DECRYPTION_FAILED);
+    }
+
+    TEST_F(ClientLibTests, Encrypt_ENVELOPE_AES_GCM) {
+        std::string header = "{\"alg\":\"RS256\"}";
+        std::string claims = "{\"exp\":" + std::to_string(time(nullptr) + 3600) + ",\"x-ms-runtime\":{\"keys\":[{\"kty\":\"RSA\","
+                             "\"n\":\"qoOpjgAAp0_c_hhBU63bUbLGuuIPq3dFkpZbpHEZXubkDzRL9XzL3GzOEdAX1v0wF0qNteJwcTRQ2Q2F9yozHqzD-anbjBXvONpMYVyQuw2oEwSFuSB7eyrN1Emlc7dI1E7ZKCR-5_K3m6j2p10-5Swbmb3Ri2wkLI1kKmzXF4uZZWN6LDW9m0vpDW_53krrAwCCGgW6pW7W7K6gerdFwGT2rkUCNuYW0E0ie0Q1Q2hJdbfF8qHbML23ufmgDnq23YGSEbuXPUv8mgdDCeKhPB2WrkBdX7x-chTxRU9uO8yRDsCb6lAeHbvhOW1CbbWZIVctTe3T5hiwsC4BdbVGKQ\","
+                             "\"e\":\"AQAB\"}]}}";
+        attest::AttestationToken token(attest::base64::binary_to_base64url(attest::Buffer(header.begin(), header.end())) + "." +
+                                       attest::base64::binary_to_base64url(attest::Buffer(claims.begin(), claims.end())) + ".sig");
+
+        std::vector<unsigned char> data(attest::envelope::default_chunk_size * 2 + 10, 0x5a);
+        unsigned char* encrypted_data = nullptr;
+        uint32_t encrypted_data_size = 0;
+        unsigned char* encryption_metadata = nullptr;
+        uint32_t encryption_metadata_size = 0;
+        attest::AttestationResult result = client->Encrypt(attest::EncryptionType::ENVELOPE_AES_GCM,
+            token,
+            data.data(),
+            data.size(),
+            &encrypted_data,
+            &encrypted_data_size,
+            &encryption_metadata,
+            &encryption_metadata_size,
+            attest::RsaScheme::RsaOaep,
+            attest::RsaHashAlg::RsaSha256);
+        ASSERT_EQ(result.code_, attest::AttestationResult::ErrorCode::SUCCESS);
+        EXPECT_EQ(encrypted_data_size, data.size() + 3 * attest::envelope::tag_size);
+        attest::envelope::Metadata metadata;
+        ASSERT_TRUE(attest::envelope::ParseMetadata(encryption_metadata, encryption_metadata_size, metadata));
+        EXPECT_EQ(metadata.chunk_size, attest::envelope::default_chunk_size);
+        EXPECT_EQ(metadata.wrapped_key.size(), 256);
+        client->Free(encrypted_data);
+        client->Free(encryption_metadata);
+
+        // The stream form produces the same layout, with a key of its own.
+        FILE* input = tmpfile();
+        FILE* output = tmpfile();
+        ASSERT_NE(input, nullptr);
+        ASSERT_NE(output, nullptr);
+        ASSERT_EQ(fwrite(data.data(), 1, data.size(), input), data.size());
+        fflush(input);
+        rewind(input);
+        result = client->EncryptStream(attest::EncryptionType::ENVELOPE_AES_GCM,
+            token,
+            fileno(input),
+            fileno(output),
+            &encryption_metadata,
+            &encryption_metadata_size,
+            attest::RsaScheme::RsaOaep,
+            attest::RsaHashAlg::RsaSha256);
+        ASSERT_EQ(result.code_, attest::AttestationResult::ErrorCode::SUCCESS);
+        EXPECT_EQ(lseek(fileno(output), 0, SEEK_END), static_cast<off_t>(data.size() + 3 * attest::envelope::tag_size));
+        attest::envelope::Metadata stream_metadata;
+        ASSERT_TRUE(attest::envelope::ParseMetadata(encryption_metadata, encryption_metadata_size, stream_metadata));
+        EXPECT_NE(stream_metadata.wrapped_key, metadata.wrapped_key);
+        client->Free(encryption_metadata);
+        fclose(input);
+        fclose(output);
+
+        result = client->EncryptStream(attest::EncryptionType::NONE, token, 0, 1,
+                                       &encryption_metadata, &encryption_metadata_size);
+        EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER);
+    }
+
+    TEST_F(ClientLibTests, DecryptToBuffer_ENVELOPE_AES_GCM_negative) {
+        std::string header = "{\"alg\":\"RS256\"}";
+        std::string claims = "{\"exp\":" + std::to_string(time(nullptr) + 3600) + ",\"x-ms-runtime\":{\"keys\":[{\"kty\":\"RSA\","
+                             "\"n\":\"qoOpjgAAp0_c_hhBU63bUbLGuuIPq3dFkpZbpHEZXubkDzRL9XzL3GzOEdAX1v0wF0qNteJwcTRQ2Q2F9yozHqzD-anbjBXvONpMYVyQuw2oEwSFuSB7eyrN1Emlc7dI1E7ZKCR-5_K3m6j2p10-5Swbmb3Ri2wkLI1kKmzXF4uZZWN6LDW9m0vpDW_53krrAwCCGgW6pW7W7K6gerdFwGT2rkUCNuYW0E0ie0Q1Q2hJdbfF8qHbML23ufmgDnq23YGSEbuXPUv8mgdDCeKhPB2WrkBdX7x-chTxRU9uO8yRDsCb6lAeHbvhOW1CbbWZIVctTe3T5hiwsC4BdbVGKQ\","
+                             "\"e\":\"AQAB\"}]}}";
+        attest::AttestationToken token(attest::base64::binary_to_base64url(attest::Buffer(header.begin(), header.end())) + "." +
+                                       attest::base64::binary_to_base64url(attest::Buffer(claims.begin(), claims.end())) + ".sig");
+
+        std::vector<unsigned char> data(1000, 0x5a);
+        unsigned char* encrypted_data = nullptr;
+        uint32_t encrypted_data_size = 0;
+        unsigned char* encryption_metadata = nullptr;
+        uint32_t encryption_metadata_size = 0;
+        ASSERT_EQ(client->Encrypt(attest::EncryptionType::ENVELOPE_AES_GCM, token, data.data(), data.size(),
+                                  &encrypted_data, &encrypted_data_size, &encryption_metadata, &encryption_metadata_size,
+                                  attest::RsaScheme::RsaOaep, attest::RsaHashAlg::RsaSha256).code_,
+                  attest::AttestationResult::ErrorCode::SUCCESS);
+
+        // The size needed is reported before the TPM is involved.
+        std::vector<unsigned char> out(10);
+        uint32_t out_size = out.size();
+        attest::AttestationResult result = client->DecryptToBuffer(attest::EncryptionType::ENVELOPE_AES_GCM,
+            encrypted_data, encrypted_data_size, encryption_metadata, encryption_metadata_size,
+            out.data(), &out_size, attest::RsaScheme::RsaOaep, attest::RsaHashAlg::RsaSha256);
+        EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER);
+        EXPECT_EQ(out_size, data.size());
+
+        // Truncated data does not match the metadata.
+        out_size = out.size();
+        result = client->DecryptToBuffer(attest::EncryptionType::ENVELOPE_AES_GCM,
+            encrypted_data, attest::envelope::tag_size - 1, encryption_metadata, encryption_metadata_size,
+            out.data(), &out_size);
+        EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER);
+
+        result = client->DecryptStream(attest::EncryptionType::NONE, 0, 1, encryption_metadata, encryption_metadata_size);
+        EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER);
+        result = client->DecryptStream(attest::EncryptionType::ENVELOPE_AES_GCM, 0, 1, encrypted_data, encrypted_data_size);
+        EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER);
+
+        client->Free(encrypted_data);
+        client->Free(encryption_metadata);
+    }
+
     TEST_F(ClientLibTests, TestParseClientPayload_negative) {
         std::string json_str = "{\"key\":\"value\"]";
         unsigned char* buffer = (unsigned char*)malloc((sizeof(unsigned char) * json_str.size()) + 1);
@@ -915,6 +1732,545 @@ namespace AttestationClientLibTest {
         EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::ERROR_PARSING_ATTESTATION_RESPONSE);
     }
 
+    TEST_F(ClientLibTests, VcekCertCache_key) {
+        attest::Buffer snp_report(sizeof(SNP_VM_REPORT), 0);
+        SNP_VM_REPORT* report = reinterpret_cast<SNP_VM_REPORT*>(snp_report.data());
+        report->SnpChipId[0] = 0xab;
+        report->SnpReportedTcb.Asuint64_t = 0x01;
+
+        std::string key;
+        EXPECT_TRUE(VcekCertCache::GetCacheKey(snp_report, key));
+        EXPECT_EQ(key.size(), 2 * sizeof(report->SnpChipId) + 1 + 2 * sizeof(uint64_t));
+        EXPECT_EQ(key.substr(0, 2), "ab");
+
+        // A TCB update must map to a different entry.
+        std::string updated_key;
+        report->SnpReportedTcb.Asuint64_t = 0x02;
+        EXPECT_TRUE(VcekCertCache::GetCacheKey(snp_report, updated_key));
+        EXPECT_NE(key, updated_key);
+
+        snp_report.resize(sizeof(SNP_VM_REPORT) - 1);
+        EXPECT_FALSE(VcekCertCache::GetCacheKey(snp_report, key));
+    }
+
+    TEST_F(ClientLibTests, VcekCertCache_positive) {
+        const std::string cache_dir = "./vcek-cache-test";
+        VcekCertCache cache(cache_dir);
+
+        std::string vcek_cert;
+        std::chrono::seconds remaining_validity(0);
+        EXPECT_FALSE(cache.Get("key", vcek_cert, remaining_validity));
+
+        // The remaining validity is that of the certificate expiring first.
+        std::string cert_chain = attest::base64::base64_decode(createCertificate(30 * 24 * 60 * 60)) +
+                                 attest::base64::base64_decode(createCertificate(24 * 60 * 60));
+        std::string cert = attest::base64::base64_encode(cert_chain);
+        EXPECT_TRUE(cache.Put("key", cert));
+        EXPECT_TRUE(cache.Get("key", vcek_cert, remaining_validity));
+        EXPECT_EQ(vcek_cert, cert);
+        EXPECT_LE(remaining_validity.count(), 24 * 60 * 60);
+        EXPECT_GT(remaining_validity.count(), 23 * 60 * 60);
+
+        // Expired entries are never served.
+        EXPECT_TRUE(cache.Put("expired", createCertificate(-60)));
+        EXPECT_FALSE(cache.Get("expired", vcek_cert, remaining_validity));
+
+        deleteFile((cache_dir + "/vcek-key.cache").c_str());
+        deleteFile((cache_dir + "/vcek-expired.cache").c_str());
+        EXPECT_EQ(rmdir(cache_dir.c_str()), 0);
+    }
+
+    TEST_F(ClientLibTests, ExtractValidityFromAttestationJwt) {
+        int64_t not_before = 0;
+        int64_t expiry = 0;
+        EXPECT_TRUE(attest::jwt::ExtractValidityFromAttestationJwt(createJwt(-60, 3600, "a"), not_before, expiry));
+        EXPECT_EQ(expiry - not_before, 3660);
+
+        std::string header = "{}";
+        std::string claims = "{\"nbf\":1}";
+        std::string jwt = attest::base64::binary_to_base64url(attest::Buffer(header.begin(), header.end())) + "." +
+                          attest::base64::binary_to_base64url(attest::Buffer(claims.begin(), claims.end())) + ".sig";
+        EXPECT_FALSE(attest::jwt::ExtractValidityFromAttestationJwt(jwt, not_before, expiry));
+        EXPECT_FALSE(attest::jwt::ExtractValidityFromAttestationJwt("garbage", not_before, expiry));
+    }
+
+    TEST_F(ClientLibTests, DataKeyCache_positive) {
+        DataKeyCache cache(std::chrono::seconds(1));
+        ASSERT_TRUE(cache.Enabled());
+
+        attest::PcrSet pcrs;
+        pcrs.hashAlg = attest::HashAlg::Sha256;
+        pcrs.pcrs.push_back(attest::PcrValue{0, std::vector<unsigned char>(32, 0x01)});
+        pcrs.pcrs.push_back(attest::PcrValue{7, std::vector<unsigned char>(32, 0x07)});
+        attest::Buffer wrapped_key(256, 0xaa);
+        attest::Buffer dek(32, 0x42);
+
+        attest::Buffer key;
+        EXPECT_FALSE(cache.Get(wrapped_key, RsaScheme::RsaOaep, RsaHashAlg::RsaSha256, pcrs, key));
+        cache.Put(wrapped_key, RsaScheme::RsaOaep, RsaHashAlg::RsaSha256, pcrs, dek);
+        EXPECT_TRUE(cache.Get(wrapped_key, RsaScheme::RsaOaep, RsaHashAlg::RsaSha256, pcrs, key));
+        EXPECT_EQ(key, dek);
+
+        // The scheme is part of the lookup.
+        EXPECT_FALSE(cache.Get(wrapped_key, RsaScheme::RsaEs, RsaHashAlg::RsaSha256, pcrs, key));
+        EXPECT_FALSE(cache.Get(attest::Buffer(256, 0xbb), RsaScheme::RsaOaep, RsaHashAlg::RsaSha256, pcrs, key));
+
+        // A PCR change drops every key, also once the PCRs are back to the old values.
+        attest::PcrSet extended = pcrs;
+        extended.pcrs[1].digest[0] ^= 1;
+        EXPECT_FALSE(cache.Get(wrapped_key, RsaScheme::RsaOaep, RsaHashAlg::RsaSha256, extended, key));
+        EXPECT_FALSE(cache.Get(wrapped_key, RsaScheme::RsaOaep, RsaHashAlg::RsaSha256, pcrs, key));
+
+        // More keys than slots evicts the oldest, keys too large are not cached.
+        for (int i = 0; i < 100; i++) {
+            cache.Put(attest::Buffer(256, static_cast<unsigned char>(i)), RsaScheme::RsaOaep, RsaHashAlg::RsaSha256, pcrs, dek);
+        }
+        EXPECT_FALSE(cache.Get(attest::Buffer(256, 0), RsaScheme::RsaOaep, RsaHashAlg::RsaSha256, pcrs, key));
+        EXPECT_TRUE(cache.Get(attest::Buffer(256, 99), RsaScheme::RsaOaep, RsaHashAlg::RsaSha256, pcrs, key));
+        cache.Put(wrapped_key, RsaScheme::RsaOaep, RsaHashAlg::RsaSha256, pcrs, attest::Buffer(1024, 0x42));
+        EXPECT_FALSE(cache.Get(wrapped_key, RsaScheme::RsaOaep, RsaHashAlg::RsaSha256, pcrs, key));
+
+        // Keys expire after the ttl.
+        cache.Put(wrapped_key, RsaScheme::RsaOaep, RsaHashAlg::RsaSha256, pcrs, dek);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+        EXPECT_FALSE(cache.Get(wrapped_key, RsaScheme::RsaOaep, RsaHashAlg::RsaSha256, pcrs, key));
+    }
+
+    TEST_F(ClientLibTests, TokenCache_positive) {
+        TokenCache cache([](const std::string&, const std::string&, std::string&) {
+                             return attest::AttestationResult(attest::AttestationResult::ErrorCode::ERROR_ATTESTATION_FAILED);
+                         },
+                         std::chrono::seconds(60));
+
+        std::string token;
+        std::string valid_token = createJwt(-60, 3600, "valid");
+        cache.Put("endpoint", "payload", valid_token);
+        EXPECT_TRUE(cache.Get("endpoint", "payload", token));
+        EXPECT_EQ(token, valid_token);
+
+        // Entries are keyed by both the endpoint and the client payload.
+        EXPECT_FALSE(cache.Get("endpoint", "other", token));
+        EXPECT_FALSE(cache.Get("other", "payload", token));
+
+        // Tokens outside of their validity period are never served.
+        cache.Put("endpoint", "expired", createJwt(-120, -60, "expired"));
+        EXPECT_FALSE(cache.Get("endpoint", "expired", token));
+        cache.Put("endpoint", "future", createJwt(3600, 7200, "future"));
+        EXPECT_FALSE(cache.Get("endpoint", "future", token));
+    }
+
+    TEST_F(ClientLibTests, TokenCache_refresh) {
+        std::atomic<int> attest_calls(0);
+        std::string refreshed_token = createJwt(-60, 7200, "refreshed");
+        TokenCache cache([&](const std::string& endpoint_url, const std::string& client_payload, std::string& jwt_token) {
+                             EXPECT_EQ(endpoint_url, "endpoint");
+                             EXPECT_EQ(client_payload, "payload");
+                             jwt_token = refreshed_token;
+                             attest_calls++;
+                             return attest::AttestationResult(attest::AttestationResult::ErrorCode::SUCCESS);
+                         },
+                         std::chrono::seconds(3599));
+
+        // The token is due for a refresh one second from now.
+        std::string token;
+        cache.Put("endpoint", "payload", createJwt(-60, 3600, "original"));
+        EXPECT_TRUE(cache.Get("endpoint", "payload", token));
+
+        // The refreshed token is stored after the callback returns, so wait for the
+        // cache to serve it rather than for the callback.
+        bool refreshed = false;
+        for (int i = 0; i < 50 && !refreshed; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            refreshed = cache.Get("endpoint", "payload", token) && token == refreshed_token;
+        }
+        EXPECT_TRUE(refreshed);
+        EXPECT_EQ(attest_calls, 1);
+    }
+
+    TEST_F(ClientLibTests, SharedTokenCache_positive) {
+        const std::string cache_dir = "./token-cache-test";
+        SharedTokenCache cache(cache_dir);
+        SharedTokenCache other_process_cache(cache_dir);
+
+        int attest_calls = 0;
+        std::string issued_token = createJwt(-60, 3600, "shared");
+        auto attest = [&](std::string& jwt_token) {
+            attest_calls++;
+            jwt_token = issued_token;
+            return attest::AttestationResult(attest::AttestationResult::ErrorCode::SUCCESS);
+        };
+
+        std::string token;
+        attest::AttestationResult result = cache.GetOrAttest("endpoint", "payload", std::chrono::seconds(0), attest, token);
+        EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::SUCCESS);
+        EXPECT_EQ(token, issued_token);
+        EXPECT_EQ(attest_calls, 1);
+
+        // Any other user of the directory gets the stored token.
+        token.clear();
+        result = other_process_cache.GetOrAttest("endpoint", "payload", std::chrono::seconds(0), attest, token);
+        EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::SUCCESS);
+        EXPECT_EQ(token, issued_token);
+        EXPECT_EQ(attest_calls, 1);
+
+        // A token that does not stay valid long enough is replaced.
+        issued_token = createJwt(-60, 7200, "replaced");
+        result = other_process_cache.GetOrAttest("endpoint", "payload", std::chrono::seconds(3600), attest, token);
+        EXPECT_EQ(token, issued_token);
+        EXPECT_EQ(attest_calls, 2);
+
+        // Different client payloads do not share a token.
+        result = cache.GetOrAttest("endpoint", "other", std::chrono::seconds(0), attest, token);
+        EXPECT_EQ(attest_calls, 3);
+
+        // Expired tokens are neither served nor kept.
+        issued_token = createJwt(-120, -60, "expired");
+        result = cache.GetOrAttest("endpoint", "expired", std::chrono::seconds(0), attest, token);
+        result = cache.GetOrAttest("endpoint", "expired", std::chrono::seconds(0), attest, token);
+        EXPECT_EQ(attest_calls, 5);
+
+        // Failures are passed through and not cached.
+        auto fail = [&](std::string&) {
+            attest_calls++;
+            return attest::AttestationResult(attest::AttestationResult::ErrorCode::ERROR_ATTESTATION_FAILED);
+        };
+        result = cache.GetOrAttest("endpoint", "failure", std::chrono::seconds(0), fail, token);
+        EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::ERROR_ATTESTATION_FAILED);
+        EXPECT_EQ(attest_calls, 6);
+
+        // Storing the next token leaves one lock file per stored entry; the locks of
+        // the expired and failed attestations are gone.
+        issued_token = createJwt(-60, 3600, "sweep");
+        result = cache.GetOrAttest("endpoint", "sweep", std::chrono::seconds(0), attest, token);
+        EXPECT_EQ(attest_calls, 7);
+
+        int entries = 0;
+        int locks = 0;
+        DIR* dir = opendir(cache_dir.c_str());
+        ASSERT_NE(dir, nullptr);
+        struct dirent* entry = nullptr;
+        while ((entry = readdir(dir)) != nullptr) {
+            std::string name(entry->d_name);
+            entries += name.compare(0, 6, "token-") == 0 ? 1 : 0;
+            locks += name.compare(0, 5, "lock-") == 0 ? 1 : 0;
+        }
+        closedir(dir);
+        EXPECT_EQ(entries, 3);
+        EXPECT_EQ(locks, 3);
+
+        deleteDirectory(cache_dir);
+    }
+
+    TEST_F(ClientLibTests, HttpTransport_pool) {
+        HttpTransport& transport = HttpTransport::GetInstance();
+
+        CURL* pooled = nullptr;
+        {
+            HttpTransport::Handle handle = transport.AcquireHandle("https://Pool.Example.com/attest?api-version=1");
+            ASSERT_NE(handle.get(), nullptr);
+            pooled = handle.get();
+        }
+
+        {
+            // A released handle is reused for the same scheme and host only.
+            HttpTransport::Handle same_host = transport.AcquireHandle("https://pool.example.com/other");
+            EXPECT_EQ(same_host.get(), pooled);
+
+            HttpTransport::Handle busy_host = transport.AcquireHandle("https://pool.example.com/");
+            EXPECT_NE(busy_host.get(), pooled);
+
+            HttpTransport::Handle other_scheme = transport.AcquireHandle("http://pool.example.com/");
+            EXPECT_NE(other_scheme.get(), pooled);
+        }
+    }
+
+    TEST_F(ClientLibTests, EvaluateResponse) {
+        uint8_t retries = 0;
+        std::chrono::milliseconds retry_delay(0);
+
+        attest::AttestationResult result = attest::curl::EvaluateResponse(200, "token", 0, retries, retry_delay);
+        EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::SUCCESS);
+        EXPECT_EQ(retry_delay.count(), 0);
+
+        result = attest::curl::EvaluateResponse(400, "bad evidence", 0, retries, retry_delay);
+        EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::ERROR_ATTESTATION_FAILED);
+        EXPECT_EQ(result.description_, "bad evidence");
+        EXPECT_EQ(retry_delay.count(), 0);
+
+        result = attest::curl::EvaluateResponse(404, "", 0, retries, retry_delay);
+        EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::ERROR_HTTP_REQUEST_FAILED);
+        EXPECT_EQ(retry_delay.count(), 0);
+
+        // Retry-After wins over a shorter back off.
+        result = attest::curl::EvaluateResponse(429, "", 60, retries, retry_delay);
+        EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::SUCCESS);
+        EXPECT_GE(retry_delay.count(), 60000);
+        EXPECT_EQ(retries, 1);
+
+        result = attest::curl::EvaluateResponse(503, "", 0, retries, retry_delay);
+        EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::SUCCESS);
+        EXPECT_GE(retry_delay.count(), 10000);
+        EXPECT_EQ(retries, 2);
+
+        retries = 3;
+        result = attest::curl::EvaluateResponse(503, "", 0, retries, retry_delay);
+        EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::ERROR_HTTP_REQUEST_EXCEEDED_RETRIES);
+        EXPECT_EQ(retry_delay.count(), 0);
+    }
+
+    TEST_F(ClientLibTests, TaskExecutor_order) {
+        std::mutex mutex;
+        std::condition_variable done;
+        std::vector<int> order;
+        auto record = [&](int i) {
+            std::lock_guard<std::mutex> lock(mutex);
+            order.push_back(i);
+            done.notify_all();
+        };
+
+        TaskExecutor executor(1);
+        EXPECT_TRUE(executor.PostAfter(std::chrono::milliseconds(200), [&]() { record(3); }));
+        EXPECT_TRUE(executor.Post([&]() { record(1); }));
+        EXPECT_TRUE(executor.Post([&]() { record(2); }));
+        EXPECT_TRUE(executor.PostAfter(std::chrono::hours(1), [&]() { record(4); }));
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            EXPECT_TRUE(done.wait_for(lock, std::chrono::seconds(10), [&]() { return order.size() == 3; }));
+        }
+        EXPECT_EQ(order, std::vector<int>({ 1, 2, 3 }));
+
+        // Queued tasks are dropped on stop and no new ones are accepted.
+        executor.Stop();
+        EXPECT_FALSE(executor.Post([&]() { record(5); }));
+        EXPECT_EQ(order.size(), 3);
+    }
+
+    TEST_F(ClientLibTests, TaskExecutor_parallel_for) {
+        TaskExecutor executor(3);
+        std::vector<std::atomic<int>> visits(1000);
+        std::mutex mutex;
+        std::set<std::thread::id> threads;
+        executor.ParallelFor(visits.size(), 7, [&](size_t begin, size_t end) {
+            EXPECT_LE(end - begin, 7);
+            for (size_t i = begin; i < end; i++) {
+                visits[i]++;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            std::lock_guard<std::mutex> lock(mutex);
+            threads.insert(std::this_thread::get_id());
+        });
+        for (auto& visit : visits) {
+            EXPECT_EQ(visit.load(), 1);
+        }
+        EXPECT_GT(threads.size(), 1);
+
+        // A stopped executor leaves the whole loop to the calling thread.
+        executor.Stop();
+        size_t visited = 0;
+        std::thread::id caller = std::this_thread::get_id();
+        executor.ParallelFor(10, 1, [&](size_t begin, size_t end) {
+            EXPECT_EQ(std::this_thread::get_id(), caller);
+            visited += end - begin;
+        });
+        EXPECT_EQ(visited, 10);
+    }
+
+    TEST_F(ClientLibTests, AsyncHttpClient_connection_failure) {
+        std::mutex mutex;
+        std::condition_variable done;
+        int completed = 0;
+
+        AsyncHttpClient http_client;
+        for (int i = 0; i < 4; i++) {
+            // Nothing listens on port 1, so every request fails without leaving the host.
+            EXPECT_TRUE(http_client.Post("http://127.0.0.1:1/attest",
+                                         "{}",
+                                         [&](CURLcode result, long response_code, const std::string&, curl_off_t) {
+                                             EXPECT_NE(result, CURLE_OK);
+                                             EXPECT_EQ(response_code, 0);
+                                             std::lock_guard<std::mutex> lock(mutex);
+                                             completed++;
+                                             done.notify_all();
+                                         }));
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        EXPECT_TRUE(done.wait_for(lock, std::chrono::seconds(30), [&]() { return completed == 4; }));
+    }
+
+    TEST_F(ClientLibTests, EventNotifier_positive) {
+        EventNotifier notifier;
+        ASSERT_GE(notifier.Fd(), 0);
+
+        struct pollfd descriptor = { notifier.Fd(), POLLIN, 0 };
+        EXPECT_EQ(poll(&descriptor, 1, 0), 0);
+
+        notifier.Notify();
+        notifier.Notify();
+        EXPECT_EQ(poll(&descriptor, 1, 0), 1);
+
+        // Notifications collapse into one.
+        notifier.Clear();
+        EXPECT_EQ(poll(&descriptor, 1, 0), 0);
+    }
+
+    TEST_F(ClientLibTests, AsyncHttpClient_external_event_loop) {
+        int completed = 0;
+        AsyncHttpClient http_client(true);
+        for (int i = 0; i < 4; i++) {
+            EXPECT_TRUE(http_client.Post("http://127.0.0.1:1/attest",
+                                         "{}",
+                                         [&](CURLcode result, long, const std::string&, curl_off_t) {
+                                             EXPECT_NE(result, CURLE_OK);
+                                             completed++;
+                                         }));
+        }
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+        while (completed < 4 && std::chrono::steady_clock::now() < deadline) {
+            std::vector<attest::PollDescriptor> descriptors;
+            int timeout_ms = -1;
+            http_client.GetPollDescriptors(descriptors, timeout_ms);
+            ASSERT_FALSE(descriptors.empty());
+
+            std::vector<struct pollfd> poll_fds;
+            for (const auto& descriptor : descriptors) {
+                short events = 0;
+                events |= (descriptor.events & attest::PollDescriptor::Read) ? POLLIN : 0;
+                events |= (descriptor.events & attest::PollDescriptor::Write) ? POLLOUT : 0;
+                poll_fds.push_back({ descriptor.fd, events, 0 });
+            }
+            poll(poll_fds.data(), poll_fds.size(), timeout_ms < 0 || timeout_ms > 1000 ? 1000 : timeout_ms);
+
+            for (size_t i = 0; i < descriptors.size(); i++) {
+                descriptors[i].revents |= (poll_fds[i].revents & POLLIN) ? attest::PollDescriptor::Read : 0;
+                descriptors[i].revents |= (poll_fds[i].revents & POLLOUT) ? attest::PollDescriptor::Write : 0;
+                descriptors[i].revents |= (poll_fds[i].revents & (POLLERR | POLLHUP)) ? attest::PollDescriptor::Error : 0;
+            }
+            http_client.Step(descriptors);
+        }
+        EXPECT_EQ(completed, 4);
+    }
+
+    TEST_F(ClientLibTests, TestAttestMultiple_negative) {
+        const unsigned char* endpoint_urls[] = {
+            reinterpret_cast<const unsigned char*>("https://primary.attest.azure.net"),
+            nullptr
+        };
+        attest::AttestationResult results[2];
+        unsigned char* jwt_tokens[2] = { nullptr, nullptr };
+
+        attest::AttestationResult result = client->AttestMultiple(endpoint_urls, 2, nullptr, results, jwt_tokens);
+        EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER);
+
+        result = client->AttestMultiple(endpoint_urls, 0, nullptr, results, jwt_tokens);
+        EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER);
+
+        result = client->AttestMultiple(endpoint_urls, 1, nullptr, nullptr, jwt_tokens);
+        EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER);
+    }
+
+    TEST_F(ClientLibTests, TestAttestMultiple_failure_returns_no_tokens) {
+        attest::ClientOptions options;
+        options.token_cache_refresh_seconds = 60;
+        AttestationClientImpl cached_client(std::make_shared<Logger>(), options);
+
+        // The payload is invalid JSON, so collecting the evidence always fails, while
+        // the first endpoint is served from the token cache.
+        const std::string client_payload = "{\"key\":\"value\"]";
+        putCachedToken(cached_client, "https://primary.attest.azure.net", client_payload, createJwt(-60, 3600, "cached"));
+
+        const unsigned char* endpoint_urls[] = {
+            reinterpret_cast<const unsigned char*>("https://primary.attest.azure.net"),
+            reinterpret_cast<const unsigned char*>("https://secondary.attest.azure.net")
+        };
+        attest::AttestationResult results[2];
+        unsigned char* jwt_tokens[2] = { nullptr, nullptr };
+        attest::AttestationResult result = cached_client.AttestMultiple(endpoint_urls,
+            2,
+            reinterpret_cast<const unsigned char*>(client_payload.c_str()),
+            results,
+            jwt_tokens);
+        EXPECT_NE(result.code_, attest::AttestationResult::ErrorCode::SUCCESS);
+        for (int i = 0; i < 2; i++) {
+            EXPECT_EQ(results[i].code_, result.code_) << i;
+            EXPECT_EQ(jwt_tokens[i], nullptr) << i;
+        }
+    }
+
+    TEST_F(ClientLibTests, NonceMerkleTree_proofs) {
+        for (size_t count : { 1, 2, 3, 5, 8, 13 }) {
+            std::vector<std::string> nonces;
+            for (size_t i = 0; i < count; i++) {
+                nonces.push_back("nonce-" + std::to_string(i));
+            }
+
+            NonceMerkleTree tree;
+            ASSERT_TRUE(tree.Build(nonces));
+            std::string root = tree.GetRootHex();
+            EXPECT_EQ(root.size(), 64);
+
+            for (size_t i = 0; i < count; i++) {
+                std::string proof = tree.GetProof(i);
+                EXPECT_TRUE(NonceMerkleTree::VerifyProof(nonces[i], proof, root));
+                EXPECT_FALSE(NonceMerkleTree::VerifyProof(nonces[i] + "x", proof, root));
+
+                std::string other_root = root;
+                other_root[0] = other_root[0] == '0' ? '1' : '0';
+                EXPECT_FALSE(NonceMerkleTree::VerifyProof(nonces[i], proof, other_root));
+            }
+            EXPECT_TRUE(tree.GetProof(count).empty());
+
+            if (count > 1) {
+                // A proof only holds for the nonce at its own position.
+                EXPECT_FALSE(NonceMerkleTree::VerifyProof(nonces[1], tree.GetProof(0), root));
+
+                Json::Value proof;
+                Json::Reader reader;
+                ASSERT_TRUE(reader.parse(tree.GetProof(0), proof));
+                std::string hash = proof["path"][0]["hash"].asString();
+                hash[0] = hash[0] == '0' ? '1' : '0';
+                proof["path"][0]["hash"] = hash;
+                EXPECT_FALSE(NonceMerkleTree::VerifyProof(nonces[0], Json::FastWriter().write(proof), root));
+            }
+        }
+
+        NonceMerkleTree empty_tree;
+        EXPECT_FALSE(empty_tree.Build(std::vector<std::string>()));
+        EXPECT_FALSE(NonceMerkleTree::VerifyProof("nonce", "not json", "00"));
+        EXPECT_FALSE(NonceMerkleTree::VerifyProof("nonce", "{\"alg\":\"sha256\",\"root\":\"00\",\"path\":[{\"position\":\"up\",\"hash\":\"zz\"}]}", "00"));
+    }
+
+    TEST_F(ClientLibTests, TestAttestBatch_negative) {
+        const unsigned char* nonces[] = {
+            reinterpret_cast<const unsigned char*>("nonce-0"),
+            nullptr
+        };
+        unsigned char* proofs[2] = { nullptr, nullptr };
+        unsigned char* jwt_token = nullptr;
+        attest::ClientParameters params = {};
+        params.attestation_endpoint_url = reinterpret_cast<const unsigned char*>("https://primary.attest.azure.net");
+
+        attest::AttestationResult result = client->AttestBatch(params, nonces, 2, &jwt_token, proofs);
+        EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER);
+
+        result = client->AttestBatch(params, nonces, 0, &jwt_token, proofs);
+        EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER);
+
+        result = client->AttestBatch(params, nonces, 1, &jwt_token, nullptr);
+        EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER);
+
+        params.client_payload = reinterpret_cast<const unsigned char*>("{\"nonce_batch_root\":\"00\"}");
+        result = client->AttestBatch(params, nonces, 1, &jwt_token, proofs);
+        EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER);
+
+        params.client_payload = reinterpret_cast<const unsigned char*>("[\"nonce\"]");
+        result = client->AttestBatch(params, nonces, 1, &jwt_token, proofs);
+        EXPECT_EQ(result.code_, attest::AttestationResult::ErrorCode::ERROR_INVALID_INPUT_PARAMETER);
+        EXPECT_EQ(proofs[0], nullptr);
+    }
+
     TEST_F(ClientLibTests, TestParseMaaResponse_positive) {
         std::string json_str = "{\"token\":\"value1\"}";
         std::string enc_token;
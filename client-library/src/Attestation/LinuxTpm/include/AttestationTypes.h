@@ -68,12 +68,41 @@ struct PcrSet
     std::vector<PcrValue> pcrs;
 };
 
+inline bool operator==(const PcrValue& lhs, const PcrValue& rhs)
+{
+    return lhs.index == rhs.index && lhs.digest == rhs.digest;
+}
+
+inline bool operator!=(const PcrValue& lhs, const PcrValue& rhs)
+{
+    return !(lhs == rhs);
+}
+
+inline bool operator==(const PcrSet& lhs, const PcrSet& rhs)
+{
+    return lhs.hashAlg == rhs.hashAlg && lhs.pcrs == rhs.pcrs;
+}
+
+inline bool operator!=(const PcrSet& lhs, const PcrSet& rhs)
+{
+    return !(lhs == rhs);
+}
+
 struct PcrQuote
 {
     std::vector<unsigned char> quote;
     std::vector<unsigned char> signature;
 };
 
+/**
+ * A PCR quote together with the PCR values it was taken over
+ */
+struct PcrSnapshot
+{
+    PcrQuote quote;
+    PcrSet pcrSet;
+};
+
 struct EphemeralKey
 {
     std::vector<unsigned char> encryptionKey;
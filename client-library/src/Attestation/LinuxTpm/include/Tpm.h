@@ -6,21 +6,29 @@
 
 #pragma once
 
+#include <chrono>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include "AttestationTypes.h"
 #include "TssWrapper.h"
 
+class EphemeralKeyPool;
+
 /**
  * Unified TPM interface that supports basic TPM functionality needed for
  * remote attestation
+ *
+ * A Tpm object owns a single TPM context that is opened once at construction
+ * and can be shared between callers; calls into the context are serialized.
  */
 class Tpm
 {
 public:
 
     Tpm();
+    ~Tpm();
 
     attest::Buffer GetAIKCert() const;
     attest::Buffer GetAIKPub() const;
@@ -28,6 +36,13 @@ public:
         const attest::PcrList& pcrs, attest::HashAlg hashAlg) const;
     attest::PcrSet GetPCRValues(
         const attest::PcrList& pcrs, attest::HashAlg hashAlg) const;
+
+    /**
+     * Gets a quote over pcrs together with the PCR values it was taken over. The last
+     * snapshot is reused while the TPM pcrUpdateCounter is unchanged.
+     */
+    attest::PcrSnapshot GetPCRSnapshot(
+        const attest::PcrList& pcrs, attest::HashAlg hashAlg) const;
     attest::Buffer GetTcgLog() const;
     attest::Buffer GetEkPubWithoutPersisting() const;
     attest::Buffer GetEkPub() const;
@@ -56,6 +71,24 @@ public:
 
     attest::EphemeralKey GetEphemeralKey(const attest::PcrSet& pcrSet) const;
 
+    /**
+     * Starts pre-generating a certified ephemeral key in the background for the current
+     * values of pcrs, so that GetEphemeralKey returns without waiting on key generation.
+     * The key is regenerated whenever the PCR values change.
+     *
+     * param[in] pcrs: PCR indices the ephemeral key policy is bound to
+     * param[in] hashAlg: PCR bank the ephemeral key policy is bound to
+     * param[in] refreshInterval: How often the PCR values are checked for changes
+     */
+    void EnableEphemeralKeyPool(const attest::PcrList& pcrs,
+                                attest::HashAlg hashAlg,
+                                std::chrono::milliseconds refreshInterval);
+
+    /**
+     * Stops pre-generating ephemeral keys.
+     */
+    void DisableEphemeralKeyPool();
+
     // Default RSA scheme to RSAES and hash algorithm to SHA1 for backcompat with MAA.
     attest::Buffer DecryptWithEphemeralKey(const attest::PcrSet& pcrSet,
                                            const attest::Buffer& encryptedBlob,
@@ -69,4 +102,6 @@ public:
 
 private:
     std::unique_ptr<TssWrapper> tssWrapper;
+    mutable std::mutex tssMutex;
+    std::unique_ptr<EphemeralKeyPool> ephemeralKeyPool;
 };
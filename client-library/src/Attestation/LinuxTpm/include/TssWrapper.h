@@ -80,6 +80,18 @@ public:
     virtual attest::PcrSet GetPCRValues(
         const attest::PcrList& pcrs, attest::HashAlg hashAlg) = 0;
 
+    /**
+     * Retrieves the quote over specified PCRs in bank together with their values
+     *
+     * param[in] pcrs: vector of PCR indices to get quote and values over
+     * param[in] hashAlg: hash algorithm for PCR bank to get quote and values from
+     *
+     * returns: PcrSnapshot structure containing the quote and the values of the PCRs
+     *      at the time of the quote
+     */
+    virtual attest::PcrSnapshot GetPCRSnapshot(
+        const attest::PcrList& pcrs, attest::HashAlg hashAlg) = 0;
+
     /**
      * Retrieve the TCG log
      *
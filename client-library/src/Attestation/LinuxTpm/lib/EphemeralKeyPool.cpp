@@ -0,0 +1,101 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="EphemeralKeyPool.cpp" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+
+#include <exception>
+
+#include "EphemeralKeyPool.h"
+#include "Tpm2Logger.h"
+
+using namespace Tpm2Logger;
+
+EphemeralKeyPool::EphemeralKeyPool(PcrReader readPcrs,
+                                   KeyCreator createKey,
+                                   std::chrono::milliseconds refreshInterval)
+    : readPcrs(readPcrs),
+      createKey(createKey),
+      refreshInterval(refreshInterval)
+{
+    this->worker = std::thread(&EphemeralKeyPool::Run, this);
+}
+
+EphemeralKeyPool::~EphemeralKeyPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopRequested = true;
+    }
+    this->wakeUp.notify_all();
+
+    if (this->worker.joinable()) {
+        this->worker.join();
+    }
+}
+
+bool EphemeralKeyPool::TryGet(const attest::PcrSet& pcrSet, attest::EphemeralKey& key)
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (this->hasKey && this->keyPcrSet == pcrSet) {
+            key = this->key;
+            return true;
+        }
+        this->refreshRequested = true;
+    }
+    this->wakeUp.notify_all();
+    return false;
+}
+
+void EphemeralKeyPool::Invalidate()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->hasKey = false;
+        this->refreshRequested = true;
+    }
+    this->wakeUp.notify_all();
+}
+
+void EphemeralKeyPool::Run()
+{
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while (!this->stopRequested) {
+        this->wakeUp.wait_for(lock, this->refreshInterval, [this] {
+            return this->stopRequested || this->refreshRequested;
+        });
+        if (this->stopRequested) {
+            break;
+        }
+        this->refreshRequested = false;
+
+        // Talk to the TPM without holding the lock so TryGet never blocks on key generation.
+        lock.unlock();
+        try {
+            attest::PcrSet pcrSet = this->readPcrs();
+
+            bool isCurrent = false;
+            {
+                std::lock_guard<std::mutex> checkLock(this->mutex);
+                isCurrent = this->hasKey && this->keyPcrSet == pcrSet;
+            }
+
+            if (!isCurrent) {
+                attest::EphemeralKey newKey = this->createKey(pcrSet);
+
+                std::lock_guard<std::mutex> updateLock(this->mutex);
+                this->keyPcrSet = pcrSet;
+                this->key = newKey;
+                this->hasKey = true;
+            }
+        }
+        catch (const std::exception& e) {
+            LIBTPM2_LOG(LogLevel::Warn, "EphemeralKeyPool", "Failed to pre-generate ephemeral key: %s", e.what());
+
+            std::lock_guard<std::mutex> failLock(this->mutex);
+            this->hasKey = false;
+        }
+        lock.lock();
+    }
+}
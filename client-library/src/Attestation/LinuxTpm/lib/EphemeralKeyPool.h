@@ -0,0 +1,83 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="EphemeralKeyPool.h" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "AttestationTypes.h"
+
+/**
+ * Keeps a certified ephemeral key ready for the current PCR values so that callers
+ * do not wait on RSA key generation and certification.
+ *
+ * The ephemeral key is a primary key created from a fixed template whose auth policy is
+ * bound to the PCR values, so every key created for the same PCR values is the same key.
+ * The pool therefore holds a single entry which a background thread regenerates whenever
+ * the PCR values change.
+ */
+class EphemeralKeyPool
+{
+public:
+    using PcrReader = std::function<attest::PcrSet()>;
+    using KeyCreator = std::function<attest::EphemeralKey(const attest::PcrSet&)>;
+
+    /**
+     * Starts the background refresh thread.
+     *
+     * param[in] readPcrs: Returns the current values of the PCRs the key is bound to
+     * param[in] createKey: Creates and certifies an ephemeral key for the given PCR values
+     * param[in] refreshInterval: How often the PCR values are checked for changes
+     */
+    EphemeralKeyPool(PcrReader readPcrs,
+                     KeyCreator createKey,
+                     std::chrono::milliseconds refreshInterval);
+
+    /**
+     * Stops and joins the background refresh thread.
+     */
+    ~EphemeralKeyPool();
+
+    EphemeralKeyPool(const EphemeralKeyPool&) = delete;
+    EphemeralKeyPool& operator=(const EphemeralKeyPool&) = delete;
+
+    /**
+     * Retrieves the pre-generated key if it was created for pcrSet. On a miss the
+     * background thread is woken up to re-check the PCR values.
+     *
+     * param[in] pcrSet: PCR values the key must be bound to
+     * param[out] key: The pre-generated key
+     *
+     * returns: true if a key for pcrSet was available
+     */
+    bool TryGet(const attest::PcrSet& pcrSet, attest::EphemeralKey& key);
+
+    /**
+     * Drops the pre-generated key and wakes up the background thread to create a new one.
+     */
+    void Invalidate();
+
+private:
+    void Run();
+
+    PcrReader readPcrs;
+    KeyCreator createKey;
+    std::chrono::milliseconds refreshInterval;
+
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    bool stopRequested = false;
+    bool refreshRequested = true;
+
+    bool hasKey = false;
+    attest::PcrSet keyPcrSet;
+    attest::EphemeralKey key;
+
+    std::thread worker;
+};
@@ -5,8 +5,10 @@
 //-------------------------------------------------------------------------------------------------
 
 #include <memory>
+#include <mutex>
 #include <vector>
 #include "Exceptions.h"
+#include "EphemeralKeyPool.h"
 #include "Tpm.h"
 #include "TssWrapper.h"
 #include "Tss2Wrapper.h"
@@ -16,48 +18,69 @@ Tpm::Tpm()
     this->tssWrapper = std::make_unique<Tss2Wrapper>();
 }
 
+Tpm::~Tpm()
+{
+    // Stop the pool before the wrapper it uses is destroyed.
+    this->ephemeralKeyPool.reset();
+}
+
 attest::Buffer Tpm::GetAIKCert() const
 {
+    std::lock_guard<std::mutex> lock(this->tssMutex);
     return this->tssWrapper->GetAIKCert();
 }
 
 attest::Buffer Tpm::GetAIKPub() const
 {
+    std::lock_guard<std::mutex> lock(this->tssMutex);
     return this->tssWrapper->GetAIKPub();
 }
 
 attest::PcrQuote Tpm::GetPCRQuote(const attest::PcrList& pcrs, attest::HashAlg hashAlg) const
 {
+    std::lock_guard<std::mutex> lock(this->tssMutex);
     return this->tssWrapper->GetPCRQuote(pcrs, hashAlg);
 }
 
 attest::PcrSet Tpm::GetPCRValues(const attest::PcrList& pcrs, attest::HashAlg hashAlg) const
 {
+    std::lock_guard<std::mutex> lock(this->tssMutex);
     return this->tssWrapper->GetPCRValues(pcrs, hashAlg);
 }
 
+attest::PcrSnapshot Tpm::GetPCRSnapshot(const attest::PcrList& pcrs, attest::HashAlg hashAlg) const
+{
+    std::lock_guard<std::mutex> lock(this->tssMutex);
+    return this->tssWrapper->GetPCRSnapshot(pcrs, hashAlg);
+}
+
 attest::Buffer Tpm::GetTcgLog() const
 {
+    std::lock_guard<std::mutex> lock(this->tssMutex);
     return this->tssWrapper->GetTcgLog();
 }
 
 attest::Buffer Tpm::GetEkPubWithoutPersisting() const
 {
+    std::lock_guard<std::mutex> lock(this->tssMutex);
     return this->tssWrapper->GetEkPubWithoutPersisting();
 }
 
 attest::Buffer Tpm::GetEkPub() const
 {
+    std::lock_guard<std::mutex> lock(this->tssMutex);
     return this->tssWrapper->GetEkPub();
 }
 
 attest::Buffer Tpm::GetEkNvCert() const
 {
+    std::lock_guard<std::mutex> lock(this->tssMutex);
     return this->tssWrapper->GetEkNvCert();
 }
 
 attest::TpmVersion Tpm::GetVersion() const
 {
+    std::lock_guard<std::mutex> lock(this->tssMutex);
     return this->tssWrapper->GetVersion();
 }
 
@@ -69,6 +92,7 @@ attest::Buffer Tpm::Unseal(
     const attest::HashAlg hashAlg,
     const bool usePcrAuth) const
 {
+    std::lock_guard<std::mutex> lock(this->tssMutex);
     return this->tssWrapper->Unseal(importablePublic, importablePrivate,
             encryptedBlob, pcrSet, hashAlg, usePcrAuth);
 }
@@ -81,49 +105,86 @@ attest::Buffer Tpm::UnsealWithEkFromSpec(
     const attest::HashAlg hashAlg,
     const bool usePcrAuth) const
 {
+    std::lock_guard<std::mutex> lock(this->tssMutex);
     return this->tssWrapper->UnsealWithEkFromSpec(importablePublic, importablePrivate,
         encryptedBlob, pcrSet, hashAlg, usePcrAuth);
 }
 
 void Tpm::RemovePersistentEk() const
 {
+    std::lock_guard<std::mutex> lock(this->tssMutex);
     return this->tssWrapper->RemovePersistentEk();
 }
 
 attest::Buffer Tpm::UnpackAiKPubToRSA(attest::Buffer& aikPubMarshaled) const
 {
+    std::lock_guard<std::mutex> lock(this->tssMutex);
     return this->tssWrapper->UnpackAiKPubToRSA(aikPubMarshaled);
 }
 
 attest::PcrQuote Tpm::UnpackPcrQuoteToRSA(attest::PcrQuote& pcrQuoteMarshaled) const
 {
+    std::lock_guard<std::mutex> lock(this->tssMutex);
     return this->tssWrapper->UnpackPcrQuoteToRSA(pcrQuoteMarshaled);
 }
 
 attest::EphemeralKey Tpm::GetEphemeralKey(const attest::PcrSet& pcrSet) const
 {
+    attest::EphemeralKey ephemeralKey;
+    if (this->ephemeralKeyPool && this->ephemeralKeyPool->TryGet(pcrSet, ephemeralKey)) {
+        return ephemeralKey;
+    }
+
+    std::lock_guard<std::mutex> lock(this->tssMutex);
     return this->tssWrapper->GetEphemeralKey(pcrSet);
 }
 
+void Tpm::EnableEphemeralKeyPool(const attest::PcrList& pcrs,
+                                 attest::HashAlg hashAlg,
+                                 std::chrono::milliseconds refreshInterval)
+{
+    DisableEphemeralKeyPool();
+
+    this->ephemeralKeyPool = std::make_unique<EphemeralKeyPool>(
+        [this, pcrs, hashAlg]() {
+            std::lock_guard<std::mutex> lock(this->tssMutex);
+            return this->tssWrapper->GetPCRValues(pcrs, hashAlg);
+        },
+        [this](const attest::PcrSet& pcrSet) {
+            std::lock_guard<std::mutex> lock(this->tssMutex);
+            return this->tssWrapper->GetEphemeralKey(pcrSet);
+        },
+        refreshInterval);
+}
+
+void Tpm::DisableEphemeralKeyPool()
+{
+    this->ephemeralKeyPool.reset();
+}
+
 attest::Buffer Tpm::DecryptWithEphemeralKey(const attest::PcrSet& pcrSet,
                                             const attest::Buffer& encryptedBlob,
                                             const attest::RsaScheme rsaWrapAlgId,
                                             const attest::RsaHashAlg rsaHashAlgId) const
 {
+    std::lock_guard<std::mutex> lock(this->tssMutex);
     return this->tssWrapper->DecryptWithEphemeralKey(pcrSet, encryptedBlob, rsaWrapAlgId, rsaHashAlgId);
 }
 
 void Tpm::WriteAikCert(const attest::Buffer& aikCert) const
 {
+    std::lock_guard<std::mutex> lock(this->tssMutex);
     this->tssWrapper->WriteAikCert(aikCert);
 }
 
 attest::Buffer Tpm::GetHCLReport() const
 {
+    std::lock_guard<std::mutex> lock(this->tssMutex);
     return this->tssWrapper->GetHCLReport();
 }
 
 attest::EphemeralKey Tpm::GetEkPubWithCertification() const
 {
+    std::lock_guard<std::mutex> lock(this->tssMutex);
     return this->tssWrapper->GetEkPubWithCertification();
 }
@@ -6,6 +6,7 @@
 
 #include "Exceptions.h"
 #include "Tss2Ctx.h"
+#include "Tss2Memory.h"
 #ifndef PLATFORM_UNIX
 #include "tss2/tss2_tcti_tbs.h"  // Windows context handling is routed to tbs library
 #define TPM_DEVICE "" // For windows we don't need the device Manager context string.
@@ -49,6 +50,56 @@ ESYS_CONTEXT* Tss2Ctx::Get()
     return this->ctx;
 }
 
+const Tss2Capabilities& Tss2Ctx::GetCapabilities()
+{
+    if (this->capabilities != nullptr) {
+        return *this->capabilities;
+    }
+
+    auto capabilities = std::make_unique<Tss2Capabilities>();
+    TPM2_PT property = TPM2_PT_FIXED;
+    TPMI_YES_NO isMore = TPM2_NO;
+    do {
+        TPMS_CAPABILITY_DATA* caps = nullptr;
+        TSS2_RC ret = Esys_GetCapability(this->Get(),
+                                         ESYS_TR_NONE, ESYS_TR_NONE, ESYS_TR_NONE,
+                                         TPM2_CAP_TPM_PROPERTIES, property,
+                                         TPM2_MAX_TPM_PROPERTIES, &isMore, &caps);
+        if (ret != TSS2_RC_SUCCESS) {
+            throw Tss2Exception("Esys_GetCapability failed", ret);
+        }
+
+        // Esys_GetCapability succeeded. Manage caps memory with a unique_c_ptr
+        auto uniqueCap = unique_c_ptr<TPMS_CAPABILITY_DATA>(caps);
+        if (uniqueCap == nullptr || uniqueCap->data.tpmProperties.count == 0) {
+            break;
+        }
+
+        const auto& properties = uniqueCap->data.tpmProperties;
+        for (uint32_t i = 0; i < properties.count; i++) {
+            switch (properties.tpmProperty[i].property) {
+                case TPM2_PT_FAMILY_INDICATOR:
+                    capabilities->familyIndicator = properties.tpmProperty[i].value;
+                    break;
+                case TPM2_PT_PCR_COUNT:
+                    capabilities->pcrCount = properties.tpmProperty[i].value;
+                    break;
+                case TPM2_PT_NV_BUFFER_MAX:
+                    capabilities->nvBufferMax = properties.tpmProperty[i].value;
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        // The TPM may not return the whole range at once, continue after the last property.
+        property = properties.tpmProperty[properties.count - 1].property + 1;
+    } while (isMore == TPM2_YES && property < TPM2_PT_VAR);
+
+    this->capabilities = std::move(capabilities);
+    return *this->capabilities;
+}
+
 //
 // Private helpers
 //
@@ -15,6 +15,17 @@
 
 #include <memory>
 
+/**
+ * Fixed TPM properties. These do not change while the TPM is running, so they are read
+ * once per context. A value of 0 means the TPM did not report the property.
+ */
+struct Tss2Capabilities
+{
+    uint32_t familyIndicator = 0;
+    uint32_t pcrCount = 0;
+    uint32_t nvBufferMax = 0;
+};
+
 /**
  * A wrapper for the TPM2 TSS context which is passed with each TPM2 API call
  */
@@ -26,8 +37,15 @@ public:
 
     virtual ESYS_CONTEXT* Get();
 
+    /**
+     * Returns the fixed TPM properties. The first call reads all of them with a single
+     * TPM2_CAP_TPM_PROPERTIES sweep, later calls are served from the cache.
+     */
+    virtual const Tss2Capabilities& GetCapabilities();
+
 private:
     ESYS_CONTEXT* ctx = nullptr;
+    std::unique_ptr<Tss2Capabilities> capabilities;
 #ifdef USE_NEW_TCTI_INITIALIZATION
     TSS2_TCTI_CONTEXT* tctiCtx = nullptr;
 #else
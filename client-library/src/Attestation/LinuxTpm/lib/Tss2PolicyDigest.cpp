@@ -0,0 +1,173 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="Tss2PolicyDigest.cpp" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+#include <cstring>
+#include <new>
+#include <sstream>
+#include <openssl/evp.h>
+#include <openssl/err.h>
+
+#include "Exceptions.h"
+#include "Tss2PolicyDigest.h"
+
+// Mask for the handle type octet of a TPM handle
+#define TPM2_HANDLE_TYPE_MASK 0xFF000000
+
+/**
+ * Get EVP_MD openssl hash algorithm for the policy hash algorithm `algorithm`
+ */
+static const EVP_MD* _GetOpenSslAlg(TPMI_ALG_HASH algorithm)
+{
+    switch (algorithm) {
+        case TPM2_ALG_SHA1:
+            return EVP_sha1();
+        case TPM2_ALG_SHA256:
+            return EVP_sha256();
+        case TPM2_ALG_SHA384:
+            return EVP_sha384();
+        case TPM2_ALG_SHA512:
+            return EVP_sha512();
+        default:
+            return nullptr;
+    }
+}
+
+/**
+ * Appends `value` to `buffer` in the big-endian TPM wire format
+ */
+static void _AppendUint32(std::vector<unsigned char>& buffer, uint32_t value)
+{
+    buffer.push_back(static_cast<unsigned char>(value >> 24));
+    buffer.push_back(static_cast<unsigned char>(value >> 16));
+    buffer.push_back(static_cast<unsigned char>(value >> 8));
+    buffer.push_back(static_cast<unsigned char>(value));
+}
+
+/**
+ * Appends `value` to `buffer` in the big-endian TPM wire format
+ */
+static void _AppendUint16(std::vector<unsigned char>& buffer, uint16_t value)
+{
+    buffer.push_back(static_cast<unsigned char>(value >> 8));
+    buffer.push_back(static_cast<unsigned char>(value));
+}
+
+Tss2PolicyDigest::Tss2PolicyDigest(TPMI_ALG_HASH policyAlg) : policyAlg(policyAlg)
+{
+    const EVP_MD* md = _GetOpenSslAlg(policyAlg);
+    if (md == nullptr) {
+        std::stringstream ss;
+        ss << "Unsupported policy hash algorithm: " << policyAlg;
+        throw std::runtime_error(ss.str());
+    }
+
+    // A policy session starts with a digest of all zeros
+    this->digest.assign(EVP_MD_size(md), 0);
+}
+
+/* See header */
+void Tss2PolicyDigest::PolicySecret(TPM2_HANDLE authorityHandle)
+{
+    if ((authorityHandle & TPM2_HANDLE_TYPE_MASK) != (TPM2_HT_PERMANENT << TPM2_HR_SHIFT)) {
+        throw std::invalid_argument("PolicySecret is only supported for permanent handles");
+    }
+
+    // policyDigest = H(H(policyDigest || TPM_CC_PolicySecret || authObject.name) || policyRef)
+    std::vector<unsigned char> data;
+    _AppendUint32(data, TPM2_CC_PolicySecret);
+    _AppendUint32(data, authorityHandle);
+    this->Extend(data);
+
+    // The policyRef is empty but the second extend still happens
+    this->Extend(std::vector<unsigned char>());
+}
+
+/* See header */
+void Tss2PolicyDigest::PolicyPcr(const TPM2B_DIGEST& digest, const TPML_PCR_SELECTION& pcrSelection)
+{
+    // policyDigest = H(policyDigest || TPM_CC_PolicyPCR || pcrs || pcrDigest)
+    std::vector<unsigned char> data;
+    _AppendUint32(data, TPM2_CC_PolicyPCR);
+
+    _AppendUint32(data, pcrSelection.count);
+    for (uint32_t i = 0; i < pcrSelection.count; i++) {
+        const auto& selection = pcrSelection.pcrSelections[i];
+        _AppendUint16(data, selection.hash);
+        data.push_back(selection.sizeofSelect);
+        data.insert(data.end(), selection.pcrSelect, selection.pcrSelect + selection.sizeofSelect);
+    }
+
+    data.insert(data.end(), digest.buffer, digest.buffer + digest.size);
+    this->Extend(data);
+}
+
+/* See header */
+void Tss2PolicyDigest::PolicyCommandCode(TPM2_CC command)
+{
+    // policyDigest = H(policyDigest || TPM_CC_PolicyCommandCode || code)
+    std::vector<unsigned char> data;
+    _AppendUint32(data, TPM2_CC_PolicyCommandCode);
+    _AppendUint32(data, command);
+    this->Extend(data);
+}
+
+/* See header */
+void Tss2PolicyDigest::PolicyAuthValue()
+{
+    // policyDigest = H(policyDigest || TPM_CC_PolicyAuthValue)
+    std::vector<unsigned char> data;
+    _AppendUint32(data, TPM2_CC_PolicyAuthValue);
+    this->Extend(data);
+}
+
+/* See header */
+unique_c_ptr<TPM2B_DIGEST> Tss2PolicyDigest::GetDigest() const
+{
+    unique_c_ptr<TPM2B_DIGEST> result((TPM2B_DIGEST*)calloc(1, sizeof(TPM2B_DIGEST)));
+    if (result == nullptr) {
+        throw std::bad_alloc();
+    }
+
+    std::memcpy(result->buffer, this->digest.data(), this->digest.size());
+    result->size = static_cast<UINT16>(this->digest.size());
+    return result;
+}
+
+//
+// Private helpers
+//
+
+void Tss2PolicyDigest::Extend(const std::vector<unsigned char>& data)
+{
+    unique_evp_md mdctx(EVP_MD_CTX_create());
+    if (!mdctx) {
+        std::stringstream ss;
+        ss << "Error initializing OpenSSL EVP context:" << ERR_error_string(ERR_get_error(), nullptr);
+        throw std::runtime_error(ss.str());
+    }
+
+    int ret = EVP_DigestInit_ex(mdctx.get(), _GetOpenSslAlg(this->policyAlg), nullptr);
+    if (!ret) {
+        throw OpenSslException(ERR_error_string(ERR_get_error(), nullptr), ret);
+    }
+
+    ret = EVP_DigestUpdate(mdctx.get(), this->digest.data(), this->digest.size());
+    if (!ret) {
+        throw OpenSslException(ERR_error_string(ERR_get_error(), nullptr), ret);
+    }
+
+    if (!data.empty()) {
+        ret = EVP_DigestUpdate(mdctx.get(), data.data(), data.size());
+        if (!ret) {
+            throw OpenSslException(ERR_error_string(ERR_get_error(), nullptr), ret);
+        }
+    }
+
+    unsigned int size = static_cast<unsigned int>(this->digest.size());
+    ret = EVP_DigestFinal_ex(mdctx.get(), this->digest.data(), &size);
+    if (!ret) {
+        throw OpenSslException(ERR_error_string(ERR_get_error(), nullptr), ret);
+    }
+}
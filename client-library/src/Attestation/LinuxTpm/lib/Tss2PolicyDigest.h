@@ -0,0 +1,69 @@
+//-------------------------------------------------------------------------------------------------
+// <copyright file="Tss2PolicyDigest.h" company="Microsoft Corporation">
+// Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//-------------------------------------------------------------------------------------------------
+#pragma once
+
+#include <vector>
+#include <tss2/tss2_tpm2_types.h>
+
+#include "Tss2Memory.h"
+
+/**
+ * Computes TPM2 policy digests on the host. Each policy command extends the digest the
+ * same way the TPM extends the policyDigest of a TPM2_SE_TRIAL session, so the result can
+ * be used as an authPolicy without any TPM round trips.
+ */
+class Tss2PolicyDigest
+{
+public:
+    /**
+     * Starts from the empty policy digest
+     *
+     * param[in] policyAlg: Hash algorithm of the policy session being reproduced
+     */
+    explicit Tss2PolicyDigest(TPMI_ALG_HASH policyAlg = TPM2_ALG_SHA256);
+
+    /**
+     * Extends the digest as TPM2_PolicySecret with an empty policyRef would
+     *
+     * param[in] authorityHandle: Permanent handle (e.g. TPM2_RH_ENDORSEMENT) that
+     * authorizes the policy. The name of a permanent handle is the handle itself.
+     */
+    void PolicySecret(TPM2_HANDLE authorityHandle);
+
+    /**
+     * Extends the digest as TPM2_PolicyPCR would
+     *
+     * param[in] digest: Hash of PCR values refered to in `pcrSelection`
+     * param[in] pcrSelection: Selection of PCR banks and indices
+     */
+    void PolicyPcr(const TPM2B_DIGEST& digest, const TPML_PCR_SELECTION& pcrSelection);
+
+    /**
+     * Extends the digest as TPM2_PolicyCommandCode would
+     */
+    void PolicyCommandCode(TPM2_CC command);
+
+    /**
+     * Extends the digest as TPM2_PolicyAuthValue would
+     */
+    void PolicyAuthValue();
+
+    /**
+     * Gets the current policy digest
+     *
+     * returns: Policy digest
+     */
+    unique_c_ptr<TPM2B_DIGEST> GetDigest() const;
+
+private:
+    /**
+     * Sets the digest to H(digest || data)
+     */
+    void Extend(const std::vector<unsigned char>& data);
+
+    TPMI_ALG_HASH policyAlg;
+    std::vector<unsigned char> digest;
+};
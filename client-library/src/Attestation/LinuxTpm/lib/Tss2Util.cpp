@@ -12,6 +12,7 @@
 #include "AttestationTypes.h"
 #include "Exceptions.h"
 #include "Tss2Memory.h"
+#include "Tss2PolicyDigest.h"
 #include "Tss2Session.h"
 #include "Tss2Util.h"
 #ifdef _DEBUG
@@ -27,6 +28,7 @@
 static void _PopulateParametersEkFromSpec(TPM2B_PUBLIC& inPub, bool setAdminWithAuthPolicy = true);
 static void _PopulateEkPublicInput(Tss2Ctx& ctx, TPM2B_PUBLIC& inPub);
 static const EVP_MD* _GetOpenSslAlg(attest::HashAlg algorithm);
+static uint16_t _GetNvBufferSize(Tss2Ctx& ctx);
 
 /* See header */
 unique_c_ptr<TPM2B_PUBLIC> Tss2Util::GenerateEk(Tss2Ctx& ctx)
@@ -192,9 +194,10 @@ std::vector<unsigned char> Tss2Util::NvRead(Tss2Ctx& ctx, TPM2_HANDLE index)
     //
     TPM2B_MAX_NV_BUFFER* nvData = nullptr;
     unique_c_ptr<TPM2B_MAX_NV_BUFFER> nvDataUnique;
+    const uint16_t maxChunkSize = _GetNvBufferSize(ctx);
 
     while (size > 0) {
-        uint16_t bytesToRead = size > __TPM2_MAX_NV_BUFFER_SIZE ? __TPM2_MAX_NV_BUFFER_SIZE : size;
+        uint16_t bytesToRead = size > maxChunkSize ? maxChunkSize : size;
 
         ret = Esys_NV_Read(ctx.Get(),
                            ESYS_TR_RH_OWNER,
@@ -350,6 +353,18 @@ const EVP_MD* _GetOpenSslAlg(attest::HashAlg algorithm) {
     }
 }
 
+/**
+ * Get the chunk size for NV reads and writes. TPMs that report a smaller
+ * TPM2_PT_NV_BUFFER_MAX than __TPM2_MAX_NV_BUFFER_SIZE are chunked by what they report.
+ */
+uint16_t _GetNvBufferSize(Tss2Ctx& ctx) {
+    uint32_t nvBufferMax = ctx.GetCapabilities().nvBufferMax;
+    if (nvBufferMax == 0 || nvBufferMax > __TPM2_MAX_NV_BUFFER_SIZE) {
+        return __TPM2_MAX_NV_BUFFER_SIZE;
+    }
+    return static_cast<uint16_t>(nvBufferMax);
+}
+
 /* See header */
 unique_c_ptr<TPML_PCR_SELECTION> Tss2Util::GetTssPcrSelection(
         Tss2Ctx& ctx,
@@ -441,11 +456,13 @@ unique_c_ptr<TPM2B_DIGEST> Tss2Util::GeneratePcrDigest(
 }
 
 /* See header */
-void Tss2Util::PopulateCurrentPcrs(Tss2Ctx& ctx, attest::PcrSet& pcrSet)
+uint32_t Tss2Util::PopulateCurrentPcrs(Tss2Ctx& ctx, attest::PcrSet& pcrSet)
 {
     auto selection = Tss2Util::GetTssPcrSelection(ctx, pcrSet, pcrSet.hashAlg);
+    const TPML_PCR_SELECTION fullSelection = *selection;
 
     uint32_t pcrUpdateCounter {0};
+    uint32_t firstPcrUpdateCounter {0};
 
     TPML_PCR_SELECTION* pcrSelOut = nullptr;
     TPML_DIGEST* pcrValues = nullptr;
@@ -466,6 +483,23 @@ void Tss2Util::PopulateCurrentPcrs(Tss2Ctx& ctx, attest::PcrSet& pcrSet)
         unique_c_ptr<TPML_DIGEST> pcrVals(pcrValues);
         unique_c_ptr<TPML_PCR_SELECTION> pcrSel(pcrSelOut);
 
+        if (pcrCount == 0)
+        {
+            firstPcrUpdateCounter = pcrUpdateCounter;
+        }
+        else if (pcrUpdateCounter != firstPcrUpdateCounter)
+        {
+            // A PCR was extended between two reads, start over from the full selection.
+            *selection = fullSelection;
+            for (auto& pcr : pcrSet.pcrs)
+            {
+                pcr.digest.clear();
+            }
+            pcrCount = 0;
+            maskSum = 1;
+            continue;
+        }
+
         if (pcrVals != nullptr && pcrSel != nullptr && pcrVals->count != 0)
         {
             for (uint32_t i = 0; i < pcrVals->count; i++)
@@ -490,44 +524,21 @@ void Tss2Util::PopulateCurrentPcrs(Tss2Ctx& ctx, attest::PcrSet& pcrSet)
         }
 
     } while (maskSum != 0);
+
+    return firstPcrUpdateCounter;
 }
 
 /* See header */
 uint8_t Tss2Util::GetPcrCount(Tss2Ctx& ctx)
 {
-    TPMI_YES_NO isMore = 0;
-    TPMS_CAPABILITY_DATA *caps = nullptr;
-    TSS2_RC ret;
-    const int capsRequested = 1;
-
-    ret = Esys_GetCapability(ctx.Get(),
-                             ESYS_TR_NONE, ESYS_TR_NONE, ESYS_TR_NONE,
-                             TPM2_CAP_TPM_PROPERTIES, TPM2_PT_PCR_COUNT,
-                             capsRequested,  &isMore, &caps);
-    if (ret != TSS2_RC_SUCCESS) {
-        throw Tss2Exception("Esys_GetCapability failed", ret);
-    }
-
-    // Esys_GetCapability succeeded. Manage outPub memory with a unique_c_ptr
-    auto uniqueCap = unique_c_ptr<TPMS_CAPABILITY_DATA>(caps);
-
-    if (uniqueCap->data.tpmProperties.count != capsRequested)
-    {
-        // TODO: Log warning: Unexpected count
-        // Need to wait for logging code to be merged
-    }
-
-    for(uint32_t i = 0 ; i < caps->data.tpmProperties.count; i++)
-    {
-        if (uniqueCap->data.tpmProperties.tpmProperty[0].property == TPM2_PT_PCR_COUNT)
-        {
-            //Downgrading (casting) the 32bit to 8bit, because we known the size of
-            //PCR count will always be in the range of uint8_t.
-            return static_cast<uint8_t>(uniqueCap->data.tpmProperties.tpmProperty[0].value);
-        }
+    uint32_t pcrCount = ctx.GetCapabilities().pcrCount;
+    if (pcrCount == 0) {
+        throw std::runtime_error("Could not find PCR count");
     }
 
-    throw std::runtime_error("Could not find PCR count");
+    //Downgrading (casting) the 32bit to 8bit, because we known the size of
+    //PCR count will always be in the range of uint8_t.
+    return static_cast<uint8_t>(pcrCount);
 }
 
 /* See header */
@@ -555,11 +566,11 @@ unique_c_ptr<TPM2B_DIGEST> Tss2Util::GetEphemeralKeyPolicyDigest(Tss2Ctx& ctx,
     auto pcrDigest = Tss2Util::GeneratePcrDigest(pcrSet, pcrSet.hashAlg);
     auto pcrSelection = Tss2Util::GetTssPcrSelection(ctx, pcrSet, pcrSet.hashAlg);
 
-    Tss2Session session(ctx.Get());
-    session.Start(TPM2_SE_TRIAL);
-    session.PolicyPcr(*pcrDigest, *pcrSelection);
+    // Compute the digest a SHA256 trial session would produce without talking to the TPM
+    Tss2PolicyDigest policy(TPM2_ALG_SHA256);
+    policy.PolicyPcr(*pcrDigest, *pcrSelection);
 
-    return session.GetDigest();
+    return policy.GetDigest();
 }
 
 void Tss2Util::PopulateEphemeralKeyPublicTemplate(Tss2Ctx& ctx,
@@ -658,8 +669,9 @@ void Tss2Util::NvWrite(Tss2Ctx& ctx, TPM2_HANDLE index, const std::vector<unsign
     auto nvHandle = HandleToEsys(ctx, index);
     int size = data.size();
     int offset = 0;
+    const uint16_t maxChunkSize = _GetNvBufferSize(ctx);
     while (size > 0) {
-        uint16_t bytesToWrite = size > __TPM2_MAX_NV_BUFFER_SIZE ? __TPM2_MAX_NV_BUFFER_SIZE : size;
+        uint16_t bytesToWrite = size > maxChunkSize ? maxChunkSize : size;
         TPM2B_MAX_NV_BUFFER nvData = { 0 };
         nvData.size = bytesToWrite;
         int bufferIdx = 0;
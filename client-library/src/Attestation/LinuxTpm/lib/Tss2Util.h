@@ -112,14 +112,16 @@ public:
     static uint8_t GetPcrCount(Tss2Ctx& ctx);
 
     /**
-     * Get and populate the digest for each pcr
+     * Get and populate the digest for each pcr. If the PCRs change while they are being
+     * read in several chunks, the read starts over so all digests describe the same state.
      *
      * param[in] ctx: wrapper for the TPM2 TSS context which is passed with each TPM2 API call
      * param[in] pcrSet: The PCR indices being used.
      *
-     * returns: by reference, digest values for each pcr in pcrSet.pcrs
+     * returns: the TPM pcrUpdateCounter the digests were read at, and by reference,
+     *      digest values for each pcr in pcrSet.pcrs
      */
-    static void PopulateCurrentPcrs(Tss2Ctx& ctx, attest::PcrSet& pcrSet);
+    static uint32_t PopulateCurrentPcrs(Tss2Ctx& ctx, attest::PcrSet& pcrSet);
 
     /**
      * Populate the Public object to be used for the ephemeral key creation.
@@ -136,6 +138,7 @@ public:
 
     /**
      * Generate and return the policy digest to be set for creation of the ephe,eral key.
+     * The digest is computed on the host and matches the one of a SHA256 trial session.
      *
      * param[in] ctx: wrapper for the TPM2 TSS context which is passed with each TPM2 API call
      * param[in] pcrSet: Pcr values to be used for generating the policy digest.
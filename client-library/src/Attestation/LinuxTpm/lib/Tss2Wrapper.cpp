@@ -31,6 +31,9 @@
 // Mask for the error bits of tpm2 compliant return code
 #define TPM2_RC_ERROR_MASK 0xFF
 
+// Number of quotes taken before giving up when the PCRs keep changing underneath
+#define MAX_PCR_SNAPSHOT_ATTEMPTS 3
+
 using namespace Tpm2Logger;
 
 Tss2Wrapper::Tss2Wrapper()
@@ -38,6 +41,16 @@ Tss2Wrapper::Tss2Wrapper()
     this->ctx = std::make_unique<Tss2Ctx>();
 }
 
+Tss2Wrapper::~Tss2Wrapper()
+{
+    try {
+        FlushEphemeralKey();
+    }
+    catch (const Tss2Exception& e) {
+        LIBTPM2_LOG(LogLevel::Warn, "~Tss2Wrapper", "Failed to flush ephemeral key: %s", e.what());
+    }
+}
+
 /* See header */
 std::vector<unsigned char> Tss2Wrapper::GetEkNvCert()
 {
@@ -214,6 +227,51 @@ attest::PcrQuote Tss2Wrapper::GetPCRQuote(
 /* See header */
 attest::PcrSet Tss2Wrapper::GetPCRValues(
     const attest::PcrList& pcrs, attest::HashAlg hashAlg)
+{
+    uint32_t pcrUpdateCounter = 0;
+    return this->ReadPCRValues(pcrs, hashAlg, pcrUpdateCounter);
+}
+
+/* See header */
+attest::PcrSnapshot Tss2Wrapper::GetPCRSnapshot(
+    const attest::PcrList& pcrs, attest::HashAlg hashAlg)
+{
+    uint32_t pcrUpdateCounter = 0;
+    attest::PcrSet pcrSet = this->ReadPCRValues(pcrs, hashAlg, pcrUpdateCounter);
+
+    // The counter is only incremented when a PCR is extended or reset, so an unchanged
+    // counter for the same selection means the cached quote is still current.
+    if (this->hasPcrSnapshot &&
+        this->pcrSnapshotUpdateCounter == pcrUpdateCounter &&
+        this->pcrSnapshot.pcrSet == pcrSet) {
+        return this->pcrSnapshot;
+    }
+
+    for (int attempt = 0; attempt < MAX_PCR_SNAPSHOT_ATTEMPTS; attempt++) {
+        attest::PcrQuote quote = this->GetPCRQuote(pcrs, hashAlg);
+
+        // Read the values again so the quote is known to describe them.
+        uint32_t pcrUpdateCounterAfterQuote = 0;
+        attest::PcrSet pcrSetAfterQuote = this->ReadPCRValues(pcrs, hashAlg, pcrUpdateCounterAfterQuote);
+        if (pcrUpdateCounterAfterQuote == pcrUpdateCounter) {
+            this->pcrSnapshot.quote = quote;
+            this->pcrSnapshot.pcrSet = pcrSet;
+            this->pcrSnapshotUpdateCounter = pcrUpdateCounter;
+            this->hasPcrSnapshot = true;
+            return this->pcrSnapshot;
+        }
+
+        LIBTPM2_LOG(LogLevel::Warn, "GetPCRSnapshot", "PCRs changed while taking a quote, retrying");
+        pcrUpdateCounter = pcrUpdateCounterAfterQuote;
+        pcrSet = pcrSetAfterQuote;
+    }
+
+    throw std::runtime_error("PCRs kept changing while taking a PCR quote");
+}
+
+/* See header */
+attest::PcrSet Tss2Wrapper::ReadPCRValues(
+    const attest::PcrList& pcrs, attest::HashAlg hashAlg, uint32_t& pcrUpdateCounter)
 {
     attest::PcrSet pcrSet;
     pcrSet.hashAlg = hashAlg;
@@ -225,7 +283,7 @@ attest::PcrSet Tss2Wrapper::GetPCRValues(
     }
 
     // Populate digest for each pcr
-    Tss2Util::PopulateCurrentPcrs(*ctx, pcrSet);
+    pcrUpdateCounter = Tss2Util::PopulateCurrentPcrs(*ctx, pcrSet);
 
     return pcrSet;
 }
@@ -291,47 +349,17 @@ std::vector<unsigned char> Tss2Wrapper::GetTcgLogFromFile(std::string fname)
 /* See header */
 attest::TpmVersion Tss2Wrapper::GetVersion()
 {
-    TPMI_YES_NO isMore = 0;
-    TPMS_CAPABILITY_DATA *caps = nullptr;
-    TSS2_RC ret;
-    const int capsRequested = 1;
-
-    ret = Esys_GetCapability(this->ctx->Get(),
-                             ESYS_TR_NONE, ESYS_TR_NONE, ESYS_TR_NONE,
-                             TPM2_CAP_TPM_PROPERTIES, TPM2_PT_FAMILY_INDICATOR,
-                             capsRequested,  &isMore, &caps);
-    if (ret != TSS2_RC_SUCCESS) {
-        throw Tss2Exception("Esys_GetCapability failed", ret);
-    }
-
-    // Esys_GetCapability succeeded. Manage outPub memory with a unique_c_ptr
-    auto uniqueCap = unique_c_ptr<TPMS_CAPABILITY_DATA>(caps);
-
-    if (uniqueCap->data.tpmProperties.count != capsRequested)
+    uint32_t value = this->ctx->GetCapabilities().familyIndicator;
+    switch (value)
     {
-        // TODO: Log warning: Unexpected count
-        // Need to wait for logging code to be merged
+        case TPM20_VERSION_STRING:
+            return attest::TpmVersion::V2_0;
+        case TPM12_VERSION_STRING:
+            return attest::TpmVersion::V1_2;
+        default:
+            // TODO: Log version string in error
+            throw std::runtime_error("Invalid TPM version string");
     }
-
-    for(uint32_t i = 0 ; i < caps->data.tpmProperties.count; i++)
-    {
-        if (uniqueCap->data.tpmProperties.tpmProperty[0].property == TPM2_PT_FAMILY_INDICATOR)
-        {
-            uint32_t value = uniqueCap->data.tpmProperties.tpmProperty[0].value;
-            switch (value)
-            {
-                case TPM20_VERSION_STRING:
-                    return attest::TpmVersion::V2_0;
-                case TPM12_VERSION_STRING:
-                    return attest::TpmVersion::V1_2;
-                default:
-                    // TODO: Log version string in error
-                    throw std::runtime_error("Invalid TPM version string");
-            }
-        }
-    }
-
-    throw std::runtime_error("Could not find TPM version");
 }
 
 /* See header */
@@ -559,6 +587,24 @@ attest::PcrQuote Tss2Wrapper::UnpackPcrQuoteToRSA(attest::PcrQuote& pcrQuoteMars
 }
 
 attest::EphemeralKey Tss2Wrapper::GetCertifiedKeyAndFlushHandle(const unique_c_ptr<TPM2B_PUBLIC>& outPubPtr, ESYS_TR primaryHandle)
+{
+    attest::EphemeralKey ephemeralKey;
+    try {
+        ephemeralKey = GetCertifiedKey(outPubPtr, primaryHandle);
+    }
+    catch (...) {
+        // Flush the key object from the tpm to make sure we are not consuming tpm memory.
+        Tss2Util::FlushObjectContext(*ctx, primaryHandle);
+        throw;
+    }
+
+    // Flush the key object from the tpm to make sure we are not consuming tpm memory.
+    Tss2Util::FlushObjectContext(*ctx, primaryHandle);
+
+    return ephemeralKey;
+}
+
+attest::EphemeralKey Tss2Wrapper::GetCertifiedKey(const unique_c_ptr<TPM2B_PUBLIC>& outPubPtr, ESYS_TR keyHandle)
 {
     TPM2B_DATA qualifyingData = { 0 };
     TPMT_SIG_SCHEME inScheme;
@@ -568,7 +614,7 @@ attest::EphemeralKey Tss2Wrapper::GetCertifiedKeyAndFlushHandle(const unique_c_p
     auto signHandle = Tss2Util::HandleToEsys(*ctx, AIK_PUB_INDEX);
 
     TSS2_RC ret = Esys_Certify(this->ctx->Get(),
-        primaryHandle,
+        keyHandle,
         signHandle.get(),
         ESYS_TR_PASSWORD,
         ESYS_TR_PASSWORD,
@@ -579,8 +625,6 @@ attest::EphemeralKey Tss2Wrapper::GetCertifiedKeyAndFlushHandle(const unique_c_p
         &signature
     );
     if (ret != TSS2_RC_SUCCESS) {
-        // Flush the key object from the tpm to make sure we are not consuming tpm memory.
-        Tss2Util::FlushObjectContext(*ctx, primaryHandle);
         throw Tss2Exception("Failed to certify ephemeral key", ret);
     }
 
@@ -588,9 +632,6 @@ attest::EphemeralKey Tss2Wrapper::GetCertifiedKeyAndFlushHandle(const unique_c_p
     unique_c_ptr<TPM2B_ATTEST> certifyInfoPtr(certifyInfo);
     unique_c_ptr<TPMT_SIGNATURE> certifyInfoSignaturePtr(signature);
 
-    // Flush the key object from the tpm to make sure we are not consuming tpm memory.
-    Tss2Util::FlushObjectContext(*ctx, primaryHandle);
-
     size_t offset = 0;
     std::vector<unsigned char> keyPub(sizeof(*outPubPtr), '\0');
     ret = Tss2_MU_TPM2B_PUBLIC_Marshal(outPubPtr.get(), keyPub.data(), keyPub.size(), &offset);
@@ -618,6 +659,9 @@ attest::EphemeralKey Tss2Wrapper::GetCertifiedKeyAndFlushHandle(const unique_c_p
 
 attest::EphemeralKey Tss2Wrapper::GetEphemeralKey(const attest::PcrSet& pcrSet) {
 
+    // Only one ephemeral key is kept loaded at a time.
+    FlushEphemeralKey();
+
     TPM2B_PUBLIC *outPublic = NULL;
 
     ESYS_TR primaryHandle = Tss2Util::CreateEphemeralKey(*ctx, pcrSet, &outPublic);
@@ -625,14 +669,32 @@ attest::EphemeralKey Tss2Wrapper::GetEphemeralKey(const attest::PcrSet& pcrSet)
     // Store the object in a unique_c_ptr<> to manage clean up after use.
     unique_c_ptr<TPM2B_PUBLIC> outPubPtr(outPublic);
 
-    return GetCertifiedKeyAndFlushHandle(outPubPtr, primaryHandle);
+    attest::EphemeralKey ephemeralKey;
+    try {
+        ephemeralKey = GetCertifiedKey(outPubPtr, primaryHandle);
+    }
+    catch (...) {
+        // Flush the key object from the tpm to make sure we are not consuming tpm memory.
+        Tss2Util::FlushObjectContext(*ctx, primaryHandle);
+        throw;
+    }
+
+    // Keep the key loaded for the decryption of the attestation response.
+    this->ephemeralKeyHandle = primaryHandle;
+    this->ephemeralKeyPcrSet = pcrSet;
+
+    return ephemeralKey;
 }
 
-attest::Buffer Tss2Wrapper::DecryptWithEphemeralKey(const attest::PcrSet& pcrSet,
-                                                    const attest::Buffer& encryptedBlob,
-                                                    const attest::RsaScheme rsaWrapAlgId,
-                                                    const attest::RsaHashAlg rsaHashAlgId) {
-    // Create an ephemeral key here and then use that key to decrypted the encrypted blob.
+ESYS_TR Tss2Wrapper::GetLoadedEphemeralKey(const attest::PcrSet& pcrSet) {
+
+    if (this->ephemeralKeyHandle != ESYS_TR_NONE &&
+        this->ephemeralKeyPcrSet == pcrSet) {
+        return this->ephemeralKeyHandle;
+    }
+
+    FlushEphemeralKey();
+
     TPM2B_PUBLIC *outPublic = NULL;
 
     ESYS_TR primaryHandle = Tss2Util::CreateEphemeralKey(*ctx, pcrSet, &outPublic);
@@ -640,6 +702,37 @@ attest::Buffer Tss2Wrapper::DecryptWithEphemeralKey(const attest::PcrSet& pcrSet
     // Store the object in a unique_c_ptr<> to manage clean up after use.
     unique_c_ptr<TPM2B_PUBLIC> outPubPtr(outPublic);
 
+    this->ephemeralKeyHandle = primaryHandle;
+    this->ephemeralKeyPcrSet = pcrSet;
+
+    return primaryHandle;
+}
+
+void Tss2Wrapper::FlushEphemeralKey() {
+
+    if (this->ephemeralKeyHandle == ESYS_TR_NONE) {
+        return;
+    }
+
+    ESYS_TR handle = this->ephemeralKeyHandle;
+    this->ephemeralKeyHandle = ESYS_TR_NONE;
+    this->ephemeralKeyPcrSet = attest::PcrSet();
+
+    Tss2Util::FlushObjectContext(*ctx, handle);
+}
+
+attest::Buffer Tss2Wrapper::DecryptWithEphemeralKey(const attest::PcrSet& pcrSet,
+                                                    const attest::Buffer& encryptedBlob,
+                                                    const attest::RsaScheme rsaWrapAlgId,
+                                                    const attest::RsaHashAlg rsaHashAlgId) {
+    if(encryptedBlob.size() > TPM2_MAX_RSA_KEY_BYTES) {
+        throw std::runtime_error("Encrypted data size larger than Max RSA key size");
+    }
+
+    // Use the ephemeral key created during evidence collection if it is still loaded,
+    // otherwise create it here, and then use that key to decrypted the encrypted blob.
+    ESYS_TR primaryHandle = GetLoadedEphemeralKey(pcrSet);
+
     Tss2Session session(this->ctx->Get());
     try {
         auto pcrDigest = Tss2Util::GeneratePcrDigest(pcrSet, pcrSet.hashAlg);
@@ -648,14 +741,10 @@ attest::Buffer Tss2Wrapper::DecryptWithEphemeralKey(const attest::PcrSet& pcrSet
         session.PolicyPcr(*pcrDigest, *pcrSelection);
     }
     catch(...) {
-        Tss2Util::FlushObjectContext(*ctx, primaryHandle);
+        FlushEphemeralKey();
         throw;
     }
 
-    if(encryptedBlob.size() > TPM2_MAX_RSA_KEY_BYTES) {
-        Tss2Util::FlushObjectContext(*ctx, primaryHandle);
-        throw std::runtime_error("Encrypted data size larger than Max RSA key size");
-    }
     TPM2B_PUBLIC_KEY_RSA cipher_msg;
     memcpy((void*)cipher_msg.buffer, (void*)encryptedBlob.data(), encryptedBlob.size());
     cipher_msg.size = static_cast<UINT16>(encryptedBlob.size());
@@ -670,14 +759,11 @@ attest::Buffer Tss2Wrapper::DecryptWithEphemeralKey(const attest::PcrSet& pcrSet
                          session.GetHandle(), ESYS_TR_NONE, ESYS_TR_NONE,
                          &cipher_msg, &scheme, nullptr, &decrypted);
     if (ret != TSS2_RC_SUCCESS) {
-        // Flush the key object from the tpm to make sure we are not consuming tpm memory.
-        Tss2Util::FlushObjectContext(*ctx, primaryHandle);
+        // Flush the key object from the tpm so that a failed key is never reused.
+        FlushEphemeralKey();
         throw Tss2Exception("Failed to decrypt message", ret);
     }
 
-    // Flush the key object from the tpm to make sure we are not consuming tpm memory.
-    Tss2Util::FlushObjectContext(*ctx, primaryHandle);
-
     attest::Buffer decryptedBlob(decrypted->buffer, decrypted->buffer + decrypted->size);
     free(decrypted);
 
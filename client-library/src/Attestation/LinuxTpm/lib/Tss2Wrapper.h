@@ -21,7 +21,7 @@ class Tss2Wrapper : public TssWrapper
 {
 public:
     Tss2Wrapper();
-    virtual ~Tss2Wrapper(){}
+    virtual ~Tss2Wrapper();
 
     /**
      * Retrieves the EK certificate
@@ -90,6 +90,22 @@ public:
     attest::PcrSet GetPCRValues(
         const attest::PcrList& pcrs, attest::HashAlg hashAlg) override;
 
+    /**
+     * Retrieves the quote over specified PCRs in bank together with their values.
+     *
+     * The quote carries no nonce, so it stays valid until a PCR is extended. The last
+     * snapshot is kept along with the TPM pcrUpdateCounter and returned as long as the
+     * counter has not changed, which saves the signing operation on repeat calls.
+     *
+     * param[in] pcrs: vector of PCR indices to get quote and values over
+     * param[in] hashAlg: hash algorithm for PCR bank to get quote and values from
+     *
+     * returns: PcrSnapshot structure containing the quote and the values of the PCRs
+     *      at the time of the quote
+     */
+    attest::PcrSnapshot GetPCRSnapshot(
+        const attest::PcrList& pcrs, attest::HashAlg hashAlg) override;
+
     /**
      * Retrieve the TCG log
      *
@@ -168,7 +184,9 @@ public:
 
     /**
      * Creates an ephemeral key along with a certifyInfo object for the key that
-     * is signed with the AIK.
+     * is signed with the AIK. The key is kept loaded in the TPM so that a
+     * following DecryptWithEphemeralKey call for the same pcrSet does not need
+     * to create it again.
      *
      * param[in] pcrSet PcrSet that will be used to create the Ephemeral key auth policy
      *
@@ -177,8 +195,9 @@ public:
     attest::EphemeralKey GetEphemeralKey(const attest::PcrSet& pcrSet) override;
 
     /**
-     * Decrypt the given encrypted blob with an ephemeral key that will be created using a
-     * ephemeral key template.
+     * Decrypt the given encrypted blob with the ephemeral key for pcrSet. The key loaded by
+     * the last GetEphemeralKey call is reused when it was created for the same PCR values,
+     * otherwise a new key is created from the ephemeral key template.
      *
      * param[in] pcrSet PcrSet that will be used to create the Ephemeral key auth policy
      * param[in] encryptedBlob: Encrypted data that needs to be decrypted.
@@ -234,6 +253,31 @@ private:
      */
     attest::EphemeralKey GetCertifiedKeyAndFlushHandle(const unique_c_ptr<TPM2B_PUBLIC>& outPubPtr, ESYS_TR primaryHandle);
 
+    /**
+     * Certifies the key with AK and generates the ephemeral buffer. The key handle is left loaded.
+     *
+     * param[in] outPubPtr: The Public key that should be outputted in the returned Ephemeral structure
+     * param[in] keyHandle: The ESYS handle of the outPublic key which needs to be certified
+     *
+     * returns: The ephemeral structure containing the public key and the certification info
+     */
+    attest::EphemeralKey GetCertifiedKey(const unique_c_ptr<TPM2B_PUBLIC>& outPubPtr, ESYS_TR keyHandle);
+
+    /**
+     * Returns the handle of the loaded ephemeral key for pcrSet, creating and loading a new
+     * key if the loaded one was created for different PCR values.
+     *
+     * param[in] pcrSet: PcrSet that the Ephemeral key auth policy is bound to
+     *
+     * returns: ESYS handle of the loaded ephemeral key
+     */
+    ESYS_TR GetLoadedEphemeralKey(const attest::PcrSet& pcrSet);
+
+    /**
+     * Flushes the loaded ephemeral key, if any, from the TPM.
+     */
+    void FlushEphemeralKey();
+
 
     /**
      * Unseal encryptedSeed using the TPM key
@@ -256,5 +300,27 @@ private:
         const attest::HashAlg hashAlg,
         bool usePcrAuth);
 
+    /**
+     * Reads the values of the specified PCRs in bank
+     *
+     * param[in] pcrs: vector of PCR indices to get values from
+     * param[in] hashAlg: hash algorithm for PCR bank to get values from
+     * param[out] pcrUpdateCounter: TPM pcrUpdateCounter at the time of the read
+     *
+     * returns: PcrSet structure containing a vector of PCR indices and their values
+     */
+    attest::PcrSet ReadPCRValues(
+        const attest::PcrList& pcrs, attest::HashAlg hashAlg, uint32_t& pcrUpdateCounter);
+
     std::unique_ptr<Tss2Ctx> ctx;
+
+    // Ephemeral key kept loaded between GetEphemeralKey and DecryptWithEphemeralKey
+    // along with the PCR values its auth policy was created for.
+    ESYS_TR ephemeralKeyHandle = ESYS_TR_NONE;
+    attest::PcrSet ephemeralKeyPcrSet;
+
+    // Last PCR quote and values along with the pcrUpdateCounter they were read at.
+    bool hasPcrSnapshot = false;
+    uint32_t pcrSnapshotUpdateCounter = 0;
+    attest::PcrSnapshot pcrSnapshot;
 };
@@ -9,8 +9,12 @@
 #include <cstring>
 #include <iostream>
 #include <numeric>
+#include <atomic>
+#include <thread>
 
 #include "Exceptions.h"
+#include "EphemeralKeyPool.h"
+#include "Tss2PolicyDigest.h"
 #include "Tss2Util.h"
 #include "TpmMocks.h"
 #include "TpmMockData.h"
@@ -19,6 +23,7 @@
 
 using ::testing::_;
 using ::testing::DoAll;
+using ::testing::Invoke;
 using ::testing::Mock;
 using ::testing::Return;
 using ::testing::SetArgPointee;
@@ -532,13 +537,13 @@ TEST_F(TpmTest, GetPCRQuote_positive)
         .Times(1)
         .WillOnce(DoAll(SetArgPointee<5>(MOCK_HANDLE), Return(0)));
 
-    // TssPcrSelection calls GetCapability to get number of PCRs implemented
+    // TssPcrSelection reads the number of PCRs implemented from the capability sweep
     auto caps = (TPMS_CAPABILITY_DATA*)calloc(1, sizeof(TPMS_CAPABILITY_DATA));
     caps->data.tpmProperties.count = 1;
     caps->data.tpmProperties.tpmProperty[0].property = TPM2_PT_PCR_COUNT;
     caps->data.tpmProperties.tpmProperty[0].value = MOCK_MAX_PCR_COUNT;
 
-    EXPECT_CALL(*tpmLibMockObj, Esys_GetCapability(_,ESYS_TR_NONE,ESYS_TR_NONE,ESYS_TR_NONE,TPM2_CAP_TPM_PROPERTIES,TPM2_PT_PCR_COUNT,1,_,_))
+    EXPECT_CALL(*tpmLibMockObj, Esys_GetCapability(_,ESYS_TR_NONE,ESYS_TR_NONE,ESYS_TR_NONE,TPM2_CAP_TPM_PROPERTIES,TPM2_PT_FIXED,TPM2_MAX_TPM_PROPERTIES,_,_))
         .Times(1)
         .WillOnce(DoAll(SetArgPointee<8>(caps), Return(0)));
 
@@ -589,13 +594,13 @@ TEST_F(TpmTest, GetPCRQuote_invalidpcr)
         .Times(1)
         .WillOnce(DoAll(SetArgPointee<5>(MOCK_HANDLE), Return(0)));
 
-    // TssPcrSelection calls GetCapability to get number of PCRs implemented
+    // TssPcrSelection reads the number of PCRs implemented from the capability sweep
     auto caps = (TPMS_CAPABILITY_DATA*)calloc(1, sizeof(TPMS_CAPABILITY_DATA));
     caps->data.tpmProperties.count = 1;
     caps->data.tpmProperties.tpmProperty[0].property = TPM2_PT_PCR_COUNT;
     caps->data.tpmProperties.tpmProperty[0].value = MOCK_MAX_PCR_COUNT;
 
-    EXPECT_CALL(*tpmLibMockObj, Esys_GetCapability(_,ESYS_TR_NONE,ESYS_TR_NONE,ESYS_TR_NONE,TPM2_CAP_TPM_PROPERTIES,TPM2_PT_PCR_COUNT,1,_,_))
+    EXPECT_CALL(*tpmLibMockObj, Esys_GetCapability(_,ESYS_TR_NONE,ESYS_TR_NONE,ESYS_TR_NONE,TPM2_CAP_TPM_PROPERTIES,TPM2_PT_FIXED,TPM2_MAX_TPM_PROPERTIES,_,_))
         .Times(1)
         .WillOnce(DoAll(SetArgPointee<8>(caps), Return(0)));
 
@@ -616,13 +621,13 @@ TEST_F(TpmTest, GetPCRQuote_invalidpcr)
  */
 TEST_F(TpmTest, GetPCRValues_positive)
 {
-    // TssPcrSelection calls GetCapability to get number of PCRs implemented
+    // TssPcrSelection reads the number of PCRs implemented from the capability sweep
     auto caps = (TPMS_CAPABILITY_DATA*)calloc(1, sizeof(TPMS_CAPABILITY_DATA));
     caps->data.tpmProperties.count = 1;
     caps->data.tpmProperties.tpmProperty[0].property = TPM2_PT_PCR_COUNT;
     caps->data.tpmProperties.tpmProperty[0].value = MOCK_MAX_PCR_COUNT;
 
-    EXPECT_CALL(*tpmLibMockObj, Esys_GetCapability(_,ESYS_TR_NONE,ESYS_TR_NONE,ESYS_TR_NONE,TPM2_CAP_TPM_PROPERTIES,TPM2_PT_PCR_COUNT,1,_,_))
+    EXPECT_CALL(*tpmLibMockObj, Esys_GetCapability(_,ESYS_TR_NONE,ESYS_TR_NONE,ESYS_TR_NONE,TPM2_CAP_TPM_PROPERTIES,TPM2_PT_FIXED,TPM2_MAX_TPM_PROPERTIES,_,_))
         .Times(1)
         .WillOnce(DoAll(SetArgPointee<8>(caps), Return(0)));
 
@@ -672,13 +677,13 @@ TEST_F(TpmTest, GetPCRValues_positive)
 
 TEST_F(TpmTest, GetPCRValues_negative)
 {
-    // TssPcrSelection calls GetCapability to get number of PCRs implemented
+    // TssPcrSelection reads the number of PCRs implemented from the capability sweep
     auto caps = (TPMS_CAPABILITY_DATA*)calloc(1, sizeof(TPMS_CAPABILITY_DATA));
     caps->data.tpmProperties.count = 1;
     caps->data.tpmProperties.tpmProperty[0].property = TPM2_PT_PCR_COUNT;
     caps->data.tpmProperties.tpmProperty[0].value = MOCK_MAX_PCR_COUNT;
 
-    EXPECT_CALL(*tpmLibMockObj, Esys_GetCapability(_,ESYS_TR_NONE,ESYS_TR_NONE,ESYS_TR_NONE,TPM2_CAP_TPM_PROPERTIES,TPM2_PT_PCR_COUNT,1,_,_))
+    EXPECT_CALL(*tpmLibMockObj, Esys_GetCapability(_,ESYS_TR_NONE,ESYS_TR_NONE,ESYS_TR_NONE,TPM2_CAP_TPM_PROPERTIES,TPM2_PT_FIXED,TPM2_MAX_TPM_PROPERTIES,_,_))
         .Times(1)
         .WillOnce(DoAll(SetArgPointee<8>(caps), Return(0)));
 
@@ -694,6 +699,77 @@ TEST_F(TpmTest, GetPCRValues_negative)
     EXPECT_FALSE(success);
 }
 
+/**
+ * Test that the PCR snapshot is reused while the pcrUpdateCounter is unchanged and
+ * retaken once a PCR is extended
+ */
+TEST_F(TpmTest, GetPCRSnapshot_cached)
+{
+    auto caps = (TPMS_CAPABILITY_DATA*)calloc(1, sizeof(TPMS_CAPABILITY_DATA));
+    caps->data.tpmProperties.count = 1;
+    caps->data.tpmProperties.tpmProperty[0].property = TPM2_PT_PCR_COUNT;
+    caps->data.tpmProperties.tpmProperty[0].value = MOCK_MAX_PCR_COUNT;
+
+    EXPECT_CALL(*tpmLibMockObj, Esys_GetCapability(_,ESYS_TR_NONE,ESYS_TR_NONE,ESYS_TR_NONE,TPM2_CAP_TPM_PROPERTIES,TPM2_PT_FIXED,TPM2_MAX_TPM_PROPERTIES,_,_))
+        .Times(1)
+        .WillOnce(DoAll(SetArgPointee<8>(caps), Return(0)));
+
+    // Counter seen by each PCR read: quote, re-read, cache hit, quote after extend, re-read
+    std::vector<uint32_t> counters = {5, 5, 5, 6, 6};
+    size_t pcrReads = 0;
+    EXPECT_CALL(*tpmLibMockObj, Esys_PCR_Read(_,ESYS_TR_NONE,ESYS_TR_NONE,ESYS_TR_NONE,_,_,_,_))
+        .Times(counters.size())
+        .WillRepeatedly(Invoke([&](ESYS_CONTEXT*, ESYS_TR, ESYS_TR, ESYS_TR,
+                                   const TPML_PCR_SELECTION* selectionIn,
+                                   UINT32* pcrUpdateCounter,
+                                   TPML_PCR_SELECTION** selectionOut,
+                                   TPML_DIGEST** values) -> TSS2_RC {
+            auto selection = (TPML_PCR_SELECTION*)calloc(1, sizeof(TPML_PCR_SELECTION));
+            *selection = *selectionIn;
+            auto digests = (TPML_DIGEST*)calloc(1, sizeof(TPML_DIGEST));
+            digests->count = MOCK_PCRS_READ_COUNT;
+            for (uint32_t i = 0; i < digests->count; i++) {
+                digests->digests[i].size = TPM2_SHA256_DIGEST_SIZE;
+                digests->digests[i].buffer[0] = static_cast<BYTE>(counters[pcrReads]);
+            }
+            *pcrUpdateCounter = counters[pcrReads++];
+            *selectionOut = selection;
+            *values = digests;
+            return 0;
+        }));
+
+    EXPECT_CALL(*tpmLibMockObj, Esys_TR_FromTPMPublic(_,AIK_PUB_INDEX,ESYS_TR_NONE,ESYS_TR_NONE,ESYS_TR_NONE,_))
+        .Times(2)
+        .WillRepeatedly(DoAll(SetArgPointee<5>(MOCK_HANDLE), Return(0)));
+
+    EXPECT_CALL(*tpmLibMockObj, Esys_Quote(_,MOCK_HANDLE,ESYS_TR_PASSWORD,ESYS_TR_NONE,ESYS_TR_NONE,_,_,_,_,_))
+        .Times(2)
+        .WillRepeatedly(Invoke([](ESYS_CONTEXT*, ESYS_TR, ESYS_TR, ESYS_TR, ESYS_TR,
+                                  const TPM2B_DATA*, const TPMT_SIG_SCHEME*, const TPML_PCR_SELECTION*,
+                                  TPM2B_ATTEST** quoted, TPMT_SIGNATURE** signature) -> TSS2_RC {
+            *quoted = (TPM2B_ATTEST*)calloc(1, sizeof(TPM2B_ATTEST));
+            (*quoted)->size = MOCK_TPM_PUBLIC_SIZE;
+            *signature = (TPMT_SIGNATURE*)calloc(1, sizeof(TPMT_SIGNATURE));
+            (*signature)->sigAlg = TPM2_ALG_RSASSA;
+            return 0;
+        }));
+
+    attest::PcrList pcrs(MOCK_PCRS_READ_COUNT);
+    std::iota(pcrs.begin(), pcrs.end(), 0);
+    attest::HashAlg hashAlg = attest::HashAlg::Sha256;
+
+    auto first = tpm->GetPCRSnapshot(pcrs, hashAlg);
+    ASSERT_EQ(first.pcrSet.pcrs.size(), pcrs.size());
+    EXPECT_EQ(first.pcrSet.pcrs[0].digest[0], 5);
+
+    auto cached = tpm->GetPCRSnapshot(pcrs, hashAlg);
+    EXPECT_EQ(cached.quote.quote, first.quote.quote);
+    EXPECT_TRUE(cached.pcrSet == first.pcrSet);
+
+    auto retaken = tpm->GetPCRSnapshot(pcrs, hashAlg);
+    EXPECT_EQ(retaken.pcrSet.pcrs[0].digest[0], 6);
+}
+
 /**
  * Test that GetTcgLog will throw an exception if no log is available.
  *
@@ -715,33 +791,82 @@ TEST_F(TpmTest, GetTcgLog_negative) {
 }
 
 /**
- * Tests retrieving TPM version
+ * Tests retrieving TPM version. The family indicator is read once by the capability
+ * sweep and served from the cache afterwards.
  */
 TEST_F(TpmTest, GetVersion_positive) {
     // GetCapability output
-    auto cap_tpm1 = (TPMS_CAPABILITY_DATA*)calloc(1,sizeof(TPMS_CAPABILITY_DATA));
-    cap_tpm1->data.tpmProperties.count = 1;
-    cap_tpm1->data.tpmProperties.tpmProperty[0].property = TPM2_PT_FAMILY_INDICATOR;
-    cap_tpm1->data.tpmProperties.tpmProperty[0].value = 0x312e3200;
-
-    auto cap_tpm2 = (TPMS_CAPABILITY_DATA*)malloc(sizeof(TPMS_CAPABILITY_DATA));
+    auto cap_tpm2 = (TPMS_CAPABILITY_DATA*)calloc(1,sizeof(TPMS_CAPABILITY_DATA));
     cap_tpm2->data.tpmProperties.count = 1;
     cap_tpm2->data.tpmProperties.tpmProperty[0].property = TPM2_PT_FAMILY_INDICATOR;
     cap_tpm2->data.tpmProperties.tpmProperty[0].value = 0x322e3000;
 
     EXPECT_CALL(*tpmLibMockObj, Esys_GetCapability(_,ESYS_TR_NONE,ESYS_TR_NONE,ESYS_TR_NONE,
-                                                   TPM2_CAP_TPM_PROPERTIES,TPM2_PT_FAMILY_INDICATOR,1,_,_))
-            .Times(2)
-            .WillOnce(DoAll(SetArgPointee<7>(TPM2_NO), SetArgPointee<8>(cap_tpm1), Return(0)))
+                                                   TPM2_CAP_TPM_PROPERTIES,TPM2_PT_FIXED,TPM2_MAX_TPM_PROPERTIES,_,_))
+            .Times(1)
             .WillOnce(DoAll(SetArgPointee<7>(TPM2_NO), SetArgPointee<8>(cap_tpm2), Return(0)));
 
     auto version = tpm->GetVersion();
-    EXPECT_EQ(version, attest::TpmVersion::V1_2);
+    EXPECT_EQ(version, attest::TpmVersion::V2_0);
 
     version = tpm->GetVersion();
     EXPECT_EQ(version, attest::TpmVersion::V2_0);
 }
 
+/**
+ * Tests retrieving TPM 1.2 version
+ */
+TEST_F(TpmTest, GetVersion_tpm12) {
+    auto cap_tpm1 = (TPMS_CAPABILITY_DATA*)calloc(1,sizeof(TPMS_CAPABILITY_DATA));
+    cap_tpm1->data.tpmProperties.count = 1;
+    cap_tpm1->data.tpmProperties.tpmProperty[0].property = TPM2_PT_FAMILY_INDICATOR;
+    cap_tpm1->data.tpmProperties.tpmProperty[0].value = 0x312e3200;
+
+    EXPECT_CALL(*tpmLibMockObj, Esys_GetCapability(_,ESYS_TR_NONE,ESYS_TR_NONE,ESYS_TR_NONE,
+                                                   TPM2_CAP_TPM_PROPERTIES,TPM2_PT_FIXED,TPM2_MAX_TPM_PROPERTIES,_,_))
+            .Times(1)
+            .WillOnce(DoAll(SetArgPointee<7>(TPM2_NO), SetArgPointee<8>(cap_tpm1), Return(0)));
+
+    auto version = tpm->GetVersion();
+    EXPECT_EQ(version, attest::TpmVersion::V1_2);
+}
+
+/**
+ * Tests that the capability sweep follows moreData and that all fixed properties are
+ * served from a single sweep
+ */
+TEST_F(TpmTest, GetCapabilities_sweep) {
+    auto caps_1 = (TPMS_CAPABILITY_DATA*)calloc(1,sizeof(TPMS_CAPABILITY_DATA));
+    caps_1->data.tpmProperties.count = 1;
+    caps_1->data.tpmProperties.tpmProperty[0].property = TPM2_PT_FAMILY_INDICATOR;
+    caps_1->data.tpmProperties.tpmProperty[0].value = 0x322e3000;
+
+    auto caps_2 = (TPMS_CAPABILITY_DATA*)calloc(1,sizeof(TPMS_CAPABILITY_DATA));
+    caps_2->data.tpmProperties.count = 2;
+    caps_2->data.tpmProperties.tpmProperty[0].property = TPM2_PT_PCR_COUNT;
+    caps_2->data.tpmProperties.tpmProperty[0].value = MOCK_MAX_PCR_COUNT;
+    caps_2->data.tpmProperties.tpmProperty[1].property = TPM2_PT_NV_BUFFER_MAX;
+    caps_2->data.tpmProperties.tpmProperty[1].value = 1024;
+
+    EXPECT_CALL(*tpmLibMockObj, Esys_GetCapability(_,ESYS_TR_NONE,ESYS_TR_NONE,ESYS_TR_NONE,
+                                                   TPM2_CAP_TPM_PROPERTIES,TPM2_PT_FIXED,TPM2_MAX_TPM_PROPERTIES,_,_))
+            .Times(1)
+            .WillOnce(DoAll(SetArgPointee<7>(TPM2_YES), SetArgPointee<8>(caps_1), Return(0)));
+    EXPECT_CALL(*tpmLibMockObj, Esys_GetCapability(_,ESYS_TR_NONE,ESYS_TR_NONE,ESYS_TR_NONE,
+                                                   TPM2_CAP_TPM_PROPERTIES,TPM2_PT_FAMILY_INDICATOR + 1,TPM2_MAX_TPM_PROPERTIES,_,_))
+            .Times(1)
+            .WillOnce(DoAll(SetArgPointee<7>(TPM2_NO), SetArgPointee<8>(caps_2), Return(0)));
+
+    Tss2Ctx ctx;
+    const auto& capabilities = ctx.GetCapabilities();
+    EXPECT_EQ(capabilities.familyIndicator, 0x322e3000u);
+    EXPECT_EQ(capabilities.pcrCount, static_cast<uint32_t>(MOCK_MAX_PCR_COUNT));
+    EXPECT_EQ(capabilities.nvBufferMax, 1024u);
+
+    // Served from the cache
+    EXPECT_EQ(Tss2Util::GetPcrCount(ctx), MOCK_MAX_PCR_COUNT);
+}
+
 /**
  * Tests TPM version not being known
  */
@@ -752,7 +877,7 @@ TEST_F(TpmTest, GetVersion_unknownversion) {
     cap->data.tpmProperties.tpmProperty[0].value = 0x0;
 
     EXPECT_CALL(*tpmLibMockObj, Esys_GetCapability(_,ESYS_TR_NONE,ESYS_TR_NONE,ESYS_TR_NONE,
-                                                   TPM2_CAP_TPM_PROPERTIES,TPM2_PT_FAMILY_INDICATOR,1,_,_))
+                                                   TPM2_CAP_TPM_PROPERTIES,TPM2_PT_FIXED,TPM2_MAX_TPM_PROPERTIES,_,_))
             .Times(1)
             .WillOnce(DoAll(SetArgPointee<7>(TPM2_NO), SetArgPointee<8>(cap), Return(0)));
 
@@ -771,7 +896,7 @@ TEST_F(TpmTest, GetVersion_unknownversion) {
  */
 TEST_F(TpmTest, GetVersion_getcapfail) {
     EXPECT_CALL(*tpmLibMockObj, Esys_GetCapability(_,ESYS_TR_NONE,ESYS_TR_NONE,ESYS_TR_NONE,
-                                                   TPM2_CAP_TPM_PROPERTIES,TPM2_PT_FAMILY_INDICATOR,1,_,_))
+                                                   TPM2_CAP_TPM_PROPERTIES,TPM2_PT_FIXED,TPM2_MAX_TPM_PROPERTIES,_,_))
             .Times(1)
             .WillOnce(Return(1));
 
@@ -813,13 +938,13 @@ TEST_F(TpmTest, Unseal_positive) {
         .Times(1)
         .WillOnce(DoAll(SetArgPointee<7>(loadedDataHandle), Return(0)));
 
-    // TssPcrSelection calls GetCapability to get number of PCRs implemented
+    // TssPcrSelection reads the number of PCRs implemented from the capability sweep
     auto caps = (TPMS_CAPABILITY_DATA*)calloc(1, sizeof(TPMS_CAPABILITY_DATA));
     caps->data.tpmProperties.count = 1;
     caps->data.tpmProperties.tpmProperty[0].property = TPM2_PT_PCR_COUNT;
     caps->data.tpmProperties.tpmProperty[0].value = MOCK_MAX_PCR_COUNT;
 
-    EXPECT_CALL(*tpmLibMockObj, Esys_GetCapability(_,ESYS_TR_NONE,ESYS_TR_NONE,ESYS_TR_NONE,TPM2_CAP_TPM_PROPERTIES,TPM2_PT_PCR_COUNT,1,_,_))
+    EXPECT_CALL(*tpmLibMockObj, Esys_GetCapability(_,ESYS_TR_NONE,ESYS_TR_NONE,ESYS_TR_NONE,TPM2_CAP_TPM_PROPERTIES,TPM2_PT_FIXED,TPM2_MAX_TPM_PROPERTIES,_,_))
         .Times(1)
         .WillOnce(DoAll(SetArgPointee<8>(caps), Return(0)));
 
@@ -886,13 +1011,13 @@ TEST_F(TpmTest, Unseal_withEkFromSpecPositive)
         .Times(1)
         .WillOnce(DoAll(SetArgPointee<7>(loadedDataHandle), Return(0)));
 
-    // TssPcrSelection calls GetCapability to get number of PCRs implemented
+    // TssPcrSelection reads the number of PCRs implemented from the capability sweep
     auto caps = (TPMS_CAPABILITY_DATA*)calloc(1, sizeof(TPMS_CAPABILITY_DATA));
     caps->data.tpmProperties.count = 1;
     caps->data.tpmProperties.tpmProperty[0].property = TPM2_PT_PCR_COUNT;
     caps->data.tpmProperties.tpmProperty[0].value = MOCK_MAX_PCR_COUNT;
 
-    EXPECT_CALL(*tpmLibMockObj, Esys_GetCapability(_, ESYS_TR_NONE, ESYS_TR_NONE, ESYS_TR_NONE, TPM2_CAP_TPM_PROPERTIES, TPM2_PT_PCR_COUNT, 1, _, _))
+    EXPECT_CALL(*tpmLibMockObj, Esys_GetCapability(_, ESYS_TR_NONE, ESYS_TR_NONE, ESYS_TR_NONE, TPM2_CAP_TPM_PROPERTIES, TPM2_PT_FIXED, TPM2_MAX_TPM_PROPERTIES, _, _))
         .Times(1)
         .WillOnce(DoAll(SetArgPointee<8>(caps), Return(0)));
 
@@ -1011,13 +1136,13 @@ TEST_F(TpmTest, Unseal_unsealfail) {
         .Times(1)
         .WillOnce(DoAll(SetArgPointee<7>(loadedDataHandle), Return(0)));
 
-    // TssPcrSelection calls GetCapability to get number of PCRs implemented
+    // TssPcrSelection reads the number of PCRs implemented from the capability sweep
     auto caps = (TPMS_CAPABILITY_DATA*)calloc(1, sizeof(TPMS_CAPABILITY_DATA));
     caps->data.tpmProperties.count = 1;
     caps->data.tpmProperties.tpmProperty[0].property = TPM2_PT_PCR_COUNT;
     caps->data.tpmProperties.tpmProperty[0].value = MOCK_MAX_PCR_COUNT;
 
-    EXPECT_CALL(*tpmLibMockObj, Esys_GetCapability(_,ESYS_TR_NONE,ESYS_TR_NONE,ESYS_TR_NONE,TPM2_CAP_TPM_PROPERTIES,TPM2_PT_PCR_COUNT,1,_,_))
+    EXPECT_CALL(*tpmLibMockObj, Esys_GetCapability(_,ESYS_TR_NONE,ESYS_TR_NONE,ESYS_TR_NONE,TPM2_CAP_TPM_PROPERTIES,TPM2_PT_FIXED,TPM2_MAX_TPM_PROPERTIES,_,_))
         .Times(1)
         .WillOnce(DoAll(SetArgPointee<8>(caps), Return(0)));
 
@@ -1213,6 +1338,169 @@ TEST_F(TpmTest, GetHCLReport_negative)
     EXPECT_FALSE(success);
 }
 
+/**
+ * Waits up to a second for condition to become true
+ */
+template <typename Condition>
+static bool WaitFor(Condition condition)
+{
+    for (int i = 0; i < 100; i++) {
+        if (condition()) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return condition();
+}
+
+/**
+ * Test that the ephemeral key pool pre-generates a key and regenerates it when the PCRs change
+ */
+TEST_F(TpmTest, EphemeralKeyPool_positive)
+{
+    attest::PcrSet pcrSet;
+    pcrSet.hashAlg = attest::HashAlg::Sha256;
+    pcrSet.pcrs.push_back({ 0, attest::Buffer(32, 0x1) });
+
+    std::mutex pcrMutex;
+    attest::PcrSet currentPcrs = pcrSet;
+    std::atomic<int> keysCreated(0);
+
+    EphemeralKeyPool pool(
+        [&]() {
+            std::lock_guard<std::mutex> lock(pcrMutex);
+            return currentPcrs;
+        },
+        [&](const attest::PcrSet& pcrs) {
+            attest::EphemeralKey key;
+            key.encryptionKey = pcrs.pcrs[0].digest;
+            keysCreated++;
+            return key;
+        },
+        std::chrono::milliseconds(10));
+
+    attest::EphemeralKey key;
+    EXPECT_TRUE(WaitFor([&]() { return pool.TryGet(pcrSet, key); }));
+    EXPECT_EQ(key.encryptionKey, pcrSet.pcrs[0].digest);
+
+    // The key is not regenerated while the PCRs are unchanged
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(keysCreated.load(), 1);
+
+    attest::PcrSet extendedPcrSet = pcrSet;
+    extendedPcrSet.pcrs[0].digest = attest::Buffer(32, 0x2);
+    {
+        std::lock_guard<std::mutex> lock(pcrMutex);
+        currentPcrs = extendedPcrSet;
+    }
+
+    EXPECT_TRUE(WaitFor([&]() { return pool.TryGet(extendedPcrSet, key); }));
+    EXPECT_EQ(key.encryptionKey, extendedPcrSet.pcrs[0].digest);
+    EXPECT_FALSE(pool.TryGet(pcrSet, key));
+}
+
+/**
+ * Test that the ephemeral key pool serves nothing when key creation fails
+ */
+TEST_F(TpmTest, EphemeralKeyPool_negative)
+{
+    attest::PcrSet pcrSet;
+    pcrSet.hashAlg = attest::HashAlg::Sha256;
+    pcrSet.pcrs.push_back({ 0, attest::Buffer(32, 0x1) });
+
+    std::atomic<int> attempts(0);
+
+    EphemeralKeyPool pool(
+        [&]() { return pcrSet; },
+        [&](const attest::PcrSet&) -> attest::EphemeralKey {
+            attempts++;
+            throw Tss2Exception("Failed to create ephemeral key", TPM2_RC_FAILURE);
+        },
+        std::chrono::milliseconds(10));
+
+    EXPECT_TRUE(WaitFor([&]() { return attempts.load() > 1; }));
+
+    attest::EphemeralKey key;
+    EXPECT_FALSE(pool.TryGet(pcrSet, key));
+}
+
+/**
+ * Tests that the host-side PolicySecret digest matches the EK auth policy from the
+ * TCG EK Credential Profile, which is the digest of a trial session running
+ * PolicySecret(TPM_RH_ENDORSEMENT)
+ */
+TEST_F(TpmTest, PolicyDigest_policySecret)
+{
+    const unsigned char expected[] = {
+        0x83, 0x71, 0x97, 0x67, 0x44, 0x84, 0xb3, 0xf8,
+        0x1a, 0x90, 0xcc, 0x8d, 0x46, 0xa5, 0xd7, 0x24,
+        0xfd, 0x52, 0xd7, 0x6e, 0x06, 0x52, 0x0b, 0x64,
+        0xf2, 0xa1, 0xda, 0x1b, 0x33, 0x14, 0x69, 0xaa,
+    };
+
+    Tss2PolicyDigest policy(TPM2_ALG_SHA256);
+    policy.PolicySecret(TPM2_RH_ENDORSEMENT);
+
+    auto digest = policy.GetDigest();
+    ASSERT_EQ(digest->size, sizeof(expected));
+    EXPECT_EQ(std::memcmp(digest->buffer, expected, sizeof(expected)), 0);
+}
+
+/**
+ * Tests the host-side PolicyPCR and PolicyCommandCode digests against the digests of a
+ * trial session over PCR0 of the SHA256 bank with all zero PCR values
+ */
+TEST_F(TpmTest, PolicyDigest_policyPcr)
+{
+    const unsigned char expectedPcr[] = {
+        0x09, 0x3c, 0xeb, 0x41, 0x18, 0x1d, 0x47, 0x80,
+        0x88, 0x62, 0xd7, 0x94, 0x62, 0x68, 0xee, 0x6a,
+        0x17, 0xa1, 0x0e, 0x3d, 0x1b, 0x79, 0xb3, 0x23,
+        0x51, 0xbc, 0x56, 0xe4, 0xbe, 0xac, 0xef, 0xf0,
+    };
+    const unsigned char expectedCommandCode[] = {
+        0x5a, 0x6c, 0x5b, 0x93, 0x01, 0x91, 0xd7, 0xad,
+        0x33, 0x6d, 0xef, 0x3b, 0xc3, 0xbd, 0x97, 0xc1,
+        0x4a, 0x7a, 0xa7, 0x31, 0x04, 0x8b, 0x06, 0xa1,
+        0x1b, 0xa3, 0xca, 0x7f, 0xc4, 0xfd, 0xf5, 0xb9,
+    };
+
+    attest::PcrSet pcrSet;
+    pcrSet.hashAlg = attest::HashAlg::Sha256;
+    pcrSet.pcrs.push_back(attest::PcrValue());
+    pcrSet.pcrs[0].index = 0;
+    pcrSet.pcrs[0].digest.assign(TPM2_SHA256_DIGEST_SIZE, 0);
+    auto pcrDigest = Tss2Util::GeneratePcrDigest(pcrSet, pcrSet.hashAlg);
+
+    TPML_PCR_SELECTION pcrSelection = {0};
+    pcrSelection.count = 1;
+    pcrSelection.pcrSelections[0].hash = TPM2_ALG_SHA256;
+    pcrSelection.pcrSelections[0].sizeofSelect = 3;
+    pcrSelection.pcrSelections[0].pcrSelect[0] = 0x01;
+
+    Tss2PolicyDigest policy(TPM2_ALG_SHA256);
+    policy.PolicyPcr(*pcrDigest, pcrSelection);
+
+    auto digest = policy.GetDigest();
+    ASSERT_EQ(digest->size, sizeof(expectedPcr));
+    EXPECT_EQ(std::memcmp(digest->buffer, expectedPcr, sizeof(expectedPcr)), 0);
+
+    policy.PolicyCommandCode(TPM2_CC_RSA_Decrypt);
+
+    digest = policy.GetDigest();
+    ASSERT_EQ(digest->size, sizeof(expectedCommandCode));
+    EXPECT_EQ(std::memcmp(digest->buffer, expectedCommandCode, sizeof(expectedCommandCode)), 0);
+}
+
+/**
+ * Tests that PolicySecret rejects handles whose name is not the handle itself
+ */
+TEST_F(TpmTest, PolicyDigest_policySecretNonPermanent)
+{
+    Tss2PolicyDigest policy(TPM2_ALG_SHA256);
+    EXPECT_THROW(policy.PolicySecret(AIK_PUB_INDEX), std::invalid_argument);
+}
+
 /**
  * Run tests
  */
@@ -2,7 +2,6 @@
 #include <stdarg.h>
 #include <vector>
 #include <AttestationClient.h>
-#include <nlohmann/json.hpp>
 #include <iostream>
 #include <string>
 #include <algorithm>
@@ -10,7 +9,6 @@
 #include <boost/algorithm/string.hpp>
 #include "Utils.h"
 #include "Logger.h"
-using json = nlohmann::json;
 
 #define OUTPUT_TYPE_JWT "TOKEN"
 #define OUTPUT_TYPE_BOOL "BOOL"
@@ -119,41 +117,35 @@ int main(int argc, char* argv[]) {
         std::string client_payload_str = "{\"nonce\":\"" + nonce + "\"}"; // nonce is optional
         params.client_payload = (unsigned char*) client_payload_str.c_str();
         params.version = CLIENT_PARAMS_VERSION;
-        unsigned char* jwt = nullptr;
+        std::shared_ptr<const attest::AttestationToken> token;
         attest::AttestationResult result;
         
         bool is_cvm = false;
         bool attestation_success = true;
         std::string jwt_str;
         // call attest
-        if ((result = attestation_client->Attest(params, &jwt)).code_ 
+        if ((result = attestation_client->Attest(params, token)).code_ 
                 != attest::AttestationResult::ErrorCode::SUCCESS) {
             attestation_success = false;
         }
 
         if (attestation_success) {
-            jwt_str = reinterpret_cast<char*>(jwt);
-            attestation_client->Free(jwt);
-            // Prase attestation token to extract isolation tee details
-            std::vector<std::string> tokens;
-            boost::split(tokens, jwt_str, [](char c) {return c == '.'; });
-            if (tokens.size() < 3) {
+            jwt_str = token->Jwt();
+            // The claims of the token are decoded by the library on first access
+            if (!token->IsValid()) {
                 printf("Invalid JWT token");
                 exit(1);
             }
 
-            json attestation_claims = json::parse(base64_decode(tokens[1]));
-            try {
-                std::string attestation_type 
-                    = attestation_claims["x-ms-isolation-tee"]["x-ms-attestation-type"].get<std::string>();
-                std::string compliance_status 
-                    = attestation_claims["x-ms-isolation-tee"]["x-ms-compliance-status"].get<std::string>();
-                if (boost::iequals(attestation_type, "sevsnpvm") &&
-                    boost::iequals(compliance_status, "azure-compliant-cvm")){
-                    is_cvm = true;
-                }
+            std::string attestation_type;
+            std::string compliance_status;
+            // sevsnp claim does not exist in the token of other isolation types
+            if (token->GetIsolationType(attestation_type) &&
+                token->GetComplianceStatus(compliance_status) &&
+                boost::iequals(attestation_type, "sevsnpvm") &&
+                boost::iequals(compliance_status, "azure-compliant-cvm")) {
+                is_cvm = true;
             }
-            catch (...) { } // sevsnp claim does not exist in the token
         }
 
         if (boost::iequals(output_type, OUTPUT_TYPE_JWT)) {
@@ -36,12 +36,3 @@ std::string binary_to_base64url(const std::vector<unsigned char>& binary_data);
  * returns: vector of unsigned char (byte)
  */
 std::vector<unsigned char> base64url_to_binary(const std::string& base64url_data);
-
-/**
- * Given a string, convert it to base64 encoded string
- *
- * param[in] data : string data
- *
- * returns: base64 encoded string
- */
-std::string base64_decode(const std::string& data);
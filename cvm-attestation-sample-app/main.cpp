@@ -7,10 +7,8 @@
 #include <algorithm>
 #include <thread>
 #include <boost/algorithm/string.hpp>
-#include <nlohmann/json.hpp>
 #include "Utils.h"
 #include "Logger.h"
-using json = nlohmann::json;
 
 
 #define OUTPUT_TYPE_JWT "token"
@@ -58,16 +56,18 @@ static int getopt(int argc, char* const argv[], const char* optstring)
 #endif //!PLATFORM_UNIX
 
 void usage(char* programName) {
-    printf("Usage: %s -a <attestation-endpoint> -n <nonce> -o <%s|%s>\n", programName, OUTPUT_TYPE_BOOL, OUTPUT_TYPE_JWT);
+    printf("Usage: %s -a <attestation-endpoint> -n <nonce> -o <%s|%s> [-c]\n", programName, OUTPUT_TYPE_BOOL, OUTPUT_TYPE_JWT);
+    printf("  -c  share the attestation token with other processes on this machine that also use -c\n");
 }
 
 int main(int argc, char* argv[]) {
     std::string attestation_url;
     std::string nonce;
     std::string output_type;
+    bool shared_token_cache = false;
 
     int opt;
-    while ((opt = getopt(argc, argv, ":a:n:o:")) != -1) {
+    while ((opt = getopt(argc, argv, ":a:n:o:c")) != -1) {
         switch (opt) {
         case 'a':
             attestation_url.assign(optarg);
@@ -78,6 +78,9 @@ int main(int argc, char* argv[]) {
         case 'o':
             output_type.assign(optarg);
             break;
+        case 'c':
+            shared_token_cache = true;
+            break;
         case ':':
             fprintf(stderr, "Option needs a value\n");
             exit(1);
@@ -101,8 +104,11 @@ int main(int argc, char* argv[]) {
         AttestationClient* attestation_client = nullptr;
         Logger* log_handle = new Logger();
 
+        attest::ClientOptions options;
+        options.shared_token_cache = shared_token_cache;
+
         // Initialize attestation client
-        if (!Initialize(log_handle, &attestation_client)) {
+        if (!InitializeWithOptions(log_handle, &options, &attestation_client)) {
             printf("Failed to create attestation client object\n");
             Uninitialize();
             exit(1);
@@ -114,41 +120,35 @@ int main(int argc, char* argv[]) {
         std::string client_payload_str = "{\"nonce\":\"" + nonce + "\"}"; // nonce is optional
         params.client_payload = (unsigned char*) client_payload_str.c_str();
         params.version = CLIENT_PARAMS_VERSION;
-        unsigned char* jwt = nullptr;
+        std::shared_ptr<const attest::AttestationToken> token;
         attest::AttestationResult result;
         
         bool is_cvm = false;
         bool attestation_success = true;
         std::string jwt_str;
         // call attest
-        if ((result = attestation_client->Attest(params, &jwt)).code_ 
+        if ((result = attestation_client->Attest(params, token)).code_ 
                 != attest::AttestationResult::ErrorCode::SUCCESS) {
             attestation_success = false;
         }
-	
+
         if (attestation_success) {
-            jwt_str = reinterpret_cast<char*>(jwt);
-            attestation_client->Free(jwt);
-            // Prase attestation token to extract isolation tee details
-            std::vector<std::string> tokens;
-            boost::split(tokens, jwt_str, [](char c) {return c == '.'; });
-            if (tokens.size() < 3) {
+            jwt_str = token->Jwt();
+            // The claims of the token are decoded by the library on first access
+            if (!token->IsValid()) {
                 printf("Invalid JWT token");
                 exit(1);
             }
 
-            json attestation_claims = json::parse(base64_decode(tokens[1]));
-            try {
-                std::string attestation_type 
-                    = attestation_claims["x-ms-isolation-tee"]["x-ms-attestation-type"].get<std::string>();
-                std::string compliance_status 
-                    = attestation_claims["x-ms-isolation-tee"]["x-ms-compliance-status"].get<std::string>();
-                if (boost::iequals(attestation_type, "sevsnpvm") &&
-                    boost::iequals(compliance_status, "azure-compliant-cvm")){
-                    is_cvm = true;
-                }
+            std::string attestation_type;
+            std::string compliance_status;
+            // sevsnp claim does not exist in the token of other isolation types
+            if (token->GetIsolationType(attestation_type) &&
+                token->GetComplianceStatus(compliance_status) &&
+                boost::iequals(attestation_type, "sevsnpvm") &&
+                boost::iequals(compliance_status, "azure-compliant-cvm")) {
+                is_cvm = true;
             }
-            catch (...) { } // sevsnp claim does not exist in the token
         }
 
         if (boost::iequals(output_type, OUTPUT_TYPE_JWT)) {
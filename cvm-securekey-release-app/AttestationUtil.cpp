@@ -15,13 +15,12 @@
 #include <sstream>
 #include <iomanip>
 #include <iostream>
-#include <boost/archive/iterators/base64_from_binary.hpp>
-#include <boost/archive/iterators/binary_from_base64.hpp>
-#include <boost/archive/iterators/transform_width.hpp>
+#include <stdexcept>
 #include <boost/algorithm/string.hpp>
 #include <curl/curl.h>
 #include <nlohmann/json.hpp>
 #include <AttestationClient.h>
+#include <Base64Codec.h>
 #include "AttestationUtil.h"
 #include "Logger.h"
 #include "Constants.h"
@@ -32,22 +31,40 @@ using json = nlohmann::json;
 bool Util::isTraceOn = false;
 int Util::traceLevel = 1;
 
+template <typename T>
+static T base64_decode_as(const std::string &data, base64::Alphabet alphabet)
+{
+    T decoded(base64::MaxDecodedSize(data.size()), 0);
+    size_t decoded_size = 0;
+    if (!decoded.empty() &&
+        !base64::Decode(data.data(), data.size(), reinterpret_cast<BYTE *>(&decoded[0]), decoded_size, alphabet))
+    {
+        throw std::invalid_argument("Invalid base64 data");
+    }
+    decoded.resize(decoded_size);
+    return decoded;
+}
+
+static std::string base64_encode_as(const std::vector<BYTE> &data, base64::Alphabet alphabet)
+{
+    std::string encoded(base64::EncodedSize(data.size(), alphabet), '\0');
+    if (!encoded.empty())
+    {
+        base64::Encode(data.data(), data.size(), &encoded[0], alphabet);
+    }
+    return encoded;
+}
+
 /// \copydoc Util::base64_to_binary()
 std::vector<BYTE> Util::base64_to_binary(const std::string &base64_data)
 {
-    using namespace boost::archive::iterators;
-    using It = transform_width<binary_from_base64<std::string::const_iterator>, 8, 6>;
-    return boost::algorithm::trim_right_copy_if(std::vector<BYTE>(It(std::begin(base64_data)), It(std::end(base64_data))), [](char c)
-                                                { return c == '\0'; });
+    return base64_decode_as<std::vector<BYTE>>(base64_data, base64::Alphabet::Standard);
 }
 
 /// \copydoc Util::binary_to_base64()
 std::string Util::binary_to_base64(const std::vector<BYTE> &binary_data)
 {
-    using namespace boost::archive::iterators;
-    using It = base64_from_binary<transform_width<std::vector<BYTE>::const_iterator, 6, 8>>;
-    auto tmp = std::string(It(std::begin(binary_data)), It(std::end(binary_data)));
-    return tmp.append((3 - binary_data.size() % 3) % 3, '=');
+    return base64_encode_as(binary_data, base64::Alphabet::Standard);
 }
 
 /// \copydoc Util::binary_to_hex()
@@ -78,38 +95,20 @@ std::vector<BYTE> Util::hex_to_binary(const std::string &hex_data)
 /// \copydoc Util::binary_to_base64url()
 std::string Util::binary_to_base64url(const std::vector<BYTE> &binary_data)
 {
-    using namespace boost::archive::iterators;
-    using It = base64_from_binary<transform_width<std::vector<BYTE>::const_iterator, 6, 8>>;
-    auto tmp = std::string(It(std::begin(binary_data)), It(std::end(binary_data)));
-
-    // For encoding to base64url, replace "+" with "-" and "/" with "_"
-    boost::replace_all(tmp, "+", "-");
-    boost::replace_all(tmp, "/", "_");
-
     // We do not need to add padding characters while url encoding.
-    return tmp;
+    return base64_encode_as(binary_data, base64::Alphabet::Url);
 }
 
 /// \copydoc Util::base64url_to_binary()
 std::vector<BYTE> Util::base64url_to_binary(const std::string &base64_data)
 {
-    std::string stringData = base64_data;
-
-    // While decoding base64 url, replace - with + and _ with + and
-    // use stanard base64 decode. we dont need to add padding characters. underlying library handles it.
-    boost::replace_all(stringData, "-", "+");
-    boost::replace_all(stringData, "_", "/");
-
-    return base64_to_binary(stringData);
+    return base64_decode_as<std::vector<BYTE>>(base64_data, base64::Alphabet::Url);
 }
 
 /// \copydoc Util::base64_decode()
 std::string Util::base64_decode(const std::string &data)
 {
-    using namespace boost::archive::iterators;
-    using It = transform_width<binary_from_base64<std::string::const_iterator>, 8, 6>;
-    return boost::algorithm::trim_right_copy_if(std::string(It(std::begin(data)), It(std::end(data))), [](char c)
-                                                { return c == '\0'; });
+    return base64_decode_as<std::string>(data, base64::Alphabet::Standard);
 }
 
 /// \copydoc Util::url_encode()
@@ -388,45 +387,39 @@ std::string Util::GetMAAToken(const std::string &attestation_url, const std::str
     std::string client_payload_str = "{\"nonce\": \"" + nonce_token + "\"}"; // nonce is optional
     params.client_payload = (PBYTE)client_payload_str.c_str();
     params.version = CLIENT_PARAMS_VERSION;
-    PBYTE jwt = nullptr;
+    std::shared_ptr<const attest::AttestationToken> token;
     attest::AttestationResult result;
 
     bool is_cvm = false;
     bool attestation_success = true;
     std::string jwt_str;
-    if ((result = attestation_client->Attest(params, &jwt)).code_ != attest::AttestationResult::ErrorCode::SUCCESS)
+    if ((result = attestation_client->Attest(params, token)).code_ != attest::AttestationResult::ErrorCode::SUCCESS)
     {
         attestation_success = false;
     }
 
     if (attestation_success)
     {
-        jwt_str = std::string(reinterpret_cast<char *>(jwt));
-        std::vector<std::string> tokens;
-        boost::split(tokens, jwt_str, [](char c)
-                     { return c == '.'; });
-        if (tokens.size() < 3)
+        jwt_str = token->Jwt();
+        // The claims of the token are decoded by the library on first access
+        if (!token->IsValid())
         {
             std::cerr << "Invalid JWT token" << std::endl;
             exit(-1);
         }
 
-        json attestation_claims = json::parse(base64_decode(tokens[1]));
-        try
+        std::string attestation_type;
+        std::string compliance_status;
+        // sevsnp claim does not exist in the token of other isolation types
+        if (token->GetIsolationType(attestation_type) &&
+            token->GetComplianceStatus(compliance_status) &&
+            boost::iequals(attestation_type, "sevsnpvm") &&
+            boost::iequals(compliance_status, "azure-compliant-cvm"))
         {
-            std::string attestation_type = attestation_claims["x-ms-isolation-tee"]["x-ms-attestation-type"].get<std::string>();
-            std::string compliance_status = attestation_claims["x-ms-isolation-tee"]["x-ms-compliance-status"].get<std::string>();
-            if (boost::iequals(attestation_type, "sevsnpvm") &&
-                boost::iequals(compliance_status, "azure-compliant-cvm"))
-            {
-                is_cvm = true;
-            }
+            is_cvm = true;
         }
-        catch (...)
-        {
-        } // sevsnp claim does not exist in the token
 
-        attestation_client->Free(jwt);
+        token.reset();
         Uninitialize();
     }
 
@@ -1294,4 +1287,4 @@ bool Util::ReleaseKey(const std::string &attestation_url,
         std::cout << "The released key is of type " << EVP_PKEY_base_id(pkey) << ". Not sure what operations are supported." << std::endl;
         return false;
     }
-}
\ No newline at end of file
+}
\ No newline at end of file